@@ -25,6 +25,7 @@
 #include <errno.h>
 #include <math.h>
 #include <signal.h>
+#include <time.h>
 
 #include "ant_native.h"
 #include "ant_types.h"
@@ -37,6 +38,35 @@ typedef ANTStatus ant_status;
 
 void app_ANT_rx_callback(ANT_U8 ucLen, ANT_U8* pucData);
 void app_ANT_state_callback(ANTRadioEnabledStatus uiNewState);
+void app_ANT_decoded_callback(const ANTDecodedData *pstData, void *pvContext);
+void app_ANT_progress_callback(ANT_U8 ucPhase, ANTStatus status, ANT_U32 ulPhaseUs);
+
+#define APP_COMMAND_TIMEOUT_MS 1000
+#define APP_BENCH_CYCLES 10
+#define APP_BENCH_MESSAGES 1000
+
+/* Set while running a command sequence, so each command waits for its response */
+static ANT_BOOL bWaitForResponse = ANT_FALSE;
+
+/* Set while benchmarking, so the phases of each cycle and each message received aren't printed */
+static ANT_BOOL bBenchmarking = ANT_FALSE;
+
+static ANTStatus TxCommand(ANT_U8 ucLen, ANT_U8 *pucMesg)
+{
+   ANTCommandResponse stResponse;
+   ANTStatus antStatus;
+
+   if (!bWaitForResponse)
+      return ant_tx_message(ucLen, pucMesg);
+
+   antStatus = ant_tx_command(ucLen, pucMesg, APP_COMMAND_TIMEOUT_MS, &stResponse);
+   if (antStatus == ANT_STATUS_FAILED)
+      printf("Command %02X rejected - %02X\n", pucMesg[1], stResponse.ucCode);
+   else if (antStatus)
+      printf("Command %02X failed: %d\n", pucMesg[1], antStatus);
+
+   return antStatus;
+}
 
 static int Ant_Create(void)
 {
@@ -64,15 +94,112 @@ static int Ant_Create(void)
       printf("failed to set ANT rx callback");
       goto CLEANUP;
    }
+
+   antStatus = set_ant_decoded_callback(app_ANT_decoded_callback, NULL);
+   if (antStatus)
+   {
+      printf("failed to set ANT decoded callback");
+      goto CLEANUP;
+   }
+
+   antStatus = set_ant_progress_callback(app_ANT_progress_callback);
+   if (antStatus)
+   {
+      printf("failed to set ANT progress callback");
+      goto CLEANUP;
+   }
    return antStatus;
 
 CLEANUP:
    return ANT_STATUS_FAILED;
 }
 
-void ProcessCommand(char cCmd)
+static ANT_U32 ElapsedUs(const struct timespec *pstStart)
+{
+   struct timespec stNow;
+
+   clock_gettime(CLOCK_MONOTONIC, &stNow);
+   return (ANT_U32)((stNow.tv_sec - pstStart->tv_sec) * 1000000 +
+         (stNow.tv_nsec - pstStart->tv_nsec) / 1000);
+}
+
+/* Times enabling and disabling the radio, starting and ending disabled */
+static ANTStatus BenchEnable(int iCycles)
+{
+   ANTStatus antStatus = ANT_STATUS_SUCCESS;
+   struct timespec stStart;
+   ANT_U32 aulMin[2] = {0xFFFFFFFF, 0xFFFFFFFF};
+   ANT_U32 aulMax[2] = {0, 0};
+   ANT_U32 aulSum[2] = {0, 0};
+   ANT_U32 ulUs;
+   int i, j;
+
+   bBenchmarking = ANT_TRUE;
+   for (i = 0; i < iCycles; i++)
+   {
+      for (j = 0; j < 2; j++)
+      {
+         clock_gettime(CLOCK_MONOTONIC, &stStart);
+         antStatus = (j == 0) ? ant_enable_radio() : ant_disable_radio();
+         ulUs = ElapsedUs(&stStart);
+         if (antStatus)
+         {
+            printf("%s failed in cycle %d: %d\n", (j == 0) ? "Enable" : "Disable", i, antStatus);
+            goto out;
+         }
+         aulMin[j] = (ulUs < aulMin[j]) ? ulUs : aulMin[j];
+         aulMax[j] = (ulUs > aulMax[j]) ? ulUs : aulMax[j];
+         aulSum[j] += ulUs;
+      }
+   }
+
+   printf("%d cycles, enable min %u avg %u max %u us, disable min %u avg %u max %u us\n", iCycles,
+         aulMin[0], aulSum[0] / iCycles, aulMax[0], aulMin[1], aulSum[1] / iCycles, aulMax[1]);
+
+out:
+   bBenchmarking = ANT_FALSE;
+   return antStatus;
+}
+
+/* Times setting the radio frequency of channel 0, without waiting for the responses.
+ * Requests aren't used, as the HAL may answer them from its cache. */
+static ANTStatus BenchTx(int iMessages)
+{
+   ANTStatus antStatus = ANT_STATUS_SUCCESS;
+   ANT_U8 aucMesg[] = {0x02, 0x45, 0x00, 57};   //MESG_CHANNEL_RADIO_FREQ_ID, Ch0, 2.457GHz
+   struct timespec stStart;
+   ANT_U32 ulUs;
+   int i;
+
+   bBenchmarking = ANT_TRUE;
+   clock_gettime(CLOCK_MONOTONIC, &stStart);
+   for (i = 0; i < iMessages; i++)
+   {
+      antStatus = ant_tx_message(sizeof(aucMesg), aucMesg);
+      if (antStatus)
+      {
+         printf("Tx failed after %d messages: %d\n", i, antStatus);
+         goto out;
+      }
+   }
+   ulUs = ElapsedUs(&stStart);
+
+   printf("%d messages in %u us, %u messages/s\n", iMessages, ulUs,
+         (ANT_U32)((unsigned long long)iMessages * 1000000 / (ulUs ? ulUs : 1)));
+
+out:
+   // Let the last responses arrive before printing them again.
+   sleep(1);
+   bBenchmarking = ANT_FALSE;
+   return antStatus;
+}
+
+ANTStatus ProcessCommand(char cCmd)
 {
    ANT_U8 TxMessage[256];
+   ANTStatus antStatus = ANT_STATUS_SUCCESS;
+   ANTChannelConfig stChannelConfig;
+   ANTLinkStats stLinkStats;
    switch (cCmd)
    {
       case 'V':
@@ -80,26 +207,41 @@ void ProcessCommand(char cCmd)
          TxMessage[1] = 0x4D;   //MESG_REQUEST_ID
          TxMessage[2] = 0x00;   //Ch0
          TxMessage[3] = 0x3E;
-         ant_tx_message(4,TxMessage);
+         antStatus = TxCommand(4,TxMessage);
          break;
       case 'R':
          TxMessage[0] = 0x01;   //Size
          TxMessage[1] = 0x4A;   //MESG_RESET_ID
          TxMessage[2] = 0x00;   //Ch0
-         ant_tx_message(3,TxMessage);
+         antStatus = TxCommand(3,TxMessage);
          break;
       case 'K':
          printf("Hard Reset returned: %d\n", ant_radio_hard_reset());
          break;
 
       case 'H':
-         //Normally we will not blindly send commands like this and actually check for responses before sending the next command, but this is just for a quick test.
-         ProcessCommand('R');   //Reset chip
-         ProcessCommand('A');   //Assign channel
-         ProcessCommand('F');   //Set RF Freq
-         ProcessCommand('I');   //Set Channel ID
-         ProcessCommand('P');   //Set Channel Period
-         ProcessCommand('O');   //Open Channel
+         //Reset chip, then Assign channel, Set Channel ID, Set Channel Period, Set RF Freq and Open Channel in one go
+         bWaitForResponse = ANT_TRUE;
+         antStatus = ProcessCommand('R');
+         bWaitForResponse = ANT_FALSE;
+         if (antStatus)
+         {
+            printf("HRM channel setup stopped at reset\n");
+            break;
+         }
+         memset(&stChannelConfig, 0, sizeof(stChannelConfig));
+         stChannelConfig.ucChannel = 0x00;            //Ch0
+         stChannelConfig.ucChannelType = 0x00;        //Rx channel
+         stChannelConfig.ucNetwork = 0x01;            //Network 1 (ANT+)
+         stChannelConfig.usDeviceNumber = 0x0000;     //Wildcard Device Number
+         stChannelConfig.ucDeviceType = 0x78;         //HRM Device Type
+         stChannelConfig.ucTransmissionType = 0x00;   //Wildcard Transmission Type
+         stChannelConfig.usPeriod = 0x1F86;           //HRM MESG Peroid 0x1F86 (8070)
+         stChannelConfig.ucRfFrequency = 57;          //2.457GHz
+         stChannelConfig.bOpen = ANT_TRUE;
+         antStatus = ant_configure_channel(&stChannelConfig, NULL, NULL);
+         if (antStatus)
+            printf("HRM channel setup failed: %d\n", antStatus);
          break;
 
       case 'A':
@@ -108,7 +250,7 @@ void ProcessCommand(char cCmd)
          TxMessage[2] = 0x00;   //Ch0
          TxMessage[3] = 0x00;   //Assignment Params (Rx channel)
          TxMessage[4] = 0x01;   //Network 1 (ANT+)
-         ant_tx_message(5,TxMessage);
+         antStatus = TxCommand(5,TxMessage);
          break;
 
       case 'F':
@@ -116,7 +258,7 @@ void ProcessCommand(char cCmd)
          TxMessage[1] = 0x45;   //MESG_CHANNEL_RADIO_FREQ_ID
          TxMessage[2] = 0x00;   //Ch0
          TxMessage[3] = 57;   //2.457GHz
-         ant_tx_message(4,TxMessage);
+         antStatus = TxCommand(4,TxMessage);
          break;
 
       case 'I':
@@ -127,7 +269,7 @@ void ProcessCommand(char cCmd)
          TxMessage[4] = 0x00;   //Wildcard Device Number
          TxMessage[5] = 0x78;   //Set HRM Device Type
          TxMessage[6] = 0x00;   //Wildcard Transmission Type
-         ant_tx_message(7,TxMessage);
+         antStatus = TxCommand(7,TxMessage);
          break;
 
       case 'P':
@@ -136,14 +278,14 @@ void ProcessCommand(char cCmd)
          TxMessage[2] = 0x00;   //Ch0
          TxMessage[3] = 0x86;   //
          TxMessage[4] = 0x1F;   // HRM MESG Peroid 0x1F86 (8070)
-         ant_tx_message(5,TxMessage);
+         antStatus = TxCommand(5,TxMessage);
          break;
 
       case 'O':
          TxMessage[0] = 0x01;   //Size
          TxMessage[1] = 0x4B;   //MESG_OPEN_CHANNEL__ID
          TxMessage[2] = 0x00;   //Ch0
-         ant_tx_message(3,TxMessage);
+         antStatus = TxCommand(3,TxMessage);
          break;
       case 'E':
          printf("Enable returned: %d\n", ant_enable_radio());
@@ -154,6 +296,27 @@ void ProcessCommand(char cCmd)
       case 'S':
          printf("State is: %d\n", ant_radio_enabled_status());
          break;
+      case 'B':
+         antStatus = BenchEnable(APP_BENCH_CYCLES);
+         break;
+      case 'T':
+         antStatus = BenchTx(APP_BENCH_MESSAGES);
+         break;
+      case 'L':
+         antStatus = ant_get_link_stats(0, &stLinkStats);   //Ch0
+         if (antStatus)
+         {
+            printf("Link stats failed: %d\n", antStatus);
+            break;
+         }
+         printf("Ch0 rx %u (%u/min) fails %u (max run %u) success %u/1000 go to search %u search timeouts %u\n",
+               stLinkStats.ulRxMessages, stLinkStats.ulRxMessagesPerMinute, stLinkStats.ulRxFails,
+               stLinkStats.usMaxConsecutiveRxFails, stLinkStats.usRxSuccessPerMille,
+               stLinkStats.ulRxFailGoToSearch, stLinkStats.ulRxSearchTimeouts);
+         printf("Ch0 searches %u last %u ms, RSSI samples %u min %d max %d avg %d dBm\n",
+               stLinkStats.ulSearches, stLinkStats.ulLastSearchTimeMs, stLinkStats.ulRssiSamples,
+               stLinkStats.cRssiMin, stLinkStats.cRssiMax, stLinkStats.cRssiAverage);
+         break;
       case '1':
          TxMessage[0] = 0x0A;   //Size
          TxMessage[1] = 0x01;   //Enable
@@ -185,6 +348,8 @@ void ProcessCommand(char cCmd)
          printf("Invalid command: %#02x\n", cCmd);
          break;
    }
+
+   return antStatus;
 }
 
 
@@ -192,6 +357,9 @@ void app_ANT_rx_callback(ANT_U8 ucLen, ANT_U8* pucData)
 {
    ANT_U8 i;
 
+   if (bBenchmarking)
+      return;
+
    for(i=0; i <ucLen; i++)
       printf("[%02X]",pucData[i]);
    switch (pucData[1])
@@ -216,21 +384,40 @@ void app_ANT_rx_callback(ANT_U8 ucLen, ANT_U8* pucData)
             printf(" Event (Ch:%d) %02X\n", pucData[2], pucData[4]);
          }
          break;
-      case 0x4E:
-         if (pucData[2] == 0)  //we are using channel 0 for HRM
-         {
-            // We are just assuming this is a HRM message and pulling the BPM out, refer to the ANT+ HRM profile documentation for proper/complete decoding instructions.
-            printf(" BPM: %u\n", pucData[10]);
-         }
-         break;
-
       default:
-
+         printf("\n");
          break;
    }
    return;
 }
 
+void app_ANT_decoded_callback(const ANTDecodedData *pstData, void *pvContext)
+{
+   (void)pvContext;
+
+   // Only printed when the heart rate changes, the HRM channel set up by 'H' is decoded natively.
+   if ((pstData->ucDeviceType == ANT_DEVICE_TYPE_HEART_RATE) &&
+         (pstData->ucChangedMask & (1 << ANT_DECODED_HR_HEART_RATE)))
+   {
+      printf(" Ch:%d BPM: %d\n", pstData->ucChannel, (int)pstData->alValues[ANT_DECODED_HR_HEART_RATE]);
+   }
+}
+
+void app_ANT_progress_callback(ANT_U8 ucPhase, ANTStatus status, ANT_U32 ulPhaseUs)
+{
+   static const char *apcPhases[] = {
+      "Power on", "Open", "Thread start", "Link up", "Thread stop", "Close", "Power off", "Vendor load"
+   };
+
+   if (bBenchmarking)
+      return;
+
+   if (ucPhase < sizeof(apcPhases) / sizeof(apcPhases[0]))
+      printf(" %s took %u us%s\n", apcPhases[ucPhase], ulPhaseUs, status ? " and failed" : "");
+   else
+      printf(" Phase %d took %u us%s\n", ucPhase, ulPhaseUs, status ? " and failed" : "");
+}
+
 void app_ANT_state_callback(ANTRadioEnabledStatus uiNewState)
 {
    const char *pcState;
@@ -301,6 +488,9 @@ int main(void)
    printf("Press E to Enable ANT\n");
    printf("Press D to Disable ANT\n");
    printf("Press S to get State\n");
+   printf("Press B to Benchmark enabling and disabling\n");
+   printf("Press T to benchmark Tx\n");
+   printf("Press L to get channel 0 Link stats\n");
    printf("\n");
    printf("Press X to eXit\n");
 
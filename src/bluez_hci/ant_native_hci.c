@@ -41,14 +41,35 @@
 #include "ant_rx.h"
 #include "ant_tx.h"
 #include "ant_hciutils.h"
+#include "ant_cache.h"
+#include "ant_radio_async.h"
+#include "ant_rx_queue.h"
+#include "ant_state_notify.h"
+#include "ant_thread.h"
 #include "ant_log.h"
 
 static pthread_mutex_t         txLock;
 pthread_mutex_t                enableLock;
 
-ANTRadioEnabledStatus radio_status = RADIO_STATUS_DISABLED;
+// Socket filtered for command complete events, kept open from enable until
+// disable so each tx doesn't have to set one up. Guarded by txLock.
+static int                     tx_socket = -1;
+
+// Only changed with set_radio_status(), so the tx and rx paths can check it
+// with a single load instead of asking the power library.
+static ANTRadioEnabledStatus radio_status = RADIO_STATUS_DISABLED;
 ANTRadioEnabledStatus get_and_set_radio_status(void);
 
+void set_radio_status(ANTRadioEnabledStatus new_status)
+{
+   __atomic_store_n(&radio_status, new_status, __ATOMIC_RELEASE);
+}
+
+ANTRadioEnabledStatus get_radio_status(void)
+{
+   return __atomic_load_n(&radio_status, __ATOMIC_ACQUIRE);
+}
+
 ////////////////////////////////////////////////////////////////////
 //  ant_init
 //
@@ -86,7 +107,7 @@ ANTStatus ant_init(void)
    ANTStatus status = ANT_STATUS_FAILED;
    ANT_FUNC_START();
 
-   mutexResult = pthread_mutex_init(&txLock, NULL); //use default attr
+   mutexResult = ant_thread_mutex_init(&txLock); //priority inheritance for real-time threads
    if (mutexResult)
    {
       ANT_ERROR("Tx Lock mutex initialization failed: %s", strerror(mutexResult));
@@ -104,6 +125,13 @@ ANTStatus ant_init(void)
       }
    }
 
+   // Lets responses answered from the cache be delivered by the rx thread.
+   if ((status == ANT_STATUS_SUCCESS) && (ant_rx_queue_open() < 0))
+   {
+      ANT_ERROR("failed to open rx queue");
+      status = ANT_STATUS_FAILED;
+   }
+
    ANT_FUNC_END();
    return status;
 }
@@ -164,6 +192,10 @@ ANTStatus ant_deinit(void)
       }
    }
 
+   ant_state_notify_stop();
+
+   ant_rx_queue_close();
+
    ANT_FUNC_END();
    return result_status;
 }
@@ -196,7 +228,10 @@ LOCK enable_LOCK
         ENDIF
         ant enable
         IF ant_enable success
-            IF rx thread is running
+            open tx socket, unless still open
+            IF could not open tx socket
+                RESULT = TRANSPORT INIT ERROR
+            ELSE IF rx thread is running
                 STATE = ENABLED
                 RESULT = SUCCESS
             ELSE
@@ -228,6 +263,7 @@ ANTStatus ant_enable_radio(void)
 {
    int result;
    int lockResult;
+   ANT_U32 ulPhaseStartUs;
    ANTStatus result_status = ANT_STATUS_FAILED;
    ANT_FUNC_START();
 
@@ -242,7 +278,7 @@ ANTStatus ant_enable_radio(void)
 
    if(RADIO_STATUS_DISABLED == radio_status)
    {
-      radio_status = RADIO_STATUS_ENABLING;
+      set_radio_status(RADIO_STATUS_ENABLING);
    }
 
    ANT_DEBUG_V("getting txLock in %s", __FUNCTION__);
@@ -267,16 +303,20 @@ ANTStatus ant_enable_radio(void)
       }
 
       ANT_DEBUG_I("radio_status (%d -> %d)", radio_status, RADIO_STATUS_ENABLING);
-      radio_status = RADIO_STATUS_ENABLING;
+      set_radio_status(RADIO_STATUS_ENABLING);
 
 #if USE_EXTERNAL_POWER_LIBRARY
-      if (RxParams.pfStateCallback)
-         RxParams.pfStateCallback(radio_status);
+      ant_state_notify(RxParams.pfStateCallback, radio_status);
 #endif
    }
 
+   // Channel states are not known again until the chip is reset.
+   ant_cache_invalidate();
+
 #if USE_EXTERNAL_POWER_LIBRARY
+   ulPhaseStartUs = ant_progress_now();
    result = ant_enable();
+   ant_progress_report(ANT_PROGRESS_POWER_ON, result ? ANT_STATUS_FAILED : ANT_STATUS_SUCCESS, ulPhaseStartUs);
 
    ANT_DEBUG_D("ant_enable() result is %d", result);
 #else
@@ -284,15 +324,29 @@ ANTStatus ant_enable_radio(void)
 #endif
    if (result == 0)
    {
-      if (RxParams.thread)
+      if (tx_socket < 0)
+      {
+         ulPhaseStartUs = ant_progress_now();
+         tx_socket = ant_open_tx_transport();
+         ant_progress_report(ANT_PROGRESS_OPEN, (tx_socket < 0) ? ANT_STATUS_FAILED : ANT_STATUS_SUCCESS, ulPhaseStartUs);
+      }
+
+      if (tx_socket < 0)
+      {
+         ANT_ERROR("Could not open Tx socket");
+         result_status = ANT_STATUS_TRANSPORT_INIT_ERR;
+      }
+      else if (RxParams.thread)
       {
          result_status = ANT_STATUS_SUCCESS;
-         radio_status = RADIO_STATUS_ENABLED; // sanity assign, cant be enabling
+         set_radio_status(RADIO_STATUS_ENABLED); // sanity assign, cant be enabling
          ANT_DEBUG_D("ANT radio re-enabled");
       }
       else
       {
-         result = pthread_create(&RxParams.thread, NULL, ANTHCIRxThread, NULL);
+         ulPhaseStartUs = ant_progress_now();
+         result = ant_thread_create(&RxParams.thread, "hci-rx", ANTHCIRxThread, NULL);
+         ant_progress_report(ANT_PROGRESS_THREAD_START, result ? ANT_STATUS_FAILED : ANT_STATUS_SUCCESS, ulPhaseStartUs);
          if (result)
          {
             ANT_ERROR("Thread initialization failed: %s", strerror(result));
@@ -305,17 +359,16 @@ ANTStatus ant_enable_radio(void)
             if (radio_status == RADIO_STATUS_ENABLING)
             {
                ANT_DEBUG_I("radio_status (%d -> %d)", radio_status, RADIO_STATUS_ENABLED);
-               radio_status = RADIO_STATUS_ENABLED;
+               set_radio_status(RADIO_STATUS_ENABLED);
 
-               if (RxParams.pfStateCallback)
-                  RxParams.pfStateCallback(radio_status);
+               ant_state_notify(RxParams.pfStateCallback, radio_status);
             }
             else
             {
                ANT_WARN("radio was already enabled but rx thread was not running");
             }
 #else
-            radio_status = RADIO_STATUS_ENABLED;
+            set_radio_status(RADIO_STATUS_ENABLED);
 #endif
          }
       }
@@ -325,8 +378,14 @@ ANTStatus ant_enable_radio(void)
       result_status = ANT_STATUS_TRANSPORT_INIT_ERR;
    }
 
-   if (result_status != ANT_STATUS_SUCCESS) // ant_enable() or rx thread creating failed
+   if (result_status != ANT_STATUS_SUCCESS) // ant_enable(), tx socket or rx thread creating failed
    {
+      if (tx_socket >= 0)
+      {
+         ant_close_tx_transport(tx_socket);
+         tx_socket = -1;
+      }
+
 #if USE_EXTERNAL_POWER_LIBRARY
       ant_disable();
 #endif
@@ -378,6 +437,187 @@ ANTStatus ant_radio_hard_reset(void)
    return result_status;
 }
 
+////////////////////////////////////////////////////////////////////
+//  ant_get_transport_stats
+//
+//  Does nothing as transport stats are not supported.
+//
+//  Parameters:
+//      pstStats        not used
+//
+//  Returns:
+//      ANT_NOT_SUPPORTED
+//
+//  Psuedocode:
+/*
+RESULT = NOT SUPPORTED
+*/
+////////////////////////////////////////////////////////////////////
+ANTStatus ant_get_transport_stats(ANTTransportStats *pstStats)
+{
+   ANTStatus result_status = ANT_STATUS_NOT_SUPPORTED;
+   ANT_FUNC_START();
+   (void)pstStats;
+   ANT_FUNC_END();
+   return result_status;
+}
+
+////////////////////////////////////////////////////////////////////
+//  ant_set_keepalive
+//
+//  Does nothing as keepalives are not supported.
+//
+//  Parameters:
+//      ulIdleMs             not used
+//      ulResponseTimeoutMs  not used
+//
+//  Returns:
+//      ANT_NOT_SUPPORTED
+//
+//  Psuedocode:
+/*
+RESULT = NOT SUPPORTED
+*/
+////////////////////////////////////////////////////////////////////
+ANTStatus ant_set_keepalive(ANT_U32 ulIdleMs, ANT_U32 ulResponseTimeoutMs)
+{
+   ANTStatus result_status = ANT_STATUS_NOT_SUPPORTED;
+   ANT_FUNC_START();
+   (void)ulIdleMs;
+   (void)ulResponseTimeoutMs;
+   ANT_FUNC_END();
+   return result_status;
+}
+
+////////////////////////////////////////////////////////////////////
+//  ant_set_standby
+//
+//  Does nothing as standby is not supported, the transport is always
+//  closed when the radio is disabled.
+//
+//  Parameters:
+//      ulGraceMs  not used
+//
+//  Returns:
+//      ANT_NOT_SUPPORTED
+//
+//  Psuedocode:
+/*
+RESULT = NOT SUPPORTED
+*/
+////////////////////////////////////////////////////////////////////
+ANTStatus ant_set_standby(ANT_U32 ulGraceMs)
+{
+   ANTStatus result_status = ANT_STATUS_NOT_SUPPORTED;
+   ANT_FUNC_START();
+   (void)ulGraceMs;
+   ANT_FUNC_END();
+   return result_status;
+}
+
+////////////////////////////////////////////////////////////////////
+//  ant_set_recovery_replay
+//
+//  Does nothing as the transport doesn't recover the chip by itself.
+//
+//  Parameters:
+//      bReplay  not used
+//
+//  Returns:
+//      ANT_NOT_SUPPORTED
+//
+//  Psuedocode:
+/*
+RESULT = NOT SUPPORTED
+*/
+////////////////////////////////////////////////////////////////////
+ANTStatus ant_set_recovery_replay(ANT_BOOL bReplay)
+{
+   ANTStatus result_status = ANT_STATUS_NOT_SUPPORTED;
+   ANT_FUNC_START();
+   (void)bReplay;
+   ANT_FUNC_END();
+   return result_status;
+}
+
+////////////////////////////////////////////////////////////////////
+//  ant_set_threadless
+//
+//  Does nothing as threadless mode is not supported, the rx thread is always
+//  used.
+//
+//  Parameters:
+//      bThreadless     not used
+//
+//  Returns:
+//      ANT_NOT_SUPPORTED
+//
+//  Psuedocode:
+/*
+RESULT = NOT SUPPORTED
+*/
+////////////////////////////////////////////////////////////////////
+ANTStatus ant_set_threadless(ANT_BOOL bThreadless)
+{
+   ANTStatus result_status = ANT_STATUS_NOT_SUPPORTED;
+   ANT_FUNC_START();
+   (void)bThreadless;
+   ANT_FUNC_END();
+   return result_status;
+}
+
+////////////////////////////////////////////////////////////////////
+//  ant_get_poll_fds
+//
+//  Does nothing as threadless mode is not supported.
+//
+//  Parameters:
+//      piFds           not used
+//      pulCount        not used
+//
+//  Returns:
+//      ANT_NOT_SUPPORTED
+//
+//  Psuedocode:
+/*
+RESULT = NOT SUPPORTED
+*/
+////////////////////////////////////////////////////////////////////
+ANTStatus ant_get_poll_fds(int *piFds, ANT_U32 *pulCount)
+{
+   ANTStatus result_status = ANT_STATUS_NOT_SUPPORTED;
+   ANT_FUNC_START();
+   (void)piFds;
+   (void)pulCount;
+   ANT_FUNC_END();
+   return result_status;
+}
+
+////////////////////////////////////////////////////////////////////
+//  ant_process_events
+//
+//  Does nothing as threadless mode is not supported.
+//
+//  Parameters:
+//      iTimeoutMs      not used
+//
+//  Returns:
+//      ANT_NOT_SUPPORTED
+//
+//  Psuedocode:
+/*
+RESULT = NOT SUPPORTED
+*/
+////////////////////////////////////////////////////////////////////
+ANTStatus ant_process_events(int iTimeoutMs)
+{
+   ANTStatus result_status = ANT_STATUS_NOT_SUPPORTED;
+   ANT_FUNC_START();
+   (void)iTimeoutMs;
+   ANT_FUNC_END();
+   return result_status;
+}
+
 ////////////////////////////////////////////////////////////////////
 //  ant_disable_radio
 //
@@ -404,6 +644,7 @@ LOCK enable_LOCK
         IF rx thread is running
             wait for rx thread to terminate
         ENDIF
+        close tx socket
         get radio status
         IF radio is disabled
             RESULT = SUCCESS
@@ -421,6 +662,7 @@ ANTStatus ant_disable_radio(void)
 {
    int result;
    int lockResult;
+   ANT_U32 ulPhaseStartUs;
    ANTStatus ret = ANT_STATUS_FAILED;
    ANT_FUNC_START();
 
@@ -447,25 +689,28 @@ ANTStatus ant_disable_radio(void)
    if (get_and_set_radio_status() != RADIO_STATUS_DISABLED)
    {
       ANT_DEBUG_I("radio_status (%d -> %d)", radio_status, RADIO_STATUS_DISABLING);
-      radio_status = RADIO_STATUS_DISABLING;
+      set_radio_status(RADIO_STATUS_DISABLING);
 
-      if (RxParams.pfStateCallback)
-         RxParams.pfStateCallback(radio_status);
+      ant_state_notify(RxParams.pfStateCallback, radio_status);
    }
 
+   ulPhaseStartUs = ant_progress_now();
    result = ant_disable();
+   ant_progress_report(ANT_PROGRESS_POWER_OFF, result ? ANT_STATUS_FAILED : ANT_STATUS_SUCCESS, ulPhaseStartUs);
 
    ANT_DEBUG_D("ant_disable() result is %d", result);
 #else
-   radio_status = RADIO_STATUS_DISABLED;
+   set_radio_status(RADIO_STATUS_DISABLED);
 #endif
 
    // If rx thread exists ( != 0)
    if (RxParams.thread)
    {
       ANT_DEBUG_V("quit rx thread, joining");
+      ulPhaseStartUs = ant_progress_now();
       pthread_join(RxParams.thread, NULL);
       RxParams.thread = 0;
+      ant_progress_report(ANT_PROGRESS_THREAD_STOP, ANT_STATUS_SUCCESS, ulPhaseStartUs);
       ANT_DEBUG_V("joined by rx thread");
    }
    else
@@ -473,6 +718,14 @@ ANTStatus ant_disable_radio(void)
       ANT_DEBUG_W("rx thread is 0 (not created?)");
    }
 
+   if (tx_socket >= 0)
+   {
+      ulPhaseStartUs = ant_progress_now();
+      ant_close_tx_transport(tx_socket);
+      tx_socket = -1;
+      ant_progress_report(ANT_PROGRESS_CLOSE, ANT_STATUS_SUCCESS, ulPhaseStartUs);
+   }
+
    switch (get_and_set_radio_status())
    {
       case RADIO_STATUS_DISABLED:
@@ -503,10 +756,10 @@ ANTStatus ant_disable_radio(void)
 ////////////////////////////////////////////////////////////////////
 //  ant_radio_enabled_status
 //
-//  Returns if the chip/transport is disabled/disabling/enabling/enabled. This
-//  function will NOT overwrite internal state variable enabling or disabling.
-//  It will call get_and_set_radio_status() if not enabling/disabling which can
-//  change internal state on errors.
+//  Returns if the chip/transport is disabled/disabling/enabling/enabled, as
+//  last set by a transition. The BlueZ core is only asked again by
+//  get_and_set_radio_status() during enable/disable, and by the rx thread when
+//  it is idle or fails, so this is cheap enough to call on every tx.
 //
 //  Parameters:
 //      -
@@ -516,33 +769,12 @@ ANTStatus ant_disable_radio(void)
 //
 //  Psuedocode:
 /*
-IF Enabling
-    RESULT = Enabling
-ELSE IF Disabling
-    RESULT = Disabling
-ELSE
-    IF ant_is_enabled
-        Enabled
-        RESULT = Enabled
-    ELSE
-        Disabled
-        RESULT = Disabled
-    ENDIF
-ENDIF
+RESULT = last radio status set
 */
 ////////////////////////////////////////////////////////////////////
 ANTRadioEnabledStatus ant_radio_enabled_status(void)
 {
-   ANT_FUNC_START();
-
-   if ((RADIO_STATUS_ENABLING != radio_status) &&
-         (RADIO_STATUS_DISABLING != radio_status))
-   {
-      get_and_set_radio_status();
-   }
-
-   ANT_FUNC_END();
-   return radio_status;
+   return get_radio_status();
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -565,30 +797,31 @@ ANTRadioEnabledStatus get_and_set_radio_status(void)
 {
    ANT_FUNC_START();
 #if USE_EXTERNAL_POWER_LIBRARY
-   ANTRadioEnabledStatus orig_status = radio_status;
+   ANTRadioEnabledStatus orig_status = get_radio_status();
+   ANTRadioEnabledStatus new_status;
    switch (ant_is_enabled())
    {
       case 0:
-         radio_status = RADIO_STATUS_DISABLED;
+         new_status = RADIO_STATUS_DISABLED;
          break;
       case 1:
-         radio_status = RADIO_STATUS_ENABLED;
+         new_status = RADIO_STATUS_ENABLED;
          break;
       default:
          ANT_ERROR("getting chip state returned an error");
-         radio_status = RADIO_STATUS_UNKNOWN;
+         new_status = RADIO_STATUS_UNKNOWN;
          break;
    }
-   if (orig_status != radio_status)
+   if (orig_status != new_status)
    {
-      ANT_DEBUG_I("radio_status (%d -> %d)", orig_status, radio_status);
+      ANT_DEBUG_I("radio_status (%d -> %d)", orig_status, new_status);
+      set_radio_status(new_status);
 
-      if (RxParams.pfStateCallback)
-         RxParams.pfStateCallback(radio_status);
+      ant_state_notify(RxParams.pfStateCallback, new_status);
    }
 #endif
    ANT_FUNC_END();
-   return radio_status;
+   return get_radio_status();
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -619,6 +852,35 @@ ANTStatus set_ant_rx_callback(ANTNativeANTEventCb rx_callback_func)
    return status;
 }
 
+////////////////////////////////////////////////////////////////////
+//  set_ant_rx_seq_callback
+//
+//  Sets which function to call with the rx sequence stamp when an ANT message
+//  is received.
+//
+//  Parameters:
+//      rx_seq_callback_func   the ANTNativeANTEventSeqCb function to be used
+//                             for received messages.
+//
+//  Returns:
+//          ANT_STATUS_SUCCESS
+//
+//  Psuedocode:
+/*
+    Rx Seq Callback = rx_seq_callback_func
+*/
+////////////////////////////////////////////////////////////////////
+ANTStatus set_ant_rx_seq_callback(ANTNativeANTEventSeqCb rx_seq_callback_func)
+{
+   ANTStatus status = ANT_STATUS_SUCCESS;
+   ANT_FUNC_START();
+
+   RxParams.pfRxSeqCallback = rx_seq_callback_func;
+
+   ANT_FUNC_END();
+   return status;
+}
+
 ////////////////////////////////////////////////////////////////////
 //  set_ant_state_callback
 //
@@ -671,6 +933,9 @@ ELSE
     Lock
     IF Lock failed
         RESULT = FAILED
+    ELSE IF request answered from cache and rx queue not full
+        QUEUE response for the rx thread to deliver
+        Unlock
     ELSE
         STORE length (little endian) in send buffer
         STORE data in send buffer
@@ -682,11 +947,12 @@ ANTStatus ant_tx_message(ANT_U8 ucLen, ANT_U8 *pucMesg)
 {
    ANTStatus   status;
 
-   /* Socket for sending HCI commands */
-   int tx_socket = -1;
-
    int lockResult;
 
+   /* Response to a request answered from the cache */
+   ANT_U8 cacheResponse[ANT_NATIVE_MAX_MESSAGE_SIZE];
+   ANT_U8 cacheResponseLen;
+
    ANT_FUNC_START();
 
    ANT_DEBUG_V("getting txLock in %s", __FUNCTION__);
@@ -699,18 +965,31 @@ ANTStatus ant_tx_message(ANT_U8 ucLen, ANT_U8 *pucMesg)
 
    ANT_DEBUG_V("got txLock in %s", __FUNCTION__);
 
-   if(RADIO_STATUS_ENABLED != get_and_set_radio_status())
+   if(RADIO_STATUS_ENABLED != get_radio_status())
    {
       ANT_DEBUG_E("ant_tx_message, ANT not enabled - ABORTING. Radio status = %d",
-                                                                  radio_status);
+                                                                  get_radio_status());
       ANT_DEBUG_V("releasing txLock in %s", __FUNCTION__);
       pthread_mutex_unlock(&txLock);
       ANT_DEBUG_V("released txLock in %s", __FUNCTION__);
       return ANT_STATUS_FAILED_BT_NOT_INITIALIZED;
    }
 
-   // Open socket
-   tx_socket = ant_open_tx_transport();
+   cacheResponseLen = ant_cache_tx_message(ucLen, pucMesg, cacheResponse);
+   // Answered without asking the chip, the rx thread delivers the response as
+   // if it had been received. If too many are waiting for it, ask the chip.
+   if((cacheResponseLen != 0) &&
+         (ant_rx_queue_message(cacheResponseLen, cacheResponse) == ANT_STATUS_SUCCESS))
+   {
+      pthread_mutex_unlock(&txLock);
+      return ANT_STATUS_SUCCESS;
+   }
+
+   // Only closed while enabled if a write failed and it couldn't be reopened.
+   if(tx_socket < 0)
+   {
+      tx_socket = ant_open_tx_transport();
+   }
 
    if(tx_socket < 0)
    {
@@ -721,9 +1000,13 @@ ANTStatus ant_tx_message(ANT_U8 ucLen, ANT_U8 *pucMesg)
       return ANT_STATUS_FAILED;
    }
 
+   // Drop events left by an earlier tx that stopped waiting for them.
+   ant_drain_tx_transport(tx_socket);
+
    // Send HCI packet
    ANT_BOOL retryRx;
    ANT_BOOL retryTx;
+   ANT_BOOL reopened = ANT_FALSE;
    status = ANT_STATUS_FAILED;
 
    int MAX_RETRIES_WRITE_FAIL = 10;
@@ -843,10 +1126,18 @@ ANTStatus ant_tx_message(ANT_U8 ucLen, ANT_U8 *pucMesg)
          retryRx = ANT_FALSE;
       
          status = ANT_STATUS_FAILED;
+
+         // The socket kept open may have gone bad, e.g. if the HCI device
+         // was reset. Try once more on a new one.
+         if(!reopened)
+         {
+            reopened = ANT_TRUE;
+            ant_close_tx_transport(tx_socket);
+            tx_socket = ant_open_tx_transport();
+            retryTx = (tx_socket >= 0);
+         }
       }
    } while(retryTx);
-   
-   ant_close_tx_transport(tx_socket);
 
    ANT_DEBUG_V("releasing txLock in %s", __FUNCTION__);
    pthread_mutex_unlock(&txLock);
@@ -57,6 +57,9 @@
 #include "ant_hciutils.h"
 #include "ant_framing.h"
 #include "ant_log.h"
+#include "ant_rx_pool.h"
+#include "ant_rx_queue.h"
+#include "ant_state_notify.h"
 
 #undef LOG_TAG
 #define LOG_TAG "antradio_rx"
@@ -64,15 +67,67 @@
 /* Global Options */
 ANTHCIRxParams RxParams = {
    .pfRxCallback = NULL,
+   .pfRxSeqCallback = NULL,
    .pfStateCallback = NULL,
    .thread = 0
 };
 
 extern pthread_mutex_t enableLock;
 extern ANTRadioEnabledStatus get_and_set_radio_status(void);
-#ifndef USE_EXTERNAL_POWER_LIBRARY
-extern ANTRadioEnabledStatus radio_status;
-#endif
+extern ANTRadioEnabledStatus get_radio_status(void);
+extern void set_radio_status(ANTRadioEnabledStatus new_status);
+
+// Stamped on every message delivered, so consumers can order messages by when they were read.
+static ANT_U32 ulRxSequence = 0;
+
+/*
+ * Stamps a message with the next rx sequence number and hands it to the rx
+ * callbacks and consumers. Also used for the messages queued for the rx
+ * thread, like responses answered without the chip.
+ */
+void ant_rx_deliver_message(ANT_U8 ucLen, ANT_U8 *pucData)
+{
+   ANT_U32 ulSeq = __atomic_add_fetch(&ulRxSequence, 1, __ATOMIC_RELAXED);
+
+   if(RxParams.pfRxSeqCallback != NULL)
+   {
+      RxParams.pfRxSeqCallback(ulSeq, ucLen, pucData);
+   }
+
+   ant_rx_pool_dispatch(ulSeq, ucLen, pucData);
+
+   if(RxParams.pfRxCallback != NULL)
+   {
+      RxParams.pfRxCallback(ucLen, pucData);
+   }
+   else if(RxParams.pfRxSeqCallback == NULL)
+   {
+      ANT_ERROR("Can't send rx message - no callback registered");
+   }
+}
+
+/*
+ * Delivers the messages queued for the rx thread, like responses answered
+ * from the cache, as if they had been received.
+ */
+static void deliver_queued_messages(void)
+{
+   ANT_U8 aucMesg[ANT_NATIVE_MAX_MESSAGE_SIZE];
+   ANT_U8 ucLen;
+   ANT_BOOL bDelivered = ANT_FALSE;
+
+   ant_rx_queue_ack();
+   while ((ucLen = ant_rx_queue_get(aucMesg)) != 0)
+   {
+      ant_rx_deliver_message(ucLen, aucMesg);
+      bDelivered = ANT_TRUE;
+   }
+
+   if (bDelivered)
+   {
+      ant_rx_pool_batch_end();
+   }
+}
 
 /*
  * This thread opens a Bluez HCI socket and waits for ANT messages.
@@ -113,19 +168,26 @@ void *ANTHCIRxThread(void *pvHCIDevice)
       goto close;
    }
 
+   // Anything still queued was meant for an rx thread that has exited.
+   ant_rx_queue_clear();
+
    /* continue running as long as not terminated */
-   while (get_and_set_radio_status() == RADIO_STATUS_ENABLED)
+   while (get_radio_status() == RADIO_STATUS_ENABLED)
    {
-      struct pollfd p;
+      struct pollfd p[2];
       int n;
 
-      p.fd = rxSocket;
-      p.events = POLLIN;
+      p[0].fd = rxSocket;
+      p[0].events = POLLIN;
+      p[0].revents = 0;
+      p[1].fd = ant_rx_queue_fd();
+      p[1].events = POLLIN;
+      p[1].revents = 0;
 
       ANT_DEBUG_V("    RX: Polling HCI for data...");
 
       /* poll socket, wait for ANT messages */
-      while ((n = poll(&p, 1, 2500)) == -1)
+      while ((n = poll(p, 2, 2500)) == -1)
       {
          if (errno == EAGAIN || errno == EINTR)
             continue;
@@ -141,6 +203,18 @@ void *ANTHCIRxThread(void *pvHCIDevice)
       if (0 == n)
       {
          ANT_DEBUG_V("    RX: Timeout");
+         // Only ask the BlueZ core when idle, in case it was disabled under us.
+         get_and_set_radio_status();
+         continue;
+      }
+
+      if (p[1].revents & POLLIN)
+      {
+         deliver_queued_messages();
+      }
+
+      if (!(p[0].revents & (POLLIN | POLLERR | POLLHUP)))
+      {
          continue;
       }
 
@@ -169,14 +243,8 @@ void *ANTHCIRxThread(void *pvHCIDevice)
 
       ANT_SERIAL(event_packet->hci_payload, hci_payload_len, 'R');
 
-      if(RxParams.pfRxCallback != NULL)
-      {
-         RxParams.pfRxCallback(hci_payload_len, event_packet->hci_payload);
-      }
-      else
-      {
-         ANT_ERROR("Can't send rx message - no callback registered");
-      }
+      ant_rx_deliver_message(hci_payload_len, event_packet->hci_payload);
+      ant_rx_pool_batch_end();
    }
 
 close:
@@ -187,12 +255,11 @@ close:
    {
       ANT_DEBUG_W("rx thread socket has unexpectedly crashed");
 #if USE_EXTERNAL_POWER_LIBRARY
-      if (RxParams.pfStateCallback)
-         RxParams.pfStateCallback(RADIO_STATUS_DISABLING);
+      ant_state_notify(RxParams.pfStateCallback, RADIO_STATUS_DISABLING);
       ant_disable();
       get_and_set_radio_status();
 #else
-      radio_status = RADIO_STATUS_DISABLED;
+      set_radio_status(RADIO_STATUS_DISABLED);
 #endif
       RxParams.thread = 0;
       pthread_mutex_unlock(&enableLock);
@@ -85,6 +85,11 @@ void ant_close_tx_transport(int socket)
 
    if(0 < socket)
    {
+      if (socket == g_ant_cmd_socket)
+      {
+         g_ant_cmd_socket = -1;
+      }
+
       if (0 == close(socket))
       {
          ANT_DEBUG_D("closed hci device (socket handle=%#x)", socket);
@@ -102,6 +107,29 @@ void ant_close_tx_transport(int socket)
    ANT_FUNC_END();
 }
 
+// Discards events already queued on a tx socket that is kept open, such as a
+// command complete that arrived after its tx stopped waiting for it, so the
+// next tx doesn't take it for its own.
+void ant_drain_tx_transport(int socket)
+{
+   ANT_U8 buf[HCI_MAX_EVENT_SIZE];
+   int stale = 0;
+
+   ANT_FUNC_START();
+
+   while (recv(socket, buf, sizeof(buf), MSG_DONTWAIT) >= 0)
+   {
+      stale++;
+   }
+
+   if (stale > 0)
+   {
+      ANT_WARN("dropped %d stale events from tx socket %#x", stale, socket);
+   }
+
+   ANT_FUNC_END();
+}
+
 /* 
 Format of an HCI WRITE command to ANT chip:
 
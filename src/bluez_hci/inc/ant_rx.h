@@ -39,6 +39,9 @@ typedef struct
    //The function to call back with received data
    ANTNativeANTEventCb pfRxCallback;
 
+   //The function to call back with received data and its rx sequence stamp
+   ANTNativeANTEventSeqCb pfRxSeqCallback;
+
    //The function to call back with state changes
    ANTNativeANTStateCb pfStateCallback;
 
@@ -52,5 +55,8 @@ extern ANTHCIRxParams RxParams;
 //The message receive thread
 void* ANTHCIRxThread(void* pvHCIDevice);
 
+//Hands a message to the rx callbacks and consumers as if it had been received
+void ant_rx_deliver_message(ANT_U8 ucLen, ANT_U8 *pucData);
+
 #endif  /* __ANT_OS_H */
 
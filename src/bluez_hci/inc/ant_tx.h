@@ -33,6 +33,7 @@
 
 int         ant_open_tx_transport(void);
 void        ant_close_tx_transport(int socket);
+void        ant_drain_tx_transport(int socket);
 ANT_BOOL    wait_for_message(int socket);
 ANTStatus   write_data(ANT_U8 ant_message[], int ant_message_len);
 
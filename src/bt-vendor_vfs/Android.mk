@@ -36,6 +36,21 @@ endif # BOARD_ANT_WIRELESS_DEVICE = "qualcomm-uart"
 LOCAL_SRC_FILES := \
    $(COMMON_DIR)/JAntNative.cpp \
    $(COMMON_DIR)/ant_utils.c \
+   $(COMMON_DIR)/ant_rx_pool.c \
+   $(COMMON_DIR)/ant_command.c \
+   $(COMMON_DIR)/ant_configure.c \
+   $(COMMON_DIR)/ant_cache.c \
+   $(COMMON_DIR)/ant_rx_queue.c \
+   $(COMMON_DIR)/ant_decoder.c \
+   $(COMMON_DIR)/ant_link_stats.c \
+   $(COMMON_DIR)/ant_tx_batch.c \
+   $(COMMON_DIR)/ant_state_notify.c \
+   $(COMMON_DIR)/ant_tx_queue.c \
+   $(COMMON_DIR)/ant_reactor.c \
+   $(COMMON_DIR)/ant_uring.c \
+   $(COMMON_DIR)/ant_thread.c \
+   $(COMMON_DIR)/ant_radio_async.c \
+   $(COMMON_DIR)/ant_journal.c \
    $(ANT_DIR)/ant_native_chardev.c \
    $(ANT_DIR)/ant_rx_chardev.c \
 
@@ -56,3 +71,27 @@ LOCAL_MODULE := libantradio
 LOCAL_SYSTEM_EXT_MODULE := true
 
 include $(BUILD_SHARED_LIBRARY)
+
+#
+# libbt-vendor.so stand-in for running the HAL on the host, see stub/bt_vendor_stub.c
+#
+
+include $(CLEAR_VARS)
+
+LOCAL_CFLAGS := -g -c -W -Wall -O2
+
+LOCAL_C_INCLUDES := \
+   $(LOCAL_PATH)/src/common/inc \
+   $(LOCAL_PATH)/$(ANT_DIR)/qualcomm/uart \
+   $(BDROID_DIR)/hci/include \
+
+LOCAL_SRC_FILES := \
+   $(ANT_DIR)/stub/bt_vendor_stub.c \
+
+LOCAL_LDLIBS := -lpthread
+
+LOCAL_MODULE_TAGS := optional
+LOCAL_MODULE := libbt-vendor-antstub
+LOCAL_MODULE_STEM := libbt-vendor
+
+include $(BUILD_HOST_SHARED_LIBRARY)
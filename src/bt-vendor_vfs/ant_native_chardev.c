@@ -29,11 +29,15 @@
 #include <errno.h>
 #include <fcntl.h> /* for open() */
 #include <linux/ioctl.h> /* For hard reset */
+#include <poll.h> /* for poll() */
 #include <pthread.h>
 #include <dlfcn.h> /* needed for runtime dll loading. */
 #include <stdint.h> /* for uint64_t */
 #include <sys/eventfd.h> /* For eventfd() */
+#include <sys/timerfd.h> /* For timerfd_create() */
+#include <time.h> /* for clock_gettime() */
 #include <unistd.h> /* for read(), write(), and close() */
+#include <string.h>
 
 #include "ant_types.h"
 #include "ant_native.h"
@@ -42,6 +46,13 @@
 #include "antradio_power.h"
 #include "ant_rx_chardev.h"
 #include "ant_hci_defines.h"
+#include "ant_cache.h"
+#include "ant_journal.h"
+#include "ant_radio_async.h"
+#include "ant_rx_queue.h"
+#include "ant_state_notify.h"
+#include "ant_tx_queue.h"
+#include "ant_thread.h"
 #include "ant_log.h"
 #include "bt_vendor_lib.h" /* used by qualcomms code to call into libbt-vendor.so */
 #include <cutils/properties.h> /* used by qualcomms additions for logging. */
@@ -76,6 +87,11 @@ static const bt_vendor_callbacks_t vendor_callbacks = {
     vendor_epilog_cb
 };
 
+// libbt-vendor stays loaded and initialized from the first enable until ant_deinit(), so a
+// power cycle only costs the power and userial operations.
+static void *vendor_so_handle=NULL;
+static void vendor_interface_release(void);
+
 #if ANT_HCI_SIZE_SIZE > 1
 #include "ant_utils.h"  // Put HCI Size value across multiple bytes
 #endif
@@ -90,13 +106,21 @@ static const bt_vendor_callbacks_t vendor_callbacks = {
 
 static ant_rx_thread_info_t stRxThreadInfo;
 static pthread_mutex_t stEnabledStatusLock = PTHREAD_MUTEX_INITIALIZER;
-static pthread_mutex_t stFlowControlLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t stRadioStatusLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t stFlowControlLock;
 static pthread_cond_t stFlowControlCond = PTHREAD_COND_INITIALIZER;
 ANTNativeANTStateCb g_fnStateCallback;
 
 static const uint64_t EVENT_FD_PLUS_ONE = 1L;
 
+// When the radio was last enabled and the rx wakeup count at that time, for the wakeup rate.
+static struct timespec stRxStatsStartTime;
+static ANT_U32 ulRxStatsStartWakeups;
+
 static void ant_channel_init(ant_channel_info_t *pstChnlInfo, const char *pcCharDevName);
+static int ant_write_message(ant_channel_type eTxPath, ANT_U8 *pucTxMessage, ANT_U8 ucMessageLength);
+static ANT_U32 ant_rx_wakeups(void);
+static void ant_standby_set(ANT_BOOL bStandby, ANT_U32 ulGraceMs);
 
 ////////////////////////////////////////////////////////////////////
 //  ant_init
@@ -123,8 +147,11 @@ ANTStatus ant_init(void)
    ANT_FUNC_START();
 
    stRxThreadInfo.stRxThread = 0;
+   stRxThreadInfo.bThreadless = ANT_FALSE;
+   stRxThreadInfo.bRxLoopStarted = ANT_FALSE;
    stRxThreadInfo.ucRunThread = 0;
    stRxThreadInfo.ucChipResetting = 0;
+   stRxThreadInfo.uiRadioStatus = RADIO_STATUS_DISABLED;
    stRxThreadInfo.pstEnabledStatusLock = &stEnabledStatusLock;
    g_fnStateCallback = 0;
 
@@ -146,6 +173,68 @@ ANTStatus ant_init(void)
       status = ANT_STATUS_SUCCESS;
    }
 
+#ifdef ANT_RX_COALESCE_US
+   // Non blocking for the same reason as the eventfd.
+   stRxThreadInfo.iRxCoalesceTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+
+   if(stRxThreadInfo.iRxCoalesceTimerFd == -1)
+   {
+      ANT_ERROR("ANT init failed. Could not create rx hold-off timer fd. Reason: %s", strerror(errno));
+      status = ANT_STATUS_FAILED;
+   }
+#endif // ANT_RX_COALESCE_US
+
+   // Non blocking for the same reason as the eventfd.
+   stRxThreadInfo.iKeepaliveTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+   stRxThreadInfo.ulKeepaliveIdleMs = ANT_KEEPALIVE_IDLE_MS;
+   stRxThreadInfo.ulKeepaliveResponseMs = ANT_KEEPALIVE_RESPONSE_MS;
+   stRxThreadInfo.ulKeepaliveRttMs = 0;
+   stRxThreadInfo.ulKeepaliveProbes = 0;
+   stRxThreadInfo.ulKeepaliveSuppressed = 0;
+
+   if(stRxThreadInfo.iKeepaliveTimerFd == -1)
+   {
+      ANT_ERROR("ANT init failed. Could not create keepalive timer fd. Reason: %s", strerror(errno));
+      status = ANT_STATUS_FAILED;
+   }
+
+   stRxThreadInfo.iStandbyTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+   stRxThreadInfo.bStandby = ANT_FALSE;
+   stRxThreadInfo.ulStandbyGraceMs = ANT_STANDBY_GRACE_MS;
+   stRxThreadInfo.bRecoveryReplay = ANT_RECOVERY_REPLAY;
+   stRxThreadInfo.ulRecoveries = 0;
+   stRxThreadInfo.ulLastRecoveryMs = 0;
+   stRxThreadInfo.ulMaxRecoveryMs = 0;
+   stRxThreadInfo.ulChannelsRestored = 0;
+   stRxThreadInfo.ulChannelsNotRestored = 0;
+
+   if(stRxThreadInfo.iStandbyTimerFd == -1)
+   {
+      ANT_ERROR("ANT init failed. Could not create standby timer fd. Reason: %s", strerror(errno));
+      status = ANT_STATUS_FAILED;
+   }
+
+   // Priority inheritance, so a real-time rx thread isn't held up by a sender holding the lock.
+   if (ant_thread_mutex_init(&stFlowControlLock))
+   {
+      ANT_ERROR("ANT init failed. Could not create flow control lock.");
+      status = ANT_STATUS_FAILED;
+   }
+
+   // Lets responses answered from the cache be delivered by the rx loop.
+   if (ant_rx_queue_open() < 0)
+   {
+      ANT_ERROR("ANT init failed. Could not open rx queue.");
+      status = ANT_STATUS_FAILED;
+   }
+
+   // The rx thread sends keepalives through the tx queue, so it can handle flow control meanwhile.
+   if (ant_tx_queue_start() != ANT_STATUS_SUCCESS)
+   {
+      ANT_ERROR("ANT init failed. Could not start tx queue.");
+      status = ANT_STATUS_FAILED;
+   }
+
    ANT_FUNC_END();
    return status;
 }
@@ -171,6 +260,13 @@ ANTStatus ant_deinit(void)
    ANTStatus result_status = ANT_STATUS_FAILED;
    ANT_FUNC_START();
 
+   if (stRxThreadInfo.bStandby) {
+      // Don't leave the transport open until standby ends.
+      ant_disable();
+   }
+
+   ant_rx_replay_stop();
+
    if(close(stRxThreadInfo.iRxShutdownEventFd) < 0)
    {
       ANT_ERROR("Could not close eventfd in deinit. Reason: %s", strerror(errno));
@@ -178,6 +274,43 @@ ANTStatus ant_deinit(void)
       result_status = ANT_STATUS_SUCCESS;
    }
 
+#ifdef ANT_RX_COALESCE_US
+   if(close(stRxThreadInfo.iRxCoalesceTimerFd) < 0)
+   {
+      ANT_ERROR("Could not close rx hold-off timer fd in deinit. Reason: %s", strerror(errno));
+      result_status = ANT_STATUS_FAILED;
+   }
+#endif // ANT_RX_COALESCE_US
+
+   ant_tx_queue_stop();
+
+   if (stRxThreadInfo.bThreadless) {
+      stRxThreadInfo.bThreadless = ANT_FALSE;
+      ant_state_notify_set_deferred(ANT_FALSE);
+      ant_rx_loop_close();
+   }
+
+   // Delivers the changes still queued and joins the notifier thread.
+   ant_state_notify_stop();
+
+   ant_rx_queue_close();
+
+   if(close(stRxThreadInfo.iKeepaliveTimerFd) < 0)
+   {
+      ANT_ERROR("Could not close keepalive timer fd in deinit. Reason: %s", strerror(errno));
+      result_status = ANT_STATUS_FAILED;
+   }
+
+   if(close(stRxThreadInfo.iStandbyTimerFd) < 0)
+   {
+      ANT_ERROR("Could not close standby timer fd in deinit. Reason: %s", strerror(errno));
+      result_status = ANT_STATUS_FAILED;
+   }
+
+   vendor_interface_release();
+
+   pthread_mutex_destroy(&stFlowControlLock);
+
    ANT_FUNC_END();
    return result_status;
 }
@@ -202,15 +335,25 @@ ANTStatus ant_deinit(void)
 //  Psuedocode:
 /*
 LOCK enable_LOCK
-    State callback: STATE = ENABLING
-    ant enable
-    IF ant_enable success
+    IF in standby and rx thread running
+        State callback: STATE = ENABLING
+        Leave standby
         State callback: STATE = ENABLED
         RESULT = SUCCESS
     ELSE
-        ant disable
-        State callback: STATE = Current state
-        RESULT = FAILURE
+        State callback: STATE = ENABLING
+        IF in standby
+            ant disable
+        ENDIF
+        ant enable
+        IF ant_enable success
+            State callback: STATE = ENABLED
+            RESULT = SUCCESS
+        ELSE
+            ant disable
+            State callback: STATE = Current state
+            RESULT = FAILURE
+        ENDIF
     ENDIF
 UNLOCK
 */
@@ -229,24 +372,39 @@ ANTStatus ant_enable_radio(void)
    }
    ANT_DEBUG_V("got stEnabledStatusLock in %s", __FUNCTION__);
 
-   if (g_fnStateCallback) {
-      g_fnStateCallback(RADIO_STATUS_ENABLING);
-   }
-
-   if (ant_enable() < 0) {
-      ANT_ERROR("ant enable failed: %s", strerror(errno));
+   if (stRxThreadInfo.bStandby && stRxThreadInfo.ucRunThread) {
+      // Still up from before, only delivery needs to resume.
+      ant_state_notify(g_fnStateCallback, RADIO_STATUS_ENABLING);
 
-      ant_disable();
+      // Anything the chip sent in standby was dropped.
+      ant_cache_invalidate();
+      ant_standby_set(ANT_FALSE, 0);
+      ant_radio_status_update();
 
-      if (g_fnStateCallback) {
-         g_fnStateCallback(ant_radio_enabled_status());
-      }
+      ant_state_notify(g_fnStateCallback, RADIO_STATUS_ENABLED);
+      result_status = ANT_STATUS_SUCCESS;
    } else {
-      if (g_fnStateCallback) {
-         g_fnStateCallback(RADIO_STATUS_ENABLED);
+      ant_state_notify(g_fnStateCallback, RADIO_STATUS_ENABLING);
+
+      if (stRxThreadInfo.bStandby) {
+         // Standby ended while waiting for the lock, finish closing the transport first.
+         ant_disable();
       }
 
-      result_status = ANT_STATUS_SUCCESS;
+      // The client sets up its channels from scratch after an enable.
+      ant_journal_clear();
+
+      if (ant_enable() < 0) {
+         ANT_ERROR("ant enable failed: %s", strerror(errno));
+
+         ant_disable();
+
+         ant_state_notify(g_fnStateCallback, ant_radio_enabled_status());
+      } else {
+         ant_state_notify(g_fnStateCallback, RADIO_STATUS_ENABLED);
+
+         result_status = ANT_STATUS_SUCCESS;
+      }
    }
 
    ANT_DEBUG_V("releasing stEnabledStatusLock in %s", __FUNCTION__);
@@ -320,8 +478,11 @@ ANTStatus ant_radio_hard_reset(void)
    ANT_DEBUG_V("got stEnabledStatusLock in %s", __FUNCTION__);
 
    stRxThreadInfo.ucChipResetting = 1;
-   if (g_fnStateCallback)
-      g_fnStateCallback(RADIO_STATUS_RESETTING);
+   ant_radio_status_update();
+   ant_state_notify(g_fnStateCallback, RADIO_STATUS_RESETTING);
+
+   // Reset on request, so the client sets up its channels again.
+   ant_journal_clear();
 
 #ifdef ANT_IOCTL_RESET_PARAMETER
    ioctl(stRxThreadInfo.astChannels[0].iFd, ANT_IOCTL_RESET, ANT_IOCTL_RESET_PARAMETER);
@@ -332,14 +493,13 @@ ANTStatus ant_radio_hard_reset(void)
    ant_disable();
 
    if (ant_enable()) { /* failed */
-      if (g_fnStateCallback)
-         g_fnStateCallback(RADIO_STATUS_DISABLED);
+      ant_state_notify(g_fnStateCallback, RADIO_STATUS_DISABLED);
    } else { /* success */
-      if (g_fnStateCallback)
-         g_fnStateCallback(RADIO_STATUS_RESET);
+      ant_state_notify(g_fnStateCallback, RADIO_STATUS_RESET);
       result_status = ANT_STATUS_SUCCESS;
    }
    stRxThreadInfo.ucChipResetting = 0;
+   ant_radio_status_update();
 
    ANT_DEBUG_V("releasing stEnabledStatusLock in %s", __FUNCTION__);
    pthread_mutex_unlock(&stEnabledStatusLock);
@@ -369,7 +529,11 @@ out:
 /*
 LOCK enable_LOCK
     State callback: STATE = DISABLING
-    ant disable
+    IF standby grace period set and current_state == ENABLED
+        Enter standby, starting standby timer
+    ELSE
+        ant disable
+    ENDIF
     State callback: STATE = Current state
     RESULT = SUCCESS
 UNLOCK
@@ -378,6 +542,7 @@ UNLOCK
 ANTStatus ant_disable_radio(void)
 {
    int iLockResult;
+   ANT_U32 ulGraceMs;
    ANTStatus ret = ANT_STATUS_FAILED;
    ANT_FUNC_START();
 
@@ -389,16 +554,19 @@ ANTStatus ant_disable_radio(void)
    }
    ANT_DEBUG_V("got stEnabledStatusLock in %s", __FUNCTION__);
 
-   if (g_fnStateCallback) {
-      g_fnStateCallback(RADIO_STATUS_DISABLING);
-   }
-
-   ant_disable();
+   ant_state_notify(g_fnStateCallback, RADIO_STATUS_DISABLING);
 
-   if (g_fnStateCallback) {
-      g_fnStateCallback(ant_radio_enabled_status());
+   ulGraceMs = __atomic_load_n(&stRxThreadInfo.ulStandbyGraceMs, __ATOMIC_RELAXED);
+   if ((ulGraceMs != 0) && (ant_radio_enabled_status() == RADIO_STATUS_ENABLED)) {
+      ANT_DEBUG_I("Keeping transport up for %u ms.", ulGraceMs);
+      ant_standby_set(ANT_TRUE, ulGraceMs);
+      ant_radio_status_update();
+   } else {
+      ant_disable();
    }
 
+   ant_state_notify(g_fnStateCallback, ant_radio_enabled_status());
+
    ret = ANT_STATUS_SUCCESS;
 
    ANT_DEBUG_V("releasing stEnabledStatusLock in %s", __FUNCTION__);
@@ -411,18 +579,16 @@ out:
 }
 
 ////////////////////////////////////////////////////////////////////
-//  ant_radio_enabled_status
+//  ant_radio_status_update
 //
-//  Gets the current chip/transport state; either disabled, disabling,
-//  enabling, enabled, or resetting.  Determines this on the fly by checking
-//  if Rx thread is running and how many of the paths for the ANT chip have
-//  open VFS files.
+//  Works out the radio status from the rx thread info and publishes it for
+//  ant_radio_enabled_status().
 //
 //  Parameters:
 //      -
 //
 //  Returns:
-//      The current radio status (ANTRadioEnabledStatus)
+//      -
 //
 //  Psuedocode:
 /*
@@ -446,9 +612,10 @@ ELSE
         ENDIF
     ENDIF
 ENDIF
+STORE RESULT as the radio status
 */
 ////////////////////////////////////////////////////////////////////
-ANTRadioEnabledStatus ant_radio_enabled_status(void)
+void ant_radio_status_update(void)
 {
    ant_channel_type eChannel;
    int iOpenFiles = 0;
@@ -456,18 +623,28 @@ ANTRadioEnabledStatus ant_radio_enabled_status(void)
    ANTRadioEnabledStatus uiRet = RADIO_STATUS_UNKNOWN;
    ANT_FUNC_START();
 
+   // Keeps the status stored in step with the last change when it is updated
+   // from more than one thread.
+   pthread_mutex_lock(&stRadioStatusLock);
+
    if (stRxThreadInfo.ucChipResetting) {
       uiRet = RADIO_STATUS_RESETTING;
       goto out;
    }
 
+   if (stRxThreadInfo.bStandby) {
+      // The transport is still up, but the radio is disabled as far as clients are concerned.
+      uiRet = RADIO_STATUS_DISABLED;
+      goto out;
+   }
+
    for (eChannel = 0; eChannel < NUM_ANT_CHANNELS; eChannel++) {
       if (stRxThreadInfo.astChannels[eChannel].iFd != -1) {
          iOpenFiles++;
       }
    }
 
-   iOpenThread = (stRxThreadInfo.stRxThread) ? 1 : 0;
+   iOpenThread = (stRxThreadInfo.stRxThread || stRxThreadInfo.bRxLoopStarted) ? 1 : 0;
 
    if (!stRxThreadInfo.ucRunThread) {
       if (iOpenFiles || iOpenThread) {
@@ -486,10 +663,33 @@ ANTRadioEnabledStatus ant_radio_enabled_status(void)
    }
 
 out:
-   ANT_DEBUG_D("get radio enabled status returned %d", uiRet);
+   ANT_DEBUG_D("radio status is now %d", uiRet);
+   __atomic_store_n(&stRxThreadInfo.uiRadioStatus, uiRet, __ATOMIC_RELEASE);
+   pthread_mutex_unlock(&stRadioStatusLock);
 
    ANT_FUNC_END();
-   return uiRet;
+}
+
+////////////////////////////////////////////////////////////////////
+//  ant_radio_enabled_status
+//
+//  Gets the radio status last published by ant_radio_status_update(), so
+//  checking it on every tx is a single load.
+//
+//  Parameters:
+//      -
+//
+//  Returns:
+//      The current radio status (ANTRadioEnabledStatus)
+//
+//  Psuedocode:
+/*
+RESULT = published radio status
+*/
+////////////////////////////////////////////////////////////////////
+ANTRadioEnabledStatus ant_radio_enabled_status(void)
+{
+   return __atomic_load_n(&stRxThreadInfo.uiRadioStatus, __ATOMIC_ACQUIRE);
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -527,6 +727,42 @@ ANTStatus set_ant_rx_callback(ANTNativeANTEventCb rx_callback_func)
    return status;
 }
 
+////////////////////////////////////////////////////////////////////
+//  set_ant_rx_seq_callback
+//
+//  Sets which function to call with the rx sequence stamp when an ANT message
+//  is received.
+//
+//  Parameters:
+//      rx_seq_callback_func   the ANTNativeANTEventSeqCb function to be used
+//                             for received messages (from all transport paths).
+//
+//  Returns:
+//          ANT_STATUS_SUCCESS
+//
+//  Psuedocode:
+/*
+FOR each transport path
+    Path Rx Seq Callback = rx_seq_callback_func
+ENDFOR
+*/
+////////////////////////////////////////////////////////////////////
+ANTStatus set_ant_rx_seq_callback(ANTNativeANTEventSeqCb rx_seq_callback_func)
+{
+   ANTStatus status = ANT_STATUS_SUCCESS;
+   ANT_FUNC_START();
+
+#ifdef ANT_DEVICE_NAME // Single transport path
+   stRxThreadInfo.astChannels[SINGLE_CHANNEL].fnRxSeqCallback = rx_seq_callback_func;
+#else // Separate data/command paths
+   stRxThreadInfo.astChannels[COMMAND_CHANNEL].fnRxSeqCallback = rx_seq_callback_func;
+   stRxThreadInfo.astChannels[DATA_CHANNEL].fnRxSeqCallback = rx_seq_callback_func;
+#endif // Separate data/command paths
+
+   ANT_FUNC_END();
+   return status;
+}
+
 ////////////////////////////////////////////////////////////////////
 //  set_ant_state_callback
 //
@@ -555,6 +791,400 @@ ANTStatus set_ant_state_callback(ANTNativeANTStateCb state_callback_func)
    return status;
 }
 
+////////////////////////////////////////////////////////////////////
+//  ant_get_transport_stats
+//
+//  Gets the rx counters summed over all transport paths, and the rx wakeup
+//  rate since the radio was last enabled
+//
+//  Parameters:
+//      pstStats        pointer to the stats to fill in
+//
+//  Returns:
+//      Success:
+//          ANT_STATUS_SUCCESS
+//      Failure:
+//          ANT_STATUS_INVALID_PARM
+//
+//  Psuedocode:
+/*
+        IF stats pointer is null
+            RESULT = INVALID PARAM
+        ELSE
+            FOR each transport path
+                ADD path counters to stats
+            ENDFOR
+            IF radio has been enabled
+                wakeup rate = wakeups since enable / time since enable
+            ENDIF
+            RESULT = SUCCESS
+        ENDIF
+*/
+////////////////////////////////////////////////////////////////////
+ANTStatus ant_get_transport_stats(ANTTransportStats *pstStats)
+{
+   ant_channel_type eChannel;
+   struct timespec stNow;
+   long long llElapsedMs;
+   ANTStatus status = ANT_STATUS_INVALID_PARM;
+   ANT_FUNC_START();
+
+   if (pstStats == NULL) {
+      goto out;
+   }
+
+   memset(pstStats, 0, sizeof(*pstStats));
+   for (eChannel = 0; eChannel < NUM_ANT_CHANNELS; eChannel++) {
+      pstStats->ulRxWakeups += stRxThreadInfo.astChannels[eChannel].ulRxWakeups;
+      pstStats->ulRxSpuriousWakeups += stRxThreadInfo.astChannels[eChannel].ulRxSpuriousWakeups;
+      pstStats->ulRxReads += stRxThreadInfo.astChannels[eChannel].ulRxReads;
+      pstStats->ulRxMessages += stRxThreadInfo.astChannels[eChannel].ulRxMessages;
+   }
+   pstStats->ulKeepaliveProbes = __atomic_load_n(&stRxThreadInfo.ulKeepaliveProbes, __ATOMIC_RELAXED);
+   pstStats->ulKeepaliveSuppressed = __atomic_load_n(&stRxThreadInfo.ulKeepaliveSuppressed, __ATOMIC_RELAXED);
+   pstStats->ulKeepaliveRttMs = __atomic_load_n(&stRxThreadInfo.ulKeepaliveRttMs, __ATOMIC_RELAXED);
+   pstStats->ulRecoveries = __atomic_load_n(&stRxThreadInfo.ulRecoveries, __ATOMIC_RELAXED);
+   pstStats->ulLastRecoveryMs = __atomic_load_n(&stRxThreadInfo.ulLastRecoveryMs, __ATOMIC_RELAXED);
+   pstStats->ulMaxRecoveryMs = __atomic_load_n(&stRxThreadInfo.ulMaxRecoveryMs, __ATOMIC_RELAXED);
+   pstStats->ulChannelsRestored = __atomic_load_n(&stRxThreadInfo.ulChannelsRestored, __ATOMIC_RELAXED);
+   pstStats->ulChannelsNotRestored = __atomic_load_n(&stRxThreadInfo.ulChannelsNotRestored, __ATOMIC_RELAXED);
+
+   if ((stRxStatsStartTime.tv_sec != 0) && (clock_gettime(CLOCK_MONOTONIC, &stNow) == 0)) {
+      llElapsedMs = (stNow.tv_sec - stRxStatsStartTime.tv_sec) * 1000LL +
+            (stNow.tv_nsec - stRxStatsStartTime.tv_nsec) / 1000000L;
+      if (llElapsedMs > 0) {
+         pstStats->ulRxWakeupsPerSec = (ANT_U32)(((pstStats->ulRxWakeups - ulRxStatsStartWakeups) * 1000LL) / llElapsedMs);
+      }
+   }
+   status = ANT_STATUS_SUCCESS;
+
+out:
+   ANT_FUNC_END();
+   return status;
+}
+
+////////////////////////////////////////////////////////////////////
+//  ant_set_keepalive
+//
+//  Sets how long the rx thread waits without rx before sending a keepalive,
+//  and how long it then waits for rx before recovering the chip. Together they
+//  are the longest time a dead chip can go unnoticed
+//
+//  Parameters:
+//      ulIdleMs             time without rx before a keepalive, 0 for none
+//      ulResponseTimeoutMs  time to wait for rx after a keepalive
+//
+//  Returns:
+//      Success:
+//          ANT_STATUS_SUCCESS
+//      Failure:
+//          ANT_STATUS_INVALID_PARM
+//
+//  Psuedocode:
+/*
+        IF keepalives enabled and response timeout is 0, or the sum overflows
+            RESULT = INVALID PARAM
+        ELSE
+            SET intervals
+            IF rx thread is running
+                EXPIRE keepalive timer now, so rx thread applies the intervals
+            ENDIF
+            RESULT = SUCCESS
+        ENDIF
+*/
+////////////////////////////////////////////////////////////////////
+ANTStatus ant_set_keepalive(ANT_U32 ulIdleMs, ANT_U32 ulResponseTimeoutMs)
+{
+   struct itimerspec stExpireNow;
+   ANTStatus status = ANT_STATUS_INVALID_PARM;
+   ANT_FUNC_START();
+
+   if ((ulIdleMs != 0) && ((ulResponseTimeoutMs == 0) || (ulResponseTimeoutMs > 0xFFFFFFFFu - ulIdleMs))) {
+      goto out;
+   }
+
+   __atomic_store_n(&stRxThreadInfo.ulKeepaliveResponseMs, ulResponseTimeoutMs, __ATOMIC_RELAXED);
+   __atomic_store_n(&stRxThreadInfo.ulKeepaliveIdleMs, ulIdleMs, __ATOMIC_RELEASE);
+   __atomic_store_n(&stRxThreadInfo.bKeepaliveChanged, ANT_TRUE, __ATOMIC_RELAXED);
+
+   if (stRxThreadInfo.ucRunThread) {
+      memset(&stExpireNow, 0, sizeof(stExpireNow));
+      stExpireNow.it_value.tv_nsec = 1;
+      if (timerfd_settime(stRxThreadInfo.iKeepaliveTimerFd, 0, &stExpireNow, NULL) < 0) {
+         ANT_WARN("keepalive change deferred to next timeout: %s", strerror(errno));
+      }
+   }
+   status = ANT_STATUS_SUCCESS;
+
+out:
+   ANT_FUNC_END();
+   return status;
+}
+
+////////////////////////////////////////////////////////////////////
+//  ant_set_standby
+//
+//  Sets how long the transport is kept up after the radio is disabled,
+//  from the next disable.
+//
+//  Parameters:
+//      ulGraceMs  Time to keep the transport up, 0 to close it on disable
+//
+//  Returns:
+//      ANT_STATUS_SUCCESS
+//
+//  Psuedocode:
+/*
+        SET grace period
+        RESULT = SUCCESS
+*/
+////////////////////////////////////////////////////////////////////
+ANTStatus ant_set_standby(ANT_U32 ulGraceMs)
+{
+   ANT_FUNC_START();
+
+   __atomic_store_n(&stRxThreadInfo.ulStandbyGraceMs, ulGraceMs, __ATOMIC_RELAXED);
+
+   ANT_FUNC_END();
+   return ANT_STATUS_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////
+//  ant_set_recovery_replay
+//
+//  Sets whether the channels are restored after a recovery.
+//
+//  Parameters:
+//      bReplay  ANT_TRUE to restore the channels
+//
+//  Returns:
+//      ANT_STATUS_SUCCESS
+//
+//  Psuedocode:
+/*
+        SET replay
+        RESULT = SUCCESS
+*/
+////////////////////////////////////////////////////////////////////
+ANTStatus ant_set_recovery_replay(ANT_BOOL bReplay)
+{
+   ANT_FUNC_START();
+
+   __atomic_store_n(&stRxThreadInfo.bRecoveryReplay, bReplay, __ATOMIC_RELAXED);
+
+   ANT_FUNC_END();
+   return ANT_STATUS_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////
+//  ant_set_threadless
+//
+//  Switches between running the rx loop on an rx thread started by enable,
+//  and running it on the caller's thread from ant_process_events()
+//
+//  Parameters:
+//      bThreadless  ANT_TRUE for threadless mode
+//
+//  Returns:
+//      Success:
+//          ANT_STATUS_SUCCESS
+//      Failures:
+//          ANT_STATUS_CONTEXT_NOT_DISABLED if the radio is not disabled
+//          ANT_STATUS_FAILED if failed to get mutex or open the rx loop
+//
+//  Psuedocode:
+/*
+LOCK enable_LOCK
+   IF current_state != DISABLED
+      RESULT = CONTEXT NOT DISABLED
+   ELSE IF threadless requested and not threadless
+      OPEN rx loop
+      DEFER tx queue and state notifications to ant_process_events()
+      RESULT = SUCCESS
+   ELSE IF threadless not requested and threadless
+      START tx queue and state notification threads again
+      CLOSE rx loop
+      RESULT = SUCCESS
+   ELSE
+      RESULT = SUCCESS
+   ENDIF
+UNLOCK
+*/
+////////////////////////////////////////////////////////////////////
+ANTStatus ant_set_threadless(ANT_BOOL bThreadless)
+{
+   int iLockResult;
+   ANTStatus status = ANT_STATUS_FAILED;
+   ANT_FUNC_START();
+
+   ANT_DEBUG_V("getting stEnabledStatusLock in %s", __FUNCTION__);
+   iLockResult = pthread_mutex_lock(&stEnabledStatusLock);
+   if(iLockResult) {
+      ANT_ERROR("threadless mode change failed to get state lock: %s", strerror(iLockResult));
+      goto out;
+   }
+   ANT_DEBUG_V("got stEnabledStatusLock in %s", __FUNCTION__);
+
+   if (stRxThreadInfo.bStandby) {
+      // The rx loop is still running, close it before it moves.
+      ant_disable();
+   }
+
+   if (ant_radio_enabled_status() != RADIO_STATUS_DISABLED) {
+      ANT_ERROR("threadless mode can only be changed while disabled");
+      status = ANT_STATUS_CONTEXT_NOT_DISABLED;
+   } else if (bThreadless && !stRxThreadInfo.bThreadless) {
+      if (ant_rx_loop_open() < 0) {
+         ANT_ERROR("failed to open rx loop: %s", strerror(errno));
+      } else if (ant_tx_queue_set_deferred(ANT_TRUE) != ANT_STATUS_SUCCESS) {
+         ant_rx_loop_close();
+      } else {
+         ant_state_notify_set_deferred(ANT_TRUE);
+         stRxThreadInfo.bThreadless = ANT_TRUE;
+         status = ANT_STATUS_SUCCESS;
+      }
+   } else if (!bThreadless && stRxThreadInfo.bThreadless) {
+      if (ant_tx_queue_set_deferred(ANT_FALSE) == ANT_STATUS_SUCCESS) {
+         ant_state_notify_set_deferred(ANT_FALSE);
+         ant_rx_loop_close();
+         stRxThreadInfo.bThreadless = ANT_FALSE;
+         status = ANT_STATUS_SUCCESS;
+      }
+   } else {
+      status = ANT_STATUS_SUCCESS;
+   }
+
+   ANT_DEBUG_V("releasing stEnabledStatusLock in %s", __FUNCTION__);
+   pthread_mutex_unlock(&stEnabledStatusLock);
+   ANT_DEBUG_V("released stEnabledStatusLock in %s", __FUNCTION__);
+
+out:
+   ANT_FUNC_END();
+   return status;
+}
+
+////////////////////////////////////////////////////////////////////
+//  ant_get_poll_fds
+//
+//  Gets the file descriptors to wait on for readability before calling
+//  ant_process_events() in threadless mode
+//
+//  Parameters:
+//      piFds     filled in with the file descriptors
+//      pulCount  in: room in piFds, out: number of file descriptors
+//
+//  Returns:
+//      Success:
+//          ANT_STATUS_SUCCESS
+//      Failures:
+//          ANT_STATUS_INVALID_PARM if there is no room for the file descriptors
+//          ANT_STATUS_NOT_APPLICABLE if not in threadless mode
+//
+//  Psuedocode:
+/*
+        IF not threadless
+            RESULT = NOT APPLICABLE
+        ELSE IF no room in piFds
+            SET count needed
+            RESULT = INVALID PARAM
+        ELSE
+            SET piFds to the rx loop epoll file descriptor
+            RESULT = SUCCESS
+        ENDIF
+*/
+////////////////////////////////////////////////////////////////////
+ANTStatus ant_get_poll_fds(int *piFds, ANT_U32 *pulCount)
+{
+   ANTStatus status = ANT_STATUS_INVALID_PARM;
+   ANT_FUNC_START();
+
+   if (pulCount == NULL) {
+      goto out;
+   }
+
+   if (!stRxThreadInfo.bThreadless) {
+      status = ANT_STATUS_NOT_APPLICABLE;
+   } else if ((piFds == NULL) || (*pulCount < 1)) {
+      *pulCount = 1;
+   } else {
+      // Everything the rx loop watches is behind its epoll file descriptor, which stays the same
+      // across enables and recoveries.
+      piFds[0] = ant_rx_loop_fd();
+      *pulCount = 1;
+      status = ANT_STATUS_SUCCESS;
+   }
+
+out:
+   ANT_FUNC_END();
+   return status;
+}
+
+////////////////////////////////////////////////////////////////////
+//  ant_process_events
+//
+//  Runs the rx loop on the caller's thread in threadless mode: reads and
+//  delivers rx, handles flow control, keepalives and recovery, and calls the
+//  state callback
+//
+//  Parameters:
+//      iTimeoutMs  longest time to wait for events, 0 to not wait, -1 forever
+//
+//  Returns:
+//      Success:
+//          ANT_STATUS_SUCCESS
+//      Failures:
+//          ANT_STATUS_NOT_APPLICABLE if not in threadless mode
+//          ANT_STATUS_FAILED if called from an rx or state callback, or from
+//          a thread other than the one running the rx loop
+//
+//  Psuedocode:
+/*
+        IF not threadless
+            RESULT = NOT APPLICABLE
+        ELSE
+            DELIVER state changes from calls since the last time
+            RUN rx loop handlers for events within timeout
+            IF called from a handler or not the rx loop's thread
+                RESULT = FAILED
+            ELSE
+                SEND messages queued by the handlers, like keepalives
+                DELIVER state changes from the handlers
+                RESULT = SUCCESS
+            ENDIF
+        ENDIF
+*/
+////////////////////////////////////////////////////////////////////
+ANTStatus ant_process_events(int iTimeoutMs)
+{
+   ANTStatus status = ANT_STATUS_NOT_APPLICABLE;
+   ANT_FUNC_START();
+
+   if (!stRxThreadInfo.bThreadless) {
+      goto out;
+   }
+
+   ant_state_notify_flush();
+
+   if (ant_rx_loop_process(&stRxThreadInfo, iTimeoutMs) < 0) {
+      if (errno == EDEADLK) {
+         ANT_ERROR("ant_process_events() called from an rx callback");
+      } else {
+         ANT_DEBUG_D("ant_process_events() called from a thread not running the rx loop");
+      }
+      status = ANT_STATUS_FAILED;
+      goto out;
+   }
+
+   // Outside of the handlers, so these can wait for flow control by running the loop again.
+   ant_tx_queue_flush();
+   ant_state_notify_flush();
+   status = ANT_STATUS_SUCCESS;
+
+out:
+   ANT_FUNC_END();
+   return status;
+}
+
 ////////////////////////////////////////////////////////////////////
 //  ant_tx_message_flowcontrol_wait
 //
@@ -631,7 +1261,7 @@ ANTStatus ant_tx_message_flowcontrol_wait(ant_channel_type eTxPath, ant_channel_
    stRxThreadInfo.astChannels[eFlowMessagePath].pucResendMessage = pucTxMessage;
 #endif // ANT_FLOW_RESEND
 
-   iResult = write(stRxThreadInfo.astChannels[eTxPath].iFd, pucTxMessage, ucMessageLength);
+   iResult = ant_write_message(eTxPath, pucTxMessage, ucMessageLength);
    if (iResult < 0) {
       ANT_ERROR("failed to write data message to device: %s", strerror(errno));
    } else if (iResult != ucMessageLength) {
@@ -641,7 +1271,12 @@ ANTStatus ant_tx_message_flowcontrol_wait(ant_channel_type eTxPath, ant_channel_
       stTimeout.tv_nsec = 0;
 
       while (stRxThreadInfo.astChannels[eFlowMessagePath].ucFlowControlResp != ANT_FLOW_GO) {
-         iCondWaitResult = pthread_cond_timedwait(&stFlowControlCond, &stFlowControlLock, &stTimeout);
+         if (stRxThreadInfo.bThreadless) {
+            // Nothing else reads the flow control response, so read it while waiting.
+            iCondWaitResult = ant_rx_loop_wait(&stRxThreadInfo, &stFlowControlCond, &stFlowControlLock, &stTimeout);
+         } else {
+            iCondWaitResult = pthread_cond_timedwait(&stFlowControlCond, &stFlowControlLock, &stTimeout);
+         }
          if (iCondWaitResult) {
             ANT_ERROR("failed to wait for flow control response: %s", strerror(iCondWaitResult));
 
@@ -707,7 +1342,7 @@ ANTStatus ant_tx_message_flowcontrol_none(ant_channel_type eTxPath, ANT_U8 ucMes
    ANTStatus status = ANT_STATUS_FAILED;\
    ANT_FUNC_START();
 
-   iResult = write(stRxThreadInfo.astChannels[eTxPath].iFd, pucTxMessage, ucMessageLength);
+   iResult = ant_write_message(eTxPath, pucTxMessage, ucMessageLength);
    if (iResult < 0) {
       ANT_ERROR("failed to write message to device: %s", strerror(errno));
    }  else if (iResult != ucMessageLength) {
@@ -740,6 +1375,10 @@ ANTStatus ant_tx_message_flowcontrol_none(ant_channel_type eTxPath, ANT_U8 ucMes
 /*
 IF not enabled
     RESULT = BT NOT INITIALIZED
+ELSE IF request answered from cache and rx queue not full
+    QUEUE response for the rx loop to deliver
+ELSE IF called from the threadless rx loop's handlers
+    QUEUE message for ant_process_events() to send
 ELSE
     Create txBuffer, MAX HCI Message Size large
     PUT ucLen in txBuffer AT ANT HCI Size Offset (0)
@@ -763,6 +1402,8 @@ ANTStatus ant_tx_message(ANT_U8 ucLen, ANT_U8 *pucMesg)
    // TODO Message length can be greater than ANT_U8 can hold.
    // Not changed as ANT_SERIAL takes length as ANT_U8.
    ANT_U8 txMessageLength = HCI_PACKET_TYPE_SIZE + ucLen + ANT_HCI_HEADER_SIZE;
+   ANT_U8 aucCacheResponse[ANT_NATIVE_MAX_MESSAGE_SIZE];
+   ANT_U8 ucCacheResponseLength;
    ANT_FUNC_START();
 
    if (ant_radio_enabled_status() != RADIO_STATUS_ENABLED) {
@@ -770,6 +1411,23 @@ ANTStatus ant_tx_message(ANT_U8 ucLen, ANT_U8 *pucMesg)
       goto out;
    }
 
+   ucCacheResponseLength = ant_cache_tx_message(ucLen, pucMesg, aucCacheResponse);
+   // Answered without asking the chip, the rx loop delivers the response as if it had been
+   // received. If too many are waiting for it, ask the chip after all.
+   if ((ucCacheResponseLength != 0) &&
+         (ant_rx_queue_message(ucCacheResponseLength, aucCacheResponse) == ANT_STATUS_SUCCESS)) {
+      status = ANT_STATUS_SUCCESS;
+      goto out;
+   }
+
+   if (stRxThreadInfo.bThreadless && ant_rx_loop_in_handlers()) {
+      // Nothing reads flow control until the handlers return, so it is sent after they have.
+      status = ant_tx_queue_message(ucLen, pucMesg);
+      goto out;
+   }
+
+   ant_journal_tx_message(ucLen, pucMesg);
+
 #if ANT_HCI_OPCODE_SIZE == 1
    txBuffer[HCI_PACKET_TYPE_SIZE + ANT_HCI_OPCODE_OFFSET] = ANT_HCI_OPCODE_TX;
 #elif ANT_HCI_OPCODE_SIZE > 1
@@ -855,6 +1513,7 @@ static void ant_channel_init(ant_channel_info_t *pstChnlInfo, const char *pcChar
 
    // TODO Only 1 of these (not per-channel) is actually ever used:
    pstChnlInfo->fnRxCallback = NULL;
+   pstChnlInfo->fnRxSeqCallback = NULL;
    pstChnlInfo->ucFlowControlResp = ANT_FLOW_GO;
 #ifdef ANT_FLOW_RESEND
    pstChnlInfo->ucResendMessageLength = 0;
@@ -863,70 +1522,130 @@ static void ant_channel_init(ant_channel_info_t *pstChnlInfo, const char *pcChar
    // TODO Only used when Flow Control message received, so must only be Command path Rx thread
    pstChnlInfo->pstFlowControlCond = &stFlowControlCond;
    pstChnlInfo->pstFlowControlLock = &stFlowControlLock;
+   pstChnlInfo->ulRxWakeups = 0;
+   pstChnlInfo->ulRxSpuriousWakeups = 0;
+   pstChnlInfo->ulRxReads = 0;
+   pstChnlInfo->ulRxMessages = 0;
 
    ANT_FUNC_END();
 }
 
+// Loads libbt-vendor and initializes its interface, unless an earlier enable already did.
+static bt_vendor_interface_t *vendor_interface_get(void) {
+
+    unsigned char bdaddr[] = {0x01, 0x02, 0x03, 0x04, 0x05, 0x06};
+    ANT_U32 ulPhaseStartUs;
+
+    if (vendor_interface) {
+        return vendor_interface;
+    }
+
+    ulPhaseStartUs = ant_progress_now();
+    vendor_so_handle = dlopen("libbt-vendor.so", RTLD_NOW);
+    if (!vendor_so_handle)
+    {
+       ALOGE("Failed to load vendor component: %s", dlerror());
+       goto fail;
+    }
+
+    vendor_interface = (bt_vendor_interface_t *) dlsym(vendor_so_handle, "BLUETOOTH_VENDOR_LIB_INTERFACE");
+    if (!vendor_interface)
+    {
+        ALOGE("Failed to accesst bt vendor interface");
+        goto fail;
+    }
+
+    if (vendor_interface->init(&vendor_callbacks, bdaddr) != 0)
+    {
+        ALOGE("Failed to initialize bt vendor interface");
+        vendor_interface = NULL;
+        goto fail;
+    }
+
+    ant_progress_report(ANT_PROGRESS_VENDOR_LOAD, ANT_STATUS_SUCCESS, ulPhaseStartUs);
+    return vendor_interface;
+
+fail:
+    if (vendor_so_handle) {
+        dlclose(vendor_so_handle);
+        vendor_so_handle = NULL;
+    }
+    ant_progress_report(ANT_PROGRESS_VENDOR_LOAD, ANT_STATUS_FAILED, ulPhaseStartUs);
+    return NULL;
+}
+
+// Cleans up and unloads libbt-vendor, if an enable loaded it.
+static void vendor_interface_release(void) {
+
+    if (vendor_interface) {
+        vendor_interface->cleanup();
+        vendor_interface = NULL;
+    }
+    if (vendor_so_handle) {
+        dlclose(vendor_so_handle);
+        vendor_so_handle = NULL;
+    }
+}
+
 // This function is used as an alternative to opening the char device directly.
 // It is needed as libbt-vendor does the power up/down control for us when we open/close the file descriptor.
 int init_transport_bdroid(int on) {
 
-    void *so_handle;
-    unsigned char bdaddr[] = {0x01, 0x02, 0x03, 0x04, 0x05, 0x06};
     int  fd[CH_MAX], powerstate, ret;
+    ANT_U32 ulPhaseStartUs;
 
     if (on) {
-        so_handle = dlopen("libbt-vendor.so", RTLD_NOW);
-        if (!so_handle)
+        if (!vendor_interface_get())
         {
-           ALOGE("Failed to load vendor component");
            return -1;
         }
 
-        vendor_interface = (bt_vendor_interface_t *) dlsym(so_handle, "BLUETOOTH_VENDOR_LIB_INTERFACE");
-        if (!vendor_interface)
-        {
-            ALOGE("Failed to accesst bt vendor interface");
-            return -1;
-        }
-
-        vendor_interface->init(&vendor_callbacks, bdaddr);
-
+        ulPhaseStartUs = ant_progress_now();
         ALOGI("Turn On BT power");
         powerstate = BT_VND_PWR_ON;
         ret = vendor_interface->op(BT_VND_OP_POWER_CTRL, &powerstate);
         if (ret < 0)
         {
             ALOGE("Failed to turn on power from  bt vendor interface");
+            ant_progress_report(ANT_PROGRESS_POWER_ON, ANT_STATUS_FAILED, ulPhaseStartUs);
             return -1;
         }
+        ant_progress_report(ANT_PROGRESS_POWER_ON, ANT_STATUS_SUCCESS, ulPhaseStartUs);
+
+        ulPhaseStartUs = ant_progress_now();
         /*call ANT_USERIAL_OPEN to get ANT handle*/
         ret = vendor_interface->op(BT_VND_OP_ANT_USERIAL_OPEN, fd);
         ALOGE("ret value: %d", ret);
         if (ret != 1)
         {
             ALOGE("Failed to get fd from  bt vendor interface");
+            ant_progress_report(ANT_PROGRESS_OPEN, ANT_STATUS_FAILED, ulPhaseStartUs);
             return -1;
         } else {
             ALOGE("FD: %x", fd[0]);
+            ant_progress_report(ANT_PROGRESS_OPEN, ANT_STATUS_SUCCESS, ulPhaseStartUs);
             return fd[0];
         }
     } else {
+        ulPhaseStartUs = ant_progress_now();
         if (vendor_interface) {
-            ALOGE("Close and cleanup the interfaces");
+            ALOGE("Close the interfaces, leaving them loaded");
             int ret = vendor_interface->op(BT_VND_OP_ANT_USERIAL_CLOSE, NULL);
 
             ALOGE("ret value: %d", ret);
+            ant_progress_report(ANT_PROGRESS_CLOSE, ANT_STATUS_SUCCESS, ulPhaseStartUs);
+
+            ulPhaseStartUs = ant_progress_now();
             ALOGI("Turn off BT power");
             powerstate = BT_VND_PWR_OFF;
             ret = vendor_interface->op(BT_VND_OP_POWER_CTRL, &powerstate);
             if (ret < 0)
             {
                 ALOGE("Failed to turn off power from  bt vendor interface");
+                ant_progress_report(ANT_PROGRESS_POWER_OFF, ANT_STATUS_FAILED, ulPhaseStartUs);
                 return -1;
             }
-            vendor_interface->cleanup();
-            vendor_interface = NULL;
+            ant_progress_report(ANT_PROGRESS_POWER_OFF, ANT_STATUS_SUCCESS, ulPhaseStartUs);
             return 0;
         } else {
 
@@ -974,6 +1693,11 @@ static int ant_enable_channel(ant_channel_info_t *pstChnlInfo)
          ANT_ERROR("failed to open dev %s: %s", pstChnlInfo->pcDevicePath, strerror(errno));
          goto out;
       }
+      // Non-blocking so the rx thread can drain the path until it is empty
+      if (fcntl(pstChnlInfo->iFd, F_SETFL, fcntl(pstChnlInfo->iFd, F_GETFL) | O_NONBLOCK) < 0) {
+         ANT_ERROR("failed to make dev %s non-blocking: %s", pstChnlInfo->pcDevicePath, strerror(errno));
+         goto out;
+      }
    } else {
       ANT_DEBUG_D("%s is already enabled", pstChnlInfo->pcDevicePath);
    }
@@ -983,12 +1707,139 @@ out:
    return iRet;
 }
 
+////////////////////////////////////////////////////////////////////
+//  ant_write_message
+//
+//  Writes a whole message to a non-blocking transport path. With
+//  ANT_RX_IO_URING the message is queued to be written through the rx
+//  loop's io_uring when it runs one.
+//
+//  Parameters:
+//      eTxPath         the transport path to write to
+//      pucTxMessage    pointer to the message data
+//      ucMessageLength the length of the message
+//
+//  Returns:
+//      Success:
+//          number of bytes written or queued
+//      Failure:
+//          -1, with errno set
+//
+//  Psuedocode:
+/*
+        IF rx loop writes through io_uring
+            QUEUE message in rx loop's io_uring
+            RESULT = message length, or FAILED if it can't be queued
+        ENDIF
+        WHILE not all bytes written
+            WRITE remaining bytes
+            IF interrupted
+                RETRY
+            ELSE IF path is full
+                WAIT until path is writable, UNTIL Write Ready Timeout
+                IF error or timeout
+                    RESULT = FAILED
+                ENDIF
+            ELSE IF error
+                RESULT = FAILED
+            ENDIF
+        ENDWHILE
+*/
+////////////////////////////////////////////////////////////////////
+static int ant_write_message(ant_channel_type eTxPath, ANT_U8 *pucTxMessage, ANT_U8 ucMessageLength)
+{
+   int iFd = stRxThreadInfo.astChannels[eTxPath].iFd;
+   int iWritten = 0;
+   int iResult;
+   struct pollfd stPollFd;
+
+#ifdef ANT_RX_IO_URING
+   iResult = ant_rx_loop_write(eTxPath, pucTxMessage, ucMessageLength);
+   if ((iResult >= 0) || (errno != ENOSYS)) {
+      return iResult;
+   }
+#endif // ANT_RX_IO_URING
+
+   while (iWritten < ucMessageLength) {
+      iResult = write(iFd, pucTxMessage + iWritten, ucMessageLength - iWritten);
+      if (iResult >= 0) {
+         iWritten += iResult;
+      } else if (errno == EINTR) {
+         continue;
+      } else if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+         stPollFd.fd = iFd;
+         stPollFd.events = POLLOUT;
+         stPollFd.revents = 0;
+
+         iResult = poll(&stPollFd, 1, ANT_WRITE_READY_TIMEOUT_MS);
+         if (iResult == 0) {
+            errno = ETIMEDOUT;
+            return -1;
+         } else if ((iResult < 0) && (errno != EINTR)) {
+            return -1;
+         } else if ((iResult > 0) && (stPollFd.revents & (POLLERR | POLLHUP | POLLNVAL))) {
+            errno = EIO;
+            return -1;
+         }
+      } else {
+         return -1;
+      }
+   }
+
+   return iWritten;
+}
+
+// Total rx wakeups over all transport paths.
+static ANT_U32 ant_rx_wakeups(void)
+{
+   ant_channel_type eChannel;
+   ANT_U32 ulWakeups = 0;
+
+   for (eChannel = 0; eChannel < NUM_ANT_CHANNELS; eChannel++) {
+      ulWakeups += stRxThreadInfo.astChannels[eChannel].ulRxWakeups;
+   }
+
+   return ulWakeups;
+}
+
+// Enters or leaves standby. In standby the rx loop drops ANT messages and stops keepalives, and
+// stops itself when the standby timer expires after ulGraceMs. Leaving disarms the timer.
+static void ant_standby_set(ANT_BOOL bStandby, ANT_U32 ulGraceMs)
+{
+   ant_channel_type eChannel;
+   struct itimerspec stTimer;
+
+   for (eChannel = 0; eChannel < NUM_ANT_CHANNELS; eChannel++) {
+      __atomic_store_n(&stRxThreadInfo.astChannels[eChannel].bStandby, bStandby, __ATOMIC_RELEASE);
+   }
+   __atomic_store_n(&stRxThreadInfo.bStandby, bStandby, __ATOMIC_RELEASE);
+
+   memset(&stTimer, 0, sizeof(stTimer));
+   stTimer.it_value.tv_sec = ulGraceMs / 1000;
+   stTimer.it_value.tv_nsec = (ulGraceMs % 1000) * 1000000;
+   if (timerfd_settime(stRxThreadInfo.iStandbyTimerFd, 0, &stTimer, NULL) < 0) {
+      ANT_WARN("failed to set standby timer: %s", strerror(errno));
+   }
+
+   if (stRxThreadInfo.ucRunThread) {
+      // Expire the keepalive timer now, so the rx loop stops or restarts keepalives.
+      __atomic_store_n(&stRxThreadInfo.bKeepaliveChanged, ANT_TRUE, __ATOMIC_RELAXED);
+      memset(&stTimer, 0, sizeof(stTimer));
+      stTimer.it_value.tv_nsec = 1;
+      if (timerfd_settime(stRxThreadInfo.iKeepaliveTimerFd, 0, &stTimer, NULL) < 0) {
+         ANT_WARN("keepalive change deferred to next timeout: %s", strerror(errno));
+      }
+   }
+}
+
 //----------------------------------------------------------------------- This is antradio_power.h:
 
 int ant_enable(void)
 {
    int iRet = -1;
    ant_channel_type eChannel;
+   int iThreadResult;
+   ANT_U32 ulPhaseStartUs;
    ANT_FUNC_START();
 
    // Reset the shutdown signal.
@@ -1001,7 +1852,15 @@ int ant_enable(void)
       goto out;
    }
 
+   // Channel states are not known again until the chip is reset.
+   ant_cache_invalidate();
+
    stRxThreadInfo.ucRunThread = 1;
+   ant_radio_status_update();
+
+   // Restart the wakeup rate from this enable.
+   ulRxStatsStartWakeups = ant_rx_wakeups();
+   clock_gettime(CLOCK_MONOTONIC, &stRxStatsStartTime);
 
    for (eChannel = 0; eChannel < NUM_ANT_CHANNELS; eChannel++) {
       if (ant_enable_channel(&stRxThreadInfo.astChannels[eChannel]) < 0) {
@@ -1012,23 +1871,42 @@ int ant_enable(void)
       }
    }
 
-   if (stRxThreadInfo.stRxThread == 0) {
-      if (pthread_create(&stRxThreadInfo.stRxThread, NULL, fnRxThread, &stRxThreadInfo) < 0) {
-         ANT_ERROR("failed to start rx thread: %s", strerror(errno));
+   ulPhaseStartUs = ant_progress_now();
+   // Reported once the rx loop hears from the chip.
+   stRxThreadInfo.bLinkUpPending = ant_progress_wanted();
+
+   if (stRxThreadInfo.bThreadless) {
+      // The caller runs the rx loop with ant_process_events(), no threads are started.
+      if (ant_rx_loop_start(&stRxThreadInfo) < 0) {
+         ANT_ERROR("failed to start rx loop");
+         ant_progress_report(ANT_PROGRESS_THREAD_START, ANT_STATUS_FAILED, ulPhaseStartUs);
          goto out;
       }
    } else {
-      ANT_DEBUG_D("rx thread is already running");
+      if (stRxThreadInfo.stRxThread == 0) {
+         iThreadResult = ant_thread_create(&stRxThreadInfo.stRxThread, "rx", fnRxThread, &stRxThreadInfo);
+         if (iThreadResult) {
+            ANT_ERROR("failed to start rx thread: %s", strerror(iThreadResult));
+            stRxThreadInfo.stRxThread = 0;
+            ant_progress_report(ANT_PROGRESS_THREAD_START, ANT_STATUS_FAILED, ulPhaseStartUs);
+            goto out;
+         }
+      } else {
+         ANT_DEBUG_D("rx thread is already running");
+      }
    }
 
    if (!stRxThreadInfo.ucRunThread) {
       ANT_ERROR("rx thread crashed during init");
+      ant_progress_report(ANT_PROGRESS_THREAD_START, ANT_STATUS_FAILED, ulPhaseStartUs);
       goto out;
    }
+   ant_progress_report(ANT_PROGRESS_THREAD_START, ANT_STATUS_SUCCESS, ulPhaseStartUs);
 
    iRet = 0;
 
 out:
+   ant_radio_status_update();
    ANT_FUNC_END();
    return iRet;
 }
@@ -1037,9 +1915,15 @@ int ant_disable(void)
 {
    int iRet = -1;
    ant_channel_type eChannel;
+   ANT_U32 ulPhaseStartUs = ant_progress_now();
    ANT_FUNC_START();
 
    stRxThreadInfo.ucRunThread = 0;
+   stRxThreadInfo.bLinkUpPending = ANT_FALSE;
+   ant_radio_status_update();
+
+   // In threadless mode there is no thread to signal, the paths just stop being watched.
+   ant_rx_loop_stop(&stRxThreadInfo);
 
    if (stRxThreadInfo.stRxThread != 0) {
       ANT_DEBUG_I("Sending shutdown signal to rx thread.");
@@ -1056,7 +1940,9 @@ int ant_disable(void)
    } else {
       ANT_DEBUG_D("rx thread is not running");
    }
+   ant_progress_report(ANT_PROGRESS_THREAD_STOP, ANT_STATUS_SUCCESS, ulPhaseStartUs);
 
+   // Closing the path also powers off the chip, libbt-vendor reports both phases.
    for (eChannel = 0; eChannel < NUM_ANT_CHANNELS; eChannel++) {
       ant_disable_channel(&stRxThreadInfo.astChannels[eChannel]);
    }
@@ -1065,6 +1951,10 @@ int ant_disable(void)
 
 out:
    stRxThreadInfo.stRxThread = 0;
+   if (stRxThreadInfo.bStandby) {
+      ant_standby_set(ANT_FALSE, 0);
+   }
+   ant_radio_status_update();
    ANT_FUNC_END();
    return iRet;
 }
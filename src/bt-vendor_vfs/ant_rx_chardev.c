@@ -30,12 +30,28 @@
 #include <poll.h>
 #include <pthread.h>
 #include <stdint.h> /* for uint64_t */
+#ifdef ANT_RX_IO_URING
+#include <fcntl.h> /* for open() */
+#include <stdio.h> /* for snprintf() */
+#include <sys/eventfd.h> /* for eventfd() */
+#endif // ANT_RX_IO_URING
+#include <sys/timerfd.h> /* for timerfd_settime() */
+#include <time.h> /* for clock_gettime() */
 
 #include "ant_types.h"
 #include "antradio_power.h"
 #include "ant_rx_chardev.h"
 #include "ant_hci_defines.h"
 #include "ant_log.h"
+#include "ant_journal.h"
+#include "ant_reactor.h"
+#include "ant_radio_async.h"
+#include "ant_rx_pool.h"
+#include "ant_rx_queue.h"
+#include "ant_state_notify.h"
+#include "ant_thread.h"
+#include "ant_tx_queue.h"
+#include "ant_uring.h"
 #include "ant_native.h"  // ANT_HCI_MAX_MSG_SIZE, ANT_MSG_ID_OFFSET, ANT_MSG_DATA_OFFSET,
                          // ant_radio_enabled_status()
 
@@ -44,9 +60,6 @@ extern ANTStatus ant_tx_message_flowcontrol_none(ant_channel_type eTxPath, ANT_U
 #undef LOG_TAG
 #define LOG_TAG "antradio_rx"
 
-#define ANT_POLL_TIMEOUT         ((int)30000)
-#define KEEPALIVE_TIMEOUT        ((int)5000)
-
 static ANT_U8 aucRxBuffer[NUM_ANT_CHANNELS][ANT_HCI_MAX_MSG_SIZE];
 
 #ifdef ANT_DEVICE_NAME // Single transport path
@@ -61,16 +74,116 @@ static ANT_U8 aucRxBuffer[NUM_ANT_CHANNELS][ANT_HCI_MAX_MSG_SIZE];
 #define EVENT_HARD_RESET (POLLERR|POLLPRI|POLLRDHUP)
 
 #define EVENTS_TO_LISTEN_FOR (EVENT_DATA_AVAILABLE|EVENT_CHIP_SHUTDOWN|EVENT_HARD_RESET)
-
-// Plus one is for the eventfd shutdown signal.
-#define NUM_POLL_FDS (NUM_ANT_CHANNELS + 1)
-#define EVENTFD_IDX NUM_ANT_CHANNELS
+// The epoll event bits used by the rx thread have the same values as the poll ones above.
+
+#ifdef ANT_RX_IO_URING
+// Requests kept in the io_uring, a multishot read per transport path and the writes.
+#define RX_URING_ENTRIES 32
+// Buffers provided to the reads of each transport path, a power of two.
+#define RX_URING_BUFFERS 16
+// Messages that can wait to be written through the ring, at most 32 for the free mask.
+#define RX_URING_TX_SLOTS 16
+#define RX_URING_OP_READ 0
+#define RX_URING_OP_WRITE 1
+// Low byte is the channel of a read, the tx slot of a write.
+#define RX_URING_USER_DATA(op, index) ((((uint64_t)(op)) << 8) | (uint64_t)(index))
+#endif // ANT_RX_IO_URING
+
+/* Context of the rx thread's event handler for a transport path */
+typedef struct {
+   ant_rx_thread_info_t *pstRxThreadInfo;
+   ant_channel_type eChannel;
+#ifdef ANT_RX_COALESCE_US
+   /* Set while data available is not watched for, until the hold-off expires */
+   ANT_BOOL bHeld;
+#endif // ANT_RX_COALESCE_US
+} ant_rx_path_t;
+
+#ifdef ANT_RX_IO_URING
+/* A message written through the io_uring */
+typedef struct {
+   ANT_U8 aucData[ANT_HCI_MAX_MSG_SIZE];
+   ANT_U8 ucLen;
+   ant_channel_type eChannel;
+} ant_rx_uring_tx_t;
+
+/* The io_uring reading and writing the transport paths, run by one rx loop at a time */
+typedef struct {
+   ant_uring_t stRing;
+   /* Signalled by the ring when requests complete */
+   int iEventFd;
+   /* Reactor of the rx loop handling completions, NULL while stopped */
+   ant_reactor_t *pstReactor;
+   /* Blocking reopens of the transport paths, -1 if not open */
+   int aiFds[NUM_ANT_CHANNELS];
+   /* Buffers provided to the reads of each path, group id is the channel */
+   ant_uring_buffers_t astBuffers[NUM_ANT_CHANNELS];
+   /* Messages to write, and a bit set for each free one */
+   ant_rx_uring_tx_t astTx[RX_URING_TX_SLOTS];
+   ANT_U32 ulTxFree;
+   /* Slots of each path's messages in order, the first aucTxInFlight of them in the ring */
+   ANT_U8 aaucTxQueue[NUM_ANT_CHANNELS][RX_URING_TX_SLOTS];
+   ANT_U8 aucTxHead[NUM_ANT_CHANNELS];
+   ANT_U8 aucTxCount[NUM_ANT_CHANNELS];
+   ANT_U8 aucTxInFlight[NUM_ANT_CHANNELS];
+} ant_rx_uring_t;
+
+// Only taken over from a loop stopped for recovery, so it can live outside the loops.
+static ant_rx_uring_t stRxUring = { .stRing = { .iRingFd = -1 }, .iEventFd = -1 };
+static ANT_U8 aucUringBuffers[NUM_ANT_CHANNELS][RX_URING_BUFFERS][ANT_HCI_MAX_MSG_SIZE];
+// Guards which loop runs the ring, its submission queue and the messages to write.
+static pthread_mutex_t stUringLock = PTHREAD_MUTEX_INITIALIZER;
+// Written to the ring's eventfd to have the rx loop submit. Requests are cancelled when the thread
+// that submitted them exits, so only the loop does.
+static const uint64_t ullUringKick = 1;
+#endif // ANT_RX_IO_URING
+
+/* The event sources of an rx loop, run by the rx thread or in threadless mode */
+typedef struct {
+   ant_reactor_t stReactor;
+   ant_rx_path_t astPaths[NUM_ANT_CHANNELS];
+} ant_rx_loop_t;
+
+// The rx loop of threadless mode, open from ant_rx_loop_open() to ant_rx_loop_close().
+static ant_rx_loop_t stThreadlessLoop = { .stReactor = { .iEpollFd = -1 } };
+// Guards the owner of the threadless rx loop and whether it is running its handlers.
+static pthread_mutex_t stThreadlessLock = PTHREAD_MUTEX_INITIALIZER;
+// The thread that runs the threadless rx loop, the first to enable or run it after it was opened.
+// Other threads waiting for flow control or responses leave reading them to it.
+static pthread_t stThreadlessOwner;
+static ANT_BOOL bThreadlessOwned = ANT_FALSE;
+// Set while the owner runs the loop's handlers, which must not run it again.
+static ANT_BOOL bThreadlessDispatching = ANT_FALSE;
+
+/* A journal replay queued by a recovery */
+typedef struct {
+   ANT_U32 ulRecovery;          // ulRecoveries after the recovery
+   ANT_U32 ulStartMs;           // when the recovery started
+   ANT_U32 ulJournalRecovery;   // from ant_journal_cancel_replay()
+} ant_rx_replay_t;
+
+// Guards the replay thread and the replay queued for it.
+static pthread_mutex_t stReplayLock = PTHREAD_MUTEX_INITIALIZER;
+// Replays the journal after recoveries, so that neither the rx thread nor the threadless rx loop
+// that recovered waits for the responses. Runs while replays are queued, one at a time, and is
+// joined before the next one is started.
+static pthread_t stReplayThread;
+static ANT_BOOL bReplayThreadStarted = ANT_FALSE;
+static ANT_BOOL bReplayThreadRunning = ANT_FALSE;
+// Only the replay for the latest recovery is kept.
+static ANT_BOOL bReplayPending = ANT_FALSE;
+static ant_rx_replay_t stPendingReplay;
 
 static ANT_U8 KEEPALIVE_MESG[] = {0x01, 0x00, 0x00};
 static ANT_U8 KEEPALIVE_RESP[] = {0x03, 0x40, 0x00, 0x00, 0x28};
 
+// Stamped on every message delivered, so consumers can order messages by when they were read.
+static ANT_U32 ulRxSequence = 0;
+
 void doReset(ant_rx_thread_info_t *stRxThreadInfo);
+static void queueReplay(ant_rx_thread_info_t *stRxThreadInfo, const ant_rx_replay_t *pstReplay);
 int readChannelMsg(ant_channel_type eChannel, ant_channel_info_t *pstChnlInfo);
+static int handleChannelData(ant_channel_type eChannel, ant_channel_info_t *pstChnlInfo, int iRxLenRead);
 
 /*
  * Function to check that all given flags are set in a particular value.
@@ -89,124 +202,918 @@ ANT_BOOL areAllFlagsSet(short value, short flags)
    return (value == flags);
 }
 
+#ifdef ANT_RX_COALESCE_US
 /*
- * This thread is run occasionally as a detached thread in order to send a keepalive message to the
- * chip.
+ * Starts the one-shot coalescing hold-off timer.
+ *
+ * Parameters:
+ *    - iTimerFd: The coalescing timer file descriptor.
+ *
+ * Returns:
+ *    - 0 on success, -1 if the timer could not be started.
  */
-void *fnKeepAliveThread(void *unused)
+static int armCoalesceTimer(int iTimerFd)
 {
-   ANT_DEBUG_V("Sending dummy keepalive message.");
-   ant_tx_message(sizeof(KEEPALIVE_MESG)/sizeof(ANT_U8), KEEPALIVE_MESG);
-   return NULL;
+   struct itimerspec stHoldOff;
+
+   stHoldOff.it_interval.tv_sec = 0;
+   stHoldOff.it_interval.tv_nsec = 0;
+   stHoldOff.it_value.tv_sec = 0;
+   stHoldOff.it_value.tv_nsec = ANT_RX_COALESCE_US * 1000L;
+
+   return timerfd_settime(iTimerFd, 0, &stHoldOff, NULL);
 }
+#endif // ANT_RX_COALESCE_US
 
 /*
- * This thread waits for ANT messages from a VFS file.
+ * Gets the monotonic clock in ms. Only differences between values are meaningful.
  */
-void *fnRxThread(void *ant_rx_thread_info)
+static ANT_U32 getMonotonicMs(void)
 {
-   int iMutexLockResult;
-   int iPollRet;
-   ant_rx_thread_info_t *stRxThreadInfo;
-   struct pollfd astPollFd[NUM_POLL_FDS];
+   struct timespec stNow;
+
+   clock_gettime(CLOCK_MONOTONIC, &stNow);
+   return (ANT_U32)(stNow.tv_sec * 1000LL + stNow.tv_nsec / 1000000L);
+}
+
+/*
+ * Starts the one-shot keepalive timer.
+ *
+ * Parameters:
+ *    - iTimerFd: The keepalive timer file descriptor.
+ *    - ulMs: Time until the timer expires, 0 to stop the timer.
+ *
+ * Returns:
+ *    - 0 on success, -1 if the timer could not be started.
+ */
+static int armKeepaliveTimer(int iTimerFd, ANT_U32 ulMs)
+{
+   struct itimerspec stDeadline;
+
+   stDeadline.it_interval.tv_sec = 0;
+   stDeadline.it_interval.tv_nsec = 0;
+   stDeadline.it_value.tv_sec = ulMs / 1000;
+   stDeadline.it_value.tv_nsec = (ulMs % 1000) * 1000000L;
+
+   return timerfd_settime(iTimerFd, 0, &stDeadline, NULL);
+}
+
+/*
+ * Records that the chip is alive. Doesn't matter what data we received, flow control and command
+ * responses are as good as a keepalive response. Any rx thread may call this.
+ */
+static void noteRxActivity(ant_rx_thread_info_t *stRxThreadInfo)
+{
+   ANT_U32 ulNow = getMonotonicMs();
+   ANT_U32 ulRttMs;
+   ANT_U32 ulRttAvgMs;
+
+   if (__atomic_load_n(&stRxThreadInfo->bLinkUpPending, __ATOMIC_RELAXED) &&
+         __atomic_exchange_n(&stRxThreadInfo->bLinkUpPending, ANT_FALSE, __ATOMIC_ACQ_REL)) {
+      ant_progress_report(ANT_PROGRESS_LINK_UP, ANT_STATUS_SUCCESS, stRxThreadInfo->ulLinkUpStartUs);
+   }
+
+   __atomic_store_n(&stRxThreadInfo->ulLastRxMs, ulNow, __ATOMIC_RELAXED);
+   if (__atomic_exchange_n(&stRxThreadInfo->bWaitingForKeepaliveResponse, ANT_FALSE, __ATOMIC_ACQ_REL)) {
+      // First rx since the keepalive, this is how long the chip took to answer.
+      ulRttMs = ulNow - stRxThreadInfo->ulKeepaliveSentMs;
+      ulRttAvgMs = __atomic_load_n(&stRxThreadInfo->ulKeepaliveRttMs, __ATOMIC_RELAXED);
+      ulRttAvgMs = ulRttAvgMs ? (ulRttAvgMs * 3 + ulRttMs) / 4 : ulRttMs;
+      __atomic_store_n(&stRxThreadInfo->ulKeepaliveRttMs, ulRttAvgMs ? ulRttAvgMs : 1, __ATOMIC_RELAXED);
+   }
+}
+
+/*
+ * Gets how long to wait without rx before sending a keepalive.
+ *
+ * Parameters:
+ *    - stRxThreadInfo: The rx thread info.
+ *    - pulWaitMs: Set to how long to wait for rx after the keepalive.
+ *
+ * Returns:
+ *    - The idle time, 0 if keepalives are off.
+ */
+static ANT_U32 getKeepaliveIdleMs(ant_rx_thread_info_t *stRxThreadInfo, ANT_U32 *pulWaitMs)
+{
+   ANT_U32 ulIdleMs = __atomic_load_n(&stRxThreadInfo->ulKeepaliveIdleMs, __ATOMIC_ACQUIRE);
+   ANT_U32 ulResponseMs = __atomic_load_n(&stRxThreadInfo->ulKeepaliveResponseMs, __ATOMIC_RELAXED);
+   ANT_U32 ulRttMs = __atomic_load_n(&stRxThreadInfo->ulKeepaliveRttMs, __ATOMIC_RELAXED);
+   ANT_U32 ulWaitMs = ulResponseMs;
+
+   // Until the chip has answered once, wait as long as configured.
+   if ((ulRttMs != 0) && (ulRttMs < ulResponseMs / ANT_KEEPALIVE_RTT_FACTOR)) {
+      ulWaitMs = ulRttMs * ANT_KEEPALIVE_RTT_FACTOR;
+      if (ulWaitMs < ANT_KEEPALIVE_MIN_RESPONSE_MS) {
+         ulWaitMs = (ulResponseMs < ANT_KEEPALIVE_MIN_RESPONSE_MS) ? ulResponseMs : ANT_KEEPALIVE_MIN_RESPONSE_MS;
+      }
+   }
+
+   *pulWaitMs = ulWaitMs;
+   // Same time to find a dead chip, with fewer keepalives.
+   return (ulIdleMs != 0) ? ulIdleMs + (ulResponseMs - ulWaitMs) : 0;
+}
+
+/*
+ * Handles expiry of the keepalive timer. Sends a keepalive if there was no rx for the idle interval,
+ * and re-arms the timer for the next deadline. The rx thread isn't woken by rx to push the deadline
+ * out, so on expiry the deadline is recomputed from the time of the last rx, and a keepalive made
+ * unnecessary by that rx is counted as suppressed.
+ *
+ * Parameters:
+ *    - pstReactor: The rx thread's reactor.
+ *    - iFd: The keepalive timer file descriptor.
+ *    - ulEvents: The timer's epoll events.
+ *    - pvContext: The rx thread info.
+ *
+ * Returns:
+ *    - 0 normally, -1 if the chip did not answer a keepalive in time.
+ */
+static int handleKeepaliveTimer(ant_reactor_t *pstReactor, int iFd, ANT_U32 ulEvents, void *pvContext)
+{
+   ant_rx_thread_info_t *stRxThreadInfo = (ant_rx_thread_info_t *)pvContext;
+   uint64_t expirations;
+   ANT_U32 ulWaitMs;
+   ANT_U32 ulIdleMs = getKeepaliveIdleMs(stRxThreadInfo, &ulWaitMs);
+   ANT_BOOL bChanged = __atomic_exchange_n(&stRxThreadInfo->bKeepaliveChanged, ANT_FALSE, __ATOMIC_RELAXED);
+   ANT_U32 ulNow = getMonotonicMs();
+   ANT_U32 ulElapsed;
+   ANT_U32 ulNextMs;
+
+   (void)pstReactor;
+   (void)ulEvents;
+
+   // reset the timer by reading, don't care if it failed as it is one-shot.
+   read(iFd, &expirations, sizeof(expirations));
+
+   if ((ulIdleMs == 0) || __atomic_load_n(&stRxThreadInfo->bStandby, __ATOMIC_ACQUIRE)) {
+      // Keepalives are off, or the radio is in standby, anything pending is forgotten.
+      __atomic_store_n(&stRxThreadInfo->bWaitingForKeepaliveResponse, ANT_FALSE, __ATOMIC_RELAXED);
+      ulNextMs = 0;
+   } else if (__atomic_load_n(&stRxThreadInfo->bWaitingForKeepaliveResponse, __ATOMIC_RELAXED)) {
+      ulElapsed = ulNow - stRxThreadInfo->ulKeepaliveSentMs;
+      if (ulElapsed >= stRxThreadInfo->ulKeepaliveWaitMs) {
+         ANT_DEBUG_E("No response to keepalive, attempting recovery.");
+         return -1;
+      }
+      ulNextMs = stRxThreadInfo->ulKeepaliveWaitMs - ulElapsed;
+   } else {
+      ulElapsed = ulNow - __atomic_load_n(&stRxThreadInfo->ulLastRxMs, __ATOMIC_RELAXED);
+      if (ulElapsed >= ulIdleMs) {
+         ANT_DEBUG_V("Sending dummy keepalive message, waiting %u ms for rx.", ulWaitMs);
+         stRxThreadInfo->ulKeepaliveSentMs = ulNow;
+         stRxThreadInfo->ulKeepaliveWaitMs = ulWaitMs;
+         __atomic_store_n(&stRxThreadInfo->ulKeepaliveProbes, stRxThreadInfo->ulKeepaliveProbes + 1, __ATOMIC_RELAXED);
+         __atomic_store_n(&stRxThreadInfo->bWaitingForKeepaliveResponse, ANT_TRUE, __ATOMIC_RELEASE);
+         // Queued so that this thread can handle flow control during the message. Don't care if it
+         // failed as the consequence is just a missed keep-alive.
+         ant_tx_queue_message(sizeof(KEEPALIVE_MESG)/sizeof(ANT_U8), KEEPALIVE_MESG);
+         ulNextMs = ulWaitMs;
+      } else {
+         if (!bChanged && (ulElapsed < ulNow - stRxThreadInfo->ulKeepaliveArmedMs)) {
+            // Heard from the chip since the timer was started.
+            __atomic_store_n(&stRxThreadInfo->ulKeepaliveSuppressed, stRxThreadInfo->ulKeepaliveSuppressed + 1, __ATOMIC_RELAXED);
+         }
+         ulNextMs = ulIdleMs - ulElapsed;
+      }
+   }
+
+   stRxThreadInfo->ulKeepaliveArmedMs = ulNow;
+   if (armKeepaliveTimer(iFd, ulNextMs) < 0) {
+      ANT_WARN("failed to start keepalive timer: %s", strerror(errno));
+   }
+   return 0;
+}
+
+/*
+ * Handles expiry of the standby timer, stopping the rx loop so the transport is closed when it
+ * exits. If the enabled state is locked, the timer is restarted to try again shortly, unless
+ * the lock holder restarted it already.
+ *
+ * Parameters:
+ *    - pstReactor: The rx thread's reactor.
+ *    - iFd: The standby timer file descriptor.
+ *    - ulEvents: The timer's epoll events.
+ *    - pvContext: The rx thread info.
+ *
+ * Returns:
+ *    - 0
+ */
+static int handleStandbyTimer(ant_reactor_t *pstReactor, int iFd, ANT_U32 ulEvents, void *pvContext)
+{
+   ant_rx_thread_info_t *stRxThreadInfo = (ant_rx_thread_info_t *)pvContext;
+   uint64_t expirations;
+   struct itimerspec stTimer;
+
+   (void)pstReactor;
+   (void)ulEvents;
+
+   // reset the timer by reading, don't care if it failed as it is one-shot.
+   read(iFd, &expirations, sizeof(expirations));
+
+   if (pthread_mutex_trylock(stRxThreadInfo->pstEnabledStatusLock) == 0) {
+      if (stRxThreadInfo->bStandby) {
+         ANT_DEBUG_I("standby timed out, closing transport.");
+         stRxThreadInfo->ucRunThread = 0;
+      }
+      pthread_mutex_unlock(stRxThreadInfo->pstEnabledStatusLock);
+   } else if ((timerfd_gettime(iFd, &stTimer) == 0) && (stTimer.it_value.tv_sec == 0) &&
+         (stTimer.it_value.tv_nsec == 0)) {
+      // Whoever holds the lock may not leave standby, so check again shortly unless they
+      // already restarted the timer.
+      ANT_DEBUG_V("standby timed out while enabled state was locked, retrying");
+      if (armKeepaliveTimer(iFd, ANT_STANDBY_RETRY_MS) < 0) {
+         ANT_WARN("failed to restart standby timer: %s", strerror(errno));
+      }
+   }
+
+   return 0;
+}
+
+/*
+ * Handles events on a transport path.
+ *
+ * Parameters:
+ *    - pstReactor: The rx thread's reactor.
+ *    - iFd: The transport path file descriptor.
+ *    - ulEvents: The path's epoll events.
+ *    - pvContext: The ant_rx_path_t of the path.
+ *
+ * Returns:
+ *    - 0 normally, -1 if the chip needs to be recovered.
+ */
+static int handlePathEvents(ant_reactor_t *pstReactor, int iFd, ANT_U32 ulEvents, void *pvContext)
+{
+   ant_rx_path_t *pstPath = (ant_rx_path_t *)pvContext;
+   ant_rx_thread_info_t *stRxThreadInfo = pstPath->pstRxThreadInfo;
+   ant_channel_info_t *pstChnlInfo = &stRxThreadInfo->astChannels[pstPath->eChannel];
+
+   (void)pstReactor;
+   (void)iFd;
+
+   if (areAllFlagsSet(ulEvents, EVENT_HARD_RESET)) {
+      ANT_ERROR("Hard reset indicated by %s. Attempting recovery.", pstChnlInfo->pcDevicePath);
+      return -1;
+   } else if (areAllFlagsSet(ulEvents, EVENT_CHIP_SHUTDOWN)) {
+      /* chip reported it was unexpectedly disabled */
+      ANT_DEBUG_D("poll hang-up from %s. exiting rx thread", pstChnlInfo->pcDevicePath);
+      return -1;
+   } else if (areAllFlagsSet(ulEvents, EVENT_DATA_AVAILABLE)) {
+      ANT_DEBUG_D("data on %s. reading it", pstChnlInfo->pcDevicePath);
+
+      // Doesn't matter what data we received, we know the chip is alive.
+      noteRxActivity(stRxThreadInfo);
+
+#ifdef ANT_RX_COALESCE_US
+      // Stop listening for data on this path until the hold-off expires, so the
+      // tty can collect the rest of the burst. Read now if the timer can't be used.
+      if ((armCoalesceTimer(stRxThreadInfo->iRxCoalesceTimerFd) == 0) &&
+            (ant_reactor_modify(pstReactor, iFd, EVENTS_TO_LISTEN_FOR & ~EVENT_DATA_AVAILABLE) == 0)) {
+         pstPath->bHeld = ANT_TRUE;
+      } else {
+         ANT_WARN("failed to start rx hold-off timer: %s", strerror(errno));
+         if (readChannelMsg(pstPath->eChannel, pstChnlInfo) < 0) {
+            // set flag to exit out of Rx Loop
+            stRxThreadInfo->ucRunThread = 0;
+         }
+      }
+#else
+      if (readChannelMsg(pstPath->eChannel, pstChnlInfo) < 0) {
+         // set flag to exit out of Rx Loop
+         stRxThreadInfo->ucRunThread = 0;
+      }
+#endif // ANT_RX_COALESCE_US
+   } else if (areAllFlagsSet(ulEvents, POLLERR)) {
+      ANT_ERROR("Unknown error from %s. Attempting recovery.", pstChnlInfo->pcDevicePath);
+      return -1;
+   } else if (ulEvents) {
+      ANT_DEBUG_W("unhandled poll result %#x from %s", ulEvents, pstChnlInfo->pcDevicePath);
+   }
+
+   return 0;
+}
+
+#ifdef ANT_RX_COALESCE_US
+/*
+ * Handles expiry of the coalescing hold-off timer, reading everything collected on the held paths.
+ *
+ * Parameters:
+ *    - pstReactor: The rx thread's reactor.
+ *    - iFd: The coalescing timer file descriptor.
+ *    - ulEvents: The timer's epoll events.
+ *    - pvContext: The array of ant_rx_path_t, one per transport path.
+ *
+ * Returns:
+ *    - 0
+ */
+static int handleCoalesceTimer(ant_reactor_t *pstReactor, int iFd, ANT_U32 ulEvents, void *pvContext)
+{
+   ant_rx_path_t *astPaths = (ant_rx_path_t *)pvContext;
+   ant_rx_thread_info_t *stRxThreadInfo = astPaths[0].pstRxThreadInfo;
    ant_channel_type eChannel;
-   ANT_FUNC_START();
+   uint64_t expirations;
+   (void)ulEvents;
+
+   // reset the timer by reading, don't care if it failed as it is one-shot.
+   read(iFd, &expirations, sizeof(expirations));
+
+   for (eChannel = 0; eChannel < NUM_ANT_CHANNELS; eChannel++) {
+      if (astPaths[eChannel].bHeld) {
+         astPaths[eChannel].bHeld = ANT_FALSE;
+         ant_reactor_modify(pstReactor, stRxThreadInfo->astChannels[eChannel].iFd, EVENTS_TO_LISTEN_FOR);
+
+         if (readChannelMsg(eChannel, &stRxThreadInfo->astChannels[eChannel]) < 0) {
+            // set flag to exit out of Rx Loop
+            stRxThreadInfo->ucRunThread = 0;
+         }
+      }
+   }
+
+   return 0;
+}
+#endif // ANT_RX_COALESCE_US
+
+/*
+ * Handles the shutdown signal, stopping the rx thread.
+ *
+ * Returns:
+ *    - 0
+ */
+static int handleShutdownEvent(ant_reactor_t *pstReactor, int iFd, ANT_U32 ulEvents, void *pvContext)
+{
+   ant_rx_thread_info_t *stRxThreadInfo = (ant_rx_thread_info_t *)pvContext;
+   (void)pstReactor;
+   (void)iFd;
+
+   if (areAllFlagsSet(ulEvents, POLLIN)) {
+      ANT_DEBUG_I("rx thread caught shutdown signal.");
+      // reset the counter by reading.
+      uint64_t counter;
+      read(iFd, &counter, sizeof(counter));
+      // don't care if read error, going to close the thread anyways.
+   } else {
+      ANT_ERROR("Shutdown event descriptor had unexpected event: %#x. exiting rx thread.", ulEvents);
+   }
+   stRxThreadInfo->ucRunThread = 0;
+
+   return 0;
+}
+
+#ifdef ANT_RX_IO_URING
+/*
+ * Queues writes through the ring for the messages of a transport path waiting behind the ones
+ * already in it, linked so they are written in order. Sent by the rx loop's next submit.
+ * Called with stUringLock held.
+ */
+static int queuePathWrites(ant_channel_type eChannel)
+{
+   ant_rx_uring_tx_t *pstTx;
+   ANT_U8 ucSlot;
+
+   while (stRxUring.aucTxInFlight[eChannel] < stRxUring.aucTxCount[eChannel]) {
+      ucSlot = stRxUring.aaucTxQueue[eChannel][(stRxUring.aucTxHead[eChannel] + stRxUring.aucTxInFlight[eChannel]) %
+            RX_URING_TX_SLOTS];
+      pstTx = &stRxUring.astTx[ucSlot];
+
+      if (ant_uring_prep_write(&stRxUring.stRing, stRxUring.aiFds[eChannel], pstTx->aucData, pstTx->ucLen,
+            (stRxUring.aucTxInFlight[eChannel] + 1) < stRxUring.aucTxCount[eChannel],
+            RX_URING_USER_DATA(RX_URING_OP_WRITE, ucSlot)) < 0) {
+         return -1;
+      }
+      stRxUring.aucTxInFlight[eChannel]++;
+   }
+
+   return 0;
+}
+
+/*
+ * Handles a completed multishot read of a transport path, passing the data on as if it had been
+ * read into the path's rx buffer, and queues the read again if it stopped.
+ *
+ * Returns:
+ *    - 0 normally, -1 if the chip needs to be recovered.
+ */
+static int handleUringRead(ant_rx_thread_info_t *stRxThreadInfo, ant_channel_type eChannel,
+      const ant_uring_cqe_t *pstCqe)
+{
+   ant_channel_info_t *pstChnlInfo = &stRxThreadInfo->astChannels[eChannel];
+   ANT_U8 *pucData;
+   int iCopied = 0;
+   int iChunk;
+   int iRet = 0;
+
+   if (pstCqe->iResult > 0) {
+      pstChnlInfo->ulRxWakeups++;
+      pstChnlInfo->ulRxReads++;
+
+      // Doesn't matter what data we received, we know the chip is alive.
+      noteRxActivity(stRxThreadInfo);
+
+      // Handled in pieces that fit after a partial packet left in the rx buffer.
+      pucData = ant_uring_buffer(&stRxUring.astBuffers[eChannel], pstCqe->iBufferId);
+      while (stRxThreadInfo->ucRunThread && (iCopied < pstCqe->iResult)) {
+         iChunk = sizeof(aucRxBuffer[eChannel]) - iRxBufferLength[eChannel];
+         if (iChunk > (pstCqe->iResult - iCopied)) {
+            iChunk = pstCqe->iResult - iCopied;
+         }
+         memcpy(&aucRxBuffer[eChannel][iRxBufferLength[eChannel]], pucData + iCopied, iChunk);
+         iCopied += iChunk;
+
+         if ((iChunk == 0) || (handleChannelData(eChannel, pstChnlInfo, iChunk) < 0)) {
+            // set flag to exit out of Rx Loop
+            stRxThreadInfo->ucRunThread = 0;
+         }
+      }
+      ant_uring_recycle_buffer(&stRxUring.astBuffers[eChannel], pstCqe->iBufferId);
+   } else if (pstCqe->iResult == 0) {
+      ANT_ERROR("%s: end of file. Attempting recovery.", pstChnlInfo->pcDevicePath);
+      iRet = -1;
+   } else if ((pstCqe->iResult != -ENOBUFS) && (pstCqe->iResult != -EINTR)) {
+      ANT_ERROR("%s: read failed: %s", pstChnlInfo->pcDevicePath, strerror(-pstCqe->iResult));
+      // set flag to exit out of Rx Loop
+      stRxThreadInfo->ucRunThread = 0;
+   }
+
+   // Running out of buffers or being interrupted stops the read, the data waits in the driver
+   // until it is queued again.
+   if ((iRet == 0) && stRxThreadInfo->ucRunThread && !pstCqe->bMore) {
+      pthread_mutex_lock(&stUringLock);
+      iRet = ant_uring_prep_read_multishot(&stRxUring.stRing, stRxUring.aiFds[eChannel], eChannel,
+            RX_URING_USER_DATA(RX_URING_OP_READ, eChannel));
+      pthread_mutex_unlock(&stUringLock);
+   }
+
+   return iRet;
+}
+
+/*
+ * Handles a completed write through the ring, freeing its slot and queuing the writes of the
+ * transport path that were waiting for it. A write that didn't happen is kept to be queued again.
+ *
+ * Returns:
+ *    - 0 normally, -1 if the chip needs to be recovered.
+ */
+static int handleUringWrite(ant_rx_thread_info_t *stRxThreadInfo, ANT_U8 ucSlot, const ant_uring_cqe_t *pstCqe)
+{
+   ant_rx_uring_tx_t *pstTx = &stRxUring.astTx[ucSlot];
+   ant_channel_type eChannel = pstTx->eChannel;
+   ANT_BOOL bRetry = ANT_FALSE;
+   int iRet = 0;
+
+   if ((pstCqe->iResult == -EINTR) || (pstCqe->iResult == -EAGAIN) || (pstCqe->iResult == -ECANCELED)) {
+      // The tty checks for signals before writing anything, and io_uring uses one to run its
+      // completions on this thread. A write cancelled as it was linked behind it goes again too.
+      ANT_DEBUG_V("%s: write not done: %s, retrying", stRxThreadInfo->astChannels[eChannel].pcDevicePath,
+            strerror(-pstCqe->iResult));
+      bRetry = ANT_TRUE;
+   } else if (pstCqe->iResult < 0) {
+      ANT_ERROR("%s: write failed: %s. Attempting recovery.", stRxThreadInfo->astChannels[eChannel].pcDevicePath,
+            strerror(-pstCqe->iResult));
+      iRet = -1;
+   } else if (pstCqe->iResult != pstTx->ucLen) {
+      ANT_ERROR("%s: wrote %d of %u bytes. Attempting recovery.", stRxThreadInfo->astChannels[eChannel].pcDevicePath,
+            pstCqe->iResult, pstTx->ucLen);
+      iRet = -1;
+   }
+
+   pthread_mutex_lock(&stUringLock);
+   stRxUring.aucTxInFlight[eChannel]--;
+   if (!bRetry) {
+      // Linked writes complete in order and stop at the first one not done, this is the first
+      // of the path's queue.
+      stRxUring.aucTxHead[eChannel] = (stRxUring.aucTxHead[eChannel] + 1) % RX_URING_TX_SLOTS;
+      stRxUring.aucTxCount[eChannel]--;
+      stRxUring.ulTxFree |= 1U << ucSlot;
+   }
+   // Queues again from the first write not done.
+   if ((iRet == 0) && (stRxUring.aucTxInFlight[eChannel] == 0)) {
+      iRet = queuePathWrites(eChannel);
+   }
+   pthread_mutex_unlock(&stUringLock);
+
+   return iRet;
+}
+
+/*
+ * Handles completed io_uring reads and writes, then submits the reads that stopped and the writes
+ * queued since the last submit, by any thread, with one system call.
+ *
+ * Parameters:
+ *    - pstReactor: The rx thread's reactor.
+ *    - iFd: The eventfd signalled by the ring.
+ *    - ulEvents: The eventfd's epoll events.
+ *    - pvContext: The transport paths, indexed by channel.
+ *
+ * Returns:
+ *    - 0 normally, -1 if the chip needs to be recovered.
+ */
+static int handleUringCompletions(ant_reactor_t *pstReactor, int iFd, ANT_U32 ulEvents, void *pvContext)
+{
+   ant_rx_path_t *astPaths = (ant_rx_path_t *)pvContext;
+   ant_rx_thread_info_t *stRxThreadInfo = astPaths[0].pstRxThreadInfo;
+   ant_uring_cqe_t stCqe;
+   uint64_t counter;
+   int iRet = 0;
+   ANT_BOOL bReadData = ANT_FALSE;
+   (void)pstReactor;
+   (void)ulEvents;
+
+   // reset the counter by reading, completions are found in the ring anyways.
+   read(iFd, &counter, sizeof(counter));
+
+   // Only this loop takes completions, and the ring stays until it stops it.
+   while ((iRet == 0) && stRxThreadInfo->ucRunThread && (ant_uring_reap(&stRxUring.stRing, &stCqe) > 0)) {
+      if ((stCqe.ullUserData >> 8) == RX_URING_OP_WRITE) {
+         iRet = handleUringWrite(stRxThreadInfo, (ANT_U8)(stCqe.ullUserData & 0xFF), &stCqe);
+      } else {
+         bReadData |= (stCqe.iResult > 0);
+         iRet = handleUringRead(stRxThreadInfo, (ant_channel_type)(stCqe.ullUserData & 0xFF), &stCqe);
+      }
+   }
+
+   if (bReadData) {
+      ant_rx_pool_batch_end();
+   }
+
+   if (iRet == 0) {
+      pthread_mutex_lock(&stUringLock);
+      if (ant_uring_submit(&stRxUring.stRing) < 0) {
+         ANT_ERROR("Could not queue reads and writes: %s. Attempting recovery.", strerror(errno));
+         iRet = -1;
+      }
+      pthread_mutex_unlock(&stUringLock);
+   }
+
+   return iRet;
+}
+
+/*
+ * Stops reading and writing the transport paths with io_uring, if the ring is run by the loop of
+ * the given reactor. Messages not written yet are dropped.
+ */
+static void stopUring(ant_reactor_t *pstReactor)
+{
+   ant_channel_type eChannel;
+
+   pthread_mutex_lock(&stUringLock);
+   if ((pstReactor != NULL) && (stRxUring.pstReactor == pstReactor)) {
+      stRxUring.pstReactor = NULL;
+
+      if (stRxUring.iEventFd >= 0) {
+         ant_reactor_remove(pstReactor, stRxUring.iEventFd);
+         close(stRxUring.iEventFd);
+         stRxUring.iEventFd = -1;
+      }
+      // Cancels the outstanding reads and writes.
+      ant_uring_close(&stRxUring.stRing);
+
+      for (eChannel = 0; eChannel < NUM_ANT_CHANNELS; eChannel++) {
+         ant_uring_free_buffers(&stRxUring.astBuffers[eChannel]);
+         if (stRxUring.aiFds[eChannel] >= 0) {
+            close(stRxUring.aiFds[eChannel]);
+            stRxUring.aiFds[eChannel] = -1;
+         }
+      }
+   }
+   pthread_mutex_unlock(&stUringLock);
+}
+
+/*
+ * Starts reading and writing the transport paths with io_uring, if the kernel supports it. Takes
+ * the ring over from a loop that stopped for recovery and hasn't closed yet.
+ *
+ * Parameters:
+ *    - pstReactor: The rx loop's reactor, to handle completions on.
+ *    - astPaths: The transport paths, indexed by channel.
+ *
+ * Returns:
+ *    - 0 on success, -1 if the paths must be read on readiness instead.
+ */
+static int startUring(ant_reactor_t *pstReactor, ant_rx_path_t *astPaths)
+{
+   ant_rx_thread_info_t *stRxThreadInfo = astPaths[0].pstRxThreadInfo;
+   ant_channel_info_t *pstChnlInfo;
+   ant_channel_type eChannel;
+   char acFdPath[32];
+
+   // A loop stopped for recovery may not have closed yet, its ring would keep reading the paths.
+   stopUring(__atomic_load_n(&stRxUring.pstReactor, __ATOMIC_ACQUIRE));
+
+   if (ant_uring_init(&stRxUring.stRing, RX_URING_ENTRIES) < 0) {
+      ANT_DEBUG_I("io_uring not available (%s), reading paths on readiness.", strerror(errno));
+      return -1;
+   }
+
+   pthread_mutex_lock(&stUringLock);
+   stRxUring.pstReactor = pstReactor;
+   stRxUring.iEventFd = -1;
+   for (eChannel = 0; eChannel < NUM_ANT_CHANNELS; eChannel++) {
+      stRxUring.aiFds[eChannel] = -1;
+      stRxUring.aucTxHead[eChannel] = 0;
+      stRxUring.aucTxCount[eChannel] = 0;
+      stRxUring.aucTxInFlight[eChannel] = 0;
+   }
+   stRxUring.ulTxFree = (1U << RX_URING_TX_SLOTS) - 1;
+   pthread_mutex_unlock(&stUringLock);
+
+   stRxUring.iEventFd = eventfd(0, EFD_NONBLOCK);
+   if ((stRxUring.iEventFd < 0) ||
+         (ant_uring_register_eventfd(&stRxUring.stRing, stRxUring.iEventFd) < 0)) {
+      ANT_WARN("io_uring completions can't be signalled (%s), reading paths on readiness.", strerror(errno));
+      goto failed;
+   }
+
+   for (eChannel = 0; eChannel < NUM_ANT_CHANNELS; eChannel++) {
+      pstChnlInfo = &stRxThreadInfo->astChannels[eChannel];
+      if (pstChnlInfo->iFd < 0) {
+         continue;
+      }
+
+      // The paths are non-blocking, the ring's reads and writes need a blocking file to wait on.
+      snprintf(acFdPath, sizeof(acFdPath), "/proc/self/fd/%d", pstChnlInfo->iFd);
+      stRxUring.aiFds[eChannel] = open(acFdPath, O_RDWR | O_CLOEXEC);
+      if (stRxUring.aiFds[eChannel] < 0) {
+         ANT_WARN("%s can't be reopened blocking (%s), reading paths on readiness.",
+               pstChnlInfo->pcDevicePath, strerror(errno));
+         goto failed;
+      }
+
+      if ((ant_uring_provide_buffers(&stRxUring.stRing, &stRxUring.astBuffers[eChannel], eChannel,
+            aucUringBuffers[eChannel][0], RX_URING_BUFFERS, ANT_HCI_MAX_MSG_SIZE) < 0) ||
+            (ant_uring_prep_read_multishot(&stRxUring.stRing, stRxUring.aiFds[eChannel], eChannel,
+            RX_URING_USER_DATA(RX_URING_OP_READ, eChannel)) < 0)) {
+         ANT_WARN("io_uring reads can't be queued (%s), reading paths on readiness.", strerror(errno));
+         goto failed;
+      }
+   }
+
+   // Submitted by the loop, which may not run on this thread.
+   if ((ant_reactor_add(pstReactor, stRxUring.iEventFd, EPOLLIN, handleUringCompletions, astPaths) < 0) ||
+         (write(stRxUring.iEventFd, &ullUringKick, sizeof(ullUringKick)) < 0)) {
+      goto failed;
+   }
+
+   ANT_DEBUG_I("reading and writing paths with io_uring.");
+   return 0;
+
+failed:
+   stopUring(pstReactor);
+   return -1;
+}
+
+////////////////////////////////////////////////////////////////////
+//  ant_rx_loop_write
+//
+//  Queues a message to be written to a transport path through the rx
+//  loop's io_uring, behind the path's messages not written yet. The loop is
+//  woken to submit it, together with its reads and the other writes queued
+//  meanwhile.
+//
+//  Parameters:
+//      eChannel      the transport path to write to
+//      pucData       the message, copied before returning
+//      ucLen         the length of the message
+//
+//  Returns:
+//      Success:
+//          ucLen
+//      Failure:
+//          -1, with errno ENOSYS if the paths aren't written through
+//          io_uring, EBUSY if too many messages are waiting to be written
+//
+//  Psuedocode:
+/*
+LOCK ring
+    IF ring not running
+        RESULT = FAILED, not supported
+    ELSE IF no free slot
+        RESULT = FAILED, busy
+    ELSE
+        COPY message to free slot
+        ADD slot to path's queue
+        IF none of path's messages in ring
+            QUEUE writes of path's queue, linked in order
+            WAKE rx loop to submit them
+        ENDIF
+        RESULT = message length
+    ENDIF
+UNLOCK ring
+*/
+////////////////////////////////////////////////////////////////////
+int ant_rx_loop_write(ant_channel_type eChannel, ANT_U8 *pucData, ANT_U8 ucLen)
+{
+   ant_rx_uring_tx_t *pstTx;
+   ANT_U8 ucSlot;
+   int iRet = -1;
+
+   pthread_mutex_lock(&stUringLock);
+
+   if ((stRxUring.pstReactor == NULL) || (stRxUring.aiFds[eChannel] < 0)) {
+      errno = ENOSYS;
+      goto out;
+   }
+   if (stRxUring.ulTxFree == 0) {
+      errno = EBUSY;
+      goto out;
+   }
+
+   ucSlot = (ANT_U8)__builtin_ctz(stRxUring.ulTxFree);
+   stRxUring.ulTxFree &= ~(1U << ucSlot);
+   pstTx = &stRxUring.astTx[ucSlot];
+   memcpy(pstTx->aucData, pucData, ucLen);
+   pstTx->ucLen = ucLen;
+   pstTx->eChannel = eChannel;
+   stRxUring.aaucTxQueue[eChannel][(stRxUring.aucTxHead[eChannel] + stRxUring.aucTxCount[eChannel]) %
+         RX_URING_TX_SLOTS] = ucSlot;
+   stRxUring.aucTxCount[eChannel]++;
+
+   // Otherwise queued by the rx loop when the path's writes in the ring complete.
+   if (stRxUring.aucTxInFlight[eChannel] == 0) {
+      if (queuePathWrites(eChannel) < 0) {
+         // Nothing else of the path is queued, so this is the last.
+         stRxUring.aucTxCount[eChannel]--;
+         stRxUring.ulTxFree |= 1U << ucSlot;
+         goto out;
+      }
+      if (write(stRxUring.iEventFd, &ullUringKick, sizeof(ullUringKick)) < 0) {
+         // Left in the ring for the rx loop's next submit.
+         ANT_WARN("failed to wake rx loop for write: %s", strerror(errno));
+      }
+   }
+   iRet = ucLen;
+
+out:
+   pthread_mutex_unlock(&stUringLock);
+   return iRet;
+}
+#endif // ANT_RX_IO_URING
+
+/*
+ * Handles messages queued for the rx loop, like responses answered from the cache, delivering them
+ * as if they had been read from the transport.
+ *
+ * Returns:
+ *    - 0
+ */
+static int handleRxQueue(ant_reactor_t *pstReactor, int iFd, ANT_U32 ulEvents, void *pvContext)
+{
+   ant_rx_thread_info_t *stRxThreadInfo = (ant_rx_thread_info_t *)pvContext;
+   ANT_U8 aucMesg[ANT_NATIVE_MAX_MESSAGE_SIZE];
+   ANT_U8 ucLen;
+   ANT_BOOL bDelivered = ANT_FALSE;
+   (void)pstReactor;
+   (void)iFd;
+   (void)ulEvents;
+
+   ant_rx_queue_ack();
+   while ((ucLen = ant_rx_queue_get(aucMesg)) != 0) {
+      ant_rx_deliver_message(&stRxThreadInfo->astChannels[SINGLE_CHANNEL], ucLen, aucMesg);
+      bDelivered = ANT_TRUE;
+   }
+
+   if (bDelivered) {
+      ant_rx_pool_batch_end();
+   }
+
+   return 0;
+}
+
+/*
+ * Opens an rx loop with no event sources.
+ *
+ * Returns:
+ *    - 0 on success, -1 if the loop's reactor could not be created.
+ */
+static int openRxLoop(ant_rx_loop_t *pstLoop)
+{
+   return ant_reactor_init(&pstLoop->stReactor);
+}
+
+/*
+ * Starts an rx loop watching the transport paths, the keepalive timer, the rx queue and, if there
+ * is a thread to stop, the shutdown signal. Every event source registers its handler, the loops running the
+ * reactor don't know about any of them.
+ *
+ * Returns:
+ *    - 0 on success, -1 if not all event sources could be watched.
+ */
+static int watchRxSources(ant_rx_loop_t *pstLoop, ant_rx_thread_info_t *stRxThreadInfo)
+{
+   int iAddFailed = 0;
+   ant_channel_type eChannel;
+   ANT_U32 ulPathEvents = EVENTS_TO_LISTEN_FOR;
+   ANT_U32 ulWaitMs;
+   ANT_U32 ulIdleMs = getKeepaliveIdleMs(stRxThreadInfo, &ulWaitMs);
+
+   // Reset the waiting for response, since we don't want a stale value if we were reset.
+   stRxThreadInfo->bWaitingForKeepaliveResponse = ANT_FALSE;
+   stRxThreadInfo->ulLastRxMs = getMonotonicMs();
+   stRxThreadInfo->ulKeepaliveArmedMs = stRxThreadInfo->ulLastRxMs;
+   if (stRxThreadInfo->bLinkUpPending) {
+      stRxThreadInfo->ulLinkUpStartUs = ant_progress_now();
+      if (ulIdleMs != 0) {
+         // Check the link right away, as if the chip had been idle for long enough.
+         stRxThreadInfo->ulLastRxMs -= ulIdleMs;
+         ulIdleMs = 1;
+      }
+   }
+   if (armKeepaliveTimer(stRxThreadInfo->iKeepaliveTimerFd, ulIdleMs) < 0) {
+      ANT_WARN("failed to start keepalive timer: %s", strerror(errno));
+   }
 
-   stRxThreadInfo = (ant_rx_thread_info_t *)ant_rx_thread_info;
    for (eChannel = 0; eChannel < NUM_ANT_CHANNELS; eChannel++) {
-      astPollFd[eChannel].fd = stRxThreadInfo->astChannels[eChannel].iFd;
-      astPollFd[eChannel].events = EVENTS_TO_LISTEN_FOR;
+      pstLoop->astPaths[eChannel].pstRxThreadInfo = stRxThreadInfo;
+      pstLoop->astPaths[eChannel].eChannel = eChannel;
+#ifdef ANT_RX_COALESCE_US
+      pstLoop->astPaths[eChannel].bHeld = ANT_FALSE;
+#endif // ANT_RX_COALESCE_US
    }
-   // Fill out poll request for the shutdown signaller.
-   astPollFd[EVENTFD_IDX].fd = stRxThreadInfo->iRxShutdownEventFd;
-   astPollFd[EVENTFD_IDX].events = POLL_IN;
 
-   // Reset the waiting for response, since we don't want a stale value if we were reset.
-   stRxThreadInfo->bWaitingForKeepaliveResponse = ANT_FALSE;
+#ifdef ANT_RX_IO_URING
+   // Reads are kept outstanding in the ring, only watch the paths for hang-ups and resets.
+   if (startUring(&pstLoop->stReactor, pstLoop->astPaths) == 0) {
+      ulPathEvents &= ~EVENT_DATA_AVAILABLE;
+   }
+#endif // ANT_RX_IO_URING
+
+   for (eChannel = 0; eChannel < NUM_ANT_CHANNELS; eChannel++) {
+      iAddFailed |= ant_reactor_add(&pstLoop->stReactor, stRxThreadInfo->astChannels[eChannel].iFd,
+            ulPathEvents, handlePathEvents, &pstLoop->astPaths[eChannel]);
+   }
+#ifdef ANT_RX_COALESCE_US
+   // The timer handlers always read the timer, so they can be edge triggered.
+   iAddFailed |= ant_reactor_add(&pstLoop->stReactor, stRxThreadInfo->iRxCoalesceTimerFd,
+         EPOLLIN | EPOLLET, handleCoalesceTimer, pstLoop->astPaths);
+#endif // ANT_RX_COALESCE_US
+   iAddFailed |= ant_reactor_add(&pstLoop->stReactor, stRxThreadInfo->iKeepaliveTimerFd,
+         EPOLLIN | EPOLLET, handleKeepaliveTimer, stRxThreadInfo);
+   iAddFailed |= ant_reactor_add(&pstLoop->stReactor, stRxThreadInfo->iStandbyTimerFd,
+         EPOLLIN | EPOLLET, handleStandbyTimer, stRxThreadInfo);
+   // Anything still queued was meant for a loop that has stopped.
+   ant_rx_queue_clear();
+   iAddFailed |= ant_reactor_add(&pstLoop->stReactor, ant_rx_queue_fd(),
+         EPOLLIN, handleRxQueue, stRxThreadInfo);
+   if (!stRxThreadInfo->bThreadless) {
+      iAddFailed |= ant_reactor_add(&pstLoop->stReactor, stRxThreadInfo->iRxShutdownEventFd,
+            EPOLLIN, handleShutdownEvent, stRxThreadInfo);
+   }
+
+   return iAddFailed ? -1 : 0;
+}
+
+/*
+ * Stops an rx loop watching the event sources added by watchRxSources(). Sources that were not
+ * added are skipped.
+ */
+static void unwatchRxSources(ant_rx_loop_t *pstLoop, ant_rx_thread_info_t *stRxThreadInfo)
+{
+   ant_channel_type eChannel;
+
+   for (eChannel = 0; eChannel < NUM_ANT_CHANNELS; eChannel++) {
+      ant_reactor_remove(&pstLoop->stReactor, stRxThreadInfo->astChannels[eChannel].iFd);
+   }
+#ifdef ANT_RX_COALESCE_US
+   ant_reactor_remove(&pstLoop->stReactor, stRxThreadInfo->iRxCoalesceTimerFd);
+#endif // ANT_RX_COALESCE_US
+   ant_reactor_remove(&pstLoop->stReactor, stRxThreadInfo->iKeepaliveTimerFd);
+   ant_reactor_remove(&pstLoop->stReactor, stRxThreadInfo->iStandbyTimerFd);
+   ant_reactor_remove(&pstLoop->stReactor, ant_rx_queue_fd());
+   ant_reactor_remove(&pstLoop->stReactor, stRxThreadInfo->iRxShutdownEventFd);
+#ifdef ANT_RX_IO_URING
+   stopUring(&pstLoop->stReactor);
+#endif // ANT_RX_IO_URING
+}
+
+/*
+ * Closes an rx loop, and with it anything it still watches.
+ */
+static void closeRxLoop(ant_rx_loop_t *pstLoop)
+{
+#ifdef ANT_RX_IO_URING
+   stopUring(&pstLoop->stReactor);
+#endif // ANT_RX_IO_URING
+   ant_reactor_close(&pstLoop->stReactor);
+}
+
+/*
+ * Cleans up after an rx loop stopped without being told to, disabling the radio unless an enable
+ * or disable is already in progress. At the end of standby the radio is already reported disabled,
+ * only the transport is closed.
+ */
+static void cleanupStoppedRx(ant_rx_thread_info_t *stRxThreadInfo)
+{
+   int iMutexLockResult;
 
-   /* continue running as long as not terminated */
-   while (stRxThreadInfo->ucRunThread) {
-      /* Wait for data available on any file (transport path), shorter wait if we just timed out. */
-      int timeout = stRxThreadInfo->bWaitingForKeepaliveResponse ? KEEPALIVE_TIMEOUT : ANT_POLL_TIMEOUT;
-      iPollRet = poll(astPollFd, NUM_POLL_FDS, timeout);
-      if (!iPollRet) {
-         if(!stRxThreadInfo->bWaitingForKeepaliveResponse)
-         {
-            stRxThreadInfo->bWaitingForKeepaliveResponse = ANT_TRUE;
-            // Keep alive is done on a separate thread so that rxThread can handle flow control during
-            // the message.
-            pthread_t thread;
-            // Don't care if it failed as the consequence is just a missed keep-alive.
-            pthread_create(&thread, NULL, fnKeepAliveThread, NULL);
-            // Detach the thread so that we don't need to join it later.
-            pthread_detach(thread);
-            ANT_DEBUG_V("poll timed out, checking exit cond");
-         } else
-         {
-            ANT_DEBUG_E("No response to keepalive, attempting recovery.");
-            doReset(stRxThreadInfo);
-            goto out;
-         }
-      } else if (iPollRet < 0) {
-         ANT_ERROR("unhandled error: %s, attempting recovery.", strerror(errno));
-         doReset(stRxThreadInfo);
-         goto out;
-      } else {
-         for (eChannel = 0; eChannel < NUM_ANT_CHANNELS; eChannel++) {
-            if (areAllFlagsSet(astPollFd[eChannel].revents, EVENT_HARD_RESET)) {
-               ANT_ERROR("Hard reset indicated by %s. Attempting recovery.",
-                            stRxThreadInfo->astChannels[eChannel].pcDevicePath);
-               doReset(stRxThreadInfo);
-               goto out;
-            } else if (areAllFlagsSet(astPollFd[eChannel].revents, EVENT_CHIP_SHUTDOWN)) {
-               /* chip reported it was unexpectedly disabled */
-               ANT_DEBUG_D(
-                     "poll hang-up from %s. exiting rx thread", stRxThreadInfo->astChannels[eChannel].pcDevicePath);
+   ant_radio_status_update();
 
-               doReset(stRxThreadInfo);
-               goto out;
-            } else if (areAllFlagsSet(astPollFd[eChannel].revents, EVENT_DATA_AVAILABLE)) {
-               ANT_DEBUG_D("data on %s. reading it",
-                            stRxThreadInfo->astChannels[eChannel].pcDevicePath);
-
-               // Doesn't matter what data we received, we know the chip is alive.
-               stRxThreadInfo->bWaitingForKeepaliveResponse = ANT_FALSE;
-
-               if (readChannelMsg(eChannel, &stRxThreadInfo->astChannels[eChannel]) < 0) {
-                  // set flag to exit out of Rx Loop
-                  stRxThreadInfo->ucRunThread = 0;
-               }
-            } else if (areAllFlagsSet(astPollFd[eChannel].revents, POLLNVAL)) {
-               ANT_ERROR("poll was called on invalid file descriptor %s. Attempting recovery.",
-                     stRxThreadInfo->astChannels[eChannel].pcDevicePath);
-               doReset(stRxThreadInfo);
-               goto out;
-            } else if (areAllFlagsSet(astPollFd[eChannel].revents, POLLERR)) {
-               ANT_ERROR("Unknown error from %s. Attempting recovery.",
-                     stRxThreadInfo->astChannels[eChannel].pcDevicePath);
-               doReset(stRxThreadInfo);
-               goto out;
-            } else if (astPollFd[eChannel].revents) {
-               ANT_DEBUG_W("unhandled poll result %#x from %s",
-                            astPollFd[eChannel].revents,
-                            stRxThreadInfo->astChannels[eChannel].pcDevicePath);
-            }
-         }
-         // Now check for shutdown signal
-         if(areAllFlagsSet(astPollFd[EVENTFD_IDX].revents, POLLIN))
-         {
-            ANT_DEBUG_I("rx thread caught shutdown signal.");
-            // reset the counter by reading.
-            uint64_t counter;
-            read(stRxThreadInfo->iRxShutdownEventFd, &counter, sizeof(counter));
-            // don't care if read error, going to close the thread anyways.
-            stRxThreadInfo->ucRunThread = 0;
-         } else if (astPollFd[EVENTFD_IDX].revents != 0) {
-            ANT_ERROR("Shutdown event descriptor had unexpected event: %#x. exiting rx thread.",
-                  astPollFd[EVENTFD_IDX].revents);
-            stRxThreadInfo->ucRunThread = 0;
-         }
+   if (stRxThreadInfo->bStandby) {
+      // If busy, whoever holds the lock sees standby ending and closes the transport.
+      if (pthread_mutex_trylock(stRxThreadInfo->pstEnabledStatusLock) == 0) {
+         // spoof our handle as closed so we don't try to join ourselves in disable
+         stRxThreadInfo->stRxThread = 0;
+         ant_disable();
+         pthread_mutex_unlock(stRxThreadInfo->pstEnabledStatusLock);
       }
+      return;
    }
 
    /* disable ANT radio if not already disabling */
@@ -222,15 +1129,11 @@ void *fnRxThread(void *ant_rx_thread_info)
       // spoof our handle as closed so we don't try to join ourselves in disable
       stRxThreadInfo->stRxThread = 0;
 
-      if (g_fnStateCallback) {
-         g_fnStateCallback(RADIO_STATUS_DISABLING);
-      }
+      ant_state_notify(g_fnStateCallback, RADIO_STATUS_DISABLING);
 
       ant_disable();
 
-      if (g_fnStateCallback) {
-         g_fnStateCallback(ant_radio_enabled_status());
-      }
+      ant_state_notify(g_fnStateCallback, ant_radio_enabled_status());
 
       ANT_DEBUG_V("releasing stEnabledStatusLock in %s", __FUNCTION__);
       pthread_mutex_unlock(stRxThreadInfo->pstEnabledStatusLock);
@@ -241,28 +1144,228 @@ void *fnRxThread(void *ant_rx_thread_info)
    } else {
       ANT_DEBUG_V("stEnabledStatusLock busy");
    }
+}
+
+/*
+ * This thread waits for ANT messages from a VFS file.
+ */
+void *fnRxThread(void *ant_rx_thread_info)
+{
+   ant_rx_thread_info_t *stRxThreadInfo;
+   ant_rx_loop_t stLoop;
+   ANT_FUNC_START();
+
+   stRxThreadInfo = (ant_rx_thread_info_t *)ant_rx_thread_info;
+
+   if (openRxLoop(&stLoop) < 0) {
+      ANT_ERROR("rx thread could not create its event loop, exiting rx thread.");
+      stRxThreadInfo->ucRunThread = 0;
+   } else if (watchRxSources(&stLoop, stRxThreadInfo) < 0) {
+      ANT_ERROR("rx thread could not watch all of its file descriptors. Attempting recovery.");
+      doReset(stRxThreadInfo);
+      goto out;
+   }
+
+   /* continue running as long as not terminated */
+   while (stRxThreadInfo->ucRunThread) {
+      /* Wait for events on any file descriptor, keepalives are driven by the timer. */
+      if (ant_reactor_dispatch(&stLoop.stReactor, -1) < 0) {
+         // Either a handler or the wait asked for recovery, and logged why.
+         doReset(stRxThreadInfo);
+         goto out;
+      }
+   }
+
+   cleanupStoppedRx(stRxThreadInfo);
 
    out:
+   closeRxLoop(&stLoop);
    ANT_FUNC_END();
 #ifdef ANDROID
    return NULL;
 #endif
 }
 
+int ant_rx_loop_open(void)
+{
+   return openRxLoop(&stThreadlessLoop);
+}
+
+void ant_rx_loop_close(void)
+{
+   closeRxLoop(&stThreadlessLoop);
+
+   pthread_mutex_lock(&stThreadlessLock);
+   bThreadlessOwned = ANT_FALSE;
+   pthread_mutex_unlock(&stThreadlessLock);
+}
+
+int ant_rx_loop_fd(void)
+{
+   return stThreadlessLoop.stReactor.iEpollFd;
+}
+
+/*
+ * Must be called with stThreadlessLock held. Makes the calling thread the owner of the threadless
+ * rx loop if it has none, and returns whether the calling thread is the owner.
+ */
+static ANT_BOOL claimThreadlessLoop(void)
+{
+   if (!bThreadlessOwned) {
+      stThreadlessOwner = pthread_self();
+      bThreadlessOwned = ANT_TRUE;
+   }
+   return pthread_equal(stThreadlessOwner, pthread_self()) ? ANT_TRUE : ANT_FALSE;
+}
+
+int ant_rx_loop_start(ant_rx_thread_info_t *stRxThreadInfo)
+{
+   int iRet = 0;
+   ANT_FUNC_START();
+
+   pthread_mutex_lock(&stThreadlessLock);
+   claimThreadlessLoop();
+   pthread_mutex_unlock(&stThreadlessLock);
+
+   if (!stRxThreadInfo->bRxLoopStarted) {
+      if (watchRxSources(&stThreadlessLoop, stRxThreadInfo) < 0) {
+         ANT_ERROR("rx loop could not watch all of its file descriptors.");
+         unwatchRxSources(&stThreadlessLoop, stRxThreadInfo);
+         iRet = -1;
+      } else {
+         stRxThreadInfo->bRxLoopStarted = ANT_TRUE;
+      }
+   }
+
+   ANT_FUNC_END();
+   return iRet;
+}
+
+void ant_rx_loop_stop(ant_rx_thread_info_t *stRxThreadInfo)
+{
+   ANT_FUNC_START();
+
+   if (stRxThreadInfo->bRxLoopStarted) {
+      unwatchRxSources(&stThreadlessLoop, stRxThreadInfo);
+      stRxThreadInfo->bRxLoopStarted = ANT_FALSE;
+   }
+
+   ANT_FUNC_END();
+}
+
+int ant_rx_loop_process(ant_rx_thread_info_t *stRxThreadInfo, int iTimeoutMs)
+{
+   int iResult;
+
+   pthread_mutex_lock(&stThreadlessLock);
+   if (!claimThreadlessLoop()) {
+      pthread_mutex_unlock(&stThreadlessLock);
+      errno = EPERM;
+      return -1;
+   }
+   if (bThreadlessDispatching) {
+      pthread_mutex_unlock(&stThreadlessLock);
+      errno = EDEADLK;
+      return -1;
+   }
+   bThreadlessDispatching = ANT_TRUE;
+   pthread_mutex_unlock(&stThreadlessLock);
+
+   iResult = ant_reactor_dispatch(&stThreadlessLoop.stReactor, iTimeoutMs);
+
+   pthread_mutex_lock(&stThreadlessLock);
+   bThreadlessDispatching = ANT_FALSE;
+   pthread_mutex_unlock(&stThreadlessLock);
+
+   // Nothing to recover while the radio is disabled.
+   if (stRxThreadInfo->bRxLoopStarted) {
+      if (iResult < 0) {
+         // Either a handler or the wait asked for recovery, and logged why.
+         doReset(stRxThreadInfo);
+      } else if (!stRxThreadInfo->ucRunThread) {
+         // A handler stopped the loop, clean up as the rx thread does when it exits.
+         cleanupStoppedRx(stRxThreadInfo);
+      }
+   }
+
+   return 0;
+}
+
+int ant_rx_loop_wait(ant_rx_thread_info_t *stRxThreadInfo, pthread_cond_t *pstCond,
+      pthread_mutex_t *pstLock, const struct timespec *pstDeadline)
+{
+   struct timespec stNow;
+   long lRemainingMs;
+   ANT_BOOL bRunLoop;
+
+   pthread_mutex_lock(&stThreadlessLock);
+   bRunLoop = claimThreadlessLoop() && !bThreadlessDispatching;
+   pthread_mutex_unlock(&stThreadlessLock);
+
+   if (!bRunLoop) {
+      // The owner's handlers update whatever is being waited for, once they run.
+      return pthread_cond_timedwait(pstCond, pstLock, pstDeadline);
+   }
+
+   clock_gettime(CLOCK_REALTIME, &stNow);
+   lRemainingMs = (pstDeadline->tv_sec - stNow.tv_sec) * 1000 + (pstDeadline->tv_nsec - stNow.tv_nsec) / 1000000;
+   if (lRemainingMs <= 0) {
+      return ETIMEDOUT;
+   }
+
+   // The handlers take the lock to update whatever is being waited for.
+   pthread_mutex_unlock(pstLock);
+   ant_rx_loop_process(stRxThreadInfo, (int)lRemainingMs);
+   pthread_mutex_lock(pstLock);
+
+   return 0;
+}
+
+ANT_BOOL ant_rx_loop_in_handlers(void)
+{
+   ANT_BOOL bInHandlers;
+
+   pthread_mutex_lock(&stThreadlessLock);
+   bInHandlers = bThreadlessDispatching && pthread_equal(stThreadlessOwner, pthread_self());
+   pthread_mutex_unlock(&stThreadlessLock);
+
+   return bInHandlers;
+}
+
+/*
+ * Records how long a recovery took, from ulStartMs.
+ */
+static void noteRecoveryTime(ant_rx_thread_info_t *stRxThreadInfo, ANT_U32 ulStartMs)
+{
+   ANT_U32 ulRecoveryMs = getMonotonicMs() - ulStartMs;
+
+   __atomic_store_n(&stRxThreadInfo->ulLastRecoveryMs, ulRecoveryMs, __ATOMIC_RELAXED);
+   if (ulRecoveryMs > stRxThreadInfo->ulMaxRecoveryMs) {
+      __atomic_store_n(&stRxThreadInfo->ulMaxRecoveryMs, ulRecoveryMs, __ATOMIC_RELAXED);
+   }
+   ANT_DEBUG_I("recovered in %u ms", ulRecoveryMs);
+}
+
 void doReset(ant_rx_thread_info_t *stRxThreadInfo)
 {
    int iMutexLockResult;
+   int enableResult = -1;
+   ANT_U32 ulStartMs = getMonotonicMs();
+   ANT_U32 ulRecovery = 0;
+   ANT_BOOL bReplay = __atomic_load_n(&stRxThreadInfo->bRecoveryReplay, __ATOMIC_RELAXED);
+   ant_rx_replay_t stReplay;
 
    ANT_FUNC_START();
    /* Chip was reset or other error, only way to recover is to
     * close and open ANT chardev */
    stRxThreadInfo->ucChipResetting = 1;
+   // Nothing a replay still in progress sends would stay.
+   stReplay.ulJournalRecovery = ant_journal_cancel_replay();
 
-   if (g_fnStateCallback) {
-      g_fnStateCallback(RADIO_STATUS_RESETTING);
-   }
+   ant_state_notify(g_fnStateCallback, RADIO_STATUS_RESETTING);
 
    stRxThreadInfo->ucRunThread = 0;
+   ant_radio_status_update();
 
    ANT_DEBUG_V("getting stEnabledStatusLock in %s", __FUNCTION__);
    iMutexLockResult = pthread_mutex_lock(stRxThreadInfo->pstEnabledStatusLock);
@@ -271,6 +1374,7 @@ void doReset(ant_rx_thread_info_t *stRxThreadInfo)
             strerror(iMutexLockResult));
       stRxThreadInfo->stRxThread = 0;
       stRxThreadInfo->ucChipResetting = 0;
+      ant_radio_status_update();
    } else {
       ANT_DEBUG_V("got stEnabledStatusLock in %s", __FUNCTION__);
 
@@ -279,16 +1383,17 @@ void doReset(ant_rx_thread_info_t *stRxThreadInfo)
 
       ant_disable();
 
-      int enableResult = ant_enable();
+      enableResult = ant_enable();
 
       stRxThreadInfo->ucChipResetting = 0;
+      ant_radio_status_update();
       if (enableResult) { /* failed */
-         if (g_fnStateCallback) {
-            g_fnStateCallback(RADIO_STATUS_DISABLED);
-         }
+         ant_state_notify(g_fnStateCallback, RADIO_STATUS_DISABLED);
       } else { /* success */
-         if (g_fnStateCallback) {
-            g_fnStateCallback(RADIO_STATUS_RESET);
+         ulRecovery = __atomic_add_fetch(&stRxThreadInfo->ulRecoveries, 1, __ATOMIC_RELAXED);
+         if (!bReplay) {
+            noteRecoveryTime(stRxThreadInfo, ulStartMs);
+            ant_state_notify(g_fnStateCallback, RADIO_STATUS_RESET);
          }
       }
 
@@ -297,6 +1402,116 @@ void doReset(ant_rx_thread_info_t *stRxThreadInfo)
       ANT_DEBUG_V("released stEnabledStatusLock in %s", __FUNCTION__);
    }
 
+   if (!enableResult && bReplay) {
+      // Reported once the channels are restored.
+      stReplay.ulRecovery = ulRecovery;
+      stReplay.ulStartMs = ulStartMs;
+      queueReplay(stRxThreadInfo, &stReplay);
+   }
+
+   ANT_FUNC_END();
+}
+
+/*
+ * Sets the journaled channels up again after a recovery, and reports the recovery if nothing else
+ * happened to the radio meanwhile.
+ */
+static void replayJournal(ant_rx_thread_info_t *stRxThreadInfo, const ant_rx_replay_t *pstReplay)
+{
+   ANT_U32 ulRestored;
+   ANT_U32 ulNotRestored;
+
+   // Without the lock, which the rx thread needs to recover again, cancelling this replay.
+   ant_journal_replay(pstReplay->ulJournalRecovery, &ulRestored, &ulNotRestored);
+   __atomic_add_fetch(&stRxThreadInfo->ulChannelsRestored, ulRestored, __ATOMIC_RELAXED);
+   __atomic_add_fetch(&stRxThreadInfo->ulChannelsNotRestored, ulNotRestored, __ATOMIC_RELAXED);
+
+   // Only reported if the radio wasn't disabled or recovered again meanwhile, which is reported
+   // by whatever did that.
+   pthread_mutex_lock(stRxThreadInfo->pstEnabledStatusLock);
+   if ((pstReplay->ulRecovery == __atomic_load_n(&stRxThreadInfo->ulRecoveries, __ATOMIC_RELAXED)) &&
+         (ant_radio_enabled_status() == RADIO_STATUS_ENABLED)) {
+      noteRecoveryTime(stRxThreadInfo, pstReplay->ulStartMs);
+      ant_state_notify(g_fnStateCallback, RADIO_STATUS_RESET);
+   }
+   pthread_mutex_unlock(stRxThreadInfo->pstEnabledStatusLock);
+}
+
+/*
+ * This thread replays the journal after recoveries, until none is queued.
+ */
+static void *fnReplayThread(void *ant_rx_thread_info)
+{
+   ant_rx_thread_info_t *stRxThreadInfo = (ant_rx_thread_info_t *)ant_rx_thread_info;
+   ant_rx_replay_t stReplay;
+   ANT_FUNC_START();
+
+   pthread_mutex_lock(&stReplayLock);
+   while (bReplayPending) {
+      bReplayPending = ANT_FALSE;
+      stReplay = stPendingReplay;
+      pthread_mutex_unlock(&stReplayLock);
+
+      replayJournal(stRxThreadInfo, &stReplay);
+
+      pthread_mutex_lock(&stReplayLock);
+   }
+   bReplayThreadRunning = ANT_FALSE;
+   pthread_mutex_unlock(&stReplayLock);
+
+   ANT_FUNC_END();
+   return NULL;
+}
+
+/*
+ * Queues a journal replay for the replay thread, starting it if it isn't running. If it can't be
+ * started, the journal is replayed on the calling thread.
+ */
+static void queueReplay(ant_rx_thread_info_t *stRxThreadInfo, const ant_rx_replay_t *pstReplay)
+{
+   int iResult = 0;
+
+   pthread_mutex_lock(&stReplayLock);
+   stPendingReplay = *pstReplay;
+   bReplayPending = ANT_TRUE;
+   if (!bReplayThreadRunning) {
+      if (bReplayThreadStarted) {
+         // Has nothing left to do but return.
+         pthread_join(stReplayThread, NULL);
+      }
+      iResult = ant_thread_create(&stReplayThread, "replay", fnReplayThread, stRxThreadInfo);
+      bReplayThreadStarted = !iResult;
+      bReplayThreadRunning = !iResult;
+      if (iResult) {
+         bReplayPending = ANT_FALSE;
+      }
+   }
+   pthread_mutex_unlock(&stReplayLock);
+
+   if (iResult) {
+      ANT_ERROR("failed to start replay thread: %s", strerror(iResult));
+      replayJournal(stRxThreadInfo, pstReplay);
+   }
+}
+
+void ant_rx_replay_stop(void)
+{
+   ANT_BOOL bJoin;
+   ANT_FUNC_START();
+
+   // Stops it before its next command.
+   ant_journal_cancel_replay();
+
+   pthread_mutex_lock(&stReplayLock);
+   bReplayPending = ANT_FALSE;
+   bJoin = bReplayThreadStarted;
+   bReplayThreadStarted = ANT_FALSE;
+   pthread_mutex_unlock(&stReplayLock);
+
+   if (bJoin) {
+      pthread_join(stReplayThread, NULL);
+   }
+
    ANT_FUNC_END();
 }
 
@@ -344,120 +1559,220 @@ int setFlowControl(ant_channel_info_t *pstChnlInfo, ANT_U8 ucFlowSetting)
    return iRet;
 }
 
+////////////////////////////////////////////////////////////////////
+//  readChannelMsg
+//
+//  Drains a readable transport path, handling all data read from it, until
+//  the read would block.
+//
+//  Parameters:
+//      eChannel      the transport path to read
+//      pstChnlInfo   the details of the transport path
+//
+//  Returns:
+//      Success:
+//          0, also when the path had no data (spurious wakeup)
+//      Failure:
+//          -1
+////////////////////////////////////////////////////////////////////
 int readChannelMsg(ant_channel_type eChannel, ant_channel_info_t *pstChnlInfo)
 {
    int iRet = -1;
    int iRxLenRead;
-   int iCurrentHciPacketOffset;
-   int iHciDataSize;
+   ANT_BOOL bReadData = ANT_FALSE;
    ANT_FUNC_START();
 
-   // Keep trying to read while there is an error, and that error is EAGAIN
-   while (((iRxLenRead = read(pstChnlInfo->iFd, &aucRxBuffer[eChannel][iRxBufferLength[eChannel]], (sizeof(aucRxBuffer[eChannel]) - iRxBufferLength[eChannel]))) < 0)
-                   && errno == EAGAIN)
-      ;
+   pstChnlInfo->ulRxWakeups++;
 
-   if (iRxLenRead < 0) {
-      if (errno == ENODEV) {
-         ANT_ERROR("%s not enabled, exiting rx thread",
-               pstChnlInfo->pcDevicePath);
+   // Keep reading until the path would block, then go back to waiting in poll()
+   for (;;) {
+      iRxLenRead = read(pstChnlInfo->iFd, &aucRxBuffer[eChannel][iRxBufferLength[eChannel]], (sizeof(aucRxBuffer[eChannel]) - iRxBufferLength[eChannel]));
 
-         goto out;
-      } else if (errno == ENXIO) {
-         ANT_ERROR("%s there is no physical ANT device connected",
-               pstChnlInfo->pcDevicePath);
+      if (iRxLenRead < 0) {
+         if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+            if (!bReadData) {
+               pstChnlInfo->ulRxSpuriousWakeups++;
+               ANT_DEBUG_V("%s was readable but had no data", pstChnlInfo->pcDevicePath);
+            }
+            iRet = 0;
+            goto out;
+         } else if (errno == EINTR) {
+            continue;
+         } else if (errno == ENODEV) {
+            ANT_ERROR("%s not enabled, exiting rx thread",
+                  pstChnlInfo->pcDevicePath);
 
-         goto out;
-      } else {
-         ANT_ERROR("%s read thread exiting, unhandled error: %s",
-               pstChnlInfo->pcDevicePath, strerror(errno));
+            goto out;
+         } else if (errno == ENXIO) {
+            ANT_ERROR("%s there is no physical ANT device connected",
+                  pstChnlInfo->pcDevicePath);
+
+            goto out;
+         } else {
+            ANT_ERROR("%s read thread exiting, unhandled error: %s",
+                  pstChnlInfo->pcDevicePath, strerror(errno));
 
+            goto out;
+         }
+      } else if (iRxLenRead == 0) {
+         ANT_DEBUG_V("%s read returned no data", pstChnlInfo->pcDevicePath);
+         iRet = 0;
          goto out;
       }
-   } else {
-      ANT_SERIAL(aucRxBuffer[eChannel], iRxLenRead, 'R');
 
-      iRxLenRead += iRxBufferLength[eChannel];   // add existing data on
+      bReadData = ANT_TRUE;
+      pstChnlInfo->ulRxReads++;
 
-      // if we didn't get a full packet, then just exit
-      if (iRxLenRead < (aucRxBuffer[eChannel][ANT_HCI_SIZE_OFFSET] + ANT_HCI_HEADER_SIZE + ANT_HCI_FOOTER_SIZE)) {
-         iRxBufferLength[eChannel] = iRxLenRead;
-         iRet = 0;
+      if (handleChannelData(eChannel, pstChnlInfo, iRxLenRead) < 0) {
          goto out;
       }
+   }
+
+out:
+   if (bReadData) {
+      ant_rx_pool_batch_end();
+   }
+
+   ANT_FUNC_END();
+   return iRet;
+}
+
+////////////////////////////////////////////////////////////////////
+//  ant_rx_deliver_message
+//
+//  Stamps an ANT message with the next rx sequence number and hands it to
+//  the rx consumers and the rx callbacks of the transport path.
+//
+//  Parameters:
+//      pstChnlInfo   the details of the transport path
+//      ucLen         the length of the message
+//      pucData       the message
+//
+//  Returns:
+//      -
+////////////////////////////////////////////////////////////////////
+void ant_rx_deliver_message(ant_channel_info_t *pstChnlInfo, ANT_U8 ucLen, ANT_U8 *pucData)
+{
+   ANT_U32 ulSeq = __atomic_add_fetch(&ulRxSequence, 1, __ATOMIC_RELAXED);
+
+   if (pstChnlInfo->fnRxSeqCallback != NULL) {
+      pstChnlInfo->fnRxSeqCallback(ulSeq, ucLen, pucData);
+   }
+
+   ant_rx_pool_dispatch(ulSeq, ucLen, pucData);
+
+   if (pstChnlInfo->fnRxCallback != NULL) {
+      pstChnlInfo->fnRxCallback(ucLen, pucData);
+   } else if (pstChnlInfo->fnRxSeqCallback == NULL) {
+      ANT_WARN("%s rx callback is null", pstChnlInfo->pcDevicePath);
+   }
+}
+
+////////////////////////////////////////////////////////////////////
+//  handleChannelData
+//
+//  Splits the data read from a transport path into HCI packets and handles
+//  each complete one. A partial packet is kept for the next read.
+//
+//  Parameters:
+//      eChannel      the transport path the data was read from
+//      pstChnlInfo   the details of the transport path
+//      iRxLenRead    the number of bytes just read into the rx buffer
+//
+//  Returns:
+//      Success:
+//          0
+//      Failure:
+//          -1
+////////////////////////////////////////////////////////////////////
+static int handleChannelData(ant_channel_type eChannel, ant_channel_info_t *pstChnlInfo, int iRxLenRead)
+{
+   int iRet = -1;
+   int iCurrentHciPacketOffset;
+   int iHciDataSize;
+   ANT_FUNC_START();
+
+   ANT_SERIAL(aucRxBuffer[eChannel], iRxLenRead, 'R');
+
+   iRxLenRead += iRxBufferLength[eChannel];   // add existing data on
+
+   // if we didn't get a full packet, then just exit
+   if (iRxLenRead < (aucRxBuffer[eChannel][ANT_HCI_SIZE_OFFSET] + ANT_HCI_HEADER_SIZE + ANT_HCI_FOOTER_SIZE)) {
+      iRxBufferLength[eChannel] = iRxLenRead;
+      iRet = 0;
+      goto out;
+   }
 
-      iRxBufferLength[eChannel] = 0;    // reset buffer length here since we should have a full packet
+   iRxBufferLength[eChannel] = 0;    // reset buffer length here since we should have a full packet
 
 #if ANT_HCI_OPCODE_SIZE == 1  // Check the different message types by opcode
-      ANT_U8 opcode = aucRxBuffer[eChannel][ANT_HCI_OPCODE_OFFSET];
+   ANT_U8 opcode = aucRxBuffer[eChannel][ANT_HCI_OPCODE_OFFSET];
 
-      if(ANT_HCI_OPCODE_COMMAND_COMPLETE == opcode) {
-         // Command Complete, so signal a FLOW_GO
-         if(setFlowControl(pstChnlInfo, ANT_FLOW_GO)) {
-            goto out;
-         }
-      } else if(ANT_HCI_OPCODE_FLOW_ON == opcode) {
-         // FLow On, so resend the last Tx
+   if(ANT_HCI_OPCODE_COMMAND_COMPLETE == opcode) {
+      // Command Complete, so signal a FLOW_GO
+      if(setFlowControl(pstChnlInfo, ANT_FLOW_GO)) {
+         goto out;
+      }
+   } else if(ANT_HCI_OPCODE_FLOW_ON == opcode) {
+      // FLow On, so resend the last Tx
 #ifdef ANT_FLOW_RESEND
-         // Check if there is a message to resend
-         if(pstChnlInfo->ucResendMessageLength > 0) {
-            ant_tx_message_flowcontrol_none(eChannel, pstChnlInfo->ucResendMessageLength, pstChnlInfo->pucResendMessage);
-         } else {
-            ANT_DEBUG_D("Resend requested by chip, but tx request cancelled");
-         }
+      // Check if there is a message to resend
+      if(pstChnlInfo->ucResendMessageLength > 0) {
+         ant_tx_message_flowcontrol_none(eChannel, pstChnlInfo->ucResendMessageLength, pstChnlInfo->pucResendMessage);
+      } else {
+         ANT_DEBUG_D("Resend requested by chip, but tx request cancelled");
+      }
 #endif // ANT_FLOW_RESEND
-      } else if(ANT_HCI_OPCODE_ANT_EVENT == opcode)
-         // ANT Event, send ANT packet to Rx Callback
+   } else if(ANT_HCI_OPCODE_ANT_EVENT == opcode)
+      // ANT Event, send ANT packet to Rx Callback
 #endif // ANT_HCI_OPCODE_SIZE == 1
-      {
-      // Received an ANT packet
-         iCurrentHciPacketOffset = 0;
-
-         while(iCurrentHciPacketOffset < iRxLenRead) {
-
-            // TODO Allow HCI Packet Size value to be larger than 1 byte
-            // This currently works as no size value is greater than 255, and little endian
-            iHciDataSize = aucRxBuffer[eChannel][iCurrentHciPacketOffset + ANT_HCI_SIZE_OFFSET];
-
-            if ((iHciDataSize + ANT_HCI_HEADER_SIZE + ANT_HCI_FOOTER_SIZE + iCurrentHciPacketOffset) >
-                  iRxLenRead) {
-               // we don't have a whole packet
-               iRxBufferLength[eChannel] = iRxLenRead - iCurrentHciPacketOffset;
-               memcpy(aucRxBuffer[eChannel], &aucRxBuffer[eChannel][iCurrentHciPacketOffset], iRxBufferLength[eChannel]);
-               // the increment at the end should push us out of the while loop
-            } else
+   {
+   // Received an ANT packet
+      iCurrentHciPacketOffset = 0;
+
+      while(iCurrentHciPacketOffset < iRxLenRead) {
+
+         // TODO Allow HCI Packet Size value to be larger than 1 byte
+         // This currently works as no size value is greater than 255, and little endian
+         iHciDataSize = aucRxBuffer[eChannel][iCurrentHciPacketOffset + ANT_HCI_SIZE_OFFSET];
+
+         if ((iHciDataSize + ANT_HCI_HEADER_SIZE + ANT_HCI_FOOTER_SIZE + iCurrentHciPacketOffset) >
+               iRxLenRead) {
+            // we don't have a whole packet
+            iRxBufferLength[eChannel] = iRxLenRead - iCurrentHciPacketOffset;
+            memcpy(aucRxBuffer[eChannel], &aucRxBuffer[eChannel][iCurrentHciPacketOffset], iRxBufferLength[eChannel]);
+            // the increment at the end should push us out of the while loop
+         } else
 #ifdef ANT_MESG_FLOW_CONTROL
-            if (aucRxBuffer[eChannel][iCurrentHciPacketOffset + ANT_HCI_DATA_OFFSET + ANT_MSG_ID_OFFSET] ==
-                  ANT_MESG_FLOW_CONTROL) {
-               // This is a flow control packet, not a standard ANT message
-               if(setFlowControl(pstChnlInfo, \
-                     aucRxBuffer[eChannel][iCurrentHciPacketOffset + ANT_HCI_DATA_OFFSET + ANT_MSG_DATA_OFFSET])) {
-                  goto out;
-               }
-            } else
+         if (aucRxBuffer[eChannel][iCurrentHciPacketOffset + ANT_HCI_DATA_OFFSET + ANT_MSG_ID_OFFSET] ==
+               ANT_MESG_FLOW_CONTROL) {
+            // This is a flow control packet, not a standard ANT message
+            if(setFlowControl(pstChnlInfo, \
+                  aucRxBuffer[eChannel][iCurrentHciPacketOffset + ANT_HCI_DATA_OFFSET + ANT_MSG_DATA_OFFSET])) {
+               goto out;
+            }
+         } else
 #endif // ANT_MESG_FLOW_CONTROL
-            {
-               ANT_U8 *msg = aucRxBuffer[eChannel] + iCurrentHciPacketOffset + ANT_HCI_DATA_OFFSET;
-               ANT_BOOL bIsKeepAliveResponse = memcmp(msg, KEEPALIVE_RESP, sizeof(KEEPALIVE_RESP)/sizeof(ANT_U8)) == 0;
-               if (bIsKeepAliveResponse) {
-                  ANT_DEBUG_V("Filtered out keepalive response.");
-               } else if (pstChnlInfo->fnRxCallback != NULL) {
-
-                  // Loop through read data until all HCI packets are written to callback
-                     pstChnlInfo->fnRxCallback(iHciDataSize, \
-                           msg);
-               } else {
-                  ANT_WARN("%s rx callback is null", pstChnlInfo->pcDevicePath);
-               }
+         {
+            ANT_U8 *msg = aucRxBuffer[eChannel] + iCurrentHciPacketOffset + ANT_HCI_DATA_OFFSET;
+            ANT_BOOL bIsKeepAliveResponse = memcmp(msg, KEEPALIVE_RESP, sizeof(KEEPALIVE_RESP)/sizeof(ANT_U8)) == 0;
+            if (bIsKeepAliveResponse) {
+               ANT_DEBUG_V("Filtered out keepalive response.");
+            } else if (__atomic_load_n(&pstChnlInfo->bStandby, __ATOMIC_ACQUIRE)) {
+               ANT_DEBUG_V("Dropped message %#x in standby.", msg[ANT_MSG_ID_OFFSET]);
+            } else {
+               pstChnlInfo->ulRxMessages++;
+
+               ant_rx_deliver_message(pstChnlInfo, iHciDataSize, msg);
             }
-
-            iCurrentHciPacketOffset = iCurrentHciPacketOffset + ANT_HCI_HEADER_SIZE + ANT_HCI_FOOTER_SIZE + iHciDataSize;
          }
-      }
 
-      iRet = 0;
+         iCurrentHciPacketOffset = iCurrentHciPacketOffset + ANT_HCI_HEADER_SIZE + ANT_HCI_FOOTER_SIZE + iHciDataSize;
+      }
    }
 
+   iRet = 0;
+
 out:
    ANT_FUNC_END();
    return iRet;
@@ -49,6 +49,8 @@ typedef struct {
    int iFd;
    /* Callback to call with ANT packet */
    ANTNativeANTEventCb fnRxCallback;
+   /* Callback to call with ANT packet and its rx sequence stamp */
+   ANTNativeANTEventSeqCb fnRxSeqCallback;
    /* Flow control response if channel supports it */
    ANT_U8 ucFlowControlResp;
    /* Handle to flow control condition */
@@ -61,6 +63,16 @@ typedef struct {
    /* The message to resend on request from chip */
    ANT_U8 *pucResendMessage;
 #endif // ANT_FLOW_RESEND
+   /* Number of times the path was readable */
+   ANT_U32 ulRxWakeups;
+   /* Number of times the path was readable but had no data */
+   ANT_U32 ulRxSpuriousWakeups;
+   /* Number of reads that returned data */
+   ANT_U32 ulRxReads;
+   /* Number of ANT messages delivered */
+   ANT_U32 ulRxMessages;
+   /* Set while the radio is in standby, ANT messages read from the path are dropped */
+   ANT_BOOL bStandby;
 } ant_channel_info_t;
 
 typedef enum {
@@ -73,13 +85,42 @@ typedef enum {
    NUM_ANT_CHANNELS
 } ant_channel_type;
 
+#if defined(ANT_RX_IO_URING) && defined(ANT_RX_COALESCE_US)
+#error "ANT_RX_IO_URING reads as soon as data arrives, it can't be used with ANT_RX_COALESCE_US"
+#endif
+
+// Default time without rx before a keepalive is sent, see ant_set_keepalive().
+#define ANT_KEEPALIVE_IDLE_MS                30000
+// Default time to wait for any rx after a keepalive before recovering the chip.
+#define ANT_KEEPALIVE_RESPONSE_MS            5000
+// Once the chip has answered keepalives, wait this many times its average answer time instead,
+// but at least ANT_KEEPALIVE_MIN_RESPONSE_MS. The time saved is added to the idle time, so
+// keepalives are sent less often while a dead chip is still found within idle + response.
+#define ANT_KEEPALIVE_RTT_FACTOR             8
+#define ANT_KEEPALIVE_MIN_RESPONSE_MS        500
+
+// Default for restoring the channels after a recovery, see ant_set_recovery_replay().
+#define ANT_RECOVERY_REPLAY                  ANT_FALSE
+
+// Default time the transport is kept up after the radio is disabled, see ant_set_standby(). 0 for
+// no standby, the transport is closed when the radio is disabled.
+#define ANT_STANDBY_GRACE_MS                 0
+// Retry after this long if the standby timer fires while the enabled state is locked.
+#define ANT_STANDBY_RETRY_MS                 50
+
 typedef struct {
    /* Thread handle */
    pthread_t stRxThread;
+   /* Set in threadless mode, where the rx loop is run by ant_process_events() instead of a thread */
+   ANT_BOOL bThreadless;
+   /* Set while the threadless rx loop watches the transport paths, stands in for stRxThread */
+   ANT_BOOL bRxLoopStarted;
    /* Exit condition */
    ANT_U8 ucRunThread;
    /* Set state as resetting override */
    ANT_U8 ucChipResetting;
+   /* Radio status derived from the fields above, see ant_radio_status_update() */
+   ANTRadioEnabledStatus uiRadioStatus;
    /* Handle to state change lock for crash cleanup */
    pthread_mutex_t *pstEnabledStatusLock;
    /* ANT channels */
@@ -88,6 +129,52 @@ typedef struct {
    int iRxShutdownEventFd;
    /* Indicates whether thread is waiting for a keepalive response. */
    ANT_BOOL bWaitingForKeepaliveResponse;
+   /* One-shot timer file descriptor polled by the rx thread for keepalive deadlines. */
+   int iKeepaliveTimerFd;
+   /* Time without rx before a keepalive is sent, 0 for no keepalives. */
+   ANT_U32 ulKeepaliveIdleMs;
+   /* Time to wait for rx after a keepalive is sent. */
+   ANT_U32 ulKeepaliveResponseMs;
+   /* Monotonic time of the last rx, in ms. */
+   ANT_U32 ulLastRxMs;
+   /* Monotonic time the pending keepalive was sent, in ms. */
+   ANT_U32 ulKeepaliveSentMs;
+   /* Time to wait for rx after the pending keepalive. */
+   ANT_U32 ulKeepaliveWaitMs;
+   /* Monotonic time the keepalive timer was last started, in ms. */
+   ANT_U32 ulKeepaliveArmedMs;
+   /* Average time from a keepalive to the next rx, 0 until the first answer. */
+   ANT_U32 ulKeepaliveRttMs;
+   /* Set when the keepalive intervals were changed, so the next timer expiry isn't counted. */
+   ANT_BOOL bKeepaliveChanged;
+   /* Number of keepalives sent. */
+   ANT_U32 ulKeepaliveProbes;
+   /* Number of keepalives not needed because the chip was heard from during the idle time. */
+   ANT_U32 ulKeepaliveSuppressed;
+   /* Set by enable to report the chip's first answer as progress, see set_ant_progress_callback(). */
+   ANT_BOOL bLinkUpPending;
+   /* Time the link was checked, in us from ant_progress_now(). */
+   ANT_U32 ulLinkUpStartUs;
+   /* Set while the radio is disabled but the transport and rx thread are kept up, see ant_set_standby(). */
+   ANT_BOOL bStandby;
+   /* Time to keep the transport up after the radio is disabled, 0 for no standby. */
+   ANT_U32 ulStandbyGraceMs;
+   /* One-shot timer file descriptor polled by the rx thread for the end of standby. */
+   int iStandbyTimerFd;
+   /* Set to restore the channels after a recovery, see ant_set_recovery_replay(). */
+   ANT_BOOL bRecoveryReplay;
+   /* Number of recoveries, also tells a recovery whether another one followed it. */
+   ANT_U32 ulRecoveries;
+   /* Time the last recovery took, and the longest one, in ms. */
+   ANT_U32 ulLastRecoveryMs;
+   ANT_U32 ulMaxRecoveryMs;
+   /* Number of channels restored, and not restored, after recoveries. */
+   ANT_U32 ulChannelsRestored;
+   ANT_U32 ulChannelsNotRestored;
+#ifdef ANT_RX_COALESCE_US
+   /* Timer file descriptor used to hold off reads so rx data is collected in batches. */
+   int iRxCoalesceTimerFd;
+#endif // ANT_RX_COALESCE_US
 } ant_rx_thread_info_t;
 
 extern ANTNativeANTStateCb g_fnStateCallback;  // TODO State callback should be inside ant_rx_thread_info_t.
@@ -96,5 +183,56 @@ extern ANTNativeANTStateCb g_fnStateCallback;  // TODO State callback should be
  * exit */
 void *fnRxThread(void *ant_rx_thread_info);
 
+/* Recomputes the radio status from the rx thread info and publishes it for
+ * ant_radio_enabled_status(). Must be called after changing any of the fields
+ * the status is derived from. */
+void ant_radio_status_update(void);
+
+/* Threadless mode, see ant_set_threadless(). Opens and closes the rx loop run
+ * on the caller's thread. Its epoll file descriptor, from ant_rx_loop_fd(),
+ * stays the same from open to close, across enables and recoveries. */
+int ant_rx_loop_open(void);
+void ant_rx_loop_close(void);
+int ant_rx_loop_fd(void);
+
+/* Starts and stops the threadless rx loop watching the transport paths and the
+ * keepalive timer, in place of starting and joining the rx thread. The first
+ * thread to start or run the loop after it was opened owns it. */
+int ant_rx_loop_start(ant_rx_thread_info_t *stRxThreadInfo);
+void ant_rx_loop_stop(ant_rx_thread_info_t *stRxThreadInfo);
+
+/* Runs the threadless rx loop's handlers for the events that arrive within
+ * iTimeoutMs, and does recovery or crash cleanup like the rx thread. Returns
+ * -1 without waiting, with errno EDEADLK if called from one of the handlers,
+ * or EPERM if called from a thread other than the loop's owner. */
+int ant_rx_loop_process(ant_rx_thread_info_t *stRxThreadInfo, int iTimeoutMs);
+
+/* Waits like pthread_cond_timedwait() in threadless mode, running the rx loop
+ * on the calling thread instead of sleeping if it is the loop's owner. Other
+ * threads, and the loop's own handlers, wait on the condition for the owner's
+ * handlers to signal it. */
+int ant_rx_loop_wait(ant_rx_thread_info_t *stRxThreadInfo, pthread_cond_t *pstCond,
+      pthread_mutex_t *pstLock, const struct timespec *pstDeadline);
+
+/* Whether the calling thread is running the threadless rx loop's handlers,
+ * where sends must not wait for flow control. */
+ANT_BOOL ant_rx_loop_in_handlers(void);
+
+/* Cancels the journal replay after a recovery, if one is in progress, and
+ * joins the thread running it. */
+void ant_rx_replay_stop(void);
+
+/* Hands an ANT message to the rx callbacks of a transport path and the rx
+ * consumers, as if it had been read from the path. */
+void ant_rx_deliver_message(ant_channel_info_t *pstChnlInfo, ANT_U8 ucLen, ANT_U8 *pucData);
+
+#ifdef ANT_RX_IO_URING
+/* Queues a message to be written to a transport path through the rx loop's
+ * io_uring, in order with the path's other messages. Returns ucLen once
+ * queued, or -1 with errno ENOSYS if the paths aren't written through
+ * io_uring and the caller must write it, or EBUSY if too many messages wait. */
+int ant_rx_loop_write(ant_channel_type eChannel, ANT_U8 *pucData, ANT_U8 ucLen);
+#endif // ANT_RX_IO_URING
+
 #endif /* ifndef __ANT_RX_NATIVE_H */
 
@@ -95,4 +95,18 @@
 #define ANT_CMD_TYPE_PACKET                  ((ANT_U8)0x0C)
 #define ANT_DATA_TYPE_PACKET                 ((ANT_U8)0x0E)
 
+// To collect rx data in batches instead of waking up for every chunk the tty
+// delivers, define the hold-off (in microseconds, less than 1 second) between
+// the path becoming readable and reading it. This adds up to the hold-off to
+// rx latency.
+// #define ANT_RX_COALESCE_US                   2000
+
+// To keep multishot reads outstanding on the transport paths with io_uring
+// instead of polling them, and send through the same ring, define
+// ANT_RX_IO_URING. Needs Linux 6.7 for multishot reads and paths that can be
+// reopened. Falls back to polling at runtime without them, or if built without
+// the io_uring headers. Can't be
+// used with ANT_RX_COALESCE_US:
+// #define ANT_RX_IO_URING
+
 #endif /* ifndef __VFS_PRERELEASE_H */
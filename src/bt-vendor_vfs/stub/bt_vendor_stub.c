@@ -0,0 +1,249 @@
+/*
+ * ANT Stack
+ *
+ * Copyright 2011 Dynastream Innovations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/******************************************************************************\
+*
+*   FILE NAME:      bt_vendor_stub.c
+*
+*   BRIEF:
+*      This file implements a stand-in for libbt-vendor.so, so the bt-vendor_vfs
+*      HAL can be run, and its enable latency measured, on a plain Linux host.
+*
+*      The ANT userial is the master end of a pty. The other end is linked to
+*      $ANT_VENDOR_STUB_PTY (default /tmp/ant_vendor_stub) for a chip simulator
+*      to open, or answered by the stub itself if $ANT_VENDOR_STUB_RESPOND is
+*      set: every message gets flow go and a RESPONSE_NO_ERROR. Powering on
+*      takes $ANT_VENDOR_STUB_POWER_US microseconds, 0 by default.
+*
+*      The platform build makes it as the host module libbt-vendor-antstub.
+*      Otherwise build it on the host from the top of the tree, with the same
+*      driver defines as the HAL and the platform's bt_vendor_lib.h, e.g.
+*
+*         gcc -shared -fPIC -o libbt-vendor.so -Isrc/common/inc \
+*            -Isrc/bt-vendor_vfs/qualcomm/uart -I<bt_vendor_lib.h dir> \
+*            src/bt-vendor_vfs/stub/bt_vendor_stub.c -lpthread
+*
+*      and point LD_LIBRARY_PATH at it when running the HAL.
+*
+\******************************************************************************/
+
+#define _GNU_SOURCE /* needed for posix_openpt(), ptsname() and cfmakeraw() */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "ant_types.h"
+#include "ant_native.h"
+#include "ant_driver_defines.h"
+#include "bt_vendor_lib.h"
+
+#define STUB_DEFAULT_PTY_LINK                "/tmp/ant_vendor_stub"
+
+#define STUB_MESG_RESPONSE_EVENT_ID          ((ANT_U8)0x40)
+#define STUB_RESPONSE_NO_ERROR               ((ANT_U8)0x00)
+
+static int iMasterFd = -1;
+static int iSlaveFd = -1;
+static const char *pcPtyLink = NULL;
+static pthread_t stResponderThread;
+static ANT_BOOL bResponderStarted = ANT_FALSE;
+static ANT_U32 ulInitCount = 0;
+
+/*
+ * Writes one ANT message from the chip to the HAL, framed as the HAL reads it.
+ */
+static void stub_write_message(ANT_U8 ucLen, const ANT_U8 *pucMesg)
+{
+   ANT_U8 aucPacket[ANT_HCI_SIZE_SIZE + ANT_NATIVE_MAX_MESSAGE_SIZE];
+
+   aucPacket[0] = ucLen;
+   memcpy(aucPacket + ANT_HCI_SIZE_SIZE, pucMesg, ucLen);
+   if (write(iSlaveFd, aucPacket, ANT_HCI_SIZE_SIZE + ucLen) < 0) {
+      fprintf(stderr, "bt vendor stub: write failed: %s\n", strerror(errno));
+   }
+}
+
+/*
+ * Answers each message the HAL sends, until the master end is closed.
+ */
+static void *stub_responder(void *pvUnused)
+{
+   ANT_U8 aucRx[256];
+   ANT_U8 aucResponse[5];
+#ifdef ANT_MESG_FLOW_CONTROL
+   const ANT_U8 aucFlowGo[] = { 1, ANT_MESG_FLOW_CONTROL, ANT_FLOW_GO };
+#endif // ANT_MESG_FLOW_CONTROL
+   ssize_t iRead;
+   ssize_t iOffset;
+   ANT_U8 ucSize;
+   (void)pvUnused;
+
+   while ((iRead = read(iSlaveFd, aucRx, sizeof(aucRx))) > 0) {
+      // Packets are the packet type, the size and then the ANT message.
+      iOffset = 0;
+      while (iOffset + HCI_PACKET_TYPE_SIZE + ANT_HCI_SIZE_SIZE < iRead) {
+         ucSize = aucRx[iOffset + HCI_PACKET_TYPE_SIZE];
+         iOffset += HCI_PACKET_TYPE_SIZE + ANT_HCI_SIZE_SIZE;
+         if ((ucSize < 3) || (iOffset + ucSize > iRead)) {
+            fprintf(stderr, "bt vendor stub: dropping %zd bytes that are not a whole message\n",
+                  iRead - iOffset);
+            break;
+         }
+
+#ifdef ANT_MESG_FLOW_CONTROL
+         stub_write_message(sizeof(aucFlowGo), aucFlowGo);
+#endif // ANT_MESG_FLOW_CONTROL
+         aucResponse[0] = 3;
+         aucResponse[1] = STUB_MESG_RESPONSE_EVENT_ID;
+         aucResponse[2] = aucRx[iOffset + 2];
+         aucResponse[3] = aucRx[iOffset + 1];
+         aucResponse[4] = STUB_RESPONSE_NO_ERROR;
+         stub_write_message(sizeof(aucResponse), aucResponse);
+
+         iOffset += ucSize;
+      }
+   }
+
+   return NULL;
+}
+
+/*
+ * Opens the pty the HAL uses as its userial, returning the master end.
+ */
+static int stub_userial_open(void)
+{
+   struct termios stTermios;
+   const char *pcSlaveName;
+
+   iMasterFd = posix_openpt(O_RDWR | O_NOCTTY);
+   if ((iMasterFd < 0) || grantpt(iMasterFd) || unlockpt(iMasterFd) ||
+         ((pcSlaveName = ptsname(iMasterFd)) == NULL)) {
+      goto fail;
+   }
+
+   // Kept open while the userial is, so the HAL doesn't see a hang up before a simulator
+   // opens the link, and raw so no byte of a message gets translated.
+   iSlaveFd = open(pcSlaveName, O_RDWR | O_NOCTTY);
+   if ((iSlaveFd < 0) || tcgetattr(iSlaveFd, &stTermios)) {
+      goto fail;
+   }
+   cfmakeraw(&stTermios);
+   if (tcsetattr(iSlaveFd, TCSANOW, &stTermios)) {
+      goto fail;
+   }
+
+   unlink(pcPtyLink);
+   if (symlink(pcSlaveName, pcPtyLink)) {
+      fprintf(stderr, "bt vendor stub: could not link %s to %s: %s\n",
+            pcPtyLink, pcSlaveName, strerror(errno));
+   }
+
+   if (getenv("ANT_VENDOR_STUB_RESPOND") != NULL) {
+      bResponderStarted = !pthread_create(&stResponderThread, NULL, stub_responder, NULL);
+   }
+
+   return iMasterFd;
+
+fail:
+   fprintf(stderr, "bt vendor stub: could not open pty: %s\n", strerror(errno));
+   if (iSlaveFd >= 0) {
+      close(iSlaveFd);
+      iSlaveFd = -1;
+   }
+   if (iMasterFd >= 0) {
+      close(iMasterFd);
+      iMasterFd = -1;
+   }
+   return -1;
+}
+
+static void stub_userial_close(void)
+{
+   // The responder's read fails once the master end is gone.
+   if (iMasterFd >= 0) {
+      close(iMasterFd);
+      iMasterFd = -1;
+   }
+   if (bResponderStarted) {
+      pthread_join(stResponderThread, NULL);
+      bResponderStarted = ANT_FALSE;
+   }
+   if (iSlaveFd >= 0) {
+      close(iSlaveFd);
+      iSlaveFd = -1;
+   }
+   if (pcPtyLink != NULL) {
+      unlink(pcPtyLink);
+   }
+}
+
+static int stub_init(const bt_vendor_callbacks_t *p_cb, unsigned char *local_bdaddr)
+{
+   (void)p_cb;
+   (void)local_bdaddr;
+
+   pcPtyLink = getenv("ANT_VENDOR_STUB_PTY");
+   if (pcPtyLink == NULL) {
+      pcPtyLink = STUB_DEFAULT_PTY_LINK;
+   }
+
+   ulInitCount++;
+   fprintf(stderr, "bt vendor stub: init %u\n", ulInitCount);
+   return 0;
+}
+
+static int stub_op(bt_vendor_opcode_t opcode, void *param)
+{
+   const char *pcPowerUs;
+
+   switch (opcode) {
+   case BT_VND_OP_POWER_CTRL:
+      pcPowerUs = getenv("ANT_VENDOR_STUB_POWER_US");
+      if ((*(int *)param == BT_VND_PWR_ON) && (pcPowerUs != NULL)) {
+         usleep(strtoul(pcPowerUs, NULL, 10));
+      }
+      return 0;
+   case BT_VND_OP_ANT_USERIAL_OPEN:
+      ((int *)param)[0] = stub_userial_open();
+      // The number of fds opened.
+      return (((int *)param)[0] < 0) ? -1 : 1;
+   case BT_VND_OP_ANT_USERIAL_CLOSE:
+      stub_userial_close();
+      return 0;
+   default:
+      return -1;
+   }
+}
+
+static void stub_cleanup(void)
+{
+   stub_userial_close();
+   fprintf(stderr, "bt vendor stub: cleanup\n");
+}
+
+const bt_vendor_interface_t BLUETOOTH_VENDOR_LIB_INTERFACE = {
+   sizeof(bt_vendor_interface_t),
+   stub_init,
+   stub_op,
+   stub_cleanup
+};
@@ -25,15 +25,59 @@
 *
 \*******************************************************************************/
 
+#include <pthread.h>
+#include <string.h>
+#ifdef ANT_JNI_UPCALL_STATS
+#include <time.h>
+#endif
+
 #include "android_runtime/AndroidRuntime.h"
 #include "jni.h"
 #include "nativehelper/JNIHelp.h"
 
+// Local references one upcall can create, freed together when the upcall returns.
+#define NATIVE_JANT_LOCAL_FRAME_SIZE 4
+// Marks, in g_sRxFrameKey, an rx thread with a local frame pushed for the batch.
+#define NATIVE_JANT_RX_FRAME_PUSHED ((void *)1)
+
 static JNIEnv *g_jEnv = NULL;
 static JavaVM *g_jVM = NULL;
+// Holds the env of native threads attached by a callback, to detach them when they exit.
+static pthread_key_t g_sAttachedEnvKey;
+// Set while an rx thread has a local frame pushed, which is popped at the end of the batch.
+static pthread_key_t g_sRxFrameKey;
 static jclass g_sJClazz;
 static jmethodID g_sMethodId_nativeCb_AntRxMessage;
 static jmethodID g_sMethodId_nativeCb_AntStateChange;
+static jmethodID g_sMethodId_nativeCb_AntProgress;
+static jmethodID g_sMethodId_nativeCb_AntDecodedData;
+static jmethodID g_sMethodId_nativeCb_AntRxRingAvailable;
+
+/*
+ * Rx ring shared with Java in a direct ByteBuffer registered by
+ * nativeJAnt_RegisterRxRing(). The buffer starts with a header of 32 bit words
+ * in native byte order, followed by the ring data:
+ *    write position   - end of the data written by native, only native writes it
+ *    read position    - end of the data consumed by java, only java writes it
+ *    dropped messages - count of messages dropped because the ring was full
+ * Each message is stored as one length byte followed by the message, wrapping
+ * at the end of the data area. The ring is empty when the positions are equal,
+ * and one byte is always left free so a full ring can be told apart.
+ */
+#define NATIVE_JANT_RX_RING_WRITE_POS      0
+#define NATIVE_JANT_RX_RING_READ_POS       1
+#define NATIVE_JANT_RX_RING_DROPPED        2
+#define NATIVE_JANT_RX_RING_HEADER_SIZE    16
+// Room for at least a few of the largest messages.
+#define NATIVE_JANT_RX_RING_MIN_DATA_SIZE  256
+
+static pthread_mutex_t g_sRxRingLock = PTHREAD_MUTEX_INITIALIZER;
+static jobject g_sRxRingBuffer = NULL;
+static volatile uint32_t *g_pulRxRingHeader = NULL;
+static uint8_t *g_pucRxRingData = NULL;
+static uint32_t g_ulRxRingDataSize = 0;
+// Messages written since java was last told about them.
+static uint32_t g_ulRxRingPending = 0;
 
 extern "C"
 {
@@ -44,7 +88,82 @@ extern "C"
 
    void nativeJAnt_RxCallback(ANT_U8 ucLen, ANT_U8* pucData);
    void nativeJAnt_StateCallback(ANTRadioEnabledStatus uiNewState);
+   void nativeJAnt_ProgressCallback(ANT_U8 ucPhase, ANTStatus status, ANT_U32 ulPhaseUs);
+   void nativeJAnt_DecodedCallback(const ANTDecodedData *pstData, void *pvContext);
+   void nativeJAnt_RxBatchCallback(void);
+}
+
+/*
+ * Detaches a native thread attached by nativeJAnt_GetEnv() when it exits.
+ */
+static void nativeJAnt_DetachThread(void *pvEnv)
+{
+   (void)pvEnv; //unused warning
+
+   ANT_DEBUG_D("detaching exiting thread from VM");
+   g_jVM->DetachCurrentThread();
+}
+
+/*
+ * Gets the env of the calling thread. Native threads are attached the first
+ * time they call up into java, and stay attached until they exit.
+ */
+static JNIEnv *nativeJAnt_GetEnv(void)
+{
+   JNIEnv *env = NULL;
+
+   if (g_jVM->GetEnv((void**) &env, JNI_VERSION_1_4) == JNI_OK)
+   {
+      return env;
+   }
+
+   ANT_DEBUG_D("attaching native thread to VM");
+   if (g_jVM->AttachCurrentThread(&env, NULL) != JNI_OK)
+   {
+      return NULL;
+   }
+
+   if (pthread_setspecific(g_sAttachedEnvKey, env))
+   {
+      // Would never be detached, so do not keep it attached.
+      ANT_ERROR("failed to remember attached thread, detaching");
+      g_jVM->DetachCurrentThread();
+      return NULL;
+   }
+
+   return env;
+}
+
+// Build with -DANT_JNI_UPCALL_STATS to log the cost of each rx upcall, to
+// compare the upcall path between builds on a device.
+#ifdef ANT_JNI_UPCALL_STATS
+// Number of rx upcalls to average the cost over before logging it.
+#define NATIVE_JANT_UPCALL_STATS_COUNT 1000
+
+static ANT_U32 g_ulUpcalls = 0;
+static uint64_t g_ullUpcallNs = 0;
+
+/*
+ * Adds the cost of an rx upcall, and logs the average per message every
+ * NATIVE_JANT_UPCALL_STATS_COUNT messages. Only called from the rx thread.
+ */
+static void nativeJAnt_CountUpcall(const struct timespec *pstStart)
+{
+   struct timespec stEnd;
+
+   clock_gettime(CLOCK_MONOTONIC, &stEnd);
+   g_ullUpcallNs += (uint64_t)(stEnd.tv_sec - pstStart->tv_sec) * 1000000000ULL +
+         stEnd.tv_nsec - pstStart->tv_nsec;
+
+   if (++g_ulUpcalls == NATIVE_JANT_UPCALL_STATS_COUNT)
+   {
+      ANT_WARN("rx upcall average %llu ns over %u messages",
+            (unsigned long long)(g_ullUpcallNs / g_ulUpcalls), g_ulUpcalls);
+      g_ulUpcalls = 0;
+      g_ullUpcallNs = 0;
+   }
 }
+#endif // ANT_JNI_UPCALL_STATS
 
 static jint nativeJAnt_Create(JNIEnv *env, jobject obj)
 {
@@ -75,6 +194,20 @@ static jint nativeJAnt_Create(JNIEnv *env, jobject obj)
       goto CLEANUP;
    }
 
+   antStatus = set_ant_rx_batch_callback(nativeJAnt_RxBatchCallback);
+   if (antStatus)
+   {
+      ANT_DEBUG_D("failed to set ANT rx batch callback");
+      goto CLEANUP;
+   }
+
+   antStatus = set_ant_progress_callback(nativeJAnt_ProgressCallback);
+   if (antStatus)
+   {
+      ANT_DEBUG_D("failed to set ANT progress callback");
+      goto CLEANUP;
+   }
+
 CLEANUP:
    ANT_FUNC_END();
    return antStatus;
@@ -127,6 +260,30 @@ static jint nativeJAnt_Disable(JNIEnv *env, jobject obj)
    return status;
 }
 
+static jint nativeJAnt_EnableAsync(JNIEnv *env, jobject obj)
+{
+   (void)env; //unused warning
+   (void)obj; //unused warning
+   ANT_FUNC_START();
+
+   ANTStatus status = ant_enable_radio_async();
+
+   ANT_FUNC_END();
+   return status;
+}
+
+static jint nativeJAnt_DisableAsync(JNIEnv *env, jobject obj)
+{
+   (void)env; //unused warning
+   (void)obj; //unused warning
+   ANT_FUNC_START();
+
+   ANTStatus status = ant_disable_radio_async();
+
+   ANT_FUNC_END();
+   return status;
+}
+
 static jint nativeJAnt_GetRadioEnabledStatus(JNIEnv *env, jobject obj)
 {
    (void)env; //unused warning
@@ -165,6 +322,305 @@ static jint nativeJAnt_TxMessage(JNIEnv *env, jobject obj, jbyteArray msg)
    return status;
 }
 
+/*
+ * Gets the address and size of a direct ByteBuffer passed to a tx native,
+ * throwing if it is not one. Returns NULL on failure.
+ */
+static ANT_U8 *nativeJAnt_GetTxBuffer(JNIEnv *env, jobject buffer, jlong *pllCapacity)
+{
+   ANT_U8 *pucAddress;
+
+   if (buffer == NULL)
+   {
+      if (jniThrowException(env, "java/lang/NullPointerException", NULL))
+      {
+         ANT_ERROR("Unable to throw NullPointerException");
+      }
+      return NULL;
+   }
+
+   pucAddress = (ANT_U8 *)env->GetDirectBufferAddress(buffer);
+   *pllCapacity = env->GetDirectBufferCapacity(buffer);
+   if ((pucAddress == NULL) || (*pllCapacity < 0))
+   {
+      if (jniThrowException(env, "java/lang/IllegalArgumentException", "buffer must be direct"))
+      {
+         ANT_ERROR("Unable to throw IllegalArgumentException");
+      }
+      return NULL;
+   }
+
+   return pucAddress;
+}
+
+static jint nativeJAnt_TxMessages(JNIEnv *env, jobject obj, jobject buffer, jint count)
+{
+   (void)obj; //unused warning
+   ANT_U32 ulSent = 0;
+   jlong llCapacity = 0;
+   ANT_FUNC_START();
+
+   ANT_U8 *pucMessages = nativeJAnt_GetTxBuffer(env, buffer, &llCapacity);
+   if (pucMessages == NULL)
+   {
+      return -1;
+   }
+
+   if (count < 0)
+   {
+      return -1;
+   }
+
+   // Messages are read in place, without copying the buffer into the VM.
+   ANTStatus status = ant_tx_messages((ANT_U32)count, pucMessages,
+         (llCapacity > 0x7FFFFFFF) ? 0x7FFFFFFF : (ANT_U32)llCapacity, &ulSent);
+   if (status)
+   {
+      ANT_WARN("nativeJAnt_TxMessages: sent %u of %d, ant_tx_messages() returned %d", ulSent, count, (int)status);
+   }
+
+   ANT_FUNC_END();
+   // Java needs to know how far the batch got, the status is in the log.
+   return (jint)ulSent;
+}
+
+static jint nativeJAnt_TxBurst(JNIEnv *env, jobject obj, jobject buffer, jint channel, jint length)
+{
+   (void)obj; //unused warning
+   jlong llCapacity = 0;
+   ANT_FUNC_START();
+
+   ANT_U8 *pucData = nativeJAnt_GetTxBuffer(env, buffer, &llCapacity);
+   if (pucData == NULL)
+   {
+      return -1;
+   }
+
+   if ((channel < 0) || (channel > 0xFF) || (length < 0) || (length > llCapacity))
+   {
+      return ANT_STATUS_INVALID_PARM;
+   }
+
+   ANTStatus status = ant_tx_burst((ANT_U8)channel, (ANT_U32)length, pucData);
+   ANT_DEBUG_D("nativeJAnt_TxBurst: ant_tx_burst() returned %d", (int)status);
+
+   ANT_FUNC_END();
+   return status;
+}
+
+static jint nativeJAnt_SetDecodingEnabled(JNIEnv *env, jobject obj, jboolean enable)
+{
+   (void)env; //unused warning
+   (void)obj; //unused warning
+   ANT_FUNC_START();
+
+   ANTStatus status;
+
+   if (enable && (NULL == g_sMethodId_nativeCb_AntDecodedData))
+   {
+      // Java has no callback to take the decoded data.
+      status = ANT_STATUS_NOT_SUPPORTED;
+   }
+   else
+   {
+      status = set_ant_decoded_callback(enable ? nativeJAnt_DecodedCallback : NULL, NULL);
+   }
+
+   ANT_FUNC_END();
+   return status;
+}
+
+static jint nativeJAnt_RegisterRxRing(JNIEnv *env, jobject obj, jobject buffer)
+{
+   jobject jOldBuffer;
+   jobject jNewBuffer = NULL;
+   uint8_t *pucAddress = NULL;
+   jlong llCapacity = 0;
+   jint status = ANT_STATUS_SUCCESS;
+   (void)obj; //unused warning
+   ANT_FUNC_START();
+
+   if (NULL == g_sMethodId_nativeCb_AntRxRingAvailable)
+   {
+      // Java could not be told about messages put in the ring.
+      status = ANT_STATUS_NOT_SUPPORTED;
+      goto out;
+   }
+
+   if (buffer != NULL)
+   {
+      pucAddress = (uint8_t *)env->GetDirectBufferAddress(buffer);
+      llCapacity = env->GetDirectBufferCapacity(buffer);
+
+      if ((pucAddress == NULL) || (((uintptr_t)pucAddress) & (sizeof(uint32_t) - 1)) ||
+            (llCapacity < NATIVE_JANT_RX_RING_HEADER_SIZE + NATIVE_JANT_RX_RING_MIN_DATA_SIZE) ||
+            (llCapacity > NATIVE_JANT_RX_RING_HEADER_SIZE + 0x7FFFFFFFLL))
+      {
+         ANT_ERROR("nativeJAnt_RegisterRxRing: buffer must be an aligned direct buffer of at least %d bytes",
+               NATIVE_JANT_RX_RING_HEADER_SIZE + NATIVE_JANT_RX_RING_MIN_DATA_SIZE);
+         status = ANT_STATUS_INVALID_PARM;
+         goto out;
+      }
+
+      jNewBuffer = env->NewGlobalRef(buffer);
+      if (jNewBuffer == NULL)
+      {
+         ANT_ERROR("nativeJAnt_RegisterRxRing: Failed creating global reference");
+         status = ANT_STATUS_FAILED;
+         goto out;
+      }
+
+      memset(pucAddress, 0, NATIVE_JANT_RX_RING_HEADER_SIZE);
+   }
+
+   // The rx thread only touches the ring with the lock held.
+   pthread_mutex_lock(&g_sRxRingLock);
+   jOldBuffer = g_sRxRingBuffer;
+   g_sRxRingBuffer = jNewBuffer;
+   g_pulRxRingHeader = (volatile uint32_t *)pucAddress;
+   g_pucRxRingData = (pucAddress != NULL) ? pucAddress + NATIVE_JANT_RX_RING_HEADER_SIZE : NULL;
+   g_ulRxRingDataSize = (uint32_t)((pucAddress != NULL) ? llCapacity - NATIVE_JANT_RX_RING_HEADER_SIZE : 0);
+   g_ulRxRingPending = 0;
+   pthread_mutex_unlock(&g_sRxRingLock);
+
+   if (jOldBuffer != NULL)
+   {
+      env->DeleteGlobalRef(jOldBuffer);
+   }
+
+out:
+   ANT_FUNC_END();
+   return status;
+}
+
+/*
+ * Appends a message to the rx ring. Must be called with g_sRxRingLock held and
+ * a ring registered. Returns false if there is no room for it.
+ */
+static bool nativeJAnt_RxRingWrite(ANT_U8 ucLen, ANT_U8 *pucData)
+{
+   uint32_t ulWrite = g_pulRxRingHeader[NATIVE_JANT_RX_RING_WRITE_POS];
+   uint32_t ulRead = __atomic_load_n(&g_pulRxRingHeader[NATIVE_JANT_RX_RING_READ_POS], __ATOMIC_ACQUIRE);
+   uint32_t ulFree;
+   uint32_t ulFirst;
+
+   if ((ulWrite >= g_ulRxRingDataSize) || (ulRead >= g_ulRxRingDataSize))
+   {
+      ANT_ERROR("nativeJAnt_RxRingWrite: ring positions corrupt, write %u read %u", ulWrite, ulRead);
+      return false;
+   }
+
+   ulFree = (ulRead + g_ulRxRingDataSize - ulWrite - 1) % g_ulRxRingDataSize;
+   if (ulFree < (uint32_t)ucLen + 1)
+   {
+      return false;
+   }
+
+   g_pucRxRingData[ulWrite] = ucLen;
+   ulWrite = (ulWrite + 1) % g_ulRxRingDataSize;
+
+   ulFirst = g_ulRxRingDataSize - ulWrite;
+   if (ulFirst > ucLen)
+   {
+      ulFirst = ucLen;
+   }
+   memcpy(g_pucRxRingData + ulWrite, pucData, ulFirst);
+   memcpy(g_pucRxRingData, pucData + ulFirst, ucLen - ulFirst);
+   ulWrite = (ulWrite + ucLen) % g_ulRxRingDataSize;
+
+   // Publish the message only once its bytes are in place.
+   __atomic_store_n(&g_pulRxRingHeader[NATIVE_JANT_RX_RING_WRITE_POS], ulWrite, __ATOMIC_RELEASE);
+   g_ulRxRingPending++;
+
+   return true;
+}
+
+/*
+ * Tells java about the messages put in the rx ring since it was last told.
+ */
+static void nativeJAnt_RxRingNotify(void)
+{
+   JNIEnv* env = NULL;
+   uint32_t ulPending;
+
+   if (NULL == g_sMethodId_nativeCb_AntRxRingAvailable)
+   {
+      return;
+   }
+
+   pthread_mutex_lock(&g_sRxRingLock);
+   ulPending = g_ulRxRingPending;
+   g_ulRxRingPending = 0;
+   pthread_mutex_unlock(&g_sRxRingLock);
+
+   if (ulPending == 0)
+   {
+      return;
+   }
+
+   ANT_FUNC_START();
+
+   env = nativeJAnt_GetEnv();
+   if (env == NULL)
+   {
+      ANT_DEBUG_D("nativeJAnt_RxRingNotify: Entered, env is null");
+      return;
+   }
+
+   ANT_DEBUG_V("nativeJAnt_RxRingNotify: Calling java rx ring callback");
+   env->CallStaticVoidMethod(g_sJClazz, g_sMethodId_nativeCb_AntRxRingAvailable, (jint)ulPending);
+   ANT_DEBUG_V("nativeJAnt_RxRingNotify: Called java rx ring callback");
+
+   if (env->ExceptionOccurred())
+   {
+      ANT_ERROR("nativeJAnt_RxRingNotify: Calling Java nativeCb_AntRxRingAvailable failed");
+      env->ExceptionDescribe();
+      env->ExceptionClear();
+   }
+
+   ANT_FUNC_END();
+   return;
+}
+
+/*
+ * Puts a message in the rx ring, telling java about what is already there if
+ * it is full. Returns false if no ring is registered.
+ */
+static bool nativeJAnt_RxRingPut(ANT_U8 ucLen, ANT_U8 *pucData)
+{
+   bool bWritten;
+
+   if (NULL == g_sMethodId_nativeCb_AntRxRingAvailable)
+   {
+      return false;
+   }
+
+   pthread_mutex_lock(&g_sRxRingLock);
+   if (g_pucRxRingData == NULL)
+   {
+      pthread_mutex_unlock(&g_sRxRingLock);
+      return false;
+   }
+   bWritten = nativeJAnt_RxRingWrite(ucLen, pucData);
+   pthread_mutex_unlock(&g_sRxRingLock);
+
+   if (!bWritten)
+   {
+      // Let java drain what is there, then try once more.
+      nativeJAnt_RxRingNotify();
+
+      pthread_mutex_lock(&g_sRxRingLock);
+      if ((g_pucRxRingData != NULL) && !nativeJAnt_RxRingWrite(ucLen, pucData))
+      {
+         __atomic_add_fetch(&g_pulRxRingHeader[NATIVE_JANT_RX_RING_DROPPED], 1, __ATOMIC_RELEASE);
+         ANT_WARN("nativeJAnt_RxRingPut: ring full, dropped %d byte message", ucLen);
+      }
+      pthread_mutex_unlock(&g_sRxRingLock);
+   }
+
+   return true;
+}
+
 static jint nativeJAnt_HardReset(JNIEnv *env, jobject obj)
 {
    (void)env; //unused warning
@@ -187,11 +643,22 @@ extern "C"
    {
       JNIEnv* env = NULL;
       jbyteArray jAntRxMsg = NULL;
+#ifdef ANT_JNI_UPCALL_STATS
+      struct timespec stStart;
+      clock_gettime(CLOCK_MONOTONIC, &stStart);
+#endif
       ANT_FUNC_START();
 
       ANT_DEBUG_D( "got message %d bytes", ucLen);
 
-      g_jVM->AttachCurrentThread((&env), NULL);
+      if (nativeJAnt_RxRingPut(ucLen, pucData))
+      {
+         // Java is told about it once the whole batch is in the ring.
+         ANT_FUNC_END();
+         return;
+      }
+
+      env = nativeJAnt_GetEnv();
 
       if (env == NULL)
       {
@@ -203,6 +670,19 @@ extern "C"
          ANT_DEBUG_D("nativeJAnt_RxCallback: jEnv %p", env);
       }
 
+      // The thread stays attached, so local references are only freed with a frame.
+      // One is pushed for the whole batch, and popped by nativeJAnt_RxBatchCallback().
+      if (pthread_getspecific(g_sRxFrameKey) == NULL)
+      {
+         if (env->PushLocalFrame(NATIVE_JANT_LOCAL_FRAME_SIZE) != JNI_OK)
+         {
+            ANT_ERROR("nativeJAnt_RxCallback: Failed pushing local frame");
+            env->ExceptionClear();
+            return;
+         }
+         pthread_setspecific(g_sRxFrameKey, NATIVE_JANT_RX_FRAME_PUSHED);
+      }
+
       jAntRxMsg = env->NewByteArray(ucLen);
 
       if (jAntRxMsg == NULL)
@@ -228,60 +708,124 @@ extern "C"
          goto CLEANUP;
       }
 
-      //Delete the local references
-      if (jAntRxMsg != NULL)
-      {
-         env->DeleteLocalRef(jAntRxMsg);
-      }
-
-      ANT_DEBUG_D("nativeJAnt_RxCallback: Exiting, Calling DetachCurrentThread at the END");
-
-      g_jVM->DetachCurrentThread();
+      // Keeps the frame from growing with the number of messages in the batch.
+      env->DeleteLocalRef(jAntRxMsg);
 
+#ifdef ANT_JNI_UPCALL_STATS
+      nativeJAnt_CountUpcall(&stStart);
+#endif
       ANT_FUNC_END();
       return;
 
    CLEANUP:
       ANT_ERROR("nativeJAnt_RxCallback: Exiting due to failure");
+
+      if (env->ExceptionOccurred())
+      {
+         env->ExceptionDescribe();
+         env->ExceptionClear();
+      }
+
       if (jAntRxMsg != NULL)
       {
          env->DeleteLocalRef(jAntRxMsg);
       }
 
+      return;
+   }
+
+   void nativeJAnt_DecodedCallback(const ANTDecodedData *pstData, void *pvContext)
+   {
+      JNIEnv* env = NULL;
+      jintArray jValues = NULL;
+      (void)pvContext; //unused warning
+      ANT_FUNC_START();
+
+      if (NULL == g_sMethodId_nativeCb_AntDecodedData)
+      {
+         ANT_FUNC_END();
+         return;
+      }
+
+      env = nativeJAnt_GetEnv();
+
+      if (env == NULL)
+      {
+         ANT_DEBUG_D("nativeJAnt_DecodedCallback: Entered, env is null");
+         return;
+      }
+
+      if (env->PushLocalFrame(NATIVE_JANT_LOCAL_FRAME_SIZE) != JNI_OK)
+      {
+         ANT_ERROR("nativeJAnt_DecodedCallback: Failed pushing local frame");
+         env->ExceptionClear();
+         return;
+      }
+
+      jValues = env->NewIntArray(pstData->ucNumValues);
+
+      if (jValues == NULL)
+      {
+         ANT_ERROR("nativeJAnt_DecodedCallback: Failed creating java int[]");
+         goto CLEANUP;
+      }
+
+      env->SetIntArrayRegion(jValues, 0, pstData->ucNumValues, (const jint*)pstData->alValues);
+
+      ANT_DEBUG_V("nativeJAnt_DecodedCallback: Calling java decoded data callback");
+      env->CallStaticVoidMethod(g_sJClazz, g_sMethodId_nativeCb_AntDecodedData,
+            (jint)pstData->ucChannel, (jint)pstData->ucDeviceType, (jint)pstData->ucPage,
+            (jint)pstData->ucChangedMask, jValues);
+      ANT_DEBUG_V("nativeJAnt_DecodedCallback: Called java decoded data callback");
+
+      if (env->ExceptionOccurred())
+      {
+         ANT_ERROR("nativeJAnt_DecodedCallback: Calling Java nativeCb_AntDecodedData failed");
+      }
+
+   CLEANUP:
       if (env->ExceptionOccurred())
       {
          env->ExceptionDescribe();
          env->ExceptionClear();
       }
 
-      g_jVM->DetachCurrentThread();
+      env->PopLocalFrame(NULL);
 
+      ANT_FUNC_END();
       return;
    }
 
-   void nativeJAnt_StateCallback(ANTRadioEnabledStatus uiNewState)
+   void nativeJAnt_RxBatchCallback(void)
    {
       JNIEnv* env = NULL;
-      jint jNewState = uiNewState;
-      ANT_BOOL iShouldDetach = ANT_FALSE;
-      ANT_FUNC_START();
 
-      g_jVM->GetEnv((void**) &env, JNI_VERSION_1_4);
-      if (env == NULL)
+      if (pthread_getspecific(g_sRxFrameKey) != NULL)
       {
-         ANT_DEBUG_D("nativeJAnt_StateCallback: called from rx thread, attaching to VM");
-         g_jVM->AttachCurrentThread((&env), NULL);
-         if (env == NULL)
+         // Pops the frame pushed by the first rx upcall of the batch.
+         env = nativeJAnt_GetEnv();
+         if (env != NULL)
          {
-            ANT_DEBUG_E("nativeJAnt_StateCallback: failed to attach rx thread to VM");
-            return;
+            env->PopLocalFrame(NULL);
          }
-         iShouldDetach = ANT_TRUE;
+         pthread_setspecific(g_sRxFrameKey, NULL);
       }
-      else
+
+      nativeJAnt_RxRingNotify();
+   }
+
+   void nativeJAnt_StateCallback(ANTRadioEnabledStatus uiNewState)
+   {
+      JNIEnv* env = NULL;
+      jint jNewState = uiNewState;
+      ANT_FUNC_START();
+
+      // Called from the state notifier thread, attached on its first upcall.
+      env = nativeJAnt_GetEnv();
+      if (env == NULL)
       {
-         ANT_DEBUG_D("nativeJAnt_StateCallback: called from java enable/disable"
-                         ", already attached, don't detach");
+         ANT_DEBUG_E("nativeJAnt_StateCallback: failed to attach rx thread to VM");
+         return;
       }
 
       ANT_DEBUG_V("nativeJAnt_StateCallback: Calling java state callback");
@@ -295,10 +839,39 @@ extern "C"
          env->ExceptionClear();
       }
 
-      if (iShouldDetach)
+      ANT_FUNC_END();
+      return;
+   }
+
+   void nativeJAnt_ProgressCallback(ANT_U8 ucPhase, ANTStatus status, ANT_U32 ulPhaseUs)
+   {
+      JNIEnv* env = NULL;
+      ANT_FUNC_START();
+
+      if (NULL == g_sMethodId_nativeCb_AntProgress)
+      {
+         ANT_FUNC_END();
+         return;
+      }
+
+      // Called from the state notifier thread, in order with the state changes.
+      env = nativeJAnt_GetEnv();
+      if (env == NULL)
       {
-         ANT_DEBUG_D("nativeJAnt_StateCallback: env was attached, detaching");
-         g_jVM->DetachCurrentThread();
+         ANT_DEBUG_E("nativeJAnt_ProgressCallback: failed to attach thread to VM");
+         return;
+      }
+
+      ANT_DEBUG_V("nativeJAnt_ProgressCallback: Calling java progress callback");
+      env->CallStaticVoidMethod(g_sJClazz, g_sMethodId_nativeCb_AntProgress,
+            (jint)ucPhase, (jint)status, (jint)ulPhaseUs);
+      ANT_DEBUG_V("nativeJAnt_ProgressCallback: Called java progress callback");
+
+      if (env->ExceptionOccurred())
+      {
+         ANT_ERROR("nativeJAnt_ProgressCallback: Calling Java nativeCb_AntProgress failed");
+         env->ExceptionDescribe();
+         env->ExceptionClear();
       }
 
       ANT_FUNC_END();
@@ -318,11 +891,74 @@ static JNINativeMethod g_sMethods[] =
    {"nativeJAnt_HardReset", "()I", (void *)nativeJAnt_HardReset}
 };
 
+/*
+ * Natives that a JAntJava from before they were added does not declare. Each
+ * group is registered on its own, and left out if the class lacks it.
+ */
+static JNINativeMethod g_sDecodingMethods[] =
+{
+   {"nativeJAnt_SetDecodingEnabled", "(Z)I", (void *)nativeJAnt_SetDecodingEnabled}
+};
+
+static JNINativeMethod g_sAsyncMethods[] =
+{
+   {"nativeJAnt_EnableAsync", "()I", (void*)nativeJAnt_EnableAsync},
+   {"nativeJAnt_DisableAsync", "()I", (void*)nativeJAnt_DisableAsync}
+};
+
+static JNINativeMethod g_sTxBufferMethods[] =
+{
+   {"nativeJAnt_TxMessages", "(Ljava/nio/ByteBuffer;I)I", (void *)nativeJAnt_TxMessages},
+   {"nativeJAnt_TxBurst", "(Ljava/nio/ByteBuffer;II)I", (void *)nativeJAnt_TxBurst}
+};
+
+static JNINativeMethod g_sRxRingMethods[] =
+{
+   {"nativeJAnt_RegisterRxRing", "(Ljava/nio/ByteBuffer;)I", (void *)nativeJAnt_RegisterRxRing}
+};
+
+/*
+ * Registers a group of optional natives. Returns false, with the exception
+ * cleared, if the class does not declare all of them.
+ */
+static bool nativeJAnt_RegisterOptionalNatives(JNINativeMethod *pstMethods, int iCount)
+{
+   if (g_jEnv->RegisterNatives(g_sJClazz, pstMethods, iCount) != JNI_OK) {
+      g_jEnv->ExceptionClear();
+      ANT_WARN("%s not declared, leaving it unregistered", pstMethods[0].name);
+      return false;
+   }
+   return true;
+}
+
+/*
+ * Gets the id of an optional java callback. Returns NULL, with the exception
+ * cleared, if the class does not declare it.
+ */
+static jmethodID nativeJAnt_GetOptionalMethodId(const char *pcName, const char *pcSignature)
+{
+   jmethodID jMethodId = g_jEnv->GetStaticMethodID(g_sJClazz, pcName, pcSignature);
+   if (NULL == jMethodId) {
+      g_jEnv->ExceptionClear();
+      ANT_WARN("%s%s not declared, not calling it", pcName, pcSignature);
+   }
+   return jMethodId;
+}
+
 jint JNI_OnLoad(JavaVM* vm, void* reserved) {
    ANT_FUNC_START();
    (void)reserved; //unused warning
 
    g_jVM = vm;
+   if (pthread_key_create(&g_sAttachedEnvKey, nativeJAnt_DetachThread)) {
+      ANT_ERROR("failed to create attached thread key");
+      return -1;
+   }
+   if (pthread_key_create(&g_sRxFrameKey, NULL)) {
+      ANT_ERROR("failed to create rx frame key");
+      return -1;
+   }
+
    if (g_jVM->GetEnv((void**) &g_jEnv, JNI_VERSION_1_4) != JNI_OK) {
       ANT_ERROR("GetEnv failed");
       return -1;
@@ -346,6 +982,9 @@ jint JNI_OnLoad(JavaVM* vm, void* reserved) {
       return -1;
    }
 
+   nativeJAnt_RegisterOptionalNatives(g_sAsyncMethods, NELEM(g_sAsyncMethods));
+   nativeJAnt_RegisterOptionalNatives(g_sTxBufferMethods, NELEM(g_sTxBufferMethods));
+
    g_sMethodId_nativeCb_AntRxMessage = g_jEnv->GetStaticMethodID(g_sJClazz,
                                              "nativeCb_AntRxMessage", "([B)V");
    if (NULL == g_sMethodId_nativeCb_AntRxMessage) {
@@ -360,6 +999,23 @@ jint JNI_OnLoad(JavaVM* vm, void* reserved) {
       return -1;
    }
 
+   g_sMethodId_nativeCb_AntProgress = nativeJAnt_GetOptionalMethodId(
+                                             "nativeCb_AntProgress", "(III)V");
+
+   // Decoding is only offered when both its native and its callback are there.
+   g_sMethodId_nativeCb_AntDecodedData = nativeJAnt_GetOptionalMethodId(
+                                             "nativeCb_AntDecodedData", "(IIII[I)V");
+   if (NULL != g_sMethodId_nativeCb_AntDecodedData) {
+      nativeJAnt_RegisterOptionalNatives(g_sDecodingMethods, NELEM(g_sDecodingMethods));
+   }
+
+   // Without the callback the ring is unsupported, and messages go through nativeCb_AntRxMessage.
+   g_sMethodId_nativeCb_AntRxRingAvailable = nativeJAnt_GetOptionalMethodId(
+                                             "nativeCb_AntRxRingAvailable", "(I)V");
+   if (NULL != g_sMethodId_nativeCb_AntRxRingAvailable) {
+      nativeJAnt_RegisterOptionalNatives(g_sRxRingMethods, NELEM(g_sRxRingMethods));
+   }
+
    ANT_FUNC_END();
    return JNI_VERSION_1_4;
 }
@@ -0,0 +1,536 @@
+/*
+ * ANT Stack
+ *
+ * Copyright 2011 Dynastream Innovations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/******************************************************************************\
+*
+*   FILE NAME:      ant_cache.c
+*
+*   BRIEF:
+*      This file implements the channel state and chip information cache.
+*      It follows the commands sent and the responses and events received to
+*      keep the state and configuration of each channel, and keeps the
+*      version, capabilities and serial number the chip reported, so requests
+*      for them can be answered without a round trip to the chip.
+*
+*
+\******************************************************************************/
+
+#include <pthread.h>
+#include <string.h>
+
+#include "ant_types.h"
+#include "ant_native.h"
+#include "ant_message.h"
+#include "ant_cache.h"
+#include "ant_log.h"
+
+#undef LOG_TAG
+#define LOG_TAG "antradio_cache"
+
+typedef struct {
+   /* State is known, from a reset or a channel status sent by the chip */
+   ANT_BOOL bKnown;
+   ANT_U8 ucState;
+   /* Channel ID was set without wildcards, or on a master, so the chip reports it as set */
+   ANT_BOOL bChannelIdCacheable;
+   /* Configuration the chip accepted */
+   ANTChannelConfig stConfig;
+   /* Configuration sent, copied to stConfig when the chip accepts it */
+   ANTChannelConfig stPending;
+} ant_cache_channel_t;
+
+typedef struct {
+   /* ID of the message the chip answers the request with */
+   ANT_U8 ucMesgId;
+   /* Length of the cached message, 0 if not received yet */
+   ANT_U8 ucLen;
+   ANT_U8 aucData[ANT_NATIVE_MAX_MESSAGE_SIZE];
+} ant_cache_chip_info_t;
+
+static ant_cache_channel_t astCacheChannels[ANT_CACHE_MAX_CHANNELS];
+// Fixed for the chip, so kept across enables.
+static ant_cache_chip_info_t astCacheChipInfo[] = {
+   { .ucMesgId = MESG_VERSION_ID },
+   { .ucMesgId = MESG_CAPABILITIES_ID },
+   { .ucMesgId = MESG_GET_SERIAL_NUM_ID },
+};
+#define NUM_CACHE_CHIP_INFO (sizeof(astCacheChipInfo) / sizeof(astCacheChipInfo[0]))
+
+static ANT_U32 ulCacheRequestsAnswered = 0;
+
+static pthread_mutex_t stCacheLock = PTHREAD_MUTEX_INITIALIZER;
+
+static ant_cache_chip_info_t *ant_cache_find_chip_info(ANT_U8 ucMesgId)
+{
+   unsigned int i;
+
+   for (i = 0; i < NUM_CACHE_CHIP_INFO; i++) {
+      if (astCacheChipInfo[i].ucMesgId == ucMesgId) {
+         return &astCacheChipInfo[i];
+      }
+   }
+
+   return NULL;
+}
+
+static ant_cache_channel_t *ant_cache_find_channel(ANT_U8 ucChannel)
+{
+   if (ucChannel >= ANT_CACHE_MAX_CHANNELS) {
+      return NULL;
+   }
+
+   return &astCacheChannels[ucChannel];
+}
+
+// Called with stCacheLock held.
+static void ant_cache_clear_channel(ant_cache_channel_t *pstChannel, ANT_U8 ucState)
+{
+   ANT_U8 ucChannel = (ANT_U8)(pstChannel - astCacheChannels);
+
+   pstChannel->ucState = ucState;
+   pstChannel->bChannelIdCacheable = ANT_FALSE;
+   memset(&pstChannel->stConfig, 0, sizeof(pstChannel->stConfig));
+   pstChannel->stConfig.ucChannel = ucChannel;
+}
+
+// Called with stCacheLock held.
+static void ant_cache_set_all_channels(ANT_BOOL bKnown)
+{
+   int i;
+
+   for (i = 0; i < ANT_CACHE_MAX_CHANNELS; i++) {
+      astCacheChannels[i].bKnown = bKnown;
+      ant_cache_clear_channel(&astCacheChannels[i], ANT_CHANNEL_STATE_UNASSIGNED);
+   }
+}
+
+////////////////////////////////////////////////////////////////////
+//  ant_cache_answer_request
+//
+//  Builds the response to a request message from the cache, if the
+//  cache holds everything the chip would answer with.
+//  Called with stCacheLock held.
+//
+//  Parameters:
+//      ucChannel       channel of the request
+//      ucRequestedId   ID of the message requested
+//      pucResponse     buffer for the response
+//
+//  Returns:
+//      Length of the response written, 0 if the request can not be
+//      answered from the cache
+//
+//  Psuedocode:
+/*
+IF channel status requested AND channel state is known
+    BUILD status from state, network and channel type
+ELSE IF channel ID requested AND channel ID set AND channel ID is reported as set
+    BUILD channel ID
+ELSE IF chip information requested AND cached
+    COPY cached message
+ENDIF
+*/
+////////////////////////////////////////////////////////////////////
+static ANT_U8 ant_cache_answer_request(ANT_U8 ucChannel, ANT_U8 ucRequestedId, ANT_U8 *pucResponse)
+{
+   ant_cache_channel_t *pstChannel;
+   ant_cache_chip_info_t *pstChipInfo;
+   ANT_U8 ucResponseLen = 0;
+
+   switch (ucRequestedId) {
+      case MESG_CHANNEL_STATUS_ID:
+         pstChannel = ant_cache_find_channel(ucChannel);
+         if ((pstChannel == NULL) || !pstChannel->bKnown) {
+            break;
+         }
+
+         pucResponse[ANT_MSG_DATA_OFFSET + 0] = ucChannel;
+         pucResponse[ANT_MSG_DATA_OFFSET + 1] = pstChannel->ucState;
+         if (pstChannel->ucState != ANT_CHANNEL_STATE_UNASSIGNED) {
+            pucResponse[ANT_MSG_DATA_OFFSET + 1] |=
+                  (pstChannel->stConfig.ucChannelType & ANT_CHANNEL_STATUS_TYPE_MASK) |
+                  ((pstChannel->stConfig.ucNetwork & ANT_CHANNEL_STATUS_NETWORK_MASK) << ANT_CHANNEL_STATUS_NETWORK_SHIFT);
+         }
+         ucResponseLen = ANT_MSG_HEADER_SIZE + 2;
+         break;
+
+      case MESG_CHANNEL_ID_ID:
+         pstChannel = ant_cache_find_channel(ucChannel);
+         if ((pstChannel == NULL) || !pstChannel->bKnown ||
+               (pstChannel->ucState == ANT_CHANNEL_STATE_UNASSIGNED) || !pstChannel->bChannelIdCacheable) {
+            break;
+         }
+
+         pucResponse[ANT_MSG_DATA_OFFSET + 0] = ucChannel;
+         pucResponse[ANT_MSG_DATA_OFFSET + 1] = (ANT_U8)pstChannel->stConfig.usDeviceNumber;
+         pucResponse[ANT_MSG_DATA_OFFSET + 2] = (ANT_U8)(pstChannel->stConfig.usDeviceNumber >> 8);
+         pucResponse[ANT_MSG_DATA_OFFSET + 3] = pstChannel->stConfig.ucDeviceType;
+         pucResponse[ANT_MSG_DATA_OFFSET + 4] = pstChannel->stConfig.ucTransmissionType;
+         ucResponseLen = ANT_MSG_HEADER_SIZE + 5;
+         break;
+
+      default:
+         pstChipInfo = ant_cache_find_chip_info(ucRequestedId);
+         if ((pstChipInfo == NULL) || (pstChipInfo->ucLen == 0)) {
+            break;
+         }
+
+         memcpy(pucResponse, pstChipInfo->aucData, pstChipInfo->ucLen);
+         return pstChipInfo->ucLen;
+   }
+
+   if (ucResponseLen != 0) {
+      pucResponse[ANT_MSG_LENGTH_OFFSET] = ucResponseLen - ANT_MSG_HEADER_SIZE;
+      pucResponse[ANT_MSG_ID_OFFSET] = ucRequestedId;
+   }
+
+   return ucResponseLen;
+}
+
+////////////////////////////////////////////////////////////////////
+//  ant_cache_tx_message
+//
+//  Remembers the configuration a command sets, and answers requests
+//  the cache can answer.
+//
+//  Parameters:
+//      ucLen           length of the message
+//      pucMesg         the message about to be sent
+//      pucResponse     buffer for a response from the cache
+//
+//  Returns:
+//      Length of the response written, 0 if the message must be sent
+//
+//  Psuedocode:
+/*
+LOCK
+    IF reset
+        MARK all channel states unknown until the chip starts up
+    ELSE IF channel configuration
+        STORE configuration as pending for the channel
+    ELSE IF request
+        BUILD response from cache
+    ENDIF
+UNLOCK
+*/
+////////////////////////////////////////////////////////////////////
+ANT_U8 ant_cache_tx_message(ANT_U8 ucLen, ANT_U8 *pucMesg, ANT_U8 *pucResponse)
+{
+   ant_cache_channel_t *pstChannel;
+   ANT_U8 *pucData = pucMesg + ANT_MSG_DATA_OFFSET;
+   ANT_U8 ucResponseLen = 0;
+
+   if (ucLen <= ANT_MSG_DATA_OFFSET) {
+      return 0;
+   }
+
+   pthread_mutex_lock(&stCacheLock);
+
+   pstChannel = ant_cache_find_channel(pucData[0]);
+
+   switch (pucMesg[ANT_MSG_ID_OFFSET]) {
+      case MESG_RESET_ID:
+         ant_cache_set_all_channels(ANT_FALSE);
+         break;
+
+      case MESG_ASSIGN_CHANNEL_ID:
+         if ((pstChannel != NULL) && (ucLen >= ANT_MSG_HEADER_SIZE + 3)) {
+            pstChannel->stPending.ucChannelType = pucData[1];
+            pstChannel->stPending.ucNetwork = pucData[2];
+            pstChannel->stPending.ucExtendedAssignment = (ucLen >= ANT_MSG_HEADER_SIZE + 4) ? pucData[3] : 0;
+         }
+         break;
+
+      case MESG_CHANNEL_ID_ID:
+         if ((pstChannel != NULL) && (ucLen >= ANT_MSG_HEADER_SIZE + 5)) {
+            pstChannel->stPending.usDeviceNumber = (ANT_U16)(pucData[1] | (pucData[2] << 8));
+            pstChannel->stPending.ucDeviceType = pucData[3];
+            pstChannel->stPending.ucTransmissionType = pucData[4];
+         }
+         break;
+
+      case MESG_CHANNEL_MESG_PERIOD_ID:
+         if ((pstChannel != NULL) && (ucLen >= ANT_MSG_HEADER_SIZE + 3)) {
+            pstChannel->stPending.usPeriod = (ANT_U16)(pucData[1] | (pucData[2] << 8));
+         }
+         break;
+
+      case MESG_CHANNEL_RADIO_FREQ_ID:
+         if ((pstChannel != NULL) && (ucLen >= ANT_MSG_HEADER_SIZE + 2)) {
+            pstChannel->stPending.ucRfFrequency = pucData[1];
+         }
+         break;
+
+      case MESG_REQUEST_ID:
+         // Only plain requests, extended requests carry more than the channel and message ID.
+         if (ucLen == ANT_MSG_HEADER_SIZE + 2) {
+            ucResponseLen = ant_cache_answer_request(pucData[0], pucData[1], pucResponse);
+            if (ucResponseLen != 0) {
+               ulCacheRequestsAnswered++;
+            }
+         }
+         break;
+
+      default:
+         break;
+   }
+
+   if (ucResponseLen != 0) {
+      ANT_DEBUG_D("answered request for 0x%02X on channel %d from cache (%u total)",
+            pucData[1], pucData[0], ulCacheRequestsAnswered);
+   }
+
+   pthread_mutex_unlock(&stCacheLock);
+
+   return ucResponseLen;
+}
+
+////////////////////////////////////////////////////////////////////
+//  ant_cache_apply_response
+//
+//  Updates a channel for a command the chip accepted.
+//  Called with stCacheLock held.
+//
+//  Parameters:
+//      pstChannel      the channel the command was for
+//      ucMesgId        ID of the command
+//
+//  Returns:
+//      -
+//
+//  Psuedocode:
+/*
+IF unassign
+    CLEAR channel
+ELSE IF assign
+    CLEAR channel configuration, the chip sets defaults on assign
+    STORE pending assignment, channel is assigned
+ELSE IF channel ID, period or RF frequency
+    STORE pending value
+ELSE IF open
+    Masters are tracking once open, slaves start searching
+ENDIF
+*/
+////////////////////////////////////////////////////////////////////
+static void ant_cache_apply_response(ant_cache_channel_t *pstChannel, ANT_U8 ucMesgId)
+{
+   ANT_BOOL bWildcard;
+
+   switch (ucMesgId) {
+      case MESG_UNASSIGN_CHANNEL_ID:
+         ant_cache_clear_channel(pstChannel, ANT_CHANNEL_STATE_UNASSIGNED);
+         break;
+
+      case MESG_ASSIGN_CHANNEL_ID:
+         ant_cache_clear_channel(pstChannel, ANT_CHANNEL_STATE_ASSIGNED);
+         pstChannel->stConfig.ucChannelType = pstChannel->stPending.ucChannelType;
+         pstChannel->stConfig.ucNetwork = pstChannel->stPending.ucNetwork;
+         pstChannel->stConfig.ucExtendedAssignment = pstChannel->stPending.ucExtendedAssignment;
+         break;
+
+      case MESG_CHANNEL_ID_ID:
+         pstChannel->stConfig.usDeviceNumber = pstChannel->stPending.usDeviceNumber;
+         pstChannel->stConfig.ucDeviceType = pstChannel->stPending.ucDeviceType;
+         pstChannel->stConfig.ucTransmissionType = pstChannel->stPending.ucTransmissionType;
+         // A slave reports the ID of the device it found in place of wildcards.
+         bWildcard = (pstChannel->stConfig.usDeviceNumber == 0) ||
+               (pstChannel->stConfig.ucDeviceType == 0) ||
+               (pstChannel->stConfig.ucTransmissionType == 0);
+         pstChannel->bChannelIdCacheable = (pstChannel->stConfig.ucChannelType & CHANNEL_TYPE_MASTER) || !bWildcard;
+         break;
+
+      case MESG_CHANNEL_MESG_PERIOD_ID:
+         pstChannel->stConfig.usPeriod = pstChannel->stPending.usPeriod;
+         break;
+
+      case MESG_CHANNEL_RADIO_FREQ_ID:
+         pstChannel->stConfig.ucRfFrequency = pstChannel->stPending.ucRfFrequency;
+         break;
+
+      case MESG_OPEN_CHANNEL_ID:
+         pstChannel->ucState = (pstChannel->stConfig.ucChannelType & CHANNEL_TYPE_MASTER) ?
+               ANT_CHANNEL_STATE_TRACKING : ANT_CHANNEL_STATE_SEARCHING;
+         break;
+
+      default:
+         break;
+   }
+}
+
+////////////////////////////////////////////////////////////////////
+//  ant_cache_rx_message
+//
+//  Updates the cache from a received message.
+//
+//  Parameters:
+//      ucLen           length of the message
+//      pucData         the message
+//
+//  Returns:
+//      -
+//
+//  Psuedocode:
+/*
+LOCK
+    IF startup message
+        ALL channels are known to be unassigned
+    ELSE IF channel response with no error
+        APPLY accepted command to channel
+    ELSE IF channel closed event
+        Channel is assigned
+    ELSE IF go to search event
+        Channel is searching
+    ELSE IF data on a searching channel
+        Channel is tracking
+    ELSE IF channel status or channel ID
+        STORE what the chip reported for the channel
+    ELSE IF chip information
+        STORE message
+    ENDIF
+UNLOCK
+*/
+////////////////////////////////////////////////////////////////////
+void ant_cache_rx_message(ANT_U8 ucLen, ANT_U8 *pucData)
+{
+   ant_cache_channel_t *pstChannel;
+   ant_cache_chip_info_t *pstChipInfo;
+   ANT_U8 *pucMesgData = pucData + ANT_MSG_DATA_OFFSET;
+   ANT_U8 ucMesgId;
+   ANT_U8 ucStatus;
+
+   if (ucLen <= ANT_MSG_DATA_OFFSET) {
+      return;
+   }
+
+   ucMesgId = pucData[ANT_MSG_ID_OFFSET];
+
+   pthread_mutex_lock(&stCacheLock);
+
+   switch (ucMesgId) {
+      case MESG_STARTUP_MESG_ID:
+         ant_cache_set_all_channels(ANT_TRUE);
+         break;
+
+      case MESG_RESPONSE_EVENT_ID:
+         pstChannel = ant_cache_find_channel(pucData[ANT_RESPONSE_CHANNEL_OFFSET]);
+         if ((pstChannel == NULL) || (ucLen < ANT_RESPONSE_SIZE)) {
+            break;
+         }
+
+         if (pucData[ANT_RESPONSE_MESG_ID_OFFSET] != MESG_EVENT_ID) {
+            if (pucData[ANT_RESPONSE_CODE_OFFSET] == RESPONSE_NO_ERROR) {
+               ant_cache_apply_response(pstChannel, pucData[ANT_RESPONSE_MESG_ID_OFFSET]);
+            }
+         } else if (pucData[ANT_RESPONSE_CODE_OFFSET] == EVENT_CHANNEL_CLOSED) {
+            pstChannel->ucState = ANT_CHANNEL_STATE_ASSIGNED;
+         } else if (pucData[ANT_RESPONSE_CODE_OFFSET] == EVENT_RX_FAIL_GO_TO_SEARCH) {
+            pstChannel->ucState = ANT_CHANNEL_STATE_SEARCHING;
+         }
+         break;
+
+      case MESG_BROADCAST_DATA_ID:
+      case MESG_ACKNOWLEDGED_DATA_ID:
+      case MESG_BURST_DATA_ID:
+      case MESG_EXT_BROADCAST_DATA_ID:
+      case MESG_EXT_ACKNOWLEDGED_DATA_ID:
+      case MESG_EXT_BURST_DATA_ID:
+      case MESG_ADV_BURST_DATA_ID:
+         pstChannel = ant_cache_find_channel(pucMesgData[0] & ANT_CHANNEL_NUMBER_MASK);
+         if ((pstChannel != NULL) && (pstChannel->ucState == ANT_CHANNEL_STATE_SEARCHING)) {
+            pstChannel->ucState = ANT_CHANNEL_STATE_TRACKING;
+         }
+         break;
+
+      case MESG_CHANNEL_STATUS_ID:
+         pstChannel = ant_cache_find_channel(pucMesgData[0]);
+         if ((pstChannel == NULL) || (ucLen < ANT_MSG_HEADER_SIZE + 2)) {
+            break;
+         }
+
+         ucStatus = pucMesgData[1];
+         if ((ucStatus & ANT_CHANNEL_STATUS_STATE_MASK) == ANT_CHANNEL_STATE_UNASSIGNED) {
+            ant_cache_clear_channel(pstChannel, ANT_CHANNEL_STATE_UNASSIGNED);
+         } else {
+            pstChannel->ucState = ucStatus & ANT_CHANNEL_STATUS_STATE_MASK;
+            pstChannel->stConfig.ucChannelType = ucStatus & ANT_CHANNEL_STATUS_TYPE_MASK;
+            // The status only has the low bits of the network number.
+            if ((pstChannel->stConfig.ucNetwork & ANT_CHANNEL_STATUS_NETWORK_MASK) !=
+                  ((ucStatus >> ANT_CHANNEL_STATUS_NETWORK_SHIFT) & ANT_CHANNEL_STATUS_NETWORK_MASK)) {
+               pstChannel->stConfig.ucNetwork = (ucStatus >> ANT_CHANNEL_STATUS_NETWORK_SHIFT) &
+                     ANT_CHANNEL_STATUS_NETWORK_MASK;
+            }
+         }
+         pstChannel->bKnown = ANT_TRUE;
+         break;
+
+      case MESG_CHANNEL_ID_ID:
+         pstChannel = ant_cache_find_channel(pucMesgData[0]);
+         if ((pstChannel == NULL) || (ucLen < ANT_MSG_HEADER_SIZE + 5)) {
+            break;
+         }
+
+         pstChannel->stConfig.usDeviceNumber = (ANT_U16)(pucMesgData[1] | (pucMesgData[2] << 8));
+         pstChannel->stConfig.ucDeviceType = pucMesgData[3];
+         pstChannel->stConfig.ucTransmissionType = pucMesgData[4];
+         break;
+
+      default:
+         pstChipInfo = ant_cache_find_chip_info(ucMesgId);
+         if (pstChipInfo != NULL) {
+            memcpy(pstChipInfo->aucData, pucData, ucLen);
+            pstChipInfo->ucLen = ucLen;
+         }
+         break;
+   }
+
+   pthread_mutex_unlock(&stCacheLock);
+}
+
+void ant_cache_invalidate(void)
+{
+   pthread_mutex_lock(&stCacheLock);
+   ant_cache_set_all_channels(ANT_FALSE);
+   pthread_mutex_unlock(&stCacheLock);
+}
+
+ANTStatus ant_get_channel_info(ANT_U8 ucChannel, ANTChannelInfo *pstInfo)
+{
+   ant_cache_channel_t *pstChannel;
+   ANTStatus status = ANT_STATUS_NO_VALUE_AVAILABLE;
+   ANT_FUNC_START();
+
+   pstChannel = ant_cache_find_channel(ucChannel);
+   if ((pstChannel == NULL) || (pstInfo == NULL)) {
+      status = ANT_STATUS_INVALID_PARM;
+      goto out;
+   }
+
+   pthread_mutex_lock(&stCacheLock);
+
+   if (pstChannel->bKnown) {
+      pstInfo->ucState = pstChannel->ucState;
+      pstInfo->stConfig = pstChannel->stConfig;
+      pstInfo->stConfig.bOpen = (pstChannel->ucState >= ANT_CHANNEL_STATE_SEARCHING);
+      status = ANT_STATUS_SUCCESS;
+   }
+
+   pthread_mutex_unlock(&stCacheLock);
+
+out:
+   ANT_FUNC_END();
+   return status;
+}
@@ -0,0 +1,524 @@
+/*
+ * ANT Stack
+ *
+ * Copyright 2011 Dynastream Innovations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/******************************************************************************\
+*
+*   FILE NAME:      ant_command.c
+*
+*   BRIEF:
+*      This file implements sending ANT commands and matching the responses
+*      the chip sends to them in the rx path, so callers can wait for the
+*      result of a command natively.
+*
+*
+\******************************************************************************/
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+#include "ant_types.h"
+#include "ant_native.h"
+#include "ant_message.h"
+#include "ant_command.h"
+#include "ant_thread.h"
+#include "ant_log.h"
+
+#undef LOG_TAG
+#define LOG_TAG "antradio_command"
+
+typedef struct {
+   /* Slot is holding a command waiting for a response */
+   ANT_BOOL bInUse;
+   /* Response received, or timed out */
+   ANT_BOOL bDone;
+   /* Order the command was sent in, the oldest matching command gets a response */
+   ANT_U32 ulOrder;
+   /* ID of the command message */
+   ANT_U8 ucCommandId;
+   /* ID of the message, other than a channel response, that answers the command */
+   ANT_U8 ucResponseId;
+   /* Channel responses must be for this channel (first data byte of the command) */
+   ANT_BOOL bMatchChannel;
+   ANT_U8 ucChannel;
+   /* When to give up waiting for the response */
+   struct timespec stDeadline;
+   /* Result for the waiter */
+   ANTStatus status;
+   ANTCommandResponse stResponse;
+   /* Async completion, NULL for a synchronous waiter */
+   ANTNativeANTCommandCb fnCallback;
+   void *pvContext;
+} ant_command_waiter_t;
+
+static ant_command_waiter_t astCommandWaiters[ANT_COMMAND_MAX_PENDING];
+static ANT_U32 ulCommandOrder = 0;
+// Read without the lock by the rx path, to skip matching when nothing is waiting.
+static ANT_U32 ulCommandsPending = 0;
+static ANT_BOOL bCommandTimerRunning = ANT_FALSE;
+
+static pthread_mutex_t stCommandLock = PTHREAD_MUTEX_INITIALIZER;
+// Signalled when any synchronous command completes.
+static pthread_cond_t stCommandDoneCond = PTHREAD_COND_INITIALIZER;
+// Signalled when an async command is added or answered, so the timer thread rechecks it.
+static pthread_cond_t stCommandTimerCond = PTHREAD_COND_INITIALIZER;
+
+static ANT_BOOL ant_command_deadline_passed(const struct timespec *pstDeadline, const struct timespec *pstNow)
+{
+   return (pstNow->tv_sec > pstDeadline->tv_sec) ||
+         ((pstNow->tv_sec == pstDeadline->tv_sec) && (pstNow->tv_nsec >= pstDeadline->tv_nsec));
+}
+
+static void ant_command_free(ant_command_waiter_t *pstWaiter)
+{
+   pstWaiter->bInUse = ANT_FALSE;
+   __atomic_sub_fetch(&ulCommandsPending, 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Must be called with stCommandLock held. Sets up a slot for the command and
+ * works out what message will answer it.
+ */
+static ant_command_waiter_t *ant_command_add(ANT_U8 ucLen, ANT_U8 *pucMesg, ANT_U32 ulTimeoutMs,
+      ANTNativeANTCommandCb fnCallback, void *pvContext)
+{
+   int i;
+   ant_command_waiter_t *pstWaiter = NULL;
+
+   for (i = 0; i < ANT_COMMAND_MAX_PENDING; i++) {
+      if (!astCommandWaiters[i].bInUse) {
+         pstWaiter = &astCommandWaiters[i];
+         break;
+      }
+   }
+
+   if (pstWaiter == NULL) {
+      return NULL;
+   }
+
+   memset(pstWaiter, 0, sizeof(*pstWaiter));
+   pstWaiter->bInUse = ANT_TRUE;
+   pstWaiter->ulOrder = ulCommandOrder++;
+   pstWaiter->ucCommandId = pucMesg[ANT_MSG_ID_OFFSET];
+   pstWaiter->ucResponseId = MESG_RESPONSE_EVENT_ID;
+   pstWaiter->status = ANT_STATUS_HARDWARE_ERR;
+   pstWaiter->fnCallback = fnCallback;
+   pstWaiter->pvContext = pvContext;
+
+   if (pstWaiter->ucCommandId == MESG_RESET_ID) {
+      pstWaiter->ucResponseId = MESG_STARTUP_MESG_ID;
+   } else if (pstWaiter->ucCommandId == MESG_REQUEST_ID) {
+      // Answered by the requested message, or a channel response if it can't be
+      if (ucLen > ANT_MSG_DATA_OFFSET + 1) {
+         pstWaiter->ucResponseId = pucMesg[ANT_MSG_DATA_OFFSET + 1];
+      }
+   } else if (ucLen > ANT_MSG_DATA_OFFSET) {
+      pstWaiter->bMatchChannel = ANT_TRUE;
+      pstWaiter->ucChannel = pucMesg[ANT_MSG_DATA_OFFSET];
+   }
+
+   clock_gettime(CLOCK_REALTIME, &pstWaiter->stDeadline);
+   pstWaiter->stDeadline.tv_sec += ulTimeoutMs / 1000;
+   pstWaiter->stDeadline.tv_nsec += (ulTimeoutMs % 1000) * 1000000L;
+   if (pstWaiter->stDeadline.tv_nsec >= 1000000000L) {
+      pstWaiter->stDeadline.tv_sec++;
+      pstWaiter->stDeadline.tv_nsec -= 1000000000L;
+   }
+
+   __atomic_add_fetch(&ulCommandsPending, 1, __ATOMIC_RELEASE);
+
+   return pstWaiter;
+}
+
+/*
+ * Must be called with stCommandLock held. Waits for a synchronous command to
+ * complete like pthread_cond_timedwait(). In threadless mode the transport's rx
+ * loop is run on this thread instead, if it is the one running it.
+ */
+static int ant_command_wait(ant_command_waiter_t *pstWaiter)
+{
+   struct timespec stNow;
+   long lRemainingMs;
+   ANTStatus status;
+
+   clock_gettime(CLOCK_REALTIME, &stNow);
+   if (ant_command_deadline_passed(&pstWaiter->stDeadline, &stNow)) {
+      return ETIMEDOUT;
+   }
+   lRemainingMs = (pstWaiter->stDeadline.tv_sec - stNow.tv_sec) * 1000 +
+         (pstWaiter->stDeadline.tv_nsec - stNow.tv_nsec) / 1000000L + 1;
+
+   pthread_mutex_unlock(&stCommandLock);
+   status = ant_process_events((int)lRemainingMs);
+   pthread_mutex_lock(&stCommandLock);
+
+   // Not threadless, called from an rx callback, or from a thread other than the one running the
+   // rx loop, which reads the response.
+   if ((status != ANT_STATUS_SUCCESS) && !pstWaiter->bDone) {
+      return pthread_cond_timedwait(&stCommandDoneCond, &stCommandLock, &pstWaiter->stDeadline);
+   }
+   return 0;
+}
+
+/*
+ * This thread runs while there are async commands waiting. It calls their
+ * callbacks with the response once the rx path has matched one, or with a
+ * timeout status when their deadline passes. Keeping the callbacks off the rx
+ * thread lets them send and wait like any other caller.
+ */
+static void *fnCommandTimerThread(void *unused)
+{
+   int i;
+   struct timespec stNow;
+   struct timespec stNext;
+   ANT_BOOL bAnyAsync;
+   ANT_BOOL bDone;
+   ANTNativeANTCommandCb fnCallback;
+   ANTCommandResponse stResponse;
+   ANTStatus status;
+   void *pvContext;
+   (void)unused;
+
+   pthread_mutex_lock(&stCommandLock);
+
+   for (;;) {
+      clock_gettime(CLOCK_REALTIME, &stNow);
+      bAnyAsync = ANT_FALSE;
+
+      for (i = 0; i < ANT_COMMAND_MAX_PENDING; i++) {
+         ant_command_waiter_t *pstWaiter = &astCommandWaiters[i];
+
+         if (!pstWaiter->bInUse || (pstWaiter->fnCallback == NULL)) {
+            continue;
+         }
+
+         if (pstWaiter->bDone || ant_command_deadline_passed(&pstWaiter->stDeadline, &stNow)) {
+            fnCallback = pstWaiter->fnCallback;
+            pvContext = pstWaiter->pvContext;
+            status = pstWaiter->status;
+            bDone = pstWaiter->bDone;
+            if (bDone) {
+               stResponse = pstWaiter->stResponse;
+            } else {
+               ANT_DEBUG_W("no response to command %#x in time", pstWaiter->ucCommandId);
+            }
+            ant_command_free(pstWaiter);
+
+            pthread_mutex_unlock(&stCommandLock);
+            fnCallback(status, bDone ? &stResponse : NULL, pvContext);
+            pthread_mutex_lock(&stCommandLock);
+
+            // The table may have changed while unlocked, start over.
+            i = -1;
+            clock_gettime(CLOCK_REALTIME, &stNow);
+            bAnyAsync = ANT_FALSE;
+            continue;
+         }
+
+         if (!bAnyAsync || ant_command_deadline_passed(&pstWaiter->stDeadline, &stNext)) {
+            stNext = pstWaiter->stDeadline;
+         }
+         bAnyAsync = ANT_TRUE;
+      }
+
+      if (!bAnyAsync) {
+         break;
+      }
+
+      pthread_cond_timedwait(&stCommandTimerCond, &stCommandLock, &stNext);
+   }
+
+   bCommandTimerRunning = ANT_FALSE;
+   pthread_mutex_unlock(&stCommandLock);
+
+   return NULL;
+}
+
+////////////////////////////////////////////////////////////////////
+//  ant_tx_command
+//
+//  Sends an ANT command and waits for the chip's response to it.
+//
+//  Parameters:
+//      ucLen           the length of the message
+//      pucMesg         pointer to the message data
+//      ulTimeoutMs     how long to wait for the response
+//      pstResponse     filled in with the response, may be NULL
+//
+//  Returns:
+//      Success:
+//          ANT_STATUS_SUCCESS
+//      Failure:
+//          ANT_STATUS_FAILED if the chip rejected the command
+//          ANT_STATUS_HARDWARE_ERR if there was no response in time
+//          ANT_STATUS_TOO_MANY_PENDING_CMDS if too many commands are waiting
+//          ant_tx_message() result if the command could not be sent
+//
+//  Psuedocode:
+/*
+LOCK commands
+    ADD waiter for the command's response
+UNLOCK
+ant tx message
+LOCK commands
+    IF tx failed
+        RESULT = tx result
+    ELSE
+        WAIT until waiter is done, UNTIL deadline
+        RESULT = waiter result
+    ENDIF
+    REMOVE waiter
+UNLOCK
+*/
+////////////////////////////////////////////////////////////////////
+ANTStatus ant_tx_command(ANT_U8 ucLen, ANT_U8 *pucMesg, ANT_U32 ulTimeoutMs, ANTCommandResponse *pstResponse)
+{
+   ant_command_waiter_t *pstWaiter;
+   int iCondWaitResult;
+   ANTStatus status = ANT_STATUS_INVALID_PARM;
+   ANT_FUNC_START();
+
+   if ((pucMesg == NULL) || (ucLen < ANT_MSG_HEADER_SIZE)) {
+      goto out;
+   }
+
+   // Wait for the response before sending, so it can't be missed.
+   pthread_mutex_lock(&stCommandLock);
+   pstWaiter = ant_command_add(ucLen, pucMesg, ulTimeoutMs, NULL, NULL);
+   pthread_mutex_unlock(&stCommandLock);
+
+   if (pstWaiter == NULL) {
+      ANT_ERROR("too many commands waiting for a response");
+      status = ANT_STATUS_TOO_MANY_PENDING_CMDS;
+      goto out;
+   }
+
+   status = ant_tx_message(ucLen, pucMesg);
+
+   pthread_mutex_lock(&stCommandLock);
+
+   if (status == ANT_STATUS_SUCCESS) {
+      while (!pstWaiter->bDone) {
+         iCondWaitResult = ant_command_wait(pstWaiter);
+         if (iCondWaitResult) {
+            if (iCondWaitResult != ETIMEDOUT) {
+               ANT_ERROR("failed to wait for command response: %s", strerror(iCondWaitResult));
+            } else {
+               ANT_DEBUG_W("no response to command %#x in time", pstWaiter->ucCommandId);
+            }
+            break;
+         }
+      }
+
+      status = pstWaiter->status;
+      if ((pstResponse != NULL) && pstWaiter->bDone) {
+         *pstResponse = pstWaiter->stResponse;
+      }
+   }
+
+   ant_command_free(pstWaiter);
+
+   pthread_mutex_unlock(&stCommandLock);
+
+out:
+   ANT_FUNC_END();
+   return status;
+}
+
+////////////////////////////////////////////////////////////////////
+//  ant_tx_command_async
+//
+//  Sends an ANT command, the result is given to the callback.
+//
+//  Parameters:
+//      ucLen           the length of the message
+//      pucMesg         pointer to the message data
+//      ulTimeoutMs     how long to wait for the response
+//      fnCallback      called with the result
+//      pvContext       passed back to the callback
+//
+//  Returns:
+//      Success:
+//          ANT_STATUS_SUCCESS, callback will be called
+//      Failure:
+//          ANT_STATUS_TOO_MANY_PENDING_CMDS if too many commands are waiting
+//          ant_tx_message() result if the command could not be sent
+//          callback will not be called
+//
+//  Psuedocode:
+/*
+LOCK commands
+    ADD waiter for the command's response, with callback
+    START timeout thread if not running, or wake it for the new deadline
+UNLOCK
+ant tx message
+IF tx failed
+    LOCK commands
+        IF waiter not yet completed
+            REMOVE waiter
+        ENDIF
+    UNLOCK
+ENDIF
+RESULT = tx result
+*/
+////////////////////////////////////////////////////////////////////
+ANTStatus ant_tx_command_async(ANT_U8 ucLen, ANT_U8 *pucMesg, ANT_U32 ulTimeoutMs,
+      ANTNativeANTCommandCb fnCallback, void *pvContext)
+{
+   ant_command_waiter_t *pstWaiter;
+   ANT_U32 ulOrder;
+   pthread_t stTimerThread;
+   int iResult;
+   ANTStatus status = ANT_STATUS_INVALID_PARM;
+   ANT_FUNC_START();
+
+   if ((pucMesg == NULL) || (ucLen < ANT_MSG_HEADER_SIZE) || (fnCallback == NULL)) {
+      goto out;
+   }
+
+   pthread_mutex_lock(&stCommandLock);
+
+   pstWaiter = ant_command_add(ucLen, pucMesg, ulTimeoutMs, fnCallback, pvContext);
+   if (pstWaiter == NULL) {
+      pthread_mutex_unlock(&stCommandLock);
+      ANT_ERROR("too many commands waiting for a response");
+      status = ANT_STATUS_TOO_MANY_PENDING_CMDS;
+      goto out;
+   }
+   ulOrder = pstWaiter->ulOrder;
+
+   if (!bCommandTimerRunning) {
+      iResult = ant_thread_create(&stTimerThread, "cmd", fnCommandTimerThread, NULL);
+      if (iResult) {
+         ANT_ERROR("failed to start command timeout thread: %s", strerror(iResult));
+         ant_command_free(pstWaiter);
+         pthread_mutex_unlock(&stCommandLock);
+         status = ANT_STATUS_FAILED;
+         goto out;
+      }
+      pthread_detach(stTimerThread);
+      bCommandTimerRunning = ANT_TRUE;
+   } else {
+      pthread_cond_signal(&stCommandTimerCond);
+   }
+
+   pthread_mutex_unlock(&stCommandLock);
+
+   status = ant_tx_message(ucLen, pucMesg);
+
+   if (status != ANT_STATUS_SUCCESS) {
+      pthread_mutex_lock(&stCommandLock);
+      // Only remove it if it wasn't completed (and maybe reused) in the meantime.
+      if (pstWaiter->bInUse && (pstWaiter->ulOrder == ulOrder)) {
+         ant_command_free(pstWaiter);
+      }
+      pthread_mutex_unlock(&stCommandLock);
+   }
+
+out:
+   ANT_FUNC_END();
+   return status;
+}
+
+////////////////////////////////////////////////////////////////////
+//  ant_command_rx_message
+//
+//  Completes the oldest command waiting for this message as its response.
+//
+//  Parameters:
+//      ucLen           length of the message
+//      pucData         the message
+//
+//  Returns:
+//      -
+//
+//  Psuedocode:
+/*
+IF no commands waiting
+    RETURN
+ENDIF
+LOCK commands
+    FIND oldest waiter this message answers
+    IF found
+        FILL IN response and result
+        IF async
+            WAKE timer thread to call callback
+        ELSE
+            WAKE synchronous waiters
+        ENDIF
+    ENDIF
+UNLOCK
+*/
+////////////////////////////////////////////////////////////////////
+void ant_command_rx_message(ANT_U8 ucLen, ANT_U8 *pucData)
+{
+   int i;
+   ANT_U8 ucId;
+   ANT_BOOL bIsResponse;
+   ant_command_waiter_t *pstMatch = NULL;
+
+   if ((__atomic_load_n(&ulCommandsPending, __ATOMIC_ACQUIRE) == 0) || (ucLen < ANT_MSG_HEADER_SIZE)) {
+      return;
+   }
+
+   ucId = pucData[ANT_MSG_ID_OFFSET];
+   bIsResponse = (ucId == MESG_RESPONSE_EVENT_ID) && (ucLen >= ANT_RESPONSE_SIZE) &&
+         (pucData[ANT_RESPONSE_MESG_ID_OFFSET] != MESG_EVENT_ID);
+
+   pthread_mutex_lock(&stCommandLock);
+
+   for (i = 0; i < ANT_COMMAND_MAX_PENDING; i++) {
+      ant_command_waiter_t *pstWaiter = &astCommandWaiters[i];
+
+      if (!pstWaiter->bInUse || pstWaiter->bDone) {
+         continue;
+      }
+
+      if (bIsResponse) {
+         if ((pucData[ANT_RESPONSE_MESG_ID_OFFSET] != pstWaiter->ucCommandId) ||
+               (pstWaiter->bMatchChannel && (pucData[ANT_RESPONSE_CHANNEL_OFFSET] != pstWaiter->ucChannel))) {
+            continue;
+         }
+      } else if ((ucId == MESG_RESPONSE_EVENT_ID) || (ucId != pstWaiter->ucResponseId)) {
+         continue;
+      }
+
+      if ((pstMatch == NULL) || ((ANT_S32)(pstWaiter->ulOrder - pstMatch->ulOrder) < 0)) {
+         pstMatch = pstWaiter;
+      }
+   }
+
+   if (pstMatch == NULL) {
+      pthread_mutex_unlock(&stCommandLock);
+      return;
+   }
+
+   pstMatch->stResponse.ucLen = ucLen;
+   memcpy(pstMatch->stResponse.aucData, pucData, ucLen);
+   pstMatch->stResponse.ucCode = bIsResponse ? pucData[ANT_RESPONSE_CODE_OFFSET] : RESPONSE_NO_ERROR;
+   pstMatch->status = (pstMatch->stResponse.ucCode == RESPONSE_NO_ERROR) ? ANT_STATUS_SUCCESS : ANT_STATUS_FAILED;
+   pstMatch->bDone = ANT_TRUE;
+
+   if (pstMatch->fnCallback != NULL) {
+      // The timer thread calls it, so the rx thread never waits on what the callback does.
+      pthread_cond_signal(&stCommandTimerCond);
+   } else {
+      pthread_cond_broadcast(&stCommandDoneCond);
+   }
+   pthread_mutex_unlock(&stCommandLock);
+}
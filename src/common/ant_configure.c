@@ -0,0 +1,329 @@
+/*
+ * ANT Stack
+ *
+ * Copyright 2011 Dynastream Innovations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/******************************************************************************\
+*
+*   FILE NAME:      ant_configure.c
+*
+*   BRIEF:
+*      This file implements setting up a whole ANT channel natively, sending
+*      the configuration commands back to back and checking every response.
+*
+*
+\******************************************************************************/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ant_types.h"
+#include "ant_native.h"
+#include "ant_message.h"
+#include "ant_thread.h"
+#include "ant_log.h"
+
+#undef LOG_TAG
+#define LOG_TAG "antradio_configure"
+
+// How long to wait for the response to each configuration command.
+#define ANT_CONFIGURE_TIMEOUT_MS             1000
+
+// Assign, channel ID, period and RF frequency.
+#define ANT_CONFIGURE_NUM_STEPS              4
+#define ANT_CONFIGURE_MAX_MESG_SIZE          8
+
+typedef struct {
+   pthread_mutex_t stLock;
+   pthread_cond_t stCond;
+   /* Commands sent that have not had a result yet */
+   int iOutstanding;
+   /* First failure */
+   ANTStatus status;
+   ANT_U8 ucFailedMesgId;
+   /* The assign command succeeded, so the channel must be unassigned on failure */
+   ANT_BOOL bAssigned;
+} ant_configure_batch_t;
+
+typedef struct {
+   ant_configure_batch_t *pstBatch;
+   ANT_U8 ucMesgId;
+} ant_configure_step_t;
+
+typedef struct {
+   ANTChannelConfig stConfig;
+   ANTNativeANTConfigureCb fnCallback;
+   void *pvContext;
+} ant_configure_job_t;
+
+/*
+ * Must be called with the batch lock held. Keeps the first failure.
+ */
+static void ant_configure_set_result(ant_configure_batch_t *pstBatch, ANTStatus status, ANT_U8 ucMesgId)
+{
+   if ((status != ANT_STATUS_SUCCESS) && (pstBatch->status == ANT_STATUS_SUCCESS)) {
+      pstBatch->status = status;
+      pstBatch->ucFailedMesgId = ucMesgId;
+   }
+}
+
+static void ant_configure_step_done(ANTStatus status, ANTCommandResponse *pstResponse, void *pvContext)
+{
+   ant_configure_step_t *pstStep = (ant_configure_step_t *)pvContext;
+   ant_configure_batch_t *pstBatch = pstStep->pstBatch;
+
+   pthread_mutex_lock(&pstBatch->stLock);
+
+   if (status != ANT_STATUS_SUCCESS) {
+      ANT_ERROR("channel configuration command %#x failed: %d, code %#x", pstStep->ucMesgId, status,
+            pstResponse ? pstResponse->ucCode : 0);
+   } else if (pstStep->ucMesgId == MESG_ASSIGN_CHANNEL_ID) {
+      pstBatch->bAssigned = ANT_TRUE;
+   }
+   ant_configure_set_result(pstBatch, status, pstStep->ucMesgId);
+
+   pstBatch->iOutstanding--;
+   // Signal with the lock held, the batch may be gone once it is released.
+   pthread_cond_signal(&pstBatch->stCond);
+   pthread_mutex_unlock(&pstBatch->stLock);
+}
+
+////////////////////////////////////////////////////////////////////
+//  ant_configure_run
+//
+//  Configures a channel, waiting for the result.
+//
+//  Parameters:
+//      pstConfig       the channel configuration
+//      pucFailedMesgId set to the ID of the message that failed, 0 on success
+//
+//  Returns:
+//      Success:
+//          ANT_STATUS_SUCCESS
+//      Failure:
+//          result of the command that failed
+//
+//  Psuedocode:
+/*
+FOR assign, channel ID, period, RF frequency
+    SEND command without waiting for response
+    IF send failed
+        STOP sending
+    ENDIF
+ENDFOR
+WAIT for results of all sent commands
+IF all succeeded AND open requested
+    SEND open and wait for response
+ENDIF
+IF any failed AND assign succeeded
+    SEND unassign and wait for response
+ENDIF
+RESULT = first failure, or SUCCESS
+*/
+////////////////////////////////////////////////////////////////////
+static ANTStatus ant_configure_run(const ANTChannelConfig *pstConfig, ANT_U8 *pucFailedMesgId)
+{
+   ANT_U8 aaucSteps[ANT_CONFIGURE_NUM_STEPS][ANT_CONFIGURE_MAX_MESG_SIZE];
+   ant_configure_step_t astSteps[ANT_CONFIGURE_NUM_STEPS];
+   ant_configure_batch_t stBatch;
+   ANT_U8 aucMesg[ANT_CONFIGURE_MAX_MESG_SIZE];
+   ANT_U8 ucChannel = pstConfig->ucChannel;
+   ANTStatus status;
+   int i;
+
+   // Assign
+   aaucSteps[0][0] = pstConfig->ucExtendedAssignment ? 4 : 3;
+   aaucSteps[0][1] = MESG_ASSIGN_CHANNEL_ID;
+   aaucSteps[0][2] = ucChannel;
+   aaucSteps[0][3] = pstConfig->ucChannelType;
+   aaucSteps[0][4] = pstConfig->ucNetwork;
+   aaucSteps[0][5] = pstConfig->ucExtendedAssignment;
+
+   // Channel ID
+   aaucSteps[1][0] = 5;
+   aaucSteps[1][1] = MESG_CHANNEL_ID_ID;
+   aaucSteps[1][2] = ucChannel;
+   aaucSteps[1][3] = (ANT_U8)pstConfig->usDeviceNumber;
+   aaucSteps[1][4] = (ANT_U8)(pstConfig->usDeviceNumber >> 8);
+   aaucSteps[1][5] = pstConfig->ucDeviceType;
+   aaucSteps[1][6] = pstConfig->ucTransmissionType;
+
+   // Period
+   aaucSteps[2][0] = 3;
+   aaucSteps[2][1] = MESG_CHANNEL_MESG_PERIOD_ID;
+   aaucSteps[2][2] = ucChannel;
+   aaucSteps[2][3] = (ANT_U8)pstConfig->usPeriod;
+   aaucSteps[2][4] = (ANT_U8)(pstConfig->usPeriod >> 8);
+
+   // RF frequency
+   aaucSteps[3][0] = 2;
+   aaucSteps[3][1] = MESG_CHANNEL_RADIO_FREQ_ID;
+   aaucSteps[3][2] = ucChannel;
+   aaucSteps[3][3] = pstConfig->ucRfFrequency;
+
+   pthread_mutex_init(&stBatch.stLock, NULL);
+   pthread_cond_init(&stBatch.stCond, NULL);
+   stBatch.iOutstanding = 0;
+   stBatch.status = ANT_STATUS_SUCCESS;
+   stBatch.ucFailedMesgId = 0;
+   stBatch.bAssigned = ANT_FALSE;
+
+   // The chip handles commands in order, so the rest can follow the assign
+   // without waiting for its response.
+   for (i = 0; i < ANT_CONFIGURE_NUM_STEPS; i++) {
+      astSteps[i].pstBatch = &stBatch;
+      astSteps[i].ucMesgId = aaucSteps[i][1];
+
+      pthread_mutex_lock(&stBatch.stLock);
+      stBatch.iOutstanding++;
+      pthread_mutex_unlock(&stBatch.stLock);
+
+      status = ant_tx_command_async(aaucSteps[i][0] + ANT_MSG_HEADER_SIZE, aaucSteps[i],
+            ANT_CONFIGURE_TIMEOUT_MS, ant_configure_step_done, &astSteps[i]);
+      if (status != ANT_STATUS_SUCCESS) {
+         ANT_ERROR("failed to send channel configuration command %#x: %d", astSteps[i].ucMesgId, status);
+         pthread_mutex_lock(&stBatch.stLock);
+         stBatch.iOutstanding--;
+         ant_configure_set_result(&stBatch, status, astSteps[i].ucMesgId);
+         pthread_mutex_unlock(&stBatch.stLock);
+         break;
+      }
+   }
+
+   pthread_mutex_lock(&stBatch.stLock);
+   while (stBatch.iOutstanding > 0) {
+      pthread_cond_wait(&stBatch.stCond, &stBatch.stLock);
+   }
+   pthread_mutex_unlock(&stBatch.stLock);
+
+   if ((stBatch.status == ANT_STATUS_SUCCESS) && pstConfig->bOpen) {
+      aucMesg[0] = 1;
+      aucMesg[1] = MESG_OPEN_CHANNEL_ID;
+      aucMesg[2] = ucChannel;
+      status = ant_tx_command(3, aucMesg, ANT_CONFIGURE_TIMEOUT_MS, NULL);
+      if (status != ANT_STATUS_SUCCESS) {
+         ANT_ERROR("failed to open channel %u: %d", ucChannel, status);
+      }
+      ant_configure_set_result(&stBatch, status, MESG_OPEN_CHANNEL_ID);
+   }
+
+   if ((stBatch.status != ANT_STATUS_SUCCESS) && stBatch.bAssigned) {
+      ANT_DEBUG_I("unassigning channel %u after failed configuration", ucChannel);
+      aucMesg[0] = 1;
+      aucMesg[1] = MESG_UNASSIGN_CHANNEL_ID;
+      aucMesg[2] = ucChannel;
+      if (ant_tx_command(3, aucMesg, ANT_CONFIGURE_TIMEOUT_MS, NULL) != ANT_STATUS_SUCCESS) {
+         ANT_ERROR("failed to unassign channel %u after failed configuration", ucChannel);
+      }
+   }
+
+   pthread_cond_destroy(&stBatch.stCond);
+   pthread_mutex_destroy(&stBatch.stLock);
+
+   *pucFailedMesgId = stBatch.ucFailedMesgId;
+   return stBatch.status;
+}
+
+/*
+ * This thread runs one async channel configuration and reports the result.
+ */
+static void *fnConfigureThread(void *pvJob)
+{
+   ant_configure_job_t *pstJob = (ant_configure_job_t *)pvJob;
+   ANT_U8 ucFailedMesgId;
+   ANTStatus status;
+
+   status = ant_configure_run(&pstJob->stConfig, &ucFailedMesgId);
+   pstJob->fnCallback(status, pstJob->stConfig.ucChannel, ucFailedMesgId, pstJob->pvContext);
+
+   free(pstJob);
+   return NULL;
+}
+
+////////////////////////////////////////////////////////////////////
+//  ant_configure_channel
+//
+//  Configures, and optionally opens, a channel.
+//
+//  Parameters:
+//      pstConfig       the channel configuration
+//      fnCallback      called with the result, or NULL to wait for it
+//      pvContext       passed back to the callback
+//
+//  Returns:
+//      Success:
+//          ANT_STATUS_SUCCESS
+//      Failure:
+//          ANT_STATUS_INVALID_PARM if no configuration given
+//          ANT_STATUS_FAILED if the configuration thread could not start
+//          result of the command that failed, when waiting for the result
+//
+//  Psuedocode:
+/*
+IF no callback
+    RESULT = configure channel
+ELSE
+    COPY configuration
+    START thread to configure channel and call callback
+    RESULT = SUCCESS if thread started
+ENDIF
+*/
+////////////////////////////////////////////////////////////////////
+ANTStatus ant_configure_channel(const ANTChannelConfig *pstConfig, ANTNativeANTConfigureCb fnCallback,
+      void *pvContext)
+{
+   ant_configure_job_t *pstJob;
+   pthread_t stThread;
+   ANT_U8 ucFailedMesgId;
+   int iResult;
+   ANTStatus status = ANT_STATUS_INVALID_PARM;
+   ANT_FUNC_START();
+
+   if (pstConfig == NULL) {
+      goto out;
+   }
+
+   if (fnCallback == NULL) {
+      status = ant_configure_run(pstConfig, &ucFailedMesgId);
+      goto out;
+   }
+
+   status = ANT_STATUS_FAILED;
+
+   pstJob = malloc(sizeof(*pstJob));
+   if (pstJob == NULL) {
+      ANT_ERROR("failed to allocate channel configuration");
+      goto out;
+   }
+   pstJob->stConfig = *pstConfig;
+   pstJob->fnCallback = fnCallback;
+   pstJob->pvContext = pvContext;
+
+   iResult = ant_thread_create(&stThread, "cfg", fnConfigureThread, pstJob);
+   if (iResult) {
+      ANT_ERROR("failed to start channel configuration thread: %s", strerror(iResult));
+      free(pstJob);
+      goto out;
+   }
+   pthread_detach(stThread);
+
+   status = ANT_STATUS_SUCCESS;
+
+out:
+   ANT_FUNC_END();
+   return status;
+}
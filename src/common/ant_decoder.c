@@ -0,0 +1,433 @@
+/*
+ * ANT Stack
+ *
+ * Copyright 2011 Dynastream Innovations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/******************************************************************************\
+*
+*   FILE NAME:      ant_decoder.c
+*
+*   BRIEF:
+*      This file implements native decoding of ANT+ data pages. Each supported
+*      device type has a table of the fields on its pages, and the decoder
+*      reports the decoded values only when one of them changes.
+*
+*
+\******************************************************************************/
+
+#include <pthread.h>
+#include <string.h>
+
+#include "ant_types.h"
+#include "ant_native.h"
+#include "ant_message.h"
+#include "ant_cache.h"
+#include "ant_log.h"
+
+#undef LOG_TAG
+#define LOG_TAG "antradio_decoder"
+
+// Field is on every page of the profile
+#define ANT_DECODER_ALL_PAGES                ((ANT_U8)0xFF)
+
+typedef struct {
+   /* Page the field is on, or ANT_DECODER_ALL_PAGES */
+   ANT_U8 ucPage;
+   /* First payload byte of the little endian field */
+   ANT_U8 ucOffset;
+   /* Width of the field in bits */
+   ANT_U8 ucBits;
+   /* Field rolls over at its width and is decoded as a running total */
+   ANT_BOOL bAccumulated;
+   /* Decoded value = raw value * usScaleNum / usScaleDen */
+   ANT_U16 usScaleNum;
+   ANT_U16 usScaleDen;
+   /* Index of the value, ANT_DECODED_* */
+   ANT_U8 ucValue;
+} ant_decoder_field_t;
+
+typedef struct {
+   ANT_U8 ucDeviceType;
+   /* Mask for the page number in payload byte 0, 0 for profiles without pages */
+   ANT_U8 ucPageMask;
+   ANT_U8 ucNumValues;
+   const ant_decoder_field_t *pstFields;
+   ANT_U8 ucNumFields;
+} ant_decoder_profile_t;
+
+#define ANT_DECODER_FIELDS(astFields) (astFields), (ANT_U8)(sizeof(astFields) / sizeof((astFields)[0]))
+
+// Heart rate pages all carry the beat data, the page number has a toggle bit.
+static const ant_decoder_field_t astHeartRateFields[] = {
+   { ANT_DECODER_ALL_PAGES, 7, 8, ANT_FALSE, 1, 1, ANT_DECODED_HR_HEART_RATE },
+   { ANT_DECODER_ALL_PAGES, 6, 8, ANT_TRUE, 1, 1, ANT_DECODED_HR_BEAT_COUNT },
+   { ANT_DECODER_ALL_PAGES, 4, 16, ANT_TRUE, 1000, 1024, ANT_DECODED_HR_BEAT_TIME },
+};
+
+// Combined speed and cadence has a single page.
+static const ant_decoder_field_t astSpeedCadenceFields[] = {
+   { ANT_DECODER_ALL_PAGES, 0, 16, ANT_TRUE, 1000, 1024, ANT_DECODED_SC_CADENCE_TIME },
+   { ANT_DECODER_ALL_PAGES, 2, 16, ANT_TRUE, 1, 1, ANT_DECODED_SC_CADENCE_REVS },
+   { ANT_DECODER_ALL_PAGES, 4, 16, ANT_TRUE, 1000, 1024, ANT_DECODED_SC_SPEED_TIME },
+   { ANT_DECODER_ALL_PAGES, 6, 16, ANT_TRUE, 1, 1, ANT_DECODED_SC_SPEED_REVS },
+};
+
+static const ant_decoder_field_t astCadenceFields[] = {
+   { ANT_DECODER_ALL_PAGES, 4, 16, ANT_TRUE, 1000, 1024, ANT_DECODED_SC_CADENCE_TIME },
+   { ANT_DECODER_ALL_PAGES, 6, 16, ANT_TRUE, 1, 1, ANT_DECODED_SC_CADENCE_REVS },
+};
+
+static const ant_decoder_field_t astSpeedFields[] = {
+   { ANT_DECODER_ALL_PAGES, 4, 16, ANT_TRUE, 1000, 1024, ANT_DECODED_SC_SPEED_TIME },
+   { ANT_DECODER_ALL_PAGES, 6, 16, ANT_TRUE, 1, 1, ANT_DECODED_SC_SPEED_REVS },
+};
+
+// Standard power only page.
+static const ant_decoder_field_t astPowerFields[] = {
+   { 0x10, 1, 8, ANT_TRUE, 1, 1, ANT_DECODED_POWER_EVENT_COUNT },
+   { 0x10, 2, 8, ANT_FALSE, 1, 1, ANT_DECODED_POWER_PEDAL_BALANCE },
+   { 0x10, 3, 8, ANT_FALSE, 1, 1, ANT_DECODED_POWER_CADENCE },
+   { 0x10, 4, 16, ANT_TRUE, 1, 1, ANT_DECODED_POWER_ACCUMULATED },
+   { 0x10, 6, 16, ANT_FALSE, 1, 1, ANT_DECODED_POWER_INSTANT },
+};
+
+// General fitness equipment page and specific trainer page.
+static const ant_decoder_field_t astFitnessEquipmentFields[] = {
+   { 0x10, 2, 8, ANT_TRUE, 250, 1, ANT_DECODED_FE_ELAPSED_TIME },
+   { 0x10, 3, 8, ANT_TRUE, 1, 1, ANT_DECODED_FE_DISTANCE },
+   { 0x10, 4, 16, ANT_FALSE, 1, 1, ANT_DECODED_FE_SPEED },
+   { 0x10, 6, 8, ANT_FALSE, 1, 1, ANT_DECODED_FE_HEART_RATE },
+   { 0x19, 1, 8, ANT_TRUE, 1, 1, ANT_DECODED_FE_EVENT_COUNT },
+   { 0x19, 2, 8, ANT_FALSE, 1, 1, ANT_DECODED_FE_CADENCE },
+   { 0x19, 3, 16, ANT_TRUE, 1, 1, ANT_DECODED_FE_ACCUMULATED_POWER },
+   { 0x19, 5, 12, ANT_FALSE, 1, 1, ANT_DECODED_FE_INSTANT_POWER },
+};
+
+static const ant_decoder_profile_t astDecoderProfiles[] = {
+   { ANT_DEVICE_TYPE_HEART_RATE, 0x7F, 3, ANT_DECODER_FIELDS(astHeartRateFields) },
+   { ANT_DEVICE_TYPE_BIKE_SPEED_CADENCE, 0x00, 4, ANT_DECODER_FIELDS(astSpeedCadenceFields) },
+   { ANT_DEVICE_TYPE_BIKE_CADENCE, 0x7F, 4, ANT_DECODER_FIELDS(astCadenceFields) },
+   { ANT_DEVICE_TYPE_BIKE_SPEED, 0x7F, 4, ANT_DECODER_FIELDS(astSpeedFields) },
+   { ANT_DEVICE_TYPE_BIKE_POWER, 0xFF, 5, ANT_DECODER_FIELDS(astPowerFields) },
+   { ANT_DEVICE_TYPE_FITNESS_EQUIPMENT, 0xFF, 8, ANT_DECODER_FIELDS(astFitnessEquipmentFields) },
+};
+#define NUM_DECODER_PROFILES (sizeof(astDecoderProfiles) / sizeof(astDecoderProfiles[0]))
+
+typedef struct {
+   /* Profile the channel is decoded with, NULL until its first page */
+   const ant_decoder_profile_t *pstProfile;
+   /* Value has been decoded at least once */
+   ANT_BOOL abHaveValue[ANT_DECODER_MAX_FIELDS];
+   /* Last raw value of accumulated fields, and the running total in raw units */
+   ANT_U32 aulLastRaw[ANT_DECODER_MAX_FIELDS];
+   ANT_U32 aulTotal[ANT_DECODER_MAX_FIELDS];
+   ANT_S32 alValues[ANT_DECODER_MAX_FIELDS];
+} ant_decoder_channel_t;
+
+static ant_decoder_channel_t astDecoderChannels[ANT_CACHE_MAX_CHANNELS];
+
+static ANTNativeANTDecodedCb fnDecodedCallback = NULL;
+static void *pvDecodedContext = NULL;
+
+// Held while decoding, rx threads for different paths may decode at once.
+static pthread_mutex_t stDecoderLock = PTHREAD_MUTEX_INITIALIZER;
+
+static const ant_decoder_profile_t *ant_decoder_find_profile(ANT_U8 ucDeviceType)
+{
+   unsigned int i;
+
+   for (i = 0; i < NUM_DECODER_PROFILES; i++) {
+      if (astDecoderProfiles[i].ucDeviceType == ucDeviceType) {
+         return &astDecoderProfiles[i];
+      }
+   }
+
+   return NULL;
+}
+
+static ANT_U32 ant_decoder_read_field(const ANT_U8 *pucPayload, const ant_decoder_field_t *pstField)
+{
+   ANT_U32 ulRaw = 0;
+   int iBytes = (pstField->ucBits + 7) / 8;
+   int i;
+
+   for (i = iBytes - 1; i >= 0; i--) {
+      ulRaw = (ulRaw << 8) | pucPayload[pstField->ucOffset + i];
+   }
+
+   return ulRaw & (ANT_U32)((1ULL << pstField->ucBits) - 1);
+}
+
+////////////////////////////////////////////////////////////////////
+//  ant_decoder_decode_page
+//
+//  Decodes the fields of a page into the channel's values.
+//  Called with stDecoderLock held.
+//
+//  Parameters:
+//      pstChannel      decoder state of the channel
+//      ucPage          page number, 0 for profiles without pages
+//      pucPayload      the 8 byte payload
+//
+//  Returns:
+//      Mask of the values that changed
+//
+//  Psuedocode:
+/*
+FOR each field on the page
+    READ raw value
+    IF accumulated
+        ADD change since last raw value, modulo the field width, to total
+    ENDIF
+    SCALE value
+    IF first value OR value differs
+        STORE value, mark changed
+    ENDIF
+ENDFOR
+*/
+////////////////////////////////////////////////////////////////////
+static ANT_U8 ant_decoder_decode_page(ant_decoder_channel_t *pstChannel, ANT_U8 ucPage, const ANT_U8 *pucPayload)
+{
+   const ant_decoder_profile_t *pstProfile = pstChannel->pstProfile;
+   const ant_decoder_field_t *pstField;
+   ANT_U32 ulRaw;
+   ANT_U32 ulMask;
+   ANT_S32 lValue;
+   ANT_U8 ucChangedMask = 0;
+   ANT_U8 ucIndex;
+   int i;
+
+   for (i = 0; i < pstProfile->ucNumFields; i++) {
+      pstField = &pstProfile->pstFields[i];
+      if ((pstField->ucPage != ANT_DECODER_ALL_PAGES) && (pstField->ucPage != ucPage)) {
+         continue;
+      }
+
+      ucIndex = pstField->ucValue;
+      ulRaw = ant_decoder_read_field(pucPayload, pstField);
+
+      if (pstField->bAccumulated) {
+         ulMask = (ANT_U32)((1ULL << pstField->ucBits) - 1);
+         if (pstChannel->abHaveValue[ucIndex]) {
+            pstChannel->aulTotal[ucIndex] += (ulRaw - pstChannel->aulLastRaw[ucIndex]) & ulMask;
+         }
+         pstChannel->aulLastRaw[ucIndex] = ulRaw;
+         ulRaw = pstChannel->aulTotal[ucIndex];
+      }
+
+      lValue = (ANT_S32)(((uint64_t)ulRaw * pstField->usScaleNum) / pstField->usScaleDen);
+
+      if (!pstChannel->abHaveValue[ucIndex] || (pstChannel->alValues[ucIndex] != lValue)) {
+         pstChannel->abHaveValue[ucIndex] = ANT_TRUE;
+         pstChannel->alValues[ucIndex] = lValue;
+         ucChangedMask |= (ANT_U8)(1 << ucIndex);
+      }
+   }
+
+   return ucChangedMask;
+}
+
+////////////////////////////////////////////////////////////////////
+//  ant_decoder_consumer
+//
+//  Rx consumer decoding the data pages of channels with a known
+//  ANT+ device type.
+//
+//  Parameters:
+//      pstMessage      the received message
+//      pvContext       unused
+//
+//  Returns:
+//      -
+//
+//  Psuedocode:
+/*
+IF channel closed or gone back to search
+    RESET decoding of the channel, running totals start again
+ELSE IF broadcast or acknowledged data
+    GET device type from extended data, or from the channel ID set on the channel
+    IF no decoder for the device type
+        RETURN
+    ENDIF
+    IF device type changed
+        RESET decoding of the channel
+    ENDIF
+    DECODE page
+    IF a value changed
+        CALL decoded callback with copy of the values
+    ENDIF
+ENDIF
+*/
+////////////////////////////////////////////////////////////////////
+static void ant_decoder_consumer(ANTRxMessage *pstMessage, void *pvContext)
+{
+   ANT_U8 *pucData = pstMessage->aucData;
+   ANT_U8 ucLen = pstMessage->ucLen;
+   ANT_U8 *pucPayload;
+   ANT_U8 ucChannel;
+   ANT_U8 ucDeviceType = 0;
+   ANT_U8 ucChangedMask;
+   const ant_decoder_profile_t *pstProfile;
+   ant_decoder_channel_t *pstChannel;
+   ANTChannelInfo stInfo;
+   ANTDecodedData stDecoded;
+   ANTNativeANTDecodedCb fnCallback;
+   void *pvCallbackContext;
+   (void)pvContext;
+
+   if (ucLen <= ANT_MSG_DATA_OFFSET) {
+      return;
+   }
+
+   ucChannel = pucData[ANT_DATA_CHANNEL_OFFSET];
+   if (ucChannel >= ANT_CACHE_MAX_CHANNELS) {
+      return;
+   }
+   pstChannel = &astDecoderChannels[ucChannel];
+
+   switch (pucData[ANT_MSG_ID_OFFSET]) {
+      case MESG_RESPONSE_EVENT_ID:
+         if ((ucLen >= ANT_RESPONSE_SIZE) && (pucData[ANT_RESPONSE_MESG_ID_OFFSET] == MESG_EVENT_ID) &&
+               ((pucData[ANT_RESPONSE_CODE_OFFSET] == EVENT_CHANNEL_CLOSED) ||
+                (pucData[ANT_RESPONSE_CODE_OFFSET] == EVENT_RX_FAIL_GO_TO_SEARCH))) {
+            pthread_mutex_lock(&stDecoderLock);
+            memset(pstChannel, 0, sizeof(*pstChannel));
+            pthread_mutex_unlock(&stDecoderLock);
+         }
+         return;
+
+      case MESG_BROADCAST_DATA_ID:
+      case MESG_ACKNOWLEDGED_DATA_ID:
+         if (ucLen < ANT_DATA_PAYLOAD_OFFSET + ANT_DATA_PAYLOAD_SIZE) {
+            return;
+         }
+         pucPayload = &pucData[ANT_DATA_PAYLOAD_OFFSET];
+         if ((ucLen >= ANT_DATA_FLAG_OFFSET + 1 + ANT_CHANNEL_ID_SIZE) &&
+               (pucData[ANT_DATA_FLAG_OFFSET] & ANT_EXT_FLAG_CHANNEL_ID)) {
+            ucDeviceType = pucData[ANT_DATA_FLAG_OFFSET + 1 + ANT_CHANNEL_ID_DEVICE_TYPE_OFFSET];
+         }
+         break;
+
+      case MESG_EXT_BROADCAST_DATA_ID:
+      case MESG_EXT_ACKNOWLEDGED_DATA_ID:
+         if (ucLen < ANT_EXT_DATA_PAYLOAD_OFFSET + ANT_DATA_PAYLOAD_SIZE) {
+            return;
+         }
+         pucPayload = &pucData[ANT_EXT_DATA_PAYLOAD_OFFSET];
+         ucDeviceType = pucData[ANT_EXT_DATA_CHANNEL_ID_OFFSET + ANT_CHANNEL_ID_DEVICE_TYPE_OFFSET];
+         break;
+
+      default:
+         return;
+   }
+
+   if ((ucDeviceType == 0) && (ant_get_channel_info(ucChannel, &stInfo) == ANT_STATUS_SUCCESS)) {
+      ucDeviceType = stInfo.stConfig.ucDeviceType;
+   }
+
+   pstProfile = ant_decoder_find_profile(ucDeviceType & ANT_DEVICE_TYPE_MASK);
+   if (pstProfile == NULL) {
+      return;
+   }
+
+   pthread_mutex_lock(&stDecoderLock);
+
+   if (pstChannel->pstProfile != pstProfile) {
+      memset(pstChannel, 0, sizeof(*pstChannel));
+      pstChannel->pstProfile = pstProfile;
+   }
+
+   stDecoded.ucPage = pucPayload[0] & pstProfile->ucPageMask;
+   ucChangedMask = ant_decoder_decode_page(pstChannel, stDecoded.ucPage, pucPayload);
+   if (ucChangedMask != 0) {
+      stDecoded.ucChannel = ucChannel;
+      stDecoded.ucDeviceType = pstProfile->ucDeviceType;
+      stDecoded.ucNumValues = pstProfile->ucNumValues;
+      stDecoded.ucChangedMask = ucChangedMask;
+      memcpy(stDecoded.alValues, pstChannel->alValues, sizeof(stDecoded.alValues));
+   }
+   fnCallback = fnDecodedCallback;
+   pvCallbackContext = pvDecodedContext;
+
+   pthread_mutex_unlock(&stDecoderLock);
+
+   if ((ucChangedMask != 0) && (fnCallback != NULL)) {
+      fnCallback(&stDecoded, pvCallbackContext);
+   }
+}
+
+////////////////////////////////////////////////////////////////////
+//  set_ant_decoded_callback
+//
+//  Starts or stops native decoding of ANT+ data pages.
+//
+//  Parameters:
+//      fnCallback      called with changed decoded values, NULL to stop
+//      pvContext       passed to fnCallback
+//
+//  Returns:
+//      Success:
+//          ANT_STATUS_SUCCESS
+//      Failure:
+//          ANT_STATUS_FAILED if decoding could not be started
+//
+//  Psuedocode:
+/*
+IF stopping AND decoding
+    REMOVE decoder rx consumer
+ENDIF
+STORE callback
+IF starting AND not decoding
+    RESET decoding of all channels
+    ADD decoder rx consumer
+ENDIF
+*/
+////////////////////////////////////////////////////////////////////
+ANTStatus set_ant_decoded_callback(ANTNativeANTDecodedCb fnCallback, void *pvContext)
+{
+   ANTStatus status = ANT_STATUS_SUCCESS;
+   ANT_BOOL bWasDecoding;
+   ANT_FUNC_START();
+
+   pthread_mutex_lock(&stDecoderLock);
+   bWasDecoding = (fnDecodedCallback != NULL);
+   pthread_mutex_unlock(&stDecoderLock);
+
+   if ((fnCallback == NULL) && bWasDecoding) {
+      // Waits for a decode in progress, so the old callback is not called after this returns.
+      ant_rx_remove_consumer(ant_decoder_consumer, NULL);
+   }
+
+   pthread_mutex_lock(&stDecoderLock);
+   fnDecodedCallback = fnCallback;
+   pvDecodedContext = pvContext;
+   if ((fnCallback != NULL) && !bWasDecoding) {
+      memset(astDecoderChannels, 0, sizeof(astDecoderChannels));
+   }
+   pthread_mutex_unlock(&stDecoderLock);
+
+   if ((fnCallback != NULL) && !bWasDecoding) {
+      status = ant_rx_add_consumer(ant_decoder_consumer, NULL);
+      if (status != ANT_STATUS_SUCCESS) {
+         ANT_ERROR("failed to add decoder rx consumer: %d", status);
+         pthread_mutex_lock(&stDecoderLock);
+         fnDecodedCallback = NULL;
+         pthread_mutex_unlock(&stDecoderLock);
+      }
+   }
+
+   ANT_FUNC_END();
+   return status;
+}
@@ -0,0 +1,446 @@
+/*
+ * ANT Stack
+ *
+ * Copyright 2011 Dynastream Innovations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/******************************************************************************\
+*
+*   FILE NAME:      ant_journal.c
+*
+*   BRIEF:
+*      This file implements the channel configuration journal. It keeps the
+*      network keys and channel configuration commands the chip accepted, for
+*      the channels that are still assigned, so that the transport can set the
+*      channels up again by itself after it recovered the chip.
+*
+*
+\******************************************************************************/
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ant_types.h"
+#include "ant_native.h"
+#include "ant_message.h"
+#include "ant_journal.h"
+#include "ant_log.h"
+
+#undef LOG_TAG
+#define LOG_TAG "antradio_journal"
+
+// Assign, channel ID, period, RF frequency and open, replayed in this order.
+#define ANT_JOURNAL_STEP_ASSIGN              0
+#define ANT_JOURNAL_STEP_OPEN                4
+#define ANT_JOURNAL_NUM_STEPS                5
+// Network key: network number and 8 key bytes.
+#define ANT_JOURNAL_MAX_MESG_SIZE            ((ANT_U8)(ANT_MSG_HEADER_SIZE + 9))
+
+typedef struct {
+   /* Length of the message, 0 if there is none */
+   ANT_U8 ucLen;
+   ANT_U8 aucMesg[ANT_JOURNAL_MAX_MESG_SIZE];
+} ant_journal_entry_t;
+
+typedef struct {
+   /* Commands the chip accepted */
+   ant_journal_entry_t astSteps[ANT_JOURNAL_NUM_STEPS];
+   /* Commands sent, copied to astSteps when the chip accepts them */
+   ant_journal_entry_t astPending[ANT_JOURNAL_NUM_STEPS];
+} ant_journal_channel_t;
+
+typedef struct {
+   ant_journal_entry_t astChannelSteps[ANT_JOURNAL_MAX_CHANNELS][ANT_JOURNAL_NUM_STEPS];
+   ant_journal_entry_t astNetworkKeys[ANT_JOURNAL_MAX_NETWORKS];
+} ant_journal_snapshot_t;
+
+static ant_journal_channel_t astJournalChannels[ANT_JOURNAL_MAX_CHANNELS];
+static ant_journal_entry_t astJournalKeys[ANT_JOURNAL_MAX_NETWORKS];
+static ant_journal_entry_t astJournalPendingKeys[ANT_JOURNAL_MAX_NETWORKS];
+
+static pthread_mutex_t stJournalLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Counts the calls to ant_journal_cancel_replay(). A replay stops once it changes.
+static ANT_U32 ulJournalRecovery = 0;
+
+static int ant_journal_find_step(ANT_U8 ucMesgId)
+{
+   switch (ucMesgId) {
+      case MESG_ASSIGN_CHANNEL_ID:
+         return ANT_JOURNAL_STEP_ASSIGN;
+      case MESG_CHANNEL_ID_ID:
+         return 1;
+      case MESG_CHANNEL_MESG_PERIOD_ID:
+         return 2;
+      case MESG_CHANNEL_RADIO_FREQ_ID:
+         return 3;
+      case MESG_OPEN_CHANNEL_ID:
+         return ANT_JOURNAL_STEP_OPEN;
+      default:
+         return -1;
+   }
+}
+
+static void ant_journal_store(ant_journal_entry_t *pstEntry, ANT_U8 ucLen, ANT_U8 *pucMesg)
+{
+   if (ucLen > ANT_JOURNAL_MAX_MESG_SIZE) {
+      ANT_DEBUG_W("message %#x of %u bytes too long to journal", pucMesg[ANT_MSG_ID_OFFSET], ucLen);
+      pstEntry->ucLen = 0;
+      return;
+   }
+
+   memcpy(pstEntry->aucMesg, pucMesg, ucLen);
+   pstEntry->ucLen = ucLen;
+}
+
+// Called with stJournalLock held.
+static void ant_journal_clear_channel(ant_journal_channel_t *pstChannel)
+{
+   int i;
+
+   for (i = 0; i < ANT_JOURNAL_NUM_STEPS; i++) {
+      pstChannel->astSteps[i].ucLen = 0;
+   }
+}
+
+// Called with stJournalLock held.
+static void ant_journal_clear_all(void)
+{
+   int i;
+
+   for (i = 0; i < ANT_JOURNAL_MAX_CHANNELS; i++) {
+      ant_journal_clear_channel(&astJournalChannels[i]);
+   }
+   for (i = 0; i < ANT_JOURNAL_MAX_NETWORKS; i++) {
+      astJournalKeys[i].ucLen = 0;
+   }
+}
+
+void ant_journal_tx_message(ANT_U8 ucLen, ANT_U8 *pucMesg)
+{
+   ANT_U8 ucMesgId;
+   ANT_U8 ucNumber;
+   int iStep;
+
+   if (ucLen <= ANT_MSG_DATA_OFFSET) {
+      return;
+   }
+
+   ucMesgId = pucMesg[ANT_MSG_ID_OFFSET];
+   ucNumber = pucMesg[ANT_MSG_DATA_OFFSET];
+
+   pthread_mutex_lock(&stJournalLock);
+
+   if (ucMesgId == MESG_RESET_ID) {
+      // The client resets the chip itself, so it sets up its channels again.
+      ant_journal_clear_all();
+   } else if (ucMesgId == MESG_NETWORK_KEY_ID) {
+      if (ucNumber < ANT_JOURNAL_MAX_NETWORKS) {
+         ant_journal_store(&astJournalPendingKeys[ucNumber], ucLen, pucMesg);
+      }
+   } else {
+      iStep = ant_journal_find_step(ucMesgId);
+      if ((iStep >= 0) && (ucNumber < ANT_JOURNAL_MAX_CHANNELS)) {
+         ant_journal_store(&astJournalChannels[ucNumber].astPending[iStep], ucLen, pucMesg);
+      }
+   }
+
+   pthread_mutex_unlock(&stJournalLock);
+}
+
+////////////////////////////////////////////////////////////////////
+//  ant_journal_rx_message
+//
+//  Journals a command when the chip accepts it.
+//
+//  Parameters:
+//      ucLen           length of the message
+//      pucData         the message
+//
+//  Returns:
+//      -
+//
+//  Psuedocode:
+/*
+IF channel response with no error
+    IF network key
+        JOURNAL pending key for the network
+    ELSE IF unassign
+        FORGET channel
+    ELSE IF assign
+        FORGET channel, the chip sets defaults on assign
+        JOURNAL pending assign
+    ELSE IF channel configuration or open
+        JOURNAL pending command
+    ELSE IF close
+        FORGET open
+    ENDIF
+ELSE IF channel closed event
+    FORGET open
+ENDIF
+*/
+////////////////////////////////////////////////////////////////////
+void ant_journal_rx_message(ANT_U8 ucLen, ANT_U8 *pucData)
+{
+   ant_journal_channel_t *pstChannel;
+   ANT_U8 ucNumber;
+   ANT_U8 ucMesgId;
+   int iStep;
+
+   if ((ucLen < ANT_RESPONSE_SIZE) || (pucData[ANT_MSG_ID_OFFSET] != MESG_RESPONSE_EVENT_ID)) {
+      return;
+   }
+
+   ucNumber = pucData[ANT_RESPONSE_CHANNEL_OFFSET];
+   ucMesgId = pucData[ANT_RESPONSE_MESG_ID_OFFSET];
+
+   pthread_mutex_lock(&stJournalLock);
+
+   if (ucMesgId == MESG_NETWORK_KEY_ID) {
+      if ((ucNumber < ANT_JOURNAL_MAX_NETWORKS) && (pucData[ANT_RESPONSE_CODE_OFFSET] == RESPONSE_NO_ERROR)) {
+         astJournalKeys[ucNumber] = astJournalPendingKeys[ucNumber];
+      }
+      goto out;
+   }
+
+   if (ucNumber >= ANT_JOURNAL_MAX_CHANNELS) {
+      goto out;
+   }
+   pstChannel = &astJournalChannels[ucNumber];
+
+   if (ucMesgId == MESG_EVENT_ID) {
+      if (pucData[ANT_RESPONSE_CODE_OFFSET] == EVENT_CHANNEL_CLOSED) {
+         pstChannel->astSteps[ANT_JOURNAL_STEP_OPEN].ucLen = 0;
+      }
+      goto out;
+   }
+
+   if (pucData[ANT_RESPONSE_CODE_OFFSET] != RESPONSE_NO_ERROR) {
+      goto out;
+   }
+
+   switch (ucMesgId) {
+      case MESG_UNASSIGN_CHANNEL_ID:
+         ant_journal_clear_channel(pstChannel);
+         break;
+
+      case MESG_CLOSE_CHANNEL_ID:
+         pstChannel->astSteps[ANT_JOURNAL_STEP_OPEN].ucLen = 0;
+         break;
+
+      default:
+         iStep = ant_journal_find_step(ucMesgId);
+         if (iStep < 0) {
+            break;
+         }
+         if (iStep == ANT_JOURNAL_STEP_ASSIGN) {
+            ant_journal_clear_channel(pstChannel);
+         }
+         pstChannel->astSteps[iStep] = pstChannel->astPending[iStep];
+         break;
+   }
+
+out:
+   pthread_mutex_unlock(&stJournalLock);
+}
+
+void ant_journal_clear(void)
+{
+   pthread_mutex_lock(&stJournalLock);
+   ant_journal_clear_all();
+   pthread_mutex_unlock(&stJournalLock);
+}
+
+ANT_U32 ant_journal_cancel_replay(void)
+{
+   return __atomic_add_fetch(&ulJournalRecovery, 1, __ATOMIC_RELEASE);
+}
+
+static ANT_U32 ant_journal_now_ms(void)
+{
+   struct timespec stNow;
+
+   clock_gettime(CLOCK_MONOTONIC, &stNow);
+   return (ANT_U32)(stNow.tv_sec * 1000LL + stNow.tv_nsec / 1000000L);
+}
+
+/*
+ * Whether the replay for ulRecovery was cancelled.
+ */
+static ANT_BOOL ant_journal_replay_cancelled(ANT_U32 ulRecovery)
+{
+   return (__atomic_load_n(&ulJournalRecovery, __ATOMIC_ACQUIRE) != ulRecovery) ? ANT_TRUE : ANT_FALSE;
+}
+
+/*
+ * Sends a journaled command and waits for the response, trying again with
+ * increasing waits in between if it fails, until the replay for ulRecovery is
+ * cancelled or ulDeadlineMs passes.
+ */
+static ANTStatus ant_journal_send(ant_journal_entry_t *pstEntry, ANT_U32 ulRecovery, ANT_U32 ulDeadlineMs)
+{
+   ANT_U32 ulBackoffMs = ANT_JOURNAL_RETRY_BACKOFF_MS;
+   ANT_S32 lRemainingMs;
+   ANTStatus status;
+   int iTry;
+
+   for (iTry = 0; ; iTry++) {
+      lRemainingMs = (ANT_S32)(ulDeadlineMs - ant_journal_now_ms());
+      if ((lRemainingMs <= 0) || ant_journal_replay_cancelled(ulRecovery)) {
+         status = ANT_STATUS_FAILED;
+         break;
+      }
+
+      status = ant_tx_command(pstEntry->ucLen, pstEntry->aucMesg,
+            (lRemainingMs < ANT_JOURNAL_TIMEOUT_MS) ? (ANT_U32)lRemainingMs : ANT_JOURNAL_TIMEOUT_MS, NULL);
+      if ((status == ANT_STATUS_SUCCESS) || (iTry == ANT_JOURNAL_RETRIES)) {
+         break;
+      }
+
+      ANT_DEBUG_W("replaying command %#x failed: %d, trying again in %u ms",
+            pstEntry->aucMesg[ANT_MSG_ID_OFFSET], status, ulBackoffMs);
+      usleep(ulBackoffMs * 1000);
+      ulBackoffMs *= 2;
+   }
+
+   return status;
+}
+
+////////////////////////////////////////////////////////////////////
+//  ant_journal_replay
+//
+//  Sets the journaled networks and channels up again after a recovery.
+//
+//  Parameters:
+//      pulRestored     set to the number of channels restored
+//      pulNotRestored  set to the number of channels that failed
+//
+//  Returns:
+//      -
+//
+//  Psuedocode:
+/*
+LOCK
+    COPY journal
+    CLEAR journal, replayed commands are journaled again when accepted
+UNLOCK
+FOR each journaled network key
+    SEND key with retries until cancelled or out of time
+ENDFOR
+FOR each journaled channel
+    FOR each journaled command, from assign to open
+        SEND command with retries until cancelled or out of time
+        IF cancelled
+            PUT copy back in journal
+            RETURN
+        ELSE IF failed
+            IF assigned
+                SEND unassign without waiting for the response
+            ENDIF
+            STOP channel
+        ENDIF
+    ENDFOR
+ENDFOR
+*/
+////////////////////////////////////////////////////////////////////
+void ant_journal_replay(ANT_U32 ulRecovery, ANT_U32 *pulRestored, ANT_U32 *pulNotRestored)
+{
+   ant_journal_snapshot_t stSnapshot;
+   ant_journal_entry_t stUnassign;
+   ANT_U32 ulRestored = 0;
+   ANT_U32 ulNotRestored = 0;
+   ANT_U32 ulDeadlineMs = ant_journal_now_ms() + ANT_JOURNAL_REPLAY_MAX_MS;
+   ANTStatus status;
+   int i;
+   int iStep;
+   ANT_FUNC_START();
+
+   pthread_mutex_lock(&stJournalLock);
+   for (i = 0; i < ANT_JOURNAL_MAX_CHANNELS; i++) {
+      memcpy(stSnapshot.astChannelSteps[i], astJournalChannels[i].astSteps, sizeof(stSnapshot.astChannelSteps[i]));
+   }
+   memcpy(stSnapshot.astNetworkKeys, astJournalKeys, sizeof(stSnapshot.astNetworkKeys));
+   ant_journal_clear_all();
+   pthread_mutex_unlock(&stJournalLock);
+
+   for (i = 0; i < ANT_JOURNAL_MAX_NETWORKS; i++) {
+      if ((stSnapshot.astNetworkKeys[i].ucLen != 0) &&
+            (ant_journal_send(&stSnapshot.astNetworkKeys[i], ulRecovery, ulDeadlineMs) != ANT_STATUS_SUCCESS)) {
+         if (ant_journal_replay_cancelled(ulRecovery)) {
+            goto cancelled;
+         }
+         ANT_ERROR("failed to restore key of network %d", i);
+      }
+   }
+
+   for (i = 0; i < ANT_JOURNAL_MAX_CHANNELS; i++) {
+      if (stSnapshot.astChannelSteps[i][ANT_JOURNAL_STEP_ASSIGN].ucLen == 0) {
+         continue;
+      }
+
+      status = ANT_STATUS_SUCCESS;
+      for (iStep = 0; (iStep < ANT_JOURNAL_NUM_STEPS) && (status == ANT_STATUS_SUCCESS); iStep++) {
+         if (stSnapshot.astChannelSteps[i][iStep].ucLen != 0) {
+            status = ant_journal_send(&stSnapshot.astChannelSteps[i][iStep], ulRecovery, ulDeadlineMs);
+         }
+      }
+
+      if (status == ANT_STATUS_SUCCESS) {
+         ulRestored++;
+      } else if (ant_journal_replay_cancelled(ulRecovery)) {
+         goto cancelled;
+      } else {
+         ANT_ERROR("failed to restore channel %d: %d", i, status);
+         ulNotRestored++;
+         // Don't leave it half configured, the client has to set it up again. iStep is one past
+         // the command that failed. Not waiting for the response keeps the replay within its time.
+         if (iStep - 1 > ANT_JOURNAL_STEP_ASSIGN) {
+            stUnassign.ucLen = ANT_MSG_HEADER_SIZE + 1;
+            stUnassign.aucMesg[ANT_MSG_LENGTH_OFFSET] = 1;
+            stUnassign.aucMesg[ANT_MSG_ID_OFFSET] = MESG_UNASSIGN_CHANNEL_ID;
+            stUnassign.aucMesg[ANT_MSG_DATA_OFFSET] = (ANT_U8)i;
+            ant_tx_message(stUnassign.ucLen, stUnassign.aucMesg);
+         }
+      }
+   }
+
+   ANT_DEBUG_I("restored %u channels, %u failed", ulRestored, ulNotRestored);
+   goto out;
+
+cancelled:
+   // The chip is being reset again, so nothing sent so far stays. The next replay starts over.
+   ANT_DEBUG_I("replay cancelled");
+   ulRestored = 0;
+   ulNotRestored = 0;
+   pthread_mutex_lock(&stJournalLock);
+   for (i = 0; i < ANT_JOURNAL_MAX_CHANNELS; i++) {
+      if (stSnapshot.astChannelSteps[i][ANT_JOURNAL_STEP_ASSIGN].ucLen != 0) {
+         memcpy(astJournalChannels[i].astSteps, stSnapshot.astChannelSteps[i], sizeof(stSnapshot.astChannelSteps[i]));
+      }
+   }
+   for (i = 0; i < ANT_JOURNAL_MAX_NETWORKS; i++) {
+      if (stSnapshot.astNetworkKeys[i].ucLen != 0) {
+         astJournalKeys[i] = stSnapshot.astNetworkKeys[i];
+      }
+   }
+   pthread_mutex_unlock(&stJournalLock);
+
+out:
+   *pulRestored = ulRestored;
+   *pulNotRestored = ulNotRestored;
+
+   ANT_FUNC_END();
+}
@@ -0,0 +1,355 @@
+/*
+ * ANT Stack
+ *
+ * Copyright 2011 Dynastream Innovations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/******************************************************************************\
+*
+*   FILE NAME:      ant_link_stats.c
+*
+*   BRIEF:
+*      This file implements the per channel RF link statistics, counted from
+*      the channel events and data messages as they are received.
+*
+*
+\******************************************************************************/
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+#include "ant_types.h"
+#include "ant_native.h"
+#include "ant_message.h"
+#include "ant_cache.h"
+#include "ant_link_stats.h"
+#include "ant_log.h"
+
+#undef LOG_TAG
+#define LOG_TAG "antradio_link_stats"
+
+typedef struct {
+   /* Counters, the derived values are filled in by ant_get_link_stats() */
+   ANTLinkStats stStats;
+   /* When counting started, on the first message after a reset of the stats */
+   ANT_BOOL bStarted;
+   struct timespec stStartTime;
+   /* Channel is searching since stSearchStartTime */
+   ANT_BOOL bSearching;
+   struct timespec stSearchStartTime;
+   ANT_S32 lRssiSum;
+} ant_link_channel_t;
+
+static ant_link_channel_t astLinkChannels[ANT_CACHE_MAX_CHANNELS];
+
+static pthread_mutex_t stLinkStatsLock = PTHREAD_MUTEX_INITIALIZER;
+
+static ANT_U32 ant_link_stats_elapsed_ms(const struct timespec *pstStart, const struct timespec *pstNow)
+{
+   return (ANT_U32)((pstNow->tv_sec - pstStart->tv_sec) * 1000 +
+         (pstNow->tv_nsec - pstStart->tv_nsec) / 1000000);
+}
+
+// Called with stLinkStatsLock held.
+static void ant_link_stats_rssi(ant_link_channel_t *pstChannel, ANT_S8 cRssi)
+{
+   ANTLinkStats *pstStats = &pstChannel->stStats;
+   int iBin;
+
+   if (pstStats->ulRssiSamples == 0) {
+      pstStats->cRssiMin = cRssi;
+      pstStats->cRssiMax = cRssi;
+   } else if (cRssi < pstStats->cRssiMin) {
+      pstStats->cRssiMin = cRssi;
+   } else if (cRssi > pstStats->cRssiMax) {
+      pstStats->cRssiMax = cRssi;
+   }
+
+   if (cRssi < ANT_LINK_RSSI_MIN_DBM) {
+      iBin = 0;
+   } else {
+      iBin = 1 + (cRssi - ANT_LINK_RSSI_MIN_DBM) / ANT_LINK_RSSI_BIN_DBM;
+      if (iBin >= ANT_LINK_RSSI_BINS) {
+         iBin = ANT_LINK_RSSI_BINS - 1;
+      }
+   }
+
+   pstStats->aulRssiHistogram[iBin]++;
+   pstStats->ulRssiSamples++;
+   pstChannel->lRssiSum += cRssi;
+}
+
+// Called with stLinkStatsLock held.
+static void ant_link_stats_data(ant_link_channel_t *pstChannel, ANT_U8 ucLen, ANT_U8 *pucData,
+      const struct timespec *pstNow)
+{
+   ANTLinkStats *pstStats = &pstChannel->stStats;
+   ANT_U8 ucFlag;
+   ANT_U8 ucOffset;
+
+   pstStats->ulRxMessages++;
+   pstStats->usConsecutiveRxFails = 0;
+
+   if (pstChannel->bSearching) {
+      pstChannel->bSearching = ANT_FALSE;
+      pstStats->ulLastSearchTimeMs = ant_link_stats_elapsed_ms(&pstChannel->stSearchStartTime, pstNow);
+      pstStats->ulSearchTimeMs += pstStats->ulLastSearchTimeMs;
+      pstStats->ulSearches++;
+   }
+
+   // Flagged extended data follows the payload, in flag bit order.
+   if ((pucData[ANT_MSG_ID_OFFSET] == MESG_EXT_BROADCAST_DATA_ID) ||
+         (pucData[ANT_MSG_ID_OFFSET] == MESG_EXT_ACKNOWLEDGED_DATA_ID) ||
+         (pucData[ANT_MSG_ID_OFFSET] == MESG_EXT_BURST_DATA_ID) ||
+         (ucLen <= ANT_DATA_FLAG_OFFSET)) {
+      return;
+   }
+
+   ucFlag = pucData[ANT_DATA_FLAG_OFFSET];
+   ucOffset = ANT_DATA_FLAG_OFFSET + 1;
+   if (ucFlag & ANT_EXT_FLAG_CHANNEL_ID) {
+      ucOffset += ANT_CHANNEL_ID_SIZE;
+   }
+
+   if ((ucFlag & ANT_EXT_FLAG_RSSI) && (ucLen >= ucOffset + ANT_RSSI_SIZE)) {
+      ant_link_stats_rssi(pstChannel, (ANT_S8)pucData[ucOffset + ANT_RSSI_VALUE_OFFSET]);
+   }
+}
+
+// Called with stLinkStatsLock held.
+static void ant_link_stats_event(ant_link_channel_t *pstChannel, ANT_U8 ucEventCode,
+      const struct timespec *pstNow)
+{
+   ANTLinkStats *pstStats = &pstChannel->stStats;
+
+   switch (ucEventCode) {
+      case EVENT_RX_SEARCH_TIMEOUT:
+         pstStats->ulRxSearchTimeouts++;
+         pstChannel->bSearching = ANT_FALSE;
+         break;
+
+      case EVENT_RX_FAIL:
+         pstStats->ulRxFails++;
+         pstStats->usConsecutiveRxFails++;
+         if (pstStats->usConsecutiveRxFails > pstStats->usMaxConsecutiveRxFails) {
+            pstStats->usMaxConsecutiveRxFails = pstStats->usConsecutiveRxFails;
+         }
+         break;
+
+      case EVENT_TX:
+         pstStats->ulTxEvents++;
+         break;
+
+      case EVENT_TRANSFER_RX_FAILED:
+         pstStats->ulTransferRxFails++;
+         break;
+
+      case EVENT_TRANSFER_TX_COMPLETED:
+         pstStats->ulTransferTxCompleted++;
+         break;
+
+      case EVENT_TRANSFER_TX_FAILED:
+         pstStats->ulTransferTxFails++;
+         break;
+
+      case EVENT_CHANNEL_CLOSED:
+         pstStats->ulChannelClosed++;
+         pstChannel->bSearching = ANT_FALSE;
+         break;
+
+      case EVENT_RX_FAIL_GO_TO_SEARCH:
+         pstStats->ulRxFailGoToSearch++;
+         pstChannel->bSearching = ANT_TRUE;
+         pstChannel->stSearchStartTime = *pstNow;
+         break;
+
+      case EVENT_CHANNEL_COLLISION:
+         pstStats->ulChannelCollisions++;
+         break;
+
+      default:
+         ANT_DEBUG_V("channel %d event %02X not counted", (int)(pstChannel - astLinkChannels), ucEventCode);
+         break;
+   }
+}
+
+////////////////////////////////////////////////////////////////////
+//  ant_link_stats_rx_message
+//
+//  Counts a received message in the link statistics of its channel.
+//
+//  Parameters:
+//      ucLen           length of the message
+//      pucData         the message
+//
+//  Returns:
+//      -
+//
+//  Psuedocode:
+/*
+IF data message
+    COUNT message, ending a search
+    IF extended data has RSSI
+        ADD RSSI to histogram
+    ENDIF
+ELSE IF channel event
+    COUNT event
+ELSE IF slave channel opened
+    START search
+ENDIF
+*/
+////////////////////////////////////////////////////////////////////
+void ant_link_stats_rx_message(ANT_U8 ucLen, ANT_U8 *pucData)
+{
+   ant_link_channel_t *pstChannel;
+   ANTChannelInfo stInfo;
+   struct timespec stNow;
+   ANT_U8 ucChannel;
+   ANT_BOOL bIsData;
+
+   if (ucLen <= ANT_MSG_DATA_OFFSET) {
+      return;
+   }
+
+   switch (pucData[ANT_MSG_ID_OFFSET]) {
+      case MESG_BROADCAST_DATA_ID:
+      case MESG_ACKNOWLEDGED_DATA_ID:
+      case MESG_BURST_DATA_ID:
+      case MESG_EXT_BROADCAST_DATA_ID:
+      case MESG_EXT_ACKNOWLEDGED_DATA_ID:
+      case MESG_EXT_BURST_DATA_ID:
+      case MESG_ADV_BURST_DATA_ID:
+         bIsData = ANT_TRUE;
+         break;
+
+      case MESG_RESPONSE_EVENT_ID:
+         if (ucLen < ANT_RESPONSE_SIZE) {
+            return;
+         }
+         bIsData = ANT_FALSE;
+         break;
+
+      default:
+         return;
+   }
+
+   ucChannel = pucData[ANT_DATA_CHANNEL_OFFSET] & ANT_CHANNEL_NUMBER_MASK;
+   if (ucChannel >= ANT_CACHE_MAX_CHANNELS) {
+      return;
+   }
+   pstChannel = &astLinkChannels[ucChannel];
+
+   if (!bIsData && (pucData[ANT_RESPONSE_MESG_ID_OFFSET] != MESG_EVENT_ID)) {
+      // Only a successful open of a slave starts a search. Checked before taking
+      // the lock, the channel state cache has its own.
+      if ((pucData[ANT_RESPONSE_MESG_ID_OFFSET] != MESG_OPEN_CHANNEL_ID) ||
+            (pucData[ANT_RESPONSE_CODE_OFFSET] != RESPONSE_NO_ERROR) ||
+            ((ant_get_channel_info(ucChannel, &stInfo) == ANT_STATUS_SUCCESS) &&
+             (stInfo.stConfig.ucChannelType & CHANNEL_TYPE_MASTER))) {
+         return;
+      }
+   }
+
+   clock_gettime(CLOCK_MONOTONIC, &stNow);
+
+   pthread_mutex_lock(&stLinkStatsLock);
+
+   if (!pstChannel->bStarted) {
+      pstChannel->bStarted = ANT_TRUE;
+      pstChannel->stStartTime = stNow;
+   }
+
+   if (bIsData) {
+      ant_link_stats_data(pstChannel, ucLen, pucData, &stNow);
+   } else if (pucData[ANT_RESPONSE_MESG_ID_OFFSET] == MESG_EVENT_ID) {
+      ant_link_stats_event(pstChannel, pucData[ANT_RESPONSE_CODE_OFFSET], &stNow);
+   } else {
+      pstChannel->bSearching = ANT_TRUE;
+      pstChannel->stSearchStartTime = stNow;
+   }
+
+   pthread_mutex_unlock(&stLinkStatsLock);
+}
+
+ANTStatus ant_get_link_stats(ANT_U8 ucChannel, ANTLinkStats *pstStats)
+{
+   ant_link_channel_t *pstChannel;
+   struct timespec stNow;
+   ANT_U32 ulExpected;
+   ANTStatus status = ANT_STATUS_SUCCESS;
+   ANT_FUNC_START();
+
+   if ((ucChannel >= ANT_CACHE_MAX_CHANNELS) || (pstStats == NULL)) {
+      status = ANT_STATUS_INVALID_PARM;
+      goto out;
+   }
+   pstChannel = &astLinkChannels[ucChannel];
+
+   clock_gettime(CLOCK_MONOTONIC, &stNow);
+
+   pthread_mutex_lock(&stLinkStatsLock);
+
+   *pstStats = pstChannel->stStats;
+
+   if (pstChannel->bStarted) {
+      pstStats->ulElapsedMs = ant_link_stats_elapsed_ms(&pstChannel->stStartTime, &stNow);
+   }
+   if (pstStats->ulElapsedMs != 0) {
+      pstStats->ulRxMessagesPerMinute = (ANT_U32)(((uint64_t)pstStats->ulRxMessages * 60000) / pstStats->ulElapsedMs);
+   }
+
+   ulExpected = pstStats->ulRxMessages + pstStats->ulRxFails;
+   if (ulExpected != 0) {
+      pstStats->usRxSuccessPerMille = (ANT_U16)(((uint64_t)pstStats->ulRxMessages * 1000) / ulExpected);
+   }
+
+   if (pstStats->ulRssiSamples != 0) {
+      pstStats->cRssiAverage = (ANT_S8)(pstChannel->lRssiSum / (ANT_S32)pstStats->ulRssiSamples);
+   }
+
+   pthread_mutex_unlock(&stLinkStatsLock);
+
+out:
+   ANT_FUNC_END();
+   return status;
+}
+
+ANTStatus ant_reset_link_stats(ANT_U8 ucChannel)
+{
+   ANTStatus status = ANT_STATUS_SUCCESS;
+   ANT_BOOL bSearching;
+   struct timespec stSearchStartTime;
+   ANT_FUNC_START();
+
+   if (ucChannel >= ANT_CACHE_MAX_CHANNELS) {
+      status = ANT_STATUS_INVALID_PARM;
+      goto out;
+   }
+
+   pthread_mutex_lock(&stLinkStatsLock);
+
+   // A search in progress is still timed.
+   bSearching = astLinkChannels[ucChannel].bSearching;
+   stSearchStartTime = astLinkChannels[ucChannel].stSearchStartTime;
+   memset(&astLinkChannels[ucChannel], 0, sizeof(astLinkChannels[ucChannel]));
+   astLinkChannels[ucChannel].bSearching = bSearching;
+   astLinkChannels[ucChannel].stSearchStartTime = stSearchStartTime;
+
+   pthread_mutex_unlock(&stLinkStatsLock);
+
+out:
+   ANT_FUNC_END();
+   return status;
+}
@@ -0,0 +1,212 @@
+/*
+ * ANT Stack
+ *
+ * Copyright 2011 Dynastream Innovations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/******************************************************************************\
+*
+*   FILE NAME:      ant_radio_async.c
+*
+*   BRIEF:
+*      This file implements enabling and disabling the radio without waiting
+*      for it, and reporting the progress of each phase.
+*
+*
+\******************************************************************************/
+
+#include <pthread.h>
+#include <stdint.h> /* for uint64_t */
+#include <string.h>
+#include <time.h> /* for clock_gettime() */
+
+#include "ant_types.h"
+#include "ant_native.h"
+#include "ant_radio_async.h"
+#include "ant_state_notify.h"
+#include "ant_thread.h"
+#include "ant_log.h"
+
+#undef LOG_TAG
+#define LOG_TAG "antradio_async"
+
+#define ANT_RADIO_REQUEST_NONE               0
+#define ANT_RADIO_REQUEST_ENABLE             1
+#define ANT_RADIO_REQUEST_DISABLE            2
+
+static ANTNativeANTProgressCb fnProgressCallback = NULL;
+
+static pthread_mutex_t stRadioRequestLock = PTHREAD_MUTEX_INITIALIZER;
+// The request the worker runs next, only the last one made counts.
+static int iRadioRequest = ANT_RADIO_REQUEST_NONE;
+static ANT_BOOL bRadioWorkerRunning = ANT_FALSE;
+
+/*
+ * Runs the requests until there are none left, then exits.
+ */
+static void *fnRadioWorkerThread(void *pvUnused)
+{
+   int iRequest;
+   (void)pvUnused;
+   ANT_FUNC_START();
+
+   pthread_mutex_lock(&stRadioRequestLock);
+   while (iRadioRequest != ANT_RADIO_REQUEST_NONE) {
+      iRequest = iRadioRequest;
+      iRadioRequest = ANT_RADIO_REQUEST_NONE;
+      pthread_mutex_unlock(&stRadioRequestLock);
+
+      // The outcome reaches the caller through the state callback, and which phase failed
+      // through the progress callback.
+      if (iRequest == ANT_RADIO_REQUEST_ENABLE) {
+         ant_enable_radio();
+      } else {
+         ant_disable_radio();
+      }
+
+      pthread_mutex_lock(&stRadioRequestLock);
+   }
+   bRadioWorkerRunning = ANT_FALSE;
+   pthread_mutex_unlock(&stRadioRequestLock);
+
+   ANT_FUNC_END();
+   return NULL;
+}
+
+/*
+ * Hands a request to the worker, starting it if it isn't running.
+ */
+static ANTStatus ant_radio_request(int iRequest)
+{
+   ANTStatus status = ANT_STATUS_SUCCESS;
+   pthread_t stWorkerThread;
+   int iResult;
+
+   pthread_mutex_lock(&stRadioRequestLock);
+   if (!bRadioWorkerRunning) {
+      iResult = ant_thread_create(&stWorkerThread, "enable", fnRadioWorkerThread, NULL);
+      if (iResult) {
+         ANT_ERROR("failed to start radio worker thread: %s", strerror(iResult));
+         status = ANT_STATUS_FAILED;
+         goto out;
+      }
+      pthread_detach(stWorkerThread);
+      bRadioWorkerRunning = ANT_TRUE;
+   }
+   iRadioRequest = iRequest;
+
+out:
+   pthread_mutex_unlock(&stRadioRequestLock);
+   return status;
+}
+
+////////////////////////////////////////////////////////////////////
+//  ant_enable_radio_async
+//
+//  Enables the radio on the worker thread.
+//
+//  Parameters:
+//      -
+//
+//  Returns:
+//      Success:
+//          ANT_STATUS_SUCCESS once the request is made
+//      Failures:
+//          ANT_STATUS_FAILED if the worker thread could not be started
+//
+//  Psuedocode:
+/*
+LOCK request
+    IF worker is not running
+        start worker
+    ENDIF
+    REQUEST = enable, replacing any request not started yet
+UNLOCK
+*/
+////////////////////////////////////////////////////////////////////
+ANTStatus ant_enable_radio_async(void)
+{
+   ANTStatus status;
+   ANT_FUNC_START();
+
+   status = ant_radio_request(ANT_RADIO_REQUEST_ENABLE);
+
+   ANT_FUNC_END();
+   return status;
+}
+
+////////////////////////////////////////////////////////////////////
+//  ant_disable_radio_async
+//
+//  Disables the radio on the worker thread.
+//
+//  Parameters:
+//      -
+//
+//  Returns:
+//      Success:
+//          ANT_STATUS_SUCCESS once the request is made
+//      Failures:
+//          ANT_STATUS_FAILED if the worker thread could not be started
+//
+//  Psuedocode:
+/*
+LOCK request
+    IF worker is not running
+        start worker
+    ENDIF
+    REQUEST = disable, replacing any request not started yet
+UNLOCK
+*/
+////////////////////////////////////////////////////////////////////
+ANTStatus ant_disable_radio_async(void)
+{
+   ANTStatus status;
+   ANT_FUNC_START();
+
+   status = ant_radio_request(ANT_RADIO_REQUEST_DISABLE);
+
+   ANT_FUNC_END();
+   return status;
+}
+
+ANTStatus set_ant_progress_callback(ANTNativeANTProgressCb fnCallback)
+{
+   ANT_FUNC_START();
+
+   __atomic_store_n(&fnProgressCallback, fnCallback, __ATOMIC_RELEASE);
+
+   ANT_FUNC_END();
+   return ANT_STATUS_SUCCESS;
+}
+
+ANT_BOOL ant_progress_wanted(void)
+{
+   return (__atomic_load_n(&fnProgressCallback, __ATOMIC_ACQUIRE) != NULL) ? ANT_TRUE : ANT_FALSE;
+}
+
+ANT_U32 ant_progress_now(void)
+{
+   struct timespec stNow;
+
+   clock_gettime(CLOCK_MONOTONIC, &stNow);
+   return (ANT_U32)((uint64_t)stNow.tv_sec * 1000000 + stNow.tv_nsec / 1000);
+}
+
+void ant_progress_report(ANT_U8 ucPhase, ANTStatus status, ANT_U32 ulStartUs)
+{
+   // Wraps every ~71 minutes, the difference is still right for shorter phases.
+   ant_state_notify_progress(__atomic_load_n(&fnProgressCallback, __ATOMIC_ACQUIRE),
+         ucPhase, status, ant_progress_now() - ulStartUs);
+}
@@ -0,0 +1,186 @@
+/*
+ * ANT Stack
+ *
+ * Copyright 2011 Dynastream Innovations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/******************************************************************************\
+*
+*   FILE NAME:      ant_reactor.c
+*
+*   BRIEF:
+*      This file implements the reactor, an epoll based event loop calling a
+*      handler per file descriptor.
+*
+*
+\******************************************************************************/
+
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <unistd.h> /* for close() */
+
+#include "ant_types.h"
+#include "ant_reactor.h"
+#include "ant_log.h"
+
+#undef LOG_TAG
+#define LOG_TAG "antradio_reactor"
+
+static ant_reactor_source_t *ant_reactor_find(ant_reactor_t *pstReactor, int iFd)
+{
+   int i;
+
+   for (i = 0; i < ANT_REACTOR_MAX_SOURCES; i++) {
+      if (pstReactor->astSources[i].iFd == iFd) {
+         return &pstReactor->astSources[i];
+      }
+   }
+   return NULL;
+}
+
+int ant_reactor_init(ant_reactor_t *pstReactor)
+{
+   int i;
+   int iRet = 0;
+   ANT_FUNC_START();
+
+   for (i = 0; i < ANT_REACTOR_MAX_SOURCES; i++) {
+      pstReactor->astSources[i].iFd = -1;
+   }
+
+   pstReactor->iEpollFd = epoll_create1(EPOLL_CLOEXEC);
+   if (pstReactor->iEpollFd < 0) {
+      ANT_ERROR("failed to create epoll instance: %s", strerror(errno));
+      iRet = -1;
+   }
+
+   ANT_FUNC_END();
+   return iRet;
+}
+
+void ant_reactor_close(ant_reactor_t *pstReactor)
+{
+   ANT_FUNC_START();
+
+   if (pstReactor->iEpollFd >= 0) {
+      close(pstReactor->iEpollFd);
+      pstReactor->iEpollFd = -1;
+   }
+
+   ANT_FUNC_END();
+}
+
+int ant_reactor_add(ant_reactor_t *pstReactor, int iFd, ANT_U32 ulEvents,
+      ant_reactor_handler_t fnHandler, void *pvContext)
+{
+   struct epoll_event stEvent;
+   ant_reactor_source_t *pstSource;
+   int iRet = -1;
+   ANT_FUNC_START();
+
+   if ((iFd < 0) || (fnHandler == NULL) || (ant_reactor_find(pstReactor, iFd) != NULL)) {
+      errno = EINVAL;
+      goto out;
+   }
+
+   pstSource = ant_reactor_find(pstReactor, -1);
+   if (pstSource == NULL) {
+      ANT_ERROR("no room to watch fd %d", iFd);
+      errno = ENOSPC;
+      goto out;
+   }
+
+   memset(&stEvent, 0, sizeof(stEvent));
+   stEvent.events = ulEvents;
+   stEvent.data.ptr = pstSource;
+   if (epoll_ctl(pstReactor->iEpollFd, EPOLL_CTL_ADD, iFd, &stEvent) < 0) {
+      ANT_ERROR("failed to watch fd %d: %s", iFd, strerror(errno));
+      goto out;
+   }
+
+   pstSource->iFd = iFd;
+   pstSource->fnHandler = fnHandler;
+   pstSource->pvContext = pvContext;
+   iRet = 0;
+
+out:
+   ANT_FUNC_END();
+   return iRet;
+}
+
+int ant_reactor_modify(ant_reactor_t *pstReactor, int iFd, ANT_U32 ulEvents)
+{
+   struct epoll_event stEvent;
+   ant_reactor_source_t *pstSource;
+
+   pstSource = (iFd < 0) ? NULL : ant_reactor_find(pstReactor, iFd);
+   if (pstSource == NULL) {
+      errno = EINVAL;
+      return -1;
+   }
+
+   memset(&stEvent, 0, sizeof(stEvent));
+   stEvent.events = ulEvents;
+   stEvent.data.ptr = pstSource;
+   return epoll_ctl(pstReactor->iEpollFd, EPOLL_CTL_MOD, iFd, &stEvent);
+}
+
+int ant_reactor_remove(ant_reactor_t *pstReactor, int iFd)
+{
+   ant_reactor_source_t *pstSource;
+   int iRet;
+   ANT_FUNC_START();
+
+   pstSource = (iFd < 0) ? NULL : ant_reactor_find(pstReactor, iFd);
+   if (pstSource == NULL) {
+      errno = EINVAL;
+      iRet = -1;
+   } else {
+      // Freed even if epoll_ctl() fails, as it only fails if the fd was already closed.
+      iRet = epoll_ctl(pstReactor->iEpollFd, EPOLL_CTL_DEL, iFd, NULL);
+      pstSource->iFd = -1;
+   }
+
+   ANT_FUNC_END();
+   return iRet;
+}
+
+int ant_reactor_dispatch(ant_reactor_t *pstReactor, int iTimeoutMs)
+{
+   struct epoll_event astEvents[ANT_REACTOR_MAX_EVENTS];
+   ant_reactor_source_t *pstSource;
+   int iEvents;
+   int i;
+   int iRet = 0;
+
+   iEvents = epoll_wait(pstReactor->iEpollFd, astEvents, ANT_REACTOR_MAX_EVENTS, iTimeoutMs);
+   if (iEvents < 0) {
+      if (errno == EINTR) {
+         return 0;
+      }
+      ANT_ERROR("waiting for events failed: %s", strerror(errno));
+      return -1;
+   }
+
+   for (i = 0; (i < iEvents) && (iRet >= 0); i++) {
+      pstSource = (ant_reactor_source_t *)astEvents[i].data.ptr;
+      // Skip sources removed by an earlier handler.
+      if (pstSource->iFd >= 0) {
+         iRet = pstSource->fnHandler(pstReactor, pstSource->iFd, astEvents[i].events, pstSource->pvContext);
+      }
+   }
+
+   return iRet;
+}
@@ -0,0 +1,350 @@
+/*
+ * ANT Stack
+ *
+ * Copyright 2011 Dynastream Innovations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/******************************************************************************\
+*
+*   FILE NAME:      ant_rx_pool.c
+*
+*   BRIEF:
+*      This file implements the rx buffer pool and the list of rx consumers.
+*      Each received message is copied into a pool buffer once, and that
+*      buffer is shared by reference with every consumer.
+*
+*
+\******************************************************************************/
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+
+#include "ant_types.h"
+#include "ant_native.h"
+#include "ant_rx_pool.h"
+#include "ant_cache.h"
+#include "ant_command.h"
+#include "ant_journal.h"
+#include "ant_link_stats.h"
+#include "ant_log.h"
+
+#undef LOG_TAG
+#define LOG_TAG "antradio_rxpool"
+
+typedef struct ant_rx_buffer {
+   /* The message given to consumers, must be first so a message can be
+    * converted back to its buffer */
+   ANTRxMessage stMessage;
+   /* Number of references held, the buffer is free when this drops to 0 */
+   ANT_U32 ulRefCount;
+   /* Next buffer in the free list */
+   struct ant_rx_buffer *pstNextFree;
+} ant_rx_buffer_t;
+
+typedef struct {
+   ANTNativeANTEventMsgCb fnConsumer;
+   void *pvContext;
+} ant_rx_consumer_t;
+
+static ant_rx_buffer_t astRxBuffers[ANT_RX_POOL_SIZE];
+static ant_rx_buffer_t *pstRxFreeList = NULL;
+static ANT_BOOL bRxPoolInitialised = ANT_FALSE;
+static pthread_mutex_t stRxPoolLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Read locked while calling consumers, so removing a consumer waits for any
+// callback to it to finish.
+static ant_rx_consumer_t astRxConsumers[ANT_RX_MAX_CONSUMERS];
+static int iRxNumConsumers = 0;
+static pthread_rwlock_t stRxConsumersLock = PTHREAD_RWLOCK_INITIALIZER;
+
+// Called after the transport has delivered a batch of messages read together.
+static ANTNativeANTRxBatchCb fnRxBatchCallback = NULL;
+
+static ant_rx_buffer_t *ant_rx_pool_get(void)
+{
+   int i;
+   ant_rx_buffer_t *pstBuffer;
+
+   pthread_mutex_lock(&stRxPoolLock);
+
+   if (!bRxPoolInitialised) {
+      for (i = 0; i < ANT_RX_POOL_SIZE; i++) {
+         astRxBuffers[i].ulRefCount = 0;
+         astRxBuffers[i].pstNextFree = pstRxFreeList;
+         pstRxFreeList = &astRxBuffers[i];
+      }
+      bRxPoolInitialised = ANT_TRUE;
+   }
+
+   pstBuffer = pstRxFreeList;
+   if (pstBuffer != NULL) {
+      pstRxFreeList = pstBuffer->pstNextFree;
+      pstBuffer->pstNextFree = NULL;
+   }
+
+   pthread_mutex_unlock(&stRxPoolLock);
+
+   return pstBuffer;
+}
+
+static void ant_rx_pool_put(ant_rx_buffer_t *pstBuffer)
+{
+   pthread_mutex_lock(&stRxPoolLock);
+   pstBuffer->pstNextFree = pstRxFreeList;
+   pstRxFreeList = pstBuffer;
+   pthread_mutex_unlock(&stRxPoolLock);
+}
+
+////////////////////////////////////////////////////////////////////
+//  ant_rx_add_consumer
+//
+//  Adds a consumer of received ANT messages.
+//
+//  Parameters:
+//      fnConsumer      function to call with each received message
+//      pvContext       passed back to the consumer with each message
+//
+//  Returns:
+//      Success:
+//          ANT_STATUS_SUCCESS
+//      Failure:
+//          ANT_STATUS_INVALID_PARM if no consumer function given
+//          ANT_STATUS_FAILED if there is no room for another consumer
+//
+//  Psuedocode:
+/*
+LOCK consumers
+    IF consumer list is full
+        RESULT = FAILED
+    ELSE
+        ADD consumer and context to list
+        RESULT = SUCCESS
+    ENDIF
+UNLOCK
+*/
+////////////////////////////////////////////////////////////////////
+ANTStatus ant_rx_add_consumer(ANTNativeANTEventMsgCb fnConsumer, void *pvContext)
+{
+   ANTStatus status = ANT_STATUS_INVALID_PARM;
+   ANT_FUNC_START();
+
+   if (fnConsumer == NULL) {
+      goto out;
+   }
+
+   pthread_rwlock_wrlock(&stRxConsumersLock);
+
+   if (iRxNumConsumers >= ANT_RX_MAX_CONSUMERS) {
+      ANT_ERROR("no room for another rx consumer, %d already added", iRxNumConsumers);
+      status = ANT_STATUS_FAILED;
+   } else {
+      astRxConsumers[iRxNumConsumers].fnConsumer = fnConsumer;
+      astRxConsumers[iRxNumConsumers].pvContext = pvContext;
+      iRxNumConsumers++;
+      status = ANT_STATUS_SUCCESS;
+   }
+
+   pthread_rwlock_unlock(&stRxConsumersLock);
+
+out:
+   ANT_FUNC_END();
+   return status;
+}
+
+////////////////////////////////////////////////////////////////////
+//  ant_rx_remove_consumer
+//
+//  Removes a consumer of received ANT messages.
+//
+//  Parameters:
+//      fnConsumer      function given when the consumer was added
+//      pvContext       context given when the consumer was added
+//
+//  Returns:
+//      Success:
+//          ANT_STATUS_SUCCESS
+//      Failure:
+//          ANT_STATUS_NO_VALUE_AVAILABLE if the consumer was not added
+//
+//  Psuedocode:
+/*
+LOCK consumers (waits for callbacks in progress)
+    IF consumer and context are in list
+        REMOVE from list
+        RESULT = SUCCESS
+    ELSE
+        RESULT = NO VALUE AVAILABLE
+    ENDIF
+UNLOCK
+*/
+////////////////////////////////////////////////////////////////////
+ANTStatus ant_rx_remove_consumer(ANTNativeANTEventMsgCb fnConsumer, void *pvContext)
+{
+   int i;
+   ANTStatus status = ANT_STATUS_NO_VALUE_AVAILABLE;
+   ANT_FUNC_START();
+
+   pthread_rwlock_wrlock(&stRxConsumersLock);
+
+   for (i = 0; i < iRxNumConsumers; i++) {
+      if ((astRxConsumers[i].fnConsumer == fnConsumer) && (astRxConsumers[i].pvContext == pvContext)) {
+         iRxNumConsumers--;
+         memmove(&astRxConsumers[i], &astRxConsumers[i + 1], (iRxNumConsumers - i) * sizeof(astRxConsumers[0]));
+         status = ANT_STATUS_SUCCESS;
+         break;
+      }
+   }
+
+   pthread_rwlock_unlock(&stRxConsumersLock);
+
+   ANT_FUNC_END();
+   return status;
+}
+
+////////////////////////////////////////////////////////////////////
+//  ant_rx_acquire
+//
+//  Takes a reference on an rx message.
+//
+//  Parameters:
+//      pstMessage      message given to a consumer
+//
+//  Returns:
+//      pstMessage
+////////////////////////////////////////////////////////////////////
+ANTRxMessage *ant_rx_acquire(ANTRxMessage *pstMessage)
+{
+   if (pstMessage != NULL) {
+      __atomic_add_fetch(&((ant_rx_buffer_t *)pstMessage)->ulRefCount, 1, __ATOMIC_RELAXED);
+   }
+
+   return pstMessage;
+}
+
+////////////////////////////////////////////////////////////////////
+//  ant_rx_release
+//
+//  Drops a reference on an rx message, returning its buffer to the pool when
+//  it was the last one.
+//
+//  Parameters:
+//      pstMessage      message previously acquired
+//
+//  Returns:
+//      -
+////////////////////////////////////////////////////////////////////
+void ant_rx_release(ANTRxMessage *pstMessage)
+{
+   ant_rx_buffer_t *pstBuffer = (ant_rx_buffer_t *)pstMessage;
+
+   if (pstBuffer == NULL) {
+      return;
+   }
+
+   if (__atomic_sub_fetch(&pstBuffer->ulRefCount, 1, __ATOMIC_ACQ_REL) == 0) {
+      ant_rx_pool_put(pstBuffer);
+   }
+}
+
+////////////////////////////////////////////////////////////////////
+//  ant_rx_pool_dispatch
+//
+//  Updates the channel state cache and link statistics and matches a received
+//  ANT message against commands waiting for a response, then passes it to
+//  every rx consumer in a single pool buffer.
+//
+//  Parameters:
+//      ulSeq           rx sequence stamp of the message
+//      ucLen           length of the message
+//      pucData         the message, only valid during this call
+//
+//  Returns:
+//      -
+//
+//  Psuedocode:
+/*
+UPDATE channel state cache and link statistics
+MATCH message to waiting commands
+READ LOCK consumers
+    IF there are consumers
+        GET free buffer from pool
+        IF no free buffer
+            Log warning, message is dropped for consumers
+        ELSE
+            COPY message into buffer, hold a reference
+            FOR each consumer
+                CALL consumer with buffer
+            ENDFOR
+            RELEASE reference
+        ENDIF
+    ENDIF
+UNLOCK
+*/
+////////////////////////////////////////////////////////////////////
+void ant_rx_pool_dispatch(ANT_U32 ulSeq, ANT_U8 ucLen, ANT_U8 *pucData)
+{
+   int i;
+   ant_rx_buffer_t *pstBuffer;
+
+   ant_cache_rx_message(ucLen, pucData);
+   ant_link_stats_rx_message(ucLen, pucData);
+   ant_command_rx_message(ucLen, pucData);
+   ant_journal_rx_message(ucLen, pucData);
+
+   pthread_rwlock_rdlock(&stRxConsumersLock);
+
+   if (iRxNumConsumers == 0) {
+      goto out;
+   }
+
+   pstBuffer = ant_rx_pool_get();
+   if (pstBuffer == NULL) {
+      ANT_WARN("all %d rx buffers are held, dropping message %u for consumers", ANT_RX_POOL_SIZE, ulSeq);
+      goto out;
+   }
+
+   pstBuffer->stMessage.ulSeq = ulSeq;
+   pstBuffer->stMessage.ucLen = ucLen;
+   memcpy(pstBuffer->stMessage.aucData, pucData, ucLen);
+   pstBuffer->ulRefCount = 1;
+
+   for (i = 0; i < iRxNumConsumers; i++) {
+      astRxConsumers[i].fnConsumer(&pstBuffer->stMessage, astRxConsumers[i].pvContext);
+   }
+
+   ant_rx_release(&pstBuffer->stMessage);
+
+out:
+   pthread_rwlock_unlock(&stRxConsumersLock);
+}
+
+ANTStatus set_ant_rx_batch_callback(ANTNativeANTRxBatchCb fnBatchCallback)
+{
+   ANT_FUNC_START();
+
+   __atomic_store_n(&fnRxBatchCallback, fnBatchCallback, __ATOMIC_RELEASE);
+
+   ANT_FUNC_END();
+   return ANT_STATUS_SUCCESS;
+}
+
+void ant_rx_pool_batch_end(void)
+{
+   ANTNativeANTRxBatchCb fnBatchCallback = __atomic_load_n(&fnRxBatchCallback, __ATOMIC_ACQUIRE);
+
+   if (fnBatchCallback != NULL) {
+      fnBatchCallback();
+   }
+}
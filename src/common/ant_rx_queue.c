@@ -0,0 +1,170 @@
+/*
+ * ANT Stack
+ *
+ * Copyright 2011 Dynastream Innovations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/******************************************************************************\
+*
+*   FILE NAME:      ant_rx_queue.c
+*
+*   BRIEF:
+*      This file implements the rx queue, messages waiting for the rx loop to
+*      deliver them as if they had been read from the chip. An eventfd tells
+*      the loop there is something to deliver.
+*
+*
+\******************************************************************************/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "ant_types.h"
+#include "ant_native.h"
+#include "ant_rx_queue.h"
+#include "ant_log.h"
+
+#undef LOG_TAG
+#define LOG_TAG "antradio_rx_queue"
+
+typedef struct {
+   ANT_U8 ucLen;
+   ANT_U8 aucMesg[ANT_NATIVE_MAX_MESSAGE_SIZE];
+} ant_rx_queue_entry_t;
+
+static pthread_mutex_t stRxQueueLock = PTHREAD_MUTEX_INITIALIZER;
+static ant_rx_queue_entry_t astRxQueue[ANT_RX_QUEUE_SIZE];
+static int iRxQueueHead = 0;
+static int iRxQueueCount = 0;
+static int iRxQueueEventFd = -1;
+
+int ant_rx_queue_open(void)
+{
+   int iRet = 0;
+   ANT_FUNC_START();
+
+   pthread_mutex_lock(&stRxQueueLock);
+   iRxQueueCount = 0;
+   // Non blocking so it can be reset by reading it whether or not it was signalled.
+   iRxQueueEventFd = eventfd(0, EFD_NONBLOCK);
+   if (iRxQueueEventFd < 0) {
+      ANT_ERROR("failed to create rx queue eventfd: %s", strerror(errno));
+      iRet = -1;
+   }
+   pthread_mutex_unlock(&stRxQueueLock);
+
+   ANT_FUNC_END();
+   return iRet;
+}
+
+void ant_rx_queue_close(void)
+{
+   ANT_FUNC_START();
+
+   pthread_mutex_lock(&stRxQueueLock);
+   iRxQueueCount = 0;
+   if ((iRxQueueEventFd >= 0) && (close(iRxQueueEventFd) < 0)) {
+      ANT_ERROR("failed to close rx queue eventfd: %s", strerror(errno));
+   }
+   iRxQueueEventFd = -1;
+   pthread_mutex_unlock(&stRxQueueLock);
+
+   ANT_FUNC_END();
+}
+
+int ant_rx_queue_fd(void)
+{
+   return iRxQueueEventFd;
+}
+
+void ant_rx_queue_clear(void)
+{
+   ANT_FUNC_START();
+
+   pthread_mutex_lock(&stRxQueueLock);
+   if (iRxQueueCount > 0) {
+      ANT_DEBUG_W("dropping %d queued rx messages", iRxQueueCount);
+   }
+   iRxQueueCount = 0;
+   pthread_mutex_unlock(&stRxQueueLock);
+   ant_rx_queue_ack();
+
+   ANT_FUNC_END();
+}
+
+ANTStatus ant_rx_queue_message(ANT_U8 ucLen, const ANT_U8 *pucMesg)
+{
+   ANTStatus status = ANT_STATUS_FAILED;
+   ant_rx_queue_entry_t *pstEntry;
+   static const uint64_t ullOne = 1;
+   ANT_FUNC_START();
+
+   if (ucLen == 0) {
+      status = ANT_STATUS_INVALID_PARM;
+      goto out;
+   }
+
+   pthread_mutex_lock(&stRxQueueLock);
+   if ((iRxQueueEventFd < 0) || (iRxQueueCount == ANT_RX_QUEUE_SIZE)) {
+      pthread_mutex_unlock(&stRxQueueLock);
+      goto out;
+   }
+
+   pstEntry = &astRxQueue[(iRxQueueHead + iRxQueueCount) % ANT_RX_QUEUE_SIZE];
+   pstEntry->ucLen = ucLen;
+   memcpy(pstEntry->aucMesg, pucMesg, ucLen);
+   iRxQueueCount++;
+
+   if (write(iRxQueueEventFd, &ullOne, sizeof(ullOne)) < 0) {
+      // Still delivered along with the next message queued.
+      ANT_ERROR("failed to signal rx queue eventfd: %s", strerror(errno));
+   }
+   pthread_mutex_unlock(&stRxQueueLock);
+
+   status = ANT_STATUS_SUCCESS;
+
+out:
+   ANT_FUNC_END();
+   return status;
+}
+
+ANT_U8 ant_rx_queue_get(ANT_U8 *pucMesg)
+{
+   ANT_U8 ucLen = 0;
+
+   pthread_mutex_lock(&stRxQueueLock);
+   if (iRxQueueCount > 0) {
+      ucLen = astRxQueue[iRxQueueHead].ucLen;
+      memcpy(pucMesg, astRxQueue[iRxQueueHead].aucMesg, ucLen);
+      iRxQueueHead = (iRxQueueHead + 1) % ANT_RX_QUEUE_SIZE;
+      iRxQueueCount--;
+   }
+   pthread_mutex_unlock(&stRxQueueLock);
+
+   return ucLen;
+}
+
+void ant_rx_queue_ack(void)
+{
+   uint64_t ullCounter;
+
+   if (iRxQueueEventFd >= 0) {
+      // Fails with EAGAIN if it was not signalled, which is fine.
+      (void)read(iRxQueueEventFd, &ullCounter, sizeof(ullCounter));
+   }
+}
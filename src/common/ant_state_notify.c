@@ -0,0 +1,283 @@
+/*
+ * ANT Stack
+ *
+ * Copyright 2011 Dynastream Innovations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/******************************************************************************\
+*
+*   FILE NAME:      ant_state_notify.c
+*
+*   BRIEF:
+*      This file implements delivering radio enabled status changes to the
+*      state callback from a notifier thread, outside of the enable locks. The
+*      thread is started by the first change and waits for more until
+*      ant_state_notify_stop(). When deferred the changes are delivered by
+*      ant_state_notify_flush() instead.
+*
+*
+\******************************************************************************/
+
+#include <pthread.h>
+#include <string.h>
+
+#include "ant_types.h"
+#include "ant_native.h"
+#include "ant_state_notify.h"
+#include "ant_thread.h"
+#include "ant_log.h"
+
+#undef LOG_TAG
+#define LOG_TAG "antradio_state"
+
+typedef struct {
+   ANTNativeANTStateCb fnCallback;
+   ANTRadioEnabledStatus uiState;
+   // Set instead of fnCallback for progress of enabling or disabling.
+   ANTNativeANTProgressCb fnProgress;
+   ANT_U8 ucPhase;
+   ANTStatus status;
+   ANT_U32 ulPhaseUs;
+} ant_state_change_t;
+
+static pthread_mutex_t stStateNotifyLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t stStateNotifyCond = PTHREAD_COND_INITIALIZER;
+static pthread_t stNotifierThread;
+static ant_state_change_t astStateQueue[ANT_STATE_NOTIFY_QUEUE_SIZE];
+static int iStateQueueHead = 0;
+static int iStateQueueCount = 0;
+// The newest change queued, delivered or not, to drop repeats of it.
+static ant_state_change_t stLastStateChange = { NULL, 0, NULL, 0, 0, 0 };
+static ANT_BOOL bNotifierStarted = ANT_FALSE;
+// Set while a thread is calling the callbacks, so only one does at a time.
+static ANT_BOOL bNotifyDelivering = ANT_FALSE;
+static ANT_BOOL bNotifyDeferred = ANT_FALSE;
+
+static void *fnStateNotifierThread(void *pvUnused);
+
+/*
+ * Delivers the queued changes one at a time until the queue is empty, or for
+ * the notifier thread until they are deferred. Must be called with
+ * stStateNotifyLock held, and from only one thread at a time so the callbacks
+ * see the changes in order.
+ */
+static void ant_state_notify_deliver(ANT_BOOL bFlush)
+{
+   ant_state_change_t stChange;
+
+   while ((iStateQueueCount > 0) && (bFlush || !bNotifyDeferred)) {
+      stChange = astStateQueue[iStateQueueHead];
+      iStateQueueHead = (iStateQueueHead + 1) % ANT_STATE_NOTIFY_QUEUE_SIZE;
+      iStateQueueCount--;
+      pthread_mutex_unlock(&stStateNotifyLock);
+
+      if (stChange.fnProgress != NULL) {
+         ANT_DEBUG_D("notifying phase %u took %u us with %d", stChange.ucPhase, stChange.ulPhaseUs, stChange.status);
+         stChange.fnProgress(stChange.ucPhase, stChange.status, stChange.ulPhaseUs);
+      } else {
+         ANT_DEBUG_D("notifying state %d", (int)stChange.uiState);
+         stChange.fnCallback(stChange.uiState);
+      }
+
+      pthread_mutex_lock(&stStateNotifyLock);
+   }
+}
+
+/*
+ * Wakes the notifier thread for a change just queued, starting it if this is
+ * the first. Must be called with stStateNotifyLock held.
+ */
+static void ant_state_notify_wake(void)
+{
+   int iResult;
+
+   if (bNotifierStarted) {
+      // A stopped thread may still be waiting to exit, so wake them all.
+      pthread_cond_broadcast(&stStateNotifyCond);
+      return;
+   }
+
+   iResult = ant_thread_create(&stNotifierThread, "state", fnStateNotifierThread, NULL);
+   if (iResult) {
+      ANT_ERROR("failed to start state notifier thread: %s", strerror(iResult));
+      iStateQueueCount = 0;
+      stLastStateChange.fnCallback = NULL;
+   } else {
+      bNotifierStarted = ANT_TRUE;
+   }
+}
+
+/*
+ * Delivers the queued changes one at a time, sleeping while there are none or
+ * they are deferred, until ant_state_notify_stop(). Only one thread calls the
+ * callbacks at a time, so they see the changes in order.
+ */
+static void *fnStateNotifierThread(void *pvUnused)
+{
+   (void)pvUnused;
+   ANT_FUNC_START();
+
+   pthread_mutex_lock(&stStateNotifyLock);
+   for (;;) {
+      if ((iStateQueueCount > 0) && !bNotifyDeferred && !bNotifyDelivering) {
+         bNotifyDelivering = ANT_TRUE;
+         ant_state_notify_deliver(ANT_FALSE);
+         bNotifyDelivering = ANT_FALSE;
+      } else if (!bNotifierStarted || !pthread_equal(pthread_self(), stNotifierThread)) {
+         // Stopped, and maybe replaced by a thread started for a later change.
+         break;
+      } else {
+         pthread_cond_wait(&stStateNotifyCond, &stStateNotifyLock);
+      }
+   }
+   pthread_mutex_unlock(&stStateNotifyLock);
+
+   ANT_FUNC_END();
+   return NULL;
+}
+
+void ant_state_notify(ANTNativeANTStateCb fnCallback, ANTRadioEnabledStatus uiNewState)
+{
+   int iTail;
+   ANT_FUNC_START();
+
+   if (fnCallback == NULL) {
+      goto out;
+   }
+
+   pthread_mutex_lock(&stStateNotifyLock);
+
+   if ((stLastStateChange.fnCallback == fnCallback) && (stLastStateChange.uiState == uiNewState)) {
+      ANT_DEBUG_V("state %d already notified", (int)uiNewState);
+      pthread_mutex_unlock(&stStateNotifyLock);
+      goto out;
+   }
+
+   if (iStateQueueCount == ANT_STATE_NOTIFY_QUEUE_SIZE) {
+      // The callback is stuck, only the newest state matters now.
+      iTail = (iStateQueueHead + iStateQueueCount - 1) % ANT_STATE_NOTIFY_QUEUE_SIZE;
+      ANT_WARN("state notification queue full, replacing the last one with state %d", (int)uiNewState);
+   } else {
+      iTail = (iStateQueueHead + iStateQueueCount) % ANT_STATE_NOTIFY_QUEUE_SIZE;
+      iStateQueueCount++;
+   }
+   memset(&astStateQueue[iTail], 0, sizeof(astStateQueue[iTail]));
+   astStateQueue[iTail].fnCallback = fnCallback;
+   astStateQueue[iTail].uiState = uiNewState;
+   stLastStateChange = astStateQueue[iTail];
+
+   if (!bNotifyDeferred) {
+      ant_state_notify_wake();
+   }
+
+   pthread_mutex_unlock(&stStateNotifyLock);
+
+out:
+   ANT_FUNC_END();
+}
+
+void ant_state_notify_progress(ANTNativeANTProgressCb fnProgress, ANT_U8 ucPhase, ANTStatus status, ANT_U32 ulPhaseUs)
+{
+   ant_state_change_t *pstChange;
+   ANT_FUNC_START();
+
+   if (fnProgress == NULL) {
+      goto out;
+   }
+
+   pthread_mutex_lock(&stStateNotifyLock);
+
+   if (iStateQueueCount == ANT_STATE_NOTIFY_QUEUE_SIZE) {
+      // State changes matter more, don't replace one with progress.
+      ANT_WARN("state notification queue full, dropping progress of phase %u", ucPhase);
+      pthread_mutex_unlock(&stStateNotifyLock);
+      goto out;
+   }
+
+   pstChange = &astStateQueue[(iStateQueueHead + iStateQueueCount) % ANT_STATE_NOTIFY_QUEUE_SIZE];
+   iStateQueueCount++;
+   memset(pstChange, 0, sizeof(*pstChange));
+   pstChange->fnProgress = fnProgress;
+   pstChange->ucPhase = ucPhase;
+   pstChange->status = status;
+   pstChange->ulPhaseUs = ulPhaseUs;
+
+   if (!bNotifyDeferred) {
+      ant_state_notify_wake();
+   }
+
+   pthread_mutex_unlock(&stStateNotifyLock);
+
+out:
+   ANT_FUNC_END();
+}
+
+void ant_state_notify_set_deferred(ANT_BOOL bDeferred)
+{
+   ANT_FUNC_START();
+
+   pthread_mutex_lock(&stStateNotifyLock);
+   bNotifyDeferred = bDeferred;
+   if (!bDeferred && (iStateQueueCount > 0)) {
+      ant_state_notify_wake();
+   }
+   pthread_mutex_unlock(&stStateNotifyLock);
+
+   ANT_FUNC_END();
+}
+
+void ant_state_notify_flush(void)
+{
+   ANT_FUNC_START();
+
+   pthread_mutex_lock(&stStateNotifyLock);
+   // Left to whoever is delivering already, so the order is kept.
+   if (bNotifyDeferred && !bNotifyDelivering) {
+      bNotifyDelivering = ANT_TRUE;
+      ant_state_notify_deliver(ANT_TRUE);
+      bNotifyDelivering = ANT_FALSE;
+      // The notifier thread may have waited for this delivery to finish.
+      pthread_cond_broadcast(&stStateNotifyCond);
+   }
+   pthread_mutex_unlock(&stStateNotifyLock);
+
+   ANT_FUNC_END();
+}
+
+void ant_state_notify_stop(void)
+{
+   ANT_BOOL bJoin;
+   pthread_t stThread;
+   ANT_FUNC_START();
+
+   pthread_mutex_lock(&stStateNotifyLock);
+   bJoin = bNotifierStarted;
+   stThread = stNotifierThread;
+   bNotifierStarted = ANT_FALSE;
+   // The changes still queued are delivered before the thread exits.
+   bNotifyDeferred = ANT_FALSE;
+   pthread_cond_broadcast(&stStateNotifyCond);
+   pthread_mutex_unlock(&stStateNotifyLock);
+
+   if (bJoin) {
+      if (pthread_equal(pthread_self(), stThread)) {
+         // Stopped from a callback, the thread exits once the callback returns.
+         pthread_detach(stThread);
+      } else {
+         pthread_join(stThread, NULL);
+      }
+   }
+
+   ANT_FUNC_END();
+}
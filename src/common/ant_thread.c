@@ -0,0 +1,241 @@
+/*
+ * ANT Stack
+ *
+ * Copyright 2011 Dynastream Innovations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/******************************************************************************\
+*
+*   FILE NAME:      ant_thread.c
+*
+*   BRIEF:
+*      This file implements starting the HAL's threads with the scheduling,
+*      CPU affinity, stack size and names set by ant_set_thread_config().
+*
+*
+\******************************************************************************/
+
+#define _GNU_SOURCE /* needed for CPU_SET(), sched_setaffinity() and pthread_setname_np() */
+
+#include <errno.h>
+#include <limits.h> /* for PTHREAD_STACK_MIN */
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h> /* for _POSIX_THREAD_PRIO_INHERIT */
+
+#include "ant_types.h"
+#include "ant_native.h"
+#include "ant_thread.h"
+#include "ant_log.h"
+
+#undef LOG_TAG
+#define LOG_TAG "antradio_thread"
+
+// Linux thread names are at most 15 characters.
+#define ANT_THREAD_NAME_SIZE                 16
+// CPUs that can be picked in ulCpuMask.
+#define ANT_THREAD_MAX_CPUS                  32
+
+typedef struct {
+   void *(*fnStart)(void *);
+   void *pvArg;
+   ANTThreadConfig stConfig;
+   char acName[ANT_THREAD_NAME_SIZE];
+} ant_thread_start_t;
+
+static pthread_mutex_t stThreadConfigLock = PTHREAD_MUTEX_INITIALIZER;
+static ANTThreadConfig stThreadConfig = {
+   ANT_THREAD_SCHED_DEFAULT, 0, 0, 0, ANT_THREAD_DEFAULT_NAME_PREFIX
+};
+
+/*
+ * Applies the settings that can only be set by the thread itself. Runs on the
+ * new thread before its start function.
+ */
+static void ant_thread_apply(const ant_thread_start_t *pstStart)
+{
+   const ANTThreadConfig *pstConfig = &pstStart->stConfig;
+   struct sched_param stParam;
+   cpu_set_t stCpus;
+   int iCpu;
+   int iResult;
+
+   iResult = pthread_setname_np(pthread_self(), pstStart->acName);
+   if (iResult) {
+      ANT_WARN("failed to name thread %s: %s", pstStart->acName, strerror(iResult));
+   }
+
+   if (pstConfig->ulCpuMask != 0) {
+      CPU_ZERO(&stCpus);
+      for (iCpu = 0; iCpu < ANT_THREAD_MAX_CPUS; iCpu++) {
+         if (pstConfig->ulCpuMask & (1u << iCpu)) {
+            CPU_SET(iCpu, &stCpus);
+         }
+      }
+      // 0 is the calling thread.
+      if (sched_setaffinity(0, sizeof(stCpus), &stCpus) < 0) {
+         ANT_WARN("failed to set CPU affinity of %s: %s", pstStart->acName, strerror(errno));
+      }
+   }
+
+   if (pstConfig->ucSchedPolicy != ANT_THREAD_SCHED_DEFAULT) {
+      memset(&stParam, 0, sizeof(stParam));
+      stParam.sched_priority = pstConfig->ucSchedPriority;
+      iResult = pthread_setschedparam(pthread_self(),
+            (pstConfig->ucSchedPolicy == ANT_THREAD_SCHED_FIFO) ? SCHED_FIFO : SCHED_RR, &stParam);
+      if (iResult) {
+         ANT_WARN("failed to set real-time scheduling of %s: %s", pstStart->acName, strerror(iResult));
+      }
+   }
+}
+
+static void *fnThreadStart(void *pvStart)
+{
+   ant_thread_start_t stStart = *(ant_thread_start_t *)pvStart;
+
+   free(pvStart);
+   ant_thread_apply(&stStart);
+
+   return stStart.fnStart(stStart.pvArg);
+}
+
+////////////////////////////////////////////////////////////////////
+//  ant_set_thread_config
+//
+//  Sets up how the threads the HAL starts from now on are run.
+//
+//  Parameters:
+//      pstConfig   the thread settings
+//
+//  Returns:
+//      Success:
+//          ANT_STATUS_SUCCESS
+//      Failures:
+//          ANT_STATUS_INVALID_PARM if a setting is out of range
+//
+//  Psuedocode:
+/*
+IF no config, unknown policy, real-time priority out of range, stack too small or name prefix not terminated
+    RESULT = INVALID PARAM
+ELSE
+    LOCK config
+        STORE config
+    UNLOCK
+    RESULT = SUCCESS
+ENDIF
+*/
+////////////////////////////////////////////////////////////////////
+ANTStatus ant_set_thread_config(const ANTThreadConfig *pstConfig)
+{
+   ANTStatus status = ANT_STATUS_INVALID_PARM;
+   int iPolicy;
+   ANT_FUNC_START();
+
+   if (pstConfig == NULL) {
+      goto out;
+   }
+
+   if (pstConfig->ucSchedPolicy == ANT_THREAD_SCHED_FIFO) {
+      iPolicy = SCHED_FIFO;
+   } else if (pstConfig->ucSchedPolicy == ANT_THREAD_SCHED_RR) {
+      iPolicy = SCHED_RR;
+   } else if (pstConfig->ucSchedPolicy != ANT_THREAD_SCHED_DEFAULT) {
+      ANT_ERROR("unknown scheduling policy %u", pstConfig->ucSchedPolicy);
+      goto out;
+   } else {
+      iPolicy = -1;
+   }
+
+   if ((iPolicy != -1) && ((pstConfig->ucSchedPriority < sched_get_priority_min(iPolicy)) ||
+         (pstConfig->ucSchedPriority > sched_get_priority_max(iPolicy)))) {
+      ANT_ERROR("real-time priority %u out of range", pstConfig->ucSchedPriority);
+      goto out;
+   }
+
+   if ((pstConfig->ulStackSize != 0) && (pstConfig->ulStackSize < PTHREAD_STACK_MIN)) {
+      ANT_ERROR("stack size %u below the minimum of %u", pstConfig->ulStackSize, (ANT_U32)PTHREAD_STACK_MIN);
+      goto out;
+   }
+
+   if (memchr(pstConfig->acNamePrefix, '\0', sizeof(pstConfig->acNamePrefix)) == NULL) {
+      ANT_ERROR("thread name prefix is not terminated");
+      goto out;
+   }
+
+   pthread_mutex_lock(&stThreadConfigLock);
+   stThreadConfig = *pstConfig;
+   pthread_mutex_unlock(&stThreadConfigLock);
+   status = ANT_STATUS_SUCCESS;
+
+out:
+   ANT_FUNC_END();
+   return status;
+}
+
+int ant_thread_create(pthread_t *pstThread, const char *pcRole, void *(*fnStart)(void *), void *pvArg)
+{
+   ant_thread_start_t *pstStart;
+   pthread_attr_t stAttr;
+   int iResult;
+
+   pstStart = malloc(sizeof(*pstStart));
+   if (pstStart == NULL) {
+      return ENOMEM;
+   }
+   pstStart->fnStart = fnStart;
+   pstStart->pvArg = pvArg;
+
+   pthread_mutex_lock(&stThreadConfigLock);
+   pstStart->stConfig = stThreadConfig;
+   pthread_mutex_unlock(&stThreadConfigLock);
+
+   snprintf(pstStart->acName, sizeof(pstStart->acName), "%s%s", pstStart->stConfig.acNamePrefix, pcRole);
+
+   pthread_attr_init(&stAttr);
+   if (pstStart->stConfig.ulStackSize != 0) {
+      iResult = pthread_attr_setstacksize(&stAttr, pstStart->stConfig.ulStackSize);
+      if (iResult) {
+         ANT_WARN("failed to set stack size of %s: %s", pstStart->acName, strerror(iResult));
+      }
+   }
+
+   iResult = pthread_create(pstThread, &stAttr, fnThreadStart, pstStart);
+   if (iResult) {
+      free(pstStart);
+   }
+
+   pthread_attr_destroy(&stAttr);
+   return iResult;
+}
+
+int ant_thread_mutex_init(pthread_mutex_t *pstMutex)
+{
+   pthread_mutexattr_t stAttr;
+   int iResult;
+
+   pthread_mutexattr_init(&stAttr);
+#if defined(_POSIX_THREAD_PRIO_INHERIT) && (_POSIX_THREAD_PRIO_INHERIT > 0)
+   iResult = pthread_mutexattr_setprotocol(&stAttr, PTHREAD_PRIO_INHERIT);
+   if (iResult) {
+      ANT_WARN("priority inheritance not available: %s", strerror(iResult));
+   }
+#endif // _POSIX_THREAD_PRIO_INHERIT
+   iResult = pthread_mutex_init(pstMutex, &stAttr);
+   pthread_mutexattr_destroy(&stAttr);
+
+   return iResult;
+}
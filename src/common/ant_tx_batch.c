@@ -0,0 +1,197 @@
+/*
+ * ANT Stack
+ *
+ * Copyright 2011 Dynastream Innovations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/******************************************************************************\
+*
+*   FILE NAME:      ant_tx_batch.c
+*
+*   BRIEF:
+*      This file implements sending several ANT messages, or a whole burst
+*      transfer, with one call into the HAL.
+*
+*
+\******************************************************************************/
+
+#include <string.h>
+
+#include "ant_types.h"
+#include "ant_native.h"
+#include "ant_message.h"
+#include "ant_log.h"
+
+#undef LOG_TAG
+#define LOG_TAG "antradio_tx_batch"
+
+////////////////////////////////////////////////////////////////////
+//  ant_tx_messages
+//
+//  Sends length prefixed messages packed in a buffer one after the other.
+//
+//  Parameters:
+//      ulCount       Maximum number of messages to send
+//      pucMessages   The packed messages
+//      ulSize        Number of bytes in pucMessages
+//      pulSent       Set to the number of messages sent, may be NULL
+//
+//  Returns:
+//      Success:
+//          ANT_STATUS_SUCCESS
+//      Failures:
+//          ANT_STATUS_INVALID_PARM if a message runs past the end of the buffer
+//          The status of the first message that could not be sent
+//
+//  Psuedocode:
+/*
+FOR each message, while there are messages left
+    IF the message does not fit in the buffer
+        RESULT = INVALID PARAMETER
+    ELSE
+        COPY message out of the caller's buffer
+        Tx message
+        IF failed
+            RESULT = tx result
+        ENDIF
+    ENDIF
+ENDFOR
+*/
+////////////////////////////////////////////////////////////////////
+ANTStatus ant_tx_messages(ANT_U32 ulCount, const ANT_U8 *pucMessages, ANT_U32 ulSize, ANT_U32 *pulSent)
+{
+   ANTStatus status = ANT_STATUS_SUCCESS;
+   ANT_U8 aucMesg[ANT_NATIVE_MAX_MESSAGE_SIZE];
+   ANT_U32 ulOffset = 0;
+   ANT_U32 ulSent = 0;
+   ANT_U8 ucLen;
+   ANT_FUNC_START();
+
+   if ((pucMessages == NULL) && (ulSize != 0)) {
+      status = ANT_STATUS_INVALID_PARM;
+      goto out;
+   }
+
+   while (ulSent < ulCount) {
+      if (ulOffset >= ulSize) {
+         ANT_ERROR("tx batch: only %u of %u messages in %u bytes", ulSent, ulCount, ulSize);
+         status = ANT_STATUS_INVALID_PARM;
+         goto out;
+      }
+
+      ucLen = pucMessages[ulOffset];
+      if ((ucLen < ANT_MSG_HEADER_SIZE) || (ucLen > ulSize - ulOffset - 1)) {
+         ANT_ERROR("tx batch: message %u of %u bytes does not fit", ulSent, ucLen);
+         status = ANT_STATUS_INVALID_PARM;
+         goto out;
+      }
+
+      // The transport may hold on to the message while waiting for flow
+      // control, so don't hand it memory the caller can still change.
+      memcpy(aucMesg, pucMessages + ulOffset + 1, ucLen);
+
+      status = ant_tx_message(ucLen, aucMesg);
+      if (status != ANT_STATUS_SUCCESS) {
+         ANT_DEBUG_D("tx batch: message %u failed with %d", ulSent, status);
+         goto out;
+      }
+
+      ulOffset += ucLen + 1;
+      ulSent++;
+   }
+
+out:
+   if (pulSent != NULL) {
+      *pulSent = ulSent;
+   }
+
+   ANT_FUNC_END();
+   return status;
+}
+
+////////////////////////////////////////////////////////////////////
+//  ant_tx_burst
+//
+//  Sends a buffer as a burst transfer.
+//
+//  Parameters:
+//      ucChannel   Channel to send the burst on
+//      ulLen       Number of bytes to send
+//      pucData     The bytes to send
+//
+//  Returns:
+//      Success:
+//          ANT_STATUS_SUCCESS
+//      Failures:
+//          ANT_STATUS_INVALID_PARM if there is nothing to send
+//          The status of the first packet that could not be sent
+//
+//  Psuedocode:
+/*
+FOR each 8 bytes of data
+    SET sequence: 0 for the first packet, then 1, 2, 3, 1, ...
+    IF last packet
+        SET last packet bit, pad with zeros
+    ENDIF
+    Tx burst data packet
+    IF failed
+        RESULT = tx result
+    ENDIF
+ENDFOR
+*/
+////////////////////////////////////////////////////////////////////
+ANTStatus ant_tx_burst(ANT_U8 ucChannel, ANT_U32 ulLen, const ANT_U8 *pucData)
+{
+   ANTStatus status = ANT_STATUS_INVALID_PARM;
+   ANT_U8 aucPacket[ANT_BURST_PACKET_SIZE];
+   ANT_U32 ulOffset = 0;
+   ANT_U32 ulChunk;
+   ANT_U8 ucSequence = 0;
+   ANT_FUNC_START();
+
+   if ((ulLen == 0) || (pucData == NULL) || (ucChannel > ANT_CHANNEL_NUMBER_MASK)) {
+      goto out;
+   }
+
+   aucPacket[ANT_MSG_LENGTH_OFFSET] = ANT_BURST_PACKET_SIZE - ANT_MSG_HEADER_SIZE;
+   aucPacket[ANT_MSG_ID_OFFSET] = MESG_BURST_DATA_ID;
+
+   while (ulOffset < ulLen) {
+      ulChunk = ulLen - ulOffset;
+      if (ulChunk > ANT_DATA_PAYLOAD_SIZE) {
+         ulChunk = ANT_DATA_PAYLOAD_SIZE;
+      }
+
+      aucPacket[ANT_DATA_CHANNEL_OFFSET] = ucChannel | (ucSequence << ANT_BURST_SEQUENCE_SHIFT);
+      if (ulOffset + ulChunk == ulLen) {
+         aucPacket[ANT_DATA_CHANNEL_OFFSET] |= ANT_BURST_LAST_PACKET;
+      }
+
+      memcpy(aucPacket + ANT_DATA_PAYLOAD_OFFSET, pucData + ulOffset, ulChunk);
+      memset(aucPacket + ANT_DATA_PAYLOAD_OFFSET + ulChunk, 0, ANT_DATA_PAYLOAD_SIZE - ulChunk);
+
+      status = ant_tx_message(ANT_BURST_PACKET_SIZE, aucPacket);
+      if (status != ANT_STATUS_SUCCESS) {
+         ANT_DEBUG_D("tx burst: packet at byte %u of %u failed with %d", ulOffset, ulLen, status);
+         goto out;
+      }
+
+      ulOffset += ulChunk;
+      ucSequence = (ucSequence == ANT_BURST_SEQUENCE_MAX) ? 1 : ucSequence + 1;
+   }
+
+out:
+   ANT_FUNC_END();
+   return status;
+}
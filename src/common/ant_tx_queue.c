@@ -0,0 +1,259 @@
+/*
+ * ANT Stack
+ *
+ * Copyright 2011 Dynastream Innovations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/******************************************************************************\
+*
+*   FILE NAME:      ant_tx_queue.c
+*
+*   BRIEF:
+*      This file implements the tx queue, a single long lived thread sending
+*      messages queued by threads that must not wait for flow control. When
+*      deferred the queue has no thread, and is sent by ant_tx_queue_flush().
+*
+*
+\******************************************************************************/
+
+#include <pthread.h>
+#include <string.h>
+
+#include "ant_types.h"
+#include "ant_native.h"
+#include "ant_tx_queue.h"
+#include "ant_thread.h"
+#include "ant_log.h"
+
+#undef LOG_TAG
+#define LOG_TAG "antradio_tx_queue"
+
+typedef struct {
+   ANT_U8 ucLen;
+   ANT_U8 aucMesg[ANT_NATIVE_MAX_MESSAGE_SIZE];
+} ant_tx_queue_entry_t;
+
+static pthread_mutex_t stTxQueueLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t stTxQueueCond = PTHREAD_COND_INITIALIZER;
+static ant_tx_queue_entry_t astTxQueue[ANT_TX_QUEUE_SIZE];
+static int iTxQueueHead = 0;
+static int iTxQueueCount = 0;
+static pthread_t stTxQueueThread;
+static ANT_BOOL bTxQueueRunning = ANT_FALSE;
+static ANT_BOOL bTxQueueDeferred = ANT_FALSE;
+// Set while stTxQueueThread needs joining.
+static ANT_BOOL bTxQueueThreadStarted = ANT_FALSE;
+
+static void *fnTxQueueThread(void *pvUnused);
+
+/*
+ * Takes the oldest message off the queue. Must be called with stTxQueueLock held.
+ */
+static ANT_BOOL ant_tx_queue_pop(ant_tx_queue_entry_t *pstEntry)
+{
+   if (iTxQueueCount == 0) {
+      return ANT_FALSE;
+   }
+
+   pstEntry->ucLen = astTxQueue[iTxQueueHead].ucLen;
+   memcpy(pstEntry->aucMesg, astTxQueue[iTxQueueHead].aucMesg, pstEntry->ucLen);
+   iTxQueueHead = (iTxQueueHead + 1) % ANT_TX_QUEUE_SIZE;
+   iTxQueueCount--;
+   return ANT_TRUE;
+}
+
+/*
+ * Sends a message taken off the queue, with stTxQueueLock not held.
+ */
+static void ant_tx_queue_send(ant_tx_queue_entry_t *pstEntry)
+{
+   ANTStatus status;
+
+   // May wait for flow control, which the rx thread handles meanwhile. In threadless mode the
+   // wait runs the rx loop itself.
+   status = ant_tx_message(pstEntry->ucLen, pstEntry->aucMesg);
+   if (status != ANT_STATUS_SUCCESS) {
+      ANT_DEBUG_W("queued message %#x failed with %d", pstEntry->aucMesg[1], status);
+   }
+}
+
+/*
+ * Starts the tx queue thread. Must be called with stTxQueueLock held.
+ */
+static ANTStatus ant_tx_queue_start_thread(void)
+{
+   int iResult;
+
+   iResult = ant_thread_create(&stTxQueueThread, "txq", fnTxQueueThread, NULL);
+   if (iResult) {
+      ANT_ERROR("failed to start tx queue thread: %s", strerror(iResult));
+      return ANT_STATUS_FAILED;
+   }
+
+   bTxQueueThreadStarted = ANT_TRUE;
+   return ANT_STATUS_SUCCESS;
+}
+
+/*
+ * Sends the queued messages in order, sleeping while the queue is empty.
+ */
+static void *fnTxQueueThread(void *pvUnused)
+{
+   ant_tx_queue_entry_t stEntry;
+   (void)pvUnused;
+   ANT_FUNC_START();
+
+   pthread_mutex_lock(&stTxQueueLock);
+   while (bTxQueueRunning && !bTxQueueDeferred) {
+      if (!ant_tx_queue_pop(&stEntry)) {
+         pthread_cond_wait(&stTxQueueCond, &stTxQueueLock);
+         continue;
+      }
+      pthread_mutex_unlock(&stTxQueueLock);
+
+      ant_tx_queue_send(&stEntry);
+
+      pthread_mutex_lock(&stTxQueueLock);
+   }
+   pthread_mutex_unlock(&stTxQueueLock);
+
+   ANT_FUNC_END();
+   return NULL;
+}
+
+ANTStatus ant_tx_queue_start(void)
+{
+   ANTStatus status = ANT_STATUS_SUCCESS;
+   ANT_FUNC_START();
+
+   pthread_mutex_lock(&stTxQueueLock);
+   if (!bTxQueueRunning) {
+      iTxQueueHead = 0;
+      iTxQueueCount = 0;
+      bTxQueueRunning = ANT_TRUE;
+
+      if (!bTxQueueDeferred) {
+         status = ant_tx_queue_start_thread();
+         if (status != ANT_STATUS_SUCCESS) {
+            bTxQueueRunning = ANT_FALSE;
+         }
+      }
+   }
+   pthread_mutex_unlock(&stTxQueueLock);
+
+   ANT_FUNC_END();
+   return status;
+}
+
+void ant_tx_queue_stop(void)
+{
+   ANT_BOOL bJoin;
+   ANT_FUNC_START();
+
+   pthread_mutex_lock(&stTxQueueLock);
+   bJoin = bTxQueueThreadStarted;
+   bTxQueueThreadStarted = ANT_FALSE;
+   bTxQueueRunning = ANT_FALSE;
+   bTxQueueDeferred = ANT_FALSE;
+   iTxQueueCount = 0;
+   pthread_cond_signal(&stTxQueueCond);
+   pthread_mutex_unlock(&stTxQueueLock);
+
+   if (bJoin) {
+      pthread_join(stTxQueueThread, NULL);
+   }
+
+   ANT_FUNC_END();
+}
+
+ANTStatus ant_tx_queue_set_deferred(ANT_BOOL bDeferred)
+{
+   ANTStatus status = ANT_STATUS_SUCCESS;
+   ANT_BOOL bJoin = ANT_FALSE;
+   ANT_FUNC_START();
+
+   pthread_mutex_lock(&stTxQueueLock);
+   if (bDeferred && !bTxQueueDeferred) {
+      // The thread leaves the messages it hasn't sent yet for ant_tx_queue_flush().
+      bTxQueueDeferred = ANT_TRUE;
+      bJoin = bTxQueueThreadStarted;
+      bTxQueueThreadStarted = ANT_FALSE;
+      pthread_cond_signal(&stTxQueueCond);
+   } else if (!bDeferred && bTxQueueDeferred) {
+      bTxQueueDeferred = ANT_FALSE;
+      if (bTxQueueRunning) {
+         status = ant_tx_queue_start_thread();
+         if (status != ANT_STATUS_SUCCESS) {
+            bTxQueueDeferred = ANT_TRUE;
+         }
+      }
+   }
+   pthread_mutex_unlock(&stTxQueueLock);
+
+   if (bJoin) {
+      pthread_join(stTxQueueThread, NULL);
+   }
+
+   ANT_FUNC_END();
+   return status;
+}
+
+void ant_tx_queue_flush(void)
+{
+   ant_tx_queue_entry_t stEntry;
+   ANT_FUNC_START();
+
+   pthread_mutex_lock(&stTxQueueLock);
+   while (bTxQueueRunning && bTxQueueDeferred && ant_tx_queue_pop(&stEntry)) {
+      pthread_mutex_unlock(&stTxQueueLock);
+
+      ant_tx_queue_send(&stEntry);
+
+      pthread_mutex_lock(&stTxQueueLock);
+   }
+   pthread_mutex_unlock(&stTxQueueLock);
+
+   ANT_FUNC_END();
+}
+
+ANTStatus ant_tx_queue_message(ANT_U8 ucLen, const ANT_U8 *pucMesg)
+{
+   ANTStatus status = ANT_STATUS_SUCCESS;
+   int iTail;
+   ANT_FUNC_START();
+
+   if ((pucMesg == NULL) || (ucLen == 0)) {
+      status = ANT_STATUS_INVALID_PARM;
+      goto out;
+   }
+
+   pthread_mutex_lock(&stTxQueueLock);
+   if (!bTxQueueRunning) {
+      status = ANT_STATUS_NOT_INITIALIZED;
+   } else if (iTxQueueCount == ANT_TX_QUEUE_SIZE) {
+      ANT_WARN("tx queue full, dropping message %#x", (ucLen > 1) ? pucMesg[1] : 0);
+      status = ANT_STATUS_TOO_MANY_PENDING_CMDS;
+   } else {
+      iTail = (iTxQueueHead + iTxQueueCount) % ANT_TX_QUEUE_SIZE;
+      astTxQueue[iTail].ucLen = ucLen;
+      memcpy(astTxQueue[iTail].aucMesg, pucMesg, ucLen);
+      iTxQueueCount++;
+      pthread_cond_signal(&stTxQueueCond);
+   }
+   pthread_mutex_unlock(&stTxQueueLock);
+
+out:
+   ANT_FUNC_END();
+   return status;
+}
@@ -0,0 +1,457 @@
+/*
+ * ANT Stack
+ *
+ * Copyright 2011 Dynastream Innovations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/******************************************************************************\
+*
+*   FILE NAME:      ant_uring.c
+*
+*   BRIEF:
+*      This file implements a minimal io_uring wrapper on the raw system
+*      calls, as there is no liburing on the platform. Without io_uring kernel
+*      headers it builds to stubs that fail, and callers fall back to reading
+*      on readiness.
+*
+*
+\******************************************************************************/
+
+#include <errno.h>
+#include <stdlib.h> /* for calloc(), free() */
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h> /* for syscall(), close() */
+
+#include "ant_types.h"
+#include "ant_uring.h"
+#include "ant_log.h"
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+
+#undef LOG_TAG
+#define LOG_TAG "antradio_uring"
+
+void ant_uring_close(ant_uring_t *pstRing)
+{
+   ANT_FUNC_START();
+
+   if (pstRing->pvSqes != NULL) {
+      munmap(pstRing->pvSqes, pstRing->szSqes);
+   }
+   if ((pstRing->pvCqRing != NULL) && (pstRing->pvCqRing != pstRing->pvSqRing)) {
+      munmap(pstRing->pvCqRing, pstRing->szCqRing);
+   }
+   if (pstRing->pvSqRing != NULL) {
+      munmap(pstRing->pvSqRing, pstRing->szSqRing);
+   }
+   pstRing->pvSqes = NULL;
+   pstRing->pvCqRing = NULL;
+   pstRing->pvSqRing = NULL;
+
+   if (pstRing->iRingFd >= 0) {
+      close(pstRing->iRingFd);
+      pstRing->iRingFd = -1;
+   }
+
+   ANT_FUNC_END();
+}
+
+// Provided buffer rings (5.19) have no feature flag, single issuer came after them (6.0).
+#if defined(IORING_SETUP_SINGLE_ISSUER) && defined(__NR_io_uring_setup)
+
+// IORING_OP_READ_MULTISHOT, from Linux 6.7, is missing from older headers.
+#define ANT_URING_OP_READ_MULTISHOT 49
+
+// Covers every opcode, so the probe reports the last one the kernel knows.
+#define ANT_URING_PROBE_OPS 256
+
+static void *ant_uring_map(int iRingFd, size_t szLen, off_t offset)
+{
+   void *pvMap = mmap(NULL, szLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, iRingFd, offset);
+
+   return (pvMap == MAP_FAILED) ? NULL : pvMap;
+}
+
+/*
+ * Checks that the kernel supports an opcode.
+ */
+static ANT_BOOL ant_uring_supports(int iRingFd, ANT_U8 ucOpcode)
+{
+   struct io_uring_probe *pstProbe;
+   ANT_BOOL bSupported = ANT_FALSE;
+
+   pstProbe = calloc(1, sizeof(*pstProbe) + ANT_URING_PROBE_OPS * sizeof(struct io_uring_probe_op));
+   if (pstProbe == NULL) {
+      return ANT_FALSE;
+   }
+
+   if ((syscall(__NR_io_uring_register, iRingFd, IORING_REGISTER_PROBE, pstProbe, ANT_URING_PROBE_OPS) == 0) &&
+         (pstProbe->last_op >= ucOpcode) && (pstProbe->ops[ucOpcode].flags & IO_URING_OP_SUPPORTED)) {
+      bSupported = ANT_TRUE;
+   }
+
+   free(pstProbe);
+   return bSupported;
+}
+
+int ant_uring_init(ant_uring_t *pstRing, ANT_U32 ulEntries)
+{
+   struct io_uring_params stParams;
+   int iSavedErrno;
+   int iRet = -1;
+   ANT_FUNC_START();
+
+   memset(pstRing, 0, sizeof(*pstRing));
+   memset(&stParams, 0, sizeof(stParams));
+
+   pstRing->iRingFd = syscall(__NR_io_uring_setup, ulEntries, &stParams);
+   if (pstRing->iRingFd < 0) {
+      // Not in the kernel, or blocked by seccomp.
+      pstRing->iRingFd = -1;
+      goto out;
+   }
+
+   // Multishot reads came after provided buffer rings, so this covers both.
+   if (!ant_uring_supports(pstRing->iRingFd, ANT_URING_OP_READ_MULTISHOT)) {
+      errno = ENOSYS;
+      goto failed;
+   }
+
+   pstRing->szSqRing = stParams.sq_off.array + stParams.sq_entries * sizeof(unsigned);
+   pstRing->szCqRing = stParams.cq_off.cqes + stParams.cq_entries * sizeof(struct io_uring_cqe);
+   if (stParams.features & IORING_FEAT_SINGLE_MMAP) {
+      if (pstRing->szCqRing > pstRing->szSqRing) {
+         pstRing->szSqRing = pstRing->szCqRing;
+      }
+      pstRing->szCqRing = pstRing->szSqRing;
+   }
+
+   pstRing->pvSqRing = ant_uring_map(pstRing->iRingFd, pstRing->szSqRing, IORING_OFF_SQ_RING);
+   if (pstRing->pvSqRing == NULL) {
+      goto failed;
+   }
+   if (stParams.features & IORING_FEAT_SINGLE_MMAP) {
+      pstRing->pvCqRing = pstRing->pvSqRing;
+   } else {
+      pstRing->pvCqRing = ant_uring_map(pstRing->iRingFd, pstRing->szCqRing, IORING_OFF_CQ_RING);
+      if (pstRing->pvCqRing == NULL) {
+         goto failed;
+      }
+   }
+   pstRing->szSqes = stParams.sq_entries * sizeof(struct io_uring_sqe);
+   pstRing->pvSqes = ant_uring_map(pstRing->iRingFd, pstRing->szSqes, IORING_OFF_SQES);
+   if (pstRing->pvSqes == NULL) {
+      goto failed;
+   }
+
+   pstRing->puiSqHead = (unsigned *)((char *)pstRing->pvSqRing + stParams.sq_off.head);
+   pstRing->puiSqTail = (unsigned *)((char *)pstRing->pvSqRing + stParams.sq_off.tail);
+   pstRing->puiSqArray = (unsigned *)((char *)pstRing->pvSqRing + stParams.sq_off.array);
+   pstRing->uiSqMask = *(unsigned *)((char *)pstRing->pvSqRing + stParams.sq_off.ring_mask);
+   pstRing->uiSqEntries = stParams.sq_entries;
+   pstRing->uiSqLocalTail = *pstRing->puiSqTail;
+   pstRing->puiCqHead = (unsigned *)((char *)pstRing->pvCqRing + stParams.cq_off.head);
+   pstRing->puiCqTail = (unsigned *)((char *)pstRing->pvCqRing + stParams.cq_off.tail);
+   pstRing->uiCqMask = *(unsigned *)((char *)pstRing->pvCqRing + stParams.cq_off.ring_mask);
+   pstRing->pvCqes = (char *)pstRing->pvCqRing + stParams.cq_off.cqes;
+
+   iRet = 0;
+   goto out;
+
+failed:
+   iSavedErrno = errno;
+   ant_uring_close(pstRing);
+   errno = iSavedErrno;
+
+out:
+   ANT_FUNC_END();
+   return iRet;
+}
+
+int ant_uring_register_eventfd(ant_uring_t *pstRing, int iEventFd)
+{
+   return syscall(__NR_io_uring_register, pstRing->iRingFd, IORING_REGISTER_EVENTFD, &iEventFd, 1);
+}
+
+/*
+ * Puts a buffer in the provided buffer ring at the local tail.
+ */
+static void ant_uring_put_buffer(ant_uring_buffers_t *pstBuffers, ANT_U16 usBufferId)
+{
+   struct io_uring_buf *pstBuf = &((struct io_uring_buf_ring *)pstBuffers->pvRing)->bufs[pstBuffers->usTail & pstBuffers->uiMask];
+
+   pstBuf->addr = (uint64_t)(uintptr_t)(pstBuffers->pucBuffers + (size_t)usBufferId * pstBuffers->ulBufferSize);
+   pstBuf->len = pstBuffers->ulBufferSize;
+   pstBuf->bid = usBufferId;
+   pstBuffers->usTail++;
+}
+
+int ant_uring_provide_buffers(ant_uring_t *pstRing, ant_uring_buffers_t *pstBuffers, ANT_U16 usGroup,
+      ANT_U8 *pucBuffers, ANT_U32 ulCount, ANT_U32 ulBufferSize)
+{
+   struct io_uring_buf_reg stReg;
+   ANT_U32 ulBuffer;
+   int iSavedErrno;
+   int iRet = -1;
+   ANT_FUNC_START();
+
+   memset(pstBuffers, 0, sizeof(*pstBuffers));
+
+   // The kernel needs the ring page aligned, which anonymous mappings are.
+   pstBuffers->szRing = ulCount * sizeof(struct io_uring_buf);
+   pstBuffers->pvRing = mmap(NULL, pstBuffers->szRing, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if (pstBuffers->pvRing == MAP_FAILED) {
+      pstBuffers->pvRing = NULL;
+      goto out;
+   }
+   pstBuffers->uiMask = ulCount - 1;
+   pstBuffers->pucBuffers = pucBuffers;
+   pstBuffers->ulBufferSize = ulBufferSize;
+
+   memset(&stReg, 0, sizeof(stReg));
+   stReg.ring_addr = (uint64_t)(uintptr_t)pstBuffers->pvRing;
+   stReg.ring_entries = ulCount;
+   stReg.bgid = usGroup;
+   if (syscall(__NR_io_uring_register, pstRing->iRingFd, IORING_REGISTER_PBUF_RING, &stReg, 1) < 0) {
+      iSavedErrno = errno;
+      ant_uring_free_buffers(pstBuffers);
+      errno = iSavedErrno;
+      goto out;
+   }
+
+   for (ulBuffer = 0; ulBuffer < ulCount; ulBuffer++) {
+      ant_uring_put_buffer(pstBuffers, (ANT_U16)ulBuffer);
+   }
+   __atomic_store_n(&((struct io_uring_buf_ring *)pstBuffers->pvRing)->tail, pstBuffers->usTail, __ATOMIC_RELEASE);
+
+   iRet = 0;
+
+out:
+   ANT_FUNC_END();
+   return iRet;
+}
+
+void ant_uring_free_buffers(ant_uring_buffers_t *pstBuffers)
+{
+   if (pstBuffers->pvRing != NULL) {
+      munmap(pstBuffers->pvRing, pstBuffers->szRing);
+      pstBuffers->pvRing = NULL;
+   }
+}
+
+ANT_U8 *ant_uring_buffer(ant_uring_buffers_t *pstBuffers, int iBufferId)
+{
+   return pstBuffers->pucBuffers + (size_t)iBufferId * pstBuffers->ulBufferSize;
+}
+
+void ant_uring_recycle_buffer(ant_uring_buffers_t *pstBuffers, int iBufferId)
+{
+   ant_uring_put_buffer(pstBuffers, (ANT_U16)iBufferId);
+   __atomic_store_n(&((struct io_uring_buf_ring *)pstBuffers->pvRing)->tail, pstBuffers->usTail, __ATOMIC_RELEASE);
+}
+
+/*
+ * Gets a cleared submission queue entry, or NULL if the queue is full.
+ */
+static struct io_uring_sqe *ant_uring_get_sqe(ant_uring_t *pstRing)
+{
+   struct io_uring_sqe *pstSqe;
+   unsigned uiHead = __atomic_load_n(pstRing->puiSqHead, __ATOMIC_ACQUIRE);
+   unsigned uiIndex;
+
+   if (pstRing->uiSqLocalTail - uiHead >= pstRing->uiSqEntries) {
+      errno = EBUSY;
+      return NULL;
+   }
+
+   uiIndex = pstRing->uiSqLocalTail & pstRing->uiSqMask;
+   pstSqe = &((struct io_uring_sqe *)pstRing->pvSqes)[uiIndex];
+   memset(pstSqe, 0, sizeof(*pstSqe));
+   pstRing->puiSqArray[uiIndex] = uiIndex;
+   pstRing->uiSqLocalTail++;
+
+   return pstSqe;
+}
+
+int ant_uring_prep_read_multishot(ant_uring_t *pstRing, int iFd, ANT_U16 usGroup, uint64_t ullUserData)
+{
+   struct io_uring_sqe *pstSqe = ant_uring_get_sqe(pstRing);
+
+   if (pstSqe == NULL) {
+      return -1;
+   }
+
+   pstSqe->opcode = ANT_URING_OP_READ_MULTISHOT;
+   pstSqe->fd = iFd;
+   // Read at the file position, like read(), into whichever buffer of the group is free.
+   pstSqe->off = (uint64_t)-1;
+   pstSqe->flags = IOSQE_BUFFER_SELECT;
+   pstSqe->buf_group = usGroup;
+   pstSqe->user_data = ullUserData;
+   return 0;
+}
+
+int ant_uring_prep_write(ant_uring_t *pstRing, int iFd, const void *pvBuf, ANT_U32 ulLen, ANT_BOOL bLinkNext,
+      uint64_t ullUserData)
+{
+   struct io_uring_sqe *pstSqe = ant_uring_get_sqe(pstRing);
+
+   if (pstSqe == NULL) {
+      return -1;
+   }
+
+   pstSqe->opcode = IORING_OP_WRITE;
+   pstSqe->fd = iFd;
+   // Write at the file position, like write().
+   pstSqe->off = (uint64_t)-1;
+   pstSqe->addr = (uint64_t)(uintptr_t)pvBuf;
+   pstSqe->len = ulLen;
+   if (bLinkNext) {
+      pstSqe->flags = IOSQE_IO_LINK;
+   }
+   pstSqe->user_data = ullUserData;
+   return 0;
+}
+
+int ant_uring_submit(ant_uring_t *pstRing)
+{
+   unsigned uiToSubmit;
+   int iRet;
+
+   // Includes entries a previous submit didn't get to.
+   uiToSubmit = pstRing->uiSqLocalTail - __atomic_load_n(pstRing->puiSqHead, __ATOMIC_ACQUIRE);
+   if (uiToSubmit == 0) {
+      return 0;
+   }
+
+   __atomic_store_n(pstRing->puiSqTail, pstRing->uiSqLocalTail, __ATOMIC_RELEASE);
+   do {
+      iRet = syscall(__NR_io_uring_enter, pstRing->iRingFd, uiToSubmit, 0, 0, NULL, 0);
+   } while ((iRet < 0) && (errno == EINTR));
+
+   return iRet;
+}
+
+int ant_uring_reap(ant_uring_t *pstRing, ant_uring_cqe_t *pstCqe)
+{
+   struct io_uring_cqe *pstKernelCqe;
+   unsigned uiHead = *pstRing->puiCqHead;
+
+   if (uiHead == __atomic_load_n(pstRing->puiCqTail, __ATOMIC_ACQUIRE)) {
+      return 0;
+   }
+
+   pstKernelCqe = &((struct io_uring_cqe *)pstRing->pvCqes)[uiHead & pstRing->uiCqMask];
+   pstCqe->ullUserData = pstKernelCqe->user_data;
+   pstCqe->iResult = pstKernelCqe->res;
+   pstCqe->bMore = (pstKernelCqe->flags & IORING_CQE_F_MORE) ? ANT_TRUE : ANT_FALSE;
+   pstCqe->iBufferId = (pstKernelCqe->flags & IORING_CQE_F_BUFFER) ?
+         (int)(pstKernelCqe->flags >> IORING_CQE_BUFFER_SHIFT) : -1;
+   __atomic_store_n(pstRing->puiCqHead, uiHead + 1, __ATOMIC_RELEASE);
+
+   return 1;
+}
+
+#else // No io_uring headers to build against.
+
+int ant_uring_init(ant_uring_t *pstRing, ANT_U32 ulEntries)
+{
+   (void)ulEntries;
+   memset(pstRing, 0, sizeof(*pstRing));
+   pstRing->iRingFd = -1;
+   errno = ENOSYS;
+   return -1;
+}
+
+int ant_uring_register_eventfd(ant_uring_t *pstRing, int iEventFd)
+{
+   (void)pstRing;
+   (void)iEventFd;
+   errno = ENOSYS;
+   return -1;
+}
+
+int ant_uring_provide_buffers(ant_uring_t *pstRing, ant_uring_buffers_t *pstBuffers, ANT_U16 usGroup,
+      ANT_U8 *pucBuffers, ANT_U32 ulCount, ANT_U32 ulBufferSize)
+{
+   (void)pstRing;
+   (void)usGroup;
+   (void)pucBuffers;
+   (void)ulCount;
+   (void)ulBufferSize;
+   memset(pstBuffers, 0, sizeof(*pstBuffers));
+   errno = ENOSYS;
+   return -1;
+}
+
+void ant_uring_free_buffers(ant_uring_buffers_t *pstBuffers)
+{
+   pstBuffers->pvRing = NULL;
+}
+
+ANT_U8 *ant_uring_buffer(ant_uring_buffers_t *pstBuffers, int iBufferId)
+{
+   return pstBuffers->pucBuffers + (size_t)iBufferId * pstBuffers->ulBufferSize;
+}
+
+void ant_uring_recycle_buffer(ant_uring_buffers_t *pstBuffers, int iBufferId)
+{
+   (void)pstBuffers;
+   (void)iBufferId;
+}
+
+int ant_uring_prep_read_multishot(ant_uring_t *pstRing, int iFd, ANT_U16 usGroup, uint64_t ullUserData)
+{
+   (void)pstRing;
+   (void)iFd;
+   (void)usGroup;
+   (void)ullUserData;
+   errno = ENOSYS;
+   return -1;
+}
+
+int ant_uring_prep_write(ant_uring_t *pstRing, int iFd, const void *pvBuf, ANT_U32 ulLen, ANT_BOOL bLinkNext,
+      uint64_t ullUserData)
+{
+   (void)pstRing;
+   (void)iFd;
+   (void)pvBuf;
+   (void)ulLen;
+   (void)bLinkNext;
+   (void)ullUserData;
+   errno = ENOSYS;
+   return -1;
+}
+
+int ant_uring_submit(ant_uring_t *pstRing)
+{
+   (void)pstRing;
+   errno = ENOSYS;
+   return -1;
+}
+
+int ant_uring_reap(ant_uring_t *pstRing, ant_uring_cqe_t *pstCqe)
+{
+   (void)pstRing;
+   (void)pstCqe;
+   return 0;
+}
+
+#endif // IORING_SETUP_SINGLE_ISSUER && __NR_io_uring_setup
@@ -0,0 +1,66 @@
+/*
+ * ANT Stack
+ *
+ * Copyright 2011 Dynastream Innovations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/******************************************************************************\
+*
+*   FILE NAME:      ant_cache.h
+*
+*   BRIEF:
+*      This file defines the hooks the transports use to keep the channel
+*      state and chip information cache up to date, and to answer requests
+*      from it without sending them to the chip.
+*
+*
+\******************************************************************************/
+
+#ifndef __ANT_CACHE_H
+#define __ANT_CACHE_H
+
+#include "ant_types.h"
+
+// Number of channels tracked. Requests for higher channels always go to the chip.
+#ifndef ANT_CACHE_MAX_CHANNELS
+#define ANT_CACHE_MAX_CHANNELS               16
+#endif
+
+/*------------------------------------------------------------------------------
+ * ant_cache_tx_message()
+ *
+ * Called for every ANT message about to be sent. If the message is a request
+ * that can be answered from the cache, the response is written to pucResponse
+ * (ANT_NATIVE_MAX_MESSAGE_SIZE bytes) and its length returned, and the message
+ * must not be sent. The transport then delivers the response as if the chip
+ * had sent it. Returns 0 if the message must be sent.
+ */
+ANT_U8 ant_cache_tx_message(ANT_U8 ucLen, ANT_U8 *pucMesg, ANT_U8 *pucResponse);
+
+/*------------------------------------------------------------------------------
+ * ant_cache_rx_message()
+ *
+ * Called for every received ANT message to update the cache.
+ */
+void ant_cache_rx_message(ANT_U8 ucLen, ANT_U8 *pucData);
+
+/*------------------------------------------------------------------------------
+ * ant_cache_invalidate()
+ *
+ * Called when the chip is powered up, as the channel states are not known
+ * again until the next reset.
+ */
+void ant_cache_invalidate(void);
+
+#endif /* ifndef __ANT_CACHE_H */
@@ -0,0 +1,47 @@
+/*
+ * ANT Stack
+ *
+ * Copyright 2011 Dynastream Innovations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/******************************************************************************\
+*
+*   FILE NAME:      ant_command.h
+*
+*   BRIEF:
+*      This file defines the rx hook used to match received messages to
+*      commands sent with ant_tx_command().
+*
+*
+\******************************************************************************/
+
+#ifndef __ANT_COMMAND_H
+#define __ANT_COMMAND_H
+
+#include "ant_types.h"
+
+// Maximum number of commands that can be waiting for a response at once.
+#ifndef ANT_COMMAND_MAX_PENDING
+#define ANT_COMMAND_MAX_PENDING              16
+#endif
+
+/*------------------------------------------------------------------------------
+ * ant_command_rx_message()
+ *
+ * Called for every received ANT message. Completes the oldest command waiting
+ * for this message as its response.
+ */
+void ant_command_rx_message(ANT_U8 ucLen, ANT_U8 *pucData);
+
+#endif /* ifndef __ANT_COMMAND_H */
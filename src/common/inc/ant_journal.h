@@ -0,0 +1,109 @@
+/*
+ * ANT Stack
+ *
+ * Copyright 2011 Dynastream Innovations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/******************************************************************************\
+*
+*   FILE NAME:      ant_journal.h
+*
+*   BRIEF:
+*      This file defines the hooks the transports use to journal the commands
+*      that configure the live channels, and to replay them once the chip has
+*      been recovered.
+*
+*
+\******************************************************************************/
+
+#ifndef __ANT_JOURNAL_H
+#define __ANT_JOURNAL_H
+
+#include "ant_types.h"
+
+// Number of channels and networks journaled. Commands for higher ones are not replayed.
+#ifndef ANT_JOURNAL_MAX_CHANNELS
+#define ANT_JOURNAL_MAX_CHANNELS             16
+#endif
+#ifndef ANT_JOURNAL_MAX_NETWORKS
+#define ANT_JOURNAL_MAX_NETWORKS             8
+#endif
+
+// How long to wait for the response to a replayed command, and how often to
+// try it again if it fails. The first retry waits ANT_JOURNAL_RETRY_BACKOFF_MS,
+// each one after that twice as long as the one before.
+#ifndef ANT_JOURNAL_TIMEOUT_MS
+#define ANT_JOURNAL_TIMEOUT_MS               500
+#endif
+#ifndef ANT_JOURNAL_RETRIES
+#define ANT_JOURNAL_RETRIES                  3
+#endif
+#ifndef ANT_JOURNAL_RETRY_BACKOFF_MS
+#define ANT_JOURNAL_RETRY_BACKOFF_MS         20
+#endif
+
+// The longest a replay sends commands for. Channels it hasn't restored by then
+// are not restored.
+#ifndef ANT_JOURNAL_REPLAY_MAX_MS
+#define ANT_JOURNAL_REPLAY_MAX_MS            2000
+#endif
+
+/*------------------------------------------------------------------------------
+ * ant_journal_tx_message()
+ *
+ * Called for every ANT message about to be sent, to hold on to configuration
+ * commands until the chip accepts them.
+ */
+void ant_journal_tx_message(ANT_U8 ucLen, ANT_U8 *pucMesg);
+
+/*------------------------------------------------------------------------------
+ * ant_journal_rx_message()
+ *
+ * Called for every received ANT message to journal the commands the chip
+ * accepted, and forget channels that were closed or unassigned.
+ */
+void ant_journal_rx_message(ANT_U8 ucLen, ANT_U8 *pucData);
+
+/*------------------------------------------------------------------------------
+ * ant_journal_clear()
+ *
+ * Called when the radio is enabled or reset on request, as the client sets up
+ * its channels again itself.
+ */
+void ant_journal_clear(void);
+
+/*------------------------------------------------------------------------------
+ * ant_journal_cancel_replay()
+ *
+ * Called when the chip is about to be recovered, or the transport closed.
+ * Cancels the replay in progress, which stops before its next command and
+ * leaves the journal as it was for the next replay. Returns the number to pass
+ * to ant_journal_replay() once this recovery is done.
+ */
+ANT_U32 ant_journal_cancel_replay(void);
+
+/*------------------------------------------------------------------------------
+ * ant_journal_replay()
+ *
+ * Called once the chip is up again after the recovery that ulRecovery, from
+ * ant_journal_cancel_replay(), was returned for. Sends the journaled network
+ * keys and channel configurations again, waiting for each response and
+ * retrying failed commands, for ANT_JOURNAL_REPLAY_MAX_MS at most. A channel
+ * that can't be restored is unassigned and dropped from the journal. Sets the
+ * number of channels restored and not restored. Must not be called from the rx
+ * callbacks or with the state lock held.
+ */
+void ant_journal_replay(ANT_U32 ulRecovery, ANT_U32 *pulRestored, ANT_U32 *pulNotRestored);
+
+#endif /* ifndef __ANT_JOURNAL_H */
@@ -0,0 +1,42 @@
+/*
+ * ANT Stack
+ *
+ * Copyright 2011 Dynastream Innovations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/******************************************************************************\
+*
+*   FILE NAME:      ant_link_stats.h
+*
+*   BRIEF:
+*      This file defines the rx hook that counts channel events and data
+*      messages into the per channel RF link statistics.
+*
+*
+\******************************************************************************/
+
+#ifndef __ANT_LINK_STATS_H
+#define __ANT_LINK_STATS_H
+
+#include "ant_types.h"
+
+/*------------------------------------------------------------------------------
+ * ant_link_stats_rx_message()
+ *
+ * Called for every received ANT message to count it in the link statistics of
+ * its channel.
+ */
+void ant_link_stats_rx_message(ANT_U8 ucLen, ANT_U8 *pucData);
+
+#endif /* ifndef __ANT_LINK_STATS_H */
@@ -0,0 +1,122 @@
+/*
+ * ANT Stack
+ *
+ * Copyright 2011 Dynastream Innovations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/******************************************************************************\
+*
+*   FILE NAME:      ant_message.h
+*
+*   BRIEF:
+*      This file defines the ANT message layout and the message IDs used by
+*      the native command handling.
+*
+*
+\******************************************************************************/
+
+#ifndef __ANT_MESSAGE_H
+#define __ANT_MESSAGE_H
+
+// -------------------------------
+// | Length | ID | Data          |
+// | 1 byte | 1  | Length bytes  |
+
+#define ANT_MSG_LENGTH_OFFSET                ((ANT_U8)0)
+#define ANT_MSG_ID_OFFSET                    ((ANT_U8)1)
+#define ANT_MSG_DATA_OFFSET                  ((ANT_U8)2)
+#define ANT_MSG_HEADER_SIZE                  ((ANT_U8)2)
+
+#define MESG_EVENT_ID                        ((ANT_U8)0x01)
+#define MESG_VERSION_ID                      ((ANT_U8)0x3E)
+#define MESG_RESPONSE_EVENT_ID               ((ANT_U8)0x40)
+#define MESG_UNASSIGN_CHANNEL_ID             ((ANT_U8)0x41)
+#define MESG_ASSIGN_CHANNEL_ID               ((ANT_U8)0x42)
+#define MESG_CHANNEL_MESG_PERIOD_ID          ((ANT_U8)0x43)
+#define MESG_CHANNEL_RADIO_FREQ_ID           ((ANT_U8)0x45)
+#define MESG_NETWORK_KEY_ID                  ((ANT_U8)0x46)
+#define MESG_RESET_ID                        ((ANT_U8)0x4A)
+#define MESG_OPEN_CHANNEL_ID                 ((ANT_U8)0x4B)
+#define MESG_CLOSE_CHANNEL_ID                ((ANT_U8)0x4C)
+#define MESG_REQUEST_ID                      ((ANT_U8)0x4D)
+#define MESG_BROADCAST_DATA_ID               ((ANT_U8)0x4E)
+#define MESG_ACKNOWLEDGED_DATA_ID            ((ANT_U8)0x4F)
+#define MESG_BURST_DATA_ID                   ((ANT_U8)0x50)
+#define MESG_CHANNEL_ID_ID                   ((ANT_U8)0x51)
+#define MESG_CHANNEL_STATUS_ID               ((ANT_U8)0x52)
+#define MESG_CAPABILITIES_ID                 ((ANT_U8)0x54)
+#define MESG_EXT_BROADCAST_DATA_ID           ((ANT_U8)0x5D)
+#define MESG_EXT_ACKNOWLEDGED_DATA_ID        ((ANT_U8)0x5E)
+#define MESG_EXT_BURST_DATA_ID               ((ANT_U8)0x5F)
+#define MESG_GET_SERIAL_NUM_ID               ((ANT_U8)0x61)
+#define MESG_STARTUP_MESG_ID                 ((ANT_U8)0x6F)
+#define MESG_ADV_BURST_DATA_ID               ((ANT_U8)0x72)
+
+// Channel response/event data: channel, message ID (MESG_EVENT_ID for events), code
+#define ANT_RESPONSE_CHANNEL_OFFSET          ((ANT_U8)(ANT_MSG_DATA_OFFSET + 0))
+#define ANT_RESPONSE_MESG_ID_OFFSET          ((ANT_U8)(ANT_MSG_DATA_OFFSET + 1))
+#define ANT_RESPONSE_CODE_OFFSET             ((ANT_U8)(ANT_MSG_DATA_OFFSET + 2))
+#define ANT_RESPONSE_SIZE                    ((ANT_U8)(ANT_MSG_HEADER_SIZE + 3))
+
+#define RESPONSE_NO_ERROR                    ((ANT_U8)0x00)
+
+#define EVENT_RX_SEARCH_TIMEOUT              ((ANT_U8)0x01)
+#define EVENT_RX_FAIL                        ((ANT_U8)0x02)
+#define EVENT_TX                             ((ANT_U8)0x03)
+#define EVENT_TRANSFER_RX_FAILED             ((ANT_U8)0x04)
+#define EVENT_TRANSFER_TX_COMPLETED          ((ANT_U8)0x05)
+#define EVENT_TRANSFER_TX_FAILED             ((ANT_U8)0x06)
+#define EVENT_CHANNEL_CLOSED                 ((ANT_U8)0x07)
+#define EVENT_RX_FAIL_GO_TO_SEARCH           ((ANT_U8)0x08)
+#define EVENT_CHANNEL_COLLISION              ((ANT_U8)0x09)
+
+// Set in the channel type of master (transmitting) channels
+#define CHANNEL_TYPE_MASTER                  ((ANT_U8)0x10)
+
+// Channel status data: channel, status (state, network number, channel type)
+#define ANT_CHANNEL_STATUS_STATE_MASK        ((ANT_U8)0x03)
+#define ANT_CHANNEL_STATUS_NETWORK_SHIFT     2
+#define ANT_CHANNEL_STATUS_NETWORK_MASK      ((ANT_U8)0x03)
+#define ANT_CHANNEL_STATUS_TYPE_MASK         ((ANT_U8)0xF0)
+
+// Data messages: channel, 8 byte payload, then flagged extended data
+#define ANT_DATA_CHANNEL_OFFSET              ((ANT_U8)(ANT_MSG_DATA_OFFSET + 0))
+#define ANT_DATA_PAYLOAD_OFFSET              ((ANT_U8)(ANT_MSG_DATA_OFFSET + 1))
+#define ANT_DATA_PAYLOAD_SIZE                ((ANT_U8)8)
+#define ANT_DATA_FLAG_OFFSET                 ((ANT_U8)(ANT_DATA_PAYLOAD_OFFSET + ANT_DATA_PAYLOAD_SIZE))
+#define ANT_EXT_FLAG_CHANNEL_ID              ((ANT_U8)0x80)
+#define ANT_EXT_FLAG_RSSI                    ((ANT_U8)0x40)
+// RSSI: measurement type, RSSI value (signed dBm), threshold
+#define ANT_RSSI_VALUE_OFFSET                ((ANT_U8)1)
+#define ANT_RSSI_SIZE                        ((ANT_U8)3)
+// Channel ID: device number (2 bytes), device type, transmission type
+#define ANT_CHANNEL_ID_DEVICE_TYPE_OFFSET    ((ANT_U8)2)
+#define ANT_CHANNEL_ID_SIZE                  ((ANT_U8)4)
+// Device type bit 7 is the pairing bit
+#define ANT_DEVICE_TYPE_MASK                 ((ANT_U8)0x7F)
+
+// Legacy extended data messages: channel, channel ID, 8 byte payload
+#define ANT_EXT_DATA_CHANNEL_ID_OFFSET       ((ANT_U8)(ANT_MSG_DATA_OFFSET + 1))
+#define ANT_EXT_DATA_PAYLOAD_OFFSET          ((ANT_U8)(ANT_EXT_DATA_CHANNEL_ID_OFFSET + ANT_CHANNEL_ID_SIZE))
+
+// Burst data carries a sequence number in the upper bits of the channel byte
+#define ANT_CHANNEL_NUMBER_MASK              ((ANT_U8)0x1F)
+// The first packet has sequence 0, the following ones count 1, 2, 3, 1, ...
+// and the last packet also has the last packet bit set.
+#define ANT_BURST_SEQUENCE_SHIFT             5
+#define ANT_BURST_SEQUENCE_MAX               ((ANT_U8)3)
+#define ANT_BURST_LAST_PACKET                ((ANT_U8)0x80)
+#define ANT_BURST_PACKET_SIZE                ((ANT_U8)(ANT_DATA_PAYLOAD_OFFSET + ANT_DATA_PAYLOAD_SIZE))
+
+#endif /* ifndef __ANT_MESSAGE_H */
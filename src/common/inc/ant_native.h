@@ -41,13 +41,91 @@
  *
  ******************************************************************************/
 
+/* Largest ANT message (length, id and data) an rx message can hold */
+#define ANT_NATIVE_MAX_MESSAGE_SIZE          255
+
+/* RSSI histogram of the link stats: bin 0 is below ANT_LINK_RSSI_MIN_DBM, the
+ * last bin is at or above ANT_LINK_RSSI_MIN_DBM + (bins - 2) * bin width */
+#define ANT_LINK_RSSI_BINS                   8
+#define ANT_LINK_RSSI_MIN_DBM                (-90)
+#define ANT_LINK_RSSI_BIN_DBM                10
+
+/* Most values a decoded ANT+ profile has */
+#define ANT_DECODER_MAX_FIELDS               8
+
+/* ANT+ device types with a native decoder */
+#define ANT_DEVICE_TYPE_BIKE_POWER           ((ANT_U8)0x0B)
+#define ANT_DEVICE_TYPE_FITNESS_EQUIPMENT    ((ANT_U8)0x11)
+#define ANT_DEVICE_TYPE_HEART_RATE           ((ANT_U8)0x78)
+#define ANT_DEVICE_TYPE_BIKE_SPEED_CADENCE   ((ANT_U8)0x79)
+#define ANT_DEVICE_TYPE_BIKE_CADENCE         ((ANT_U8)0x7A)
+#define ANT_DEVICE_TYPE_BIKE_SPEED           ((ANT_U8)0x7B)
+
+/* Decoded value indexes for each device type. Accumulated values are running
+ * totals since decoding of the channel started, with rollovers removed. */
+
+/* Heart rate */
+#define ANT_DECODED_HR_HEART_RATE            0  /* bpm */
+#define ANT_DECODED_HR_BEAT_COUNT            1  /* accumulated beats */
+#define ANT_DECODED_HR_BEAT_TIME             2  /* accumulated ms, time of the last beat */
+
+/* Bike speed and cadence, bike cadence and bike speed. The single sensors only
+ * report their own values. */
+#define ANT_DECODED_SC_CADENCE_TIME          0  /* accumulated ms, time of the last crank revolution */
+#define ANT_DECODED_SC_CADENCE_REVS          1  /* accumulated crank revolutions */
+#define ANT_DECODED_SC_SPEED_TIME            2  /* accumulated ms, time of the last wheel revolution */
+#define ANT_DECODED_SC_SPEED_REVS            3  /* accumulated wheel revolutions */
+
+/* Bike power, from the power only page */
+#define ANT_DECODED_POWER_EVENT_COUNT        0  /* accumulated power events */
+#define ANT_DECODED_POWER_PEDAL_BALANCE      1  /* raw pedal power byte */
+#define ANT_DECODED_POWER_CADENCE            2  /* rpm, 255 if not available */
+#define ANT_DECODED_POWER_ACCUMULATED        3  /* accumulated W */
+#define ANT_DECODED_POWER_INSTANT            4  /* W */
+
+/* Fitness equipment, from the general and the trainer pages */
+#define ANT_DECODED_FE_ELAPSED_TIME          0  /* accumulated ms */
+#define ANT_DECODED_FE_DISTANCE              1  /* accumulated m */
+#define ANT_DECODED_FE_SPEED                 2  /* mm/s */
+#define ANT_DECODED_FE_HEART_RATE            3  /* bpm, 255 if not available */
+#define ANT_DECODED_FE_EVENT_COUNT           4  /* accumulated trainer events */
+#define ANT_DECODED_FE_CADENCE               5  /* rpm, 255 if not available */
+#define ANT_DECODED_FE_ACCUMULATED_POWER     6  /* accumulated W */
+#define ANT_DECODED_FE_INSTANT_POWER         7  /* W */
+
+/* Phases of enabling and disabling the radio, see set_ant_progress_callback().
+ * Transports only report the phases they have. */
+#define ANT_PROGRESS_POWER_ON                ((ANT_U8)0)  /* chip powered, e.g. by libbt-vendor */
+#define ANT_PROGRESS_OPEN                    ((ANT_U8)1)  /* transport paths opened */
+#define ANT_PROGRESS_THREAD_START            ((ANT_U8)2)  /* rx thread or threadless rx loop started */
+#define ANT_PROGRESS_LINK_UP                 ((ANT_U8)3)  /* chip answered the first keepalive */
+#define ANT_PROGRESS_THREAD_STOP             ((ANT_U8)4)  /* rx thread stopped */
+#define ANT_PROGRESS_CLOSE                   ((ANT_U8)5)  /* transport paths closed */
+#define ANT_PROGRESS_POWER_OFF               ((ANT_U8)6)  /* chip powered off */
+#define ANT_PROGRESS_VENDOR_LOAD             ((ANT_U8)7)  /* libbt-vendor loaded and initialized, first enable only */
+
 /*******************************************************************************
  *
  * Types
  *
  ******************************************************************************/
 typedef void (*ANTNativeANTEventCb)(ANT_U8 ucLen, ANT_U8* pucData);
+typedef void (*ANTNativeANTEventSeqCb)(ANT_U32 ulSeq, ANT_U8 ucLen, ANT_U8* pucData);
 typedef void (*ANTNativeANTStateCb)(ANTRadioEnabledStatus uiNewState);
+typedef void (*ANTNativeANTProgressCb)(ANT_U8 ucPhase, ANTStatus status, ANT_U32 ulPhaseUs);
+
+typedef void (*ANTNativeANTRxBatchCb)(void);
+
+struct ANTRxMessage;
+typedef void (*ANTNativeANTEventMsgCb)(struct ANTRxMessage *pstMessage, void *pvContext);
+
+struct ANTCommandResponse;
+typedef void (*ANTNativeANTCommandCb)(ANTStatus status, struct ANTCommandResponse *pstResponse, void *pvContext);
+
+typedef void (*ANTNativeANTConfigureCb)(ANTStatus status, ANT_U8 ucChannel, ANT_U8 ucFailedMesgId, void *pvContext);
+
+struct ANTDecodedData;
+typedef void (*ANTNativeANTDecodedCb)(const struct ANTDecodedData *pstData, void *pvContext);
 
 /*******************************************************************************
  *
@@ -55,6 +133,164 @@ typedef void (*ANTNativeANTStateCb)(ANTRadioEnabledStatus uiNewState);
  *
  ******************************************************************************/
 
+/* Transport counters, totals over all transport paths since ant_init() */
+typedef struct {
+   /* Number of times the rx thread woke up for a readable transport path */
+   ANT_U32 ulRxWakeups;
+   /* Number of wakeups where the transport path had no data to read */
+   ANT_U32 ulRxSpuriousWakeups;
+   /* Number of reads that returned data */
+   ANT_U32 ulRxReads;
+   /* Number of ANT messages delivered to the rx callbacks */
+   ANT_U32 ulRxMessages;
+   /* Average rx wakeups per second since the radio was last enabled */
+   ANT_U32 ulRxWakeupsPerSec;
+   /* Number of keepalives sent to the chip */
+   ANT_U32 ulKeepaliveProbes;
+   /* Number of keepalives not sent as the chip was heard from anyway */
+   ANT_U32 ulKeepaliveSuppressed;
+   /* Average time for the chip to answer a keepalive in ms, 0 if never answered */
+   ANT_U32 ulKeepaliveRttMs;
+   /* Number of times the transport recovered the chip */
+   ANT_U32 ulRecoveries;
+   /* Time the last recovery took in ms, including restoring the channels */
+   ANT_U32 ulLastRecoveryMs;
+   /* Longest recovery in ms */
+   ANT_U32 ulMaxRecoveryMs;
+   /* Number of channels restored after recoveries, see ant_set_recovery_replay() */
+   ANT_U32 ulChannelsRestored;
+   /* Number of channels that could not be restored and were unassigned */
+   ANT_U32 ulChannelsNotRestored;
+} ANTTransportStats;
+
+/* A received ANT message in the shared rx buffer pool. Read only, as the same
+ * buffer is handed to every rx consumer. */
+typedef struct ANTRxMessage {
+   /* Rx sequence stamp, as given to the rx sequence callback */
+   ANT_U32 ulSeq;
+   /* Number of bytes of aucData used */
+   ANT_U8 ucLen;
+   /* ANT message: length, id and data */
+   ANT_U8 aucData[ANT_NATIVE_MAX_MESSAGE_SIZE];
+} ANTRxMessage;
+
+/* The response the chip sent to a command sent with ant_tx_command() */
+typedef struct ANTCommandResponse {
+   /* Response code from a channel response, RESPONSE_NO_ERROR (0) for other responses */
+   ANT_U8 ucCode;
+   /* Number of bytes of aucData used */
+   ANT_U8 ucLen;
+   /* ANT message: length, id and data */
+   ANT_U8 aucData[ANT_NATIVE_MAX_MESSAGE_SIZE];
+} ANTCommandResponse;
+
+/* Everything needed to set up and open an ANT channel */
+typedef struct {
+   ANT_U8 ucChannel;
+   /* Channel assignment */
+   ANT_U8 ucChannelType;
+   ANT_U8 ucNetwork;
+   /* Extended assignment, only sent if not 0 */
+   ANT_U8 ucExtendedAssignment;
+   /* Channel ID */
+   ANT_U16 usDeviceNumber;
+   ANT_U8 ucDeviceType;
+   ANT_U8 ucTransmissionType;
+   /* Channel period, in 1/32768 s */
+   ANT_U16 usPeriod;
+   /* RF frequency, offset from 2400 MHz */
+   ANT_U8 ucRfFrequency;
+   /* Open the channel once it is configured */
+   ANT_BOOL bOpen;
+} ANTChannelConfig;
+
+/* Channel states, as in the channel status message */
+#define ANT_CHANNEL_STATE_UNASSIGNED         ((ANT_U8)0)
+#define ANT_CHANNEL_STATE_ASSIGNED           ((ANT_U8)1)
+#define ANT_CHANNEL_STATE_SEARCHING          ((ANT_U8)2)
+#define ANT_CHANNEL_STATE_TRACKING           ((ANT_U8)3)
+
+/* A channel as last seen by the HAL */
+typedef struct {
+   /* One of ANT_CHANNEL_STATE_* */
+   ANT_U8 ucState;
+   /* Configuration the chip accepted, 0 for anything not set since the channel
+    * was assigned. bOpen is set while the channel is searching or tracking. */
+   ANTChannelConfig stConfig;
+} ANTChannelInfo;
+
+/* RF link statistics of a channel, since ant_init() or the last reset of the stats */
+typedef struct {
+   /* Data messages received, including each burst packet */
+   ANT_U32 ulRxMessages;
+   /* Channel events */
+   ANT_U32 ulRxFails;
+   ANT_U32 ulRxFailGoToSearch;
+   ANT_U32 ulRxSearchTimeouts;
+   ANT_U32 ulTxEvents;
+   ANT_U32 ulTransferRxFails;
+   ANT_U32 ulTransferTxCompleted;
+   ANT_U32 ulTransferTxFails;
+   ANT_U32 ulChannelCollisions;
+   ANT_U32 ulChannelClosed;
+   /* Received data messages out of expected ones (data messages and rx fails), in 1/1000 */
+   ANT_U16 usRxSuccessPerMille;
+   /* Rx fails since the last data message, and the longest such run */
+   ANT_U16 usConsecutiveRxFails;
+   ANT_U16 usMaxConsecutiveRxFails;
+   /* Data messages received per minute */
+   ANT_U32 ulRxMessagesPerMinute;
+   /* Time the stats cover */
+   ANT_U32 ulElapsedMs;
+   /* Searches that found a device, their total and last time from open or
+    * going back to search until the first data message */
+   ANT_U32 ulSearches;
+   ANT_U32 ulSearchTimeMs;
+   ANT_U32 ulLastSearchTimeMs;
+   /* RSSI of extended data messages that carried it, in dBm */
+   ANT_U32 ulRssiSamples;
+   ANT_S8 cRssiMin;
+   ANT_S8 cRssiMax;
+   ANT_S8 cRssiAverage;
+   ANT_U32 aulRssiHistogram[ANT_LINK_RSSI_BINS];
+} ANTLinkStats;
+
+/* Scheduling of the threads the HAL starts */
+#define ANT_THREAD_SCHED_DEFAULT             ((ANT_U8)0)
+#define ANT_THREAD_SCHED_FIFO                ((ANT_U8)1)
+#define ANT_THREAD_SCHED_RR                  ((ANT_U8)2)
+
+#define ANT_THREAD_NAME_PREFIX_SIZE          8
+#define ANT_THREAD_DEFAULT_NAME_PREFIX       "ant-"
+
+/* How the threads the HAL starts are run */
+typedef struct {
+   /* One of ANT_THREAD_SCHED_*, and the priority for FIFO and RR */
+   ANT_U8 ucSchedPolicy;
+   ANT_U8 ucSchedPriority;
+   /* CPUs the threads may run on, bit 0 for CPU 0, 0 for any */
+   ANT_U32 ulCpuMask;
+   /* Stack size in bytes, 0 for the default */
+   ANT_U32 ulStackSize;
+   /* Prepended to the role of each thread, e.g. "rx", to name it */
+   char acNamePrefix[ANT_THREAD_NAME_PREFIX_SIZE];
+} ANTThreadConfig;
+
+/* Values decoded from an ANT+ data page, sent only when a value changed */
+typedef struct ANTDecodedData {
+   ANT_U8 ucChannel;
+   /* ANT+ device type the page was decoded as, ANT_DEVICE_TYPE_* */
+   ANT_U8 ucDeviceType;
+   /* Data page the values changed on, 0 for profiles without pages */
+   ANT_U8 ucPage;
+   /* Number of values used by the device type */
+   ANT_U8 ucNumValues;
+   /* Bit n is set if alValues[n] changed on this page */
+   ANT_U8 ucChangedMask;
+   /* Latest values, indexed by the ANT_DECODED_* of the device type */
+   ANT_S32 alValues[ANT_DECODER_MAX_FIELDS];
+} ANTDecodedData;
+
 /*******************************************************************************
  *
  * Function declarations
@@ -89,6 +325,25 @@ ANTStatus ant_enable_radio(void);
  */
 ANTStatus ant_disable_radio(void);
 
+/*------------------------------------------------------------------------------
+ * ant_enable_radio_async()
+ *
+ * Enables the radio like ant_enable_radio() on a worker thread, and returns
+ * without waiting. The state callback is told when the radio is enabled, or
+ * disabled again if enabling failed, and the progress callback about each
+ * phase. Requests made while the worker is busy run after it, and only the
+ * last one of them runs. Wait for the final state before ant_deinit().
+ */
+ANTStatus ant_enable_radio_async(void);
+
+/*------------------------------------------------------------------------------
+ * ant_disable_radio_async()
+ *
+ * Disables the radio like ant_disable_radio() on the worker thread of
+ * ant_enable_radio_async(), and returns without waiting.
+ */
+ANTStatus ant_disable_radio_async(void);
+
 /*------------------------------------------------------------------------------
  * ant_radio_enabled_status()
  *
@@ -103,13 +358,93 @@ ANTRadioEnabledStatus ant_radio_enabled_status(void);
  */
 ANTStatus set_ant_rx_callback(ANTNativeANTEventCb rx_callback_func);
 
+/*------------------------------------------------------------------------------
+ * set_ant_rx_seq_callback()
+ *
+ * Sets a callback function for receiving ANT messages together with a global
+ * sequence stamp. Stamps increase in the order messages were read from the
+ * chip across all transport paths, so messages delivered on different rx
+ * threads can be put back in order.
+ */
+ANTStatus set_ant_rx_seq_callback(ANTNativeANTEventSeqCb rx_seq_callback_func);
+
+/*------------------------------------------------------------------------------
+ * set_ant_rx_batch_callback()
+ *
+ * Sets a callback called from the rx thread after the messages read together
+ * from the chip have all been passed to the rx callbacks, so received messages
+ * can be handed on once per batch instead of once per message.
+ */
+ANTStatus set_ant_rx_batch_callback(ANTNativeANTRxBatchCb fnBatchCallback);
+
+/*------------------------------------------------------------------------------
+ * ant_rx_add_consumer()
+ *
+ * Adds a consumer of received ANT messages. Each message is copied once from
+ * the transport's read buffer into a buffer from the rx buffer pool, and the
+ * same buffer is passed to every consumer without further copies. The buffer
+ * is only valid during the callback, unless the consumer takes a reference
+ * with ant_rx_acquire().
+ */
+ANTStatus ant_rx_add_consumer(ANTNativeANTEventMsgCb fnConsumer, void *pvContext);
+
+/*------------------------------------------------------------------------------
+ * ant_rx_remove_consumer()
+ *
+ * Removes a consumer added with the same callback and context. No callback to
+ * the consumer is in progress once this returns, so it must not be called from
+ * a consumer callback.
+ */
+ANTStatus ant_rx_remove_consumer(ANTNativeANTEventMsgCb fnConsumer, void *pvContext);
+
+/*------------------------------------------------------------------------------
+ * ant_rx_acquire()
+ *
+ * Takes a reference on an rx message so it can be kept or forwarded after the
+ * consumer callback returns. Returns the message.
+ */
+ANTRxMessage *ant_rx_acquire(ANTRxMessage *pstMessage);
+
+/*------------------------------------------------------------------------------
+ * ant_rx_release()
+ *
+ * Drops a reference taken with ant_rx_acquire(). The buffer goes back to the
+ * rx buffer pool when the last reference is dropped.
+ */
+void ant_rx_release(ANTRxMessage *pstMessage);
+
+/*------------------------------------------------------------------------------
+ * set_ant_decoded_callback()
+ *
+ * Starts decoding the data pages of ANT+ channels with a native decoder for
+ * their device type, taken from the channel ID set on the channel or from
+ * extended data. The callback is called from an rx thread only when a decoded
+ * value changes. Setting NULL stops decoding. Must not be called from an rx
+ * callback.
+ */
+ANTStatus set_ant_decoded_callback(ANTNativeANTDecodedCb fnCallback, void *pvContext);
+
 /*------------------------------------------------------------------------------
  * set_ant_state_callback()
  *
- * Sets the callback function for any ANT radio enabled status state changes
+ * Sets the callback function for any ANT radio enabled status state changes.
+ * It is called in order from a notifier thread once the change has been made,
+ * so it may call back into the HAL. Repeats of the same state are not reported.
  */
 ANTStatus set_ant_state_callback(ANTNativeANTStateCb state_callback_func);
 
+/*------------------------------------------------------------------------------
+ * set_ant_progress_callback()
+ *
+ * Sets the callback told how long each phase of enabling or disabling the radio
+ * took, and whether it succeeded. It is called from the same thread as the
+ * state callback, in order with the state changes, e.g. power on and open
+ * between ENABLING and ENABLED. While it is set, enabling also checks the link
+ * with a keepalive right away, and reports ANT_PROGRESS_LINK_UP once the chip
+ * answers, timed from the keepalive.
+ */
+ANTStatus set_ant_progress_callback(ANTNativeANTProgressCb fnCallback);
+
 /*------------------------------------------------------------------------------
  * ant_tx_message()
  *
@@ -117,6 +452,74 @@ ANTStatus set_ant_state_callback(ANTNativeANTStateCb state_callback_func);
  */
 ANTStatus ant_tx_message(ANT_U8 ucLen, ANT_U8 *pucMesg);
 
+/*------------------------------------------------------------------------------
+ * ant_tx_messages()
+ *
+ * Sends up to ulCount messages packed back to back in pucMessages, each stored
+ * as a length byte followed by the message as passed to ant_tx_message().
+ * Stops at the first message that fails or does not fit in ulSize bytes.
+ * The number of messages sent is returned in pulSent if it is not NULL.
+ */
+ANTStatus ant_tx_messages(ANT_U32 ulCount, const ANT_U8 *pucMessages, ANT_U32 ulSize, ANT_U32 *pulSent);
+
+/*------------------------------------------------------------------------------
+ * ant_tx_burst()
+ *
+ * Sends ulLen bytes as a burst transfer on a channel, split into burst data
+ * packets with their sequence numbers set. The last packet is padded with
+ * zeros. Stops at the first packet that fails.
+ */
+ANTStatus ant_tx_burst(ANT_U8 ucChannel, ANT_U32 ulLen, const ANT_U8 *pucData);
+
+/*------------------------------------------------------------------------------
+ * ant_tx_command()
+ *
+ * Sends an ANT command message to the chip and waits up to ulTimeoutMs for the
+ * chip's response to it. The response is the channel response for the command,
+ * the requested message for MESG_REQUEST_ID, or the startup message for
+ * MESG_RESET_ID. Returns ANT_STATUS_SUCCESS if the command succeeded,
+ * ANT_STATUS_FAILED with the response filled in if the chip rejected it, and
+ * ANT_STATUS_HARDWARE_ERR if there was no response in time.
+ * Must not be called from an rx callback.
+ */
+ANTStatus ant_tx_command(ANT_U8 ucLen, ANT_U8 *pucMesg, ANT_U32 ulTimeoutMs, ANTCommandResponse *pstResponse);
+
+/*------------------------------------------------------------------------------
+ * ant_tx_command_async()
+ *
+ * Sends an ANT command message to the chip and returns once it is sent. The
+ * callback is called with the same status ant_tx_command() would return, and
+ * the response if there was one, from an internal thread, never the rx thread.
+ * It may send messages and wait for other commands, but holds up the callbacks
+ * of other async commands while it does.
+ */
+ANTStatus ant_tx_command_async(ANT_U8 ucLen, ANT_U8 *pucMesg, ANT_U32 ulTimeoutMs,
+      ANTNativeANTCommandCb fnCallback, void *pvContext);
+
+/*------------------------------------------------------------------------------
+ * ant_configure_channel()
+ *
+ * Assigns a channel, sets its ID, period and RF frequency, and opens it if
+ * asked to. The configuration commands are sent without waiting for each
+ * other's responses, and the channel is only opened once all of them have
+ * succeeded. If any command fails the channel is unassigned again.
+ * With no callback this waits for the result. Otherwise it returns once the
+ * configuration has been started, and the callback is called with the result
+ * and the ID of the message that failed (0 on success) from an internal thread.
+ * Must not be called from an rx callback.
+ */
+ANTStatus ant_configure_channel(const ANTChannelConfig *pstConfig, ANTNativeANTConfigureCb fnCallback,
+      void *pvContext);
+
+/*------------------------------------------------------------------------------
+ * ant_get_channel_info()
+ *
+ * Gets the state and configuration of a channel from the messages the HAL has
+ * seen, without asking the chip. Returns ANT_STATUS_NO_VALUE_AVAILABLE if the
+ * state of the channel is not known, e.g. before the first reset after enable.
+ */
+ANTStatus ant_get_channel_info(ANT_U8 ucChannel, ANTChannelInfo *pstInfo);
+
 /*------------------------------------------------------------------------------
  * ant_radio_hard_reset()
  *
@@ -124,6 +527,125 @@ ANTStatus ant_tx_message(ANT_U8 ucLen, ANT_U8 *pucMesg);
  */
 ANTStatus ant_radio_hard_reset(void);
 
+/*------------------------------------------------------------------------------
+ * ant_get_transport_stats()
+ *
+ * Gets the transport counters, if supported by the transport
+ */
+ANTStatus ant_get_transport_stats(ANTTransportStats *pstStats);
+
+/*------------------------------------------------------------------------------
+ * ant_set_keepalive()
+ *
+ * Sets how long the transport waits without receiving anything from the chip
+ * before sending a keepalive, and how long it then waits for the chip to answer
+ * before recovering it. An idle time of 0 turns keepalives off. Takes effect
+ * immediately, also while the radio is enabled.
+ *
+ * The sum is the longest a dead chip can go unnoticed. Any rx, including flow
+ * control and command responses, counts as an answer. Once the chip answers
+ * faster than the response timeout, the transport waits less for the answer
+ * and correspondingly longer before sending keepalives.
+ */
+ANTStatus ant_set_keepalive(ANT_U32 ulIdleMs, ANT_U32 ulResponseTimeoutMs);
+
+/*------------------------------------------------------------------------------
+ * ant_set_standby()
+ *
+ * Sets how long the transport stays up after the radio is disabled, 0 to close
+ * it when the radio is disabled. Takes effect from the next disable. While in
+ * standby the radio is reported disabled, nothing can be sent, and anything the
+ * chip sends is dropped, but the chip stays powered and the rx thread stays
+ * parked, so enabling again within ulGraceMs only resumes delivery. Once
+ * ulGraceMs has passed, or if the radio is disabled again, the transport is
+ * closed as usual. Not supported by all transports.
+ */
+ANTStatus ant_set_standby(ANT_U32 ulGraceMs);
+
+/*------------------------------------------------------------------------------
+ * ant_set_recovery_replay()
+ *
+ * Turns restoring the channels after a recovery on or off, off by default.
+ * When the transport recovers the chip, e.g. after a missed keepalive or a
+ * transport error, it sends the network keys and the configuration of the
+ * channels that were assigned again, and opens the ones that were open, before
+ * reporting RADIO_STATUS_RESET. The client then doesn't have to set them up
+ * again. Failed commands are retried a few times, for ANT_JOURNAL_REPLAY_MAX_MS
+ * in all; a channel that still can't be restored is unassigned. The commands
+ * are sent from a thread of their own, and their responses are delivered to
+ * the rx callbacks like any other. Not supported by all transports.
+ */
+ANTStatus ant_set_recovery_replay(ANT_BOOL bReplay);
+
+/*------------------------------------------------------------------------------
+ * ant_set_threadless()
+ *
+ * Turns threadless mode on or off, only while the radio is disabled. In
+ * threadless mode enabling the radio starts no rx thread. The caller waits for
+ * the file descriptors from ant_get_poll_fds() to become readable, e.g. in its
+ * own epoll loop, and then calls ant_process_events(), which reads and delivers
+ * rx, handles flow control, keepalives and recovery, and calls the state
+ * callback, all on the calling thread. Messages waiting for flow control run
+ * the rx loop themselves, as does ant_tx_command() waiting for a response, so
+ * rx callbacks can be called from within them. Messages sent from the rx
+ * callbacks are queued and sent once the callbacks return, so rx callbacks
+ * must not wait for responses. Sent from other threads, messages wait for the
+ * thread running the rx loop to read flow control and responses.
+ * ant_tx_command_async() still completes commands on its own thread, and
+ * ant_configure_channel() needs a callback in threadless mode.
+ * Not supported by all transports.
+ */
+ANTStatus ant_set_threadless(ANT_BOOL bThreadless);
+
+/*------------------------------------------------------------------------------
+ * ant_get_poll_fds()
+ *
+ * Gets the file descriptors to wait on for readability in threadless mode.
+ * *pulCount is the room in piFds, and is set to the number of descriptors. They
+ * stay the same until threadless mode is turned off, also across enables and
+ * recoveries.
+ */
+ANTStatus ant_get_poll_fds(int *piFds, ANT_U32 *pulCount);
+
+/*------------------------------------------------------------------------------
+ * ant_process_events()
+ *
+ * Handles the events that arrive within iTimeoutMs in threadless mode, 0 to
+ * only handle what is already pending, -1 to wait for something. Must not be
+ * called from the callbacks. The rx loop belongs to the thread that first
+ * enables the radio or calls this after threadless mode is turned on, and
+ * this fails on any other thread.
+ */
+ANTStatus ant_process_events(int iTimeoutMs);
+
+/*------------------------------------------------------------------------------
+ * ant_set_thread_config()
+ *
+ * Sets the scheduling, CPU affinity, stack size and name prefix of the threads
+ * the HAL starts from then on, e.g. the rx thread when the radio is enabled.
+ * Threads already running keep their settings, so set this before ant_init() to
+ * cover all threads. Real-time scheduling needs the permission to use it; a
+ * setting that can't be applied is logged and the thread runs without it. The
+ * locks a real-time rx thread can wait on use priority inheritance where the C
+ * library supports it.
+ */
+ANTStatus ant_set_thread_config(const ANTThreadConfig *pstConfig);
+
+/*------------------------------------------------------------------------------
+ * ant_get_link_stats()
+ *
+ * Gets the RF link statistics of a channel, counted from the channel events
+ * and data messages received
+ */
+ANTStatus ant_get_link_stats(ANT_U8 ucChannel, ANTLinkStats *pstStats);
+
+/*------------------------------------------------------------------------------
+ * ant_reset_link_stats()
+ *
+ * Clears the RF link statistics of a channel
+ */
+ANTStatus ant_reset_link_stats(ANT_U8 ucChannel);
+
 /*------------------------------------------------------------------------------
  * ant_get_lib_version()
  *
@@ -0,0 +1,58 @@
+/*
+ * ANT Stack
+ *
+ * Copyright 2011 Dynastream Innovations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/******************************************************************************\
+*
+*   FILE NAME:      ant_radio_async.h
+*
+*   BRIEF:
+*      This file defines how the transports report progress of enabling and
+*      disabling the radio.
+*
+*
+\******************************************************************************/
+
+#ifndef __ANT_RADIO_ASYNC_H
+#define __ANT_RADIO_ASYNC_H
+
+#include "ant_types.h"
+
+/*------------------------------------------------------------------------------
+ * ant_progress_wanted()
+ *
+ * Gets whether a progress callback is set, so the transport can skip work only
+ * needed to report progress.
+ */
+ANT_BOOL ant_progress_wanted(void);
+
+/*------------------------------------------------------------------------------
+ * ant_progress_now()
+ *
+ * Gets the monotonic time in us, to pass to ant_progress_report() once the
+ * phase started then is done.
+ */
+ANT_U32 ant_progress_now(void);
+
+/*------------------------------------------------------------------------------
+ * ant_progress_report()
+ *
+ * Queues progress of a phase for the progress callback, timed from ulStartUs.
+ * Can be used with the enabled status lock held, as ant_state_notify().
+ */
+void ant_progress_report(ANT_U8 ucPhase, ANTStatus status, ANT_U32 ulStartUs);
+
+#endif /* ifndef __ANT_RADIO_ASYNC_H */
@@ -0,0 +1,96 @@
+/*
+ * ANT Stack
+ *
+ * Copyright 2011 Dynastream Innovations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/******************************************************************************\
+*
+*   FILE NAME:      ant_reactor.h
+*
+*   BRIEF:
+*      This file defines the reactor, an epoll based event loop. Each file
+*      descriptor is registered with the handler to call when it has events,
+*      so new event sources don't need changes to the loop.
+*
+*
+\******************************************************************************/
+
+#ifndef __ANT_REACTOR_H
+#define __ANT_REACTOR_H
+
+#include <sys/epoll.h>
+
+#include "ant_types.h"
+
+// Number of file descriptors a reactor can watch.
+#ifndef ANT_REACTOR_MAX_SOURCES
+#define ANT_REACTOR_MAX_SOURCES              16
+#endif
+
+// Number of events handled per wait.
+#ifndef ANT_REACTOR_MAX_EVENTS
+#define ANT_REACTOR_MAX_EVENTS               8
+#endif
+
+typedef struct ant_reactor ant_reactor_t;
+
+/* Called with the events (EPOLLIN, ...) of a registered file descriptor.
+ * Returning a negative value stops the dispatch, and is returned by
+ * ant_reactor_dispatch(). */
+typedef int (*ant_reactor_handler_t)(ant_reactor_t *pstReactor, int iFd, ANT_U32 ulEvents, void *pvContext);
+
+typedef struct {
+   /* Registered file descriptor, -1 if the slot is free */
+   int iFd;
+   /* Called when the file descriptor has events */
+   ant_reactor_handler_t fnHandler;
+   /* Passed to the handler */
+   void *pvContext;
+} ant_reactor_source_t;
+
+struct ant_reactor {
+   /* The epoll instance */
+   int iEpollFd;
+   /* Registered event sources */
+   ant_reactor_source_t astSources[ANT_REACTOR_MAX_SOURCES];
+};
+
+/* Creates the epoll instance. Returns 0 on success, -1 on failure. */
+int ant_reactor_init(ant_reactor_t *pstReactor);
+
+/* Closes the epoll instance. The registered file descriptors are not closed. */
+void ant_reactor_close(ant_reactor_t *pstReactor);
+
+/* Watches a file descriptor for the given epoll events, EPOLLET may be used
+ * if the handler always drains the file descriptor. Returns 0 on success, -1
+ * on failure. */
+int ant_reactor_add(ant_reactor_t *pstReactor, int iFd, ANT_U32 ulEvents,
+      ant_reactor_handler_t fnHandler, void *pvContext);
+
+/* Changes the events watched for on a registered file descriptor. Returns 0
+ * on success, -1 on failure. */
+int ant_reactor_modify(ant_reactor_t *pstReactor, int iFd, ANT_U32 ulEvents);
+
+/* Stops watching a file descriptor. Safe to call from a handler, events
+ * already returned for the file descriptor are then not handled. Returns 0 on
+ * success, -1 on failure. */
+int ant_reactor_remove(ant_reactor_t *pstReactor, int iFd);
+
+/* Waits up to iTimeoutMs (-1 for no timeout) for events and calls the
+ * handlers. Returns 0 if waiting timed out or was interrupted, or all handlers
+ * succeeded, the handler's result if a handler failed, -1 if waiting failed. */
+int ant_reactor_dispatch(ant_reactor_t *pstReactor, int iTimeoutMs);
+
+#endif /* ifndef __ANT_REACTOR_H */
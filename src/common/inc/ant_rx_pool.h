@@ -0,0 +1,62 @@
+/*
+ * ANT Stack
+ *
+ * Copyright 2011 Dynastream Innovations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/******************************************************************************\
+*
+*   FILE NAME:      ant_rx_pool.h
+*
+*   BRIEF:
+*      This file defines the interface the transports use to hand received
+*      ANT messages to the rx consumers through the shared rx buffer pool.
+*
+*
+\******************************************************************************/
+
+#ifndef __ANT_RX_POOL_H
+#define __ANT_RX_POOL_H
+
+#include "ant_types.h"
+
+// Number of rx buffers shared by all consumers. A message is dropped for the
+// consumers if they are all held.
+#ifndef ANT_RX_POOL_SIZE
+#define ANT_RX_POOL_SIZE                     32
+#endif
+
+// Maximum number of consumers that can be added with ant_rx_add_consumer().
+#ifndef ANT_RX_MAX_CONSUMERS
+#define ANT_RX_MAX_CONSUMERS                 8
+#endif
+
+/*------------------------------------------------------------------------------
+ * ant_rx_pool_dispatch()
+ *
+ * Called by the transport rx thread once for every ANT message received, after
+ * it has been stamped. Passes the message to the native command handling and
+ * all rx consumers.
+ *
+ * pucData points into the transport's read buffer, which is reused by the next
+ * read and can hold several messages, so the message is copied once into a
+ * pool buffer. That is the only copy, consumers share the pool buffer.
+ */
+void ant_rx_pool_dispatch(ANT_U32 ulSeq, ANT_U8 ucLen, ANT_U8 *pucData);
+
+// Called by the transports once the messages from one read, or one drain of a
+// transport path, have all been dispatched.
+void ant_rx_pool_batch_end(void);
+
+#endif /* ifndef __ANT_RX_POOL_H */
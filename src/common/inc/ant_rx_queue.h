@@ -0,0 +1,97 @@
+/*
+ * ANT Stack
+ *
+ * Copyright 2011 Dynastream Innovations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/******************************************************************************\
+*
+*   FILE NAME:      ant_rx_queue.h
+*
+*   BRIEF:
+*      This file defines the rx queue, used to hand messages that were not read
+*      from the chip, like responses answered from the cache, to the rx loop so
+*      they are delivered on the normal rx path.
+*
+*
+\******************************************************************************/
+
+#ifndef __ANT_RX_QUEUE_H
+#define __ANT_RX_QUEUE_H
+
+#include "ant_types.h"
+
+// Number of messages that can wait for the rx loop.
+#ifndef ANT_RX_QUEUE_SIZE
+#define ANT_RX_QUEUE_SIZE                    8
+#endif
+
+/*------------------------------------------------------------------------------
+ * ant_rx_queue_open()
+ *
+ * Creates the event file descriptor signalled when a message is queued. Called
+ * by the transport from ant_init(). Returns 0, or -1 with errno set.
+ */
+int ant_rx_queue_open(void);
+
+/*------------------------------------------------------------------------------
+ * ant_rx_queue_close()
+ *
+ * Drops any queued messages and closes the event file descriptor. Called by
+ * the transport from ant_deinit().
+ */
+void ant_rx_queue_close(void);
+
+/*------------------------------------------------------------------------------
+ * ant_rx_queue_fd()
+ *
+ * Gets the event file descriptor for the rx loop to watch, -1 if not open. It
+ * is readable while messages may be queued.
+ */
+int ant_rx_queue_fd(void);
+
+/*------------------------------------------------------------------------------
+ * ant_rx_queue_clear()
+ *
+ * Drops any queued messages, which were meant for an rx loop that has stopped.
+ * Called by the transport when it starts an rx loop.
+ */
+void ant_rx_queue_clear(void);
+
+/*------------------------------------------------------------------------------
+ * ant_rx_queue_message()
+ *
+ * Copies a message into the rx queue and signals the event file descriptor.
+ * Returns ANT_STATUS_FAILED if the queue is full or not open.
+ */
+ANTStatus ant_rx_queue_message(ANT_U8 ucLen, const ANT_U8 *pucMesg);
+
+/*------------------------------------------------------------------------------
+ * ant_rx_queue_get()
+ *
+ * Takes the oldest message off the queue, returning its length, or 0 if the
+ * queue is empty. pucMesg must hold ANT_NATIVE_MAX_MESSAGE_SIZE bytes. The rx
+ * loop resets the event file descriptor with ant_rx_queue_ack() first, then
+ * gets messages until there are none left.
+ */
+ANT_U8 ant_rx_queue_get(ANT_U8 *pucMesg);
+
+/*------------------------------------------------------------------------------
+ * ant_rx_queue_ack()
+ *
+ * Resets the event file descriptor, before the rx loop gets the messages.
+ */
+void ant_rx_queue_ack(void);
+
+#endif /* ifndef __ANT_RX_QUEUE_H */
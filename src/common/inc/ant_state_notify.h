@@ -0,0 +1,86 @@
+/*
+ * ANT Stack
+ *
+ * Copyright 2011 Dynastream Innovations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/******************************************************************************\
+*
+*   FILE NAME:      ant_state_notify.h
+*
+*   BRIEF:
+*      This file defines the interface the transports use to report radio
+*      enabled status changes without calling the state callback themselves.
+*
+*
+\******************************************************************************/
+
+#ifndef __ANT_STATE_NOTIFY_H
+#define __ANT_STATE_NOTIFY_H
+
+#include "ant_types.h"
+#include "ant_native.h"
+
+// Number of state changes that can wait for a slow state callback. If more
+// are reported the newest replaces the last one waiting.
+#ifndef ANT_STATE_NOTIFY_QUEUE_SIZE
+#define ANT_STATE_NOTIFY_QUEUE_SIZE          8
+#endif
+
+/*------------------------------------------------------------------------------
+ * ant_state_notify()
+ *
+ * Queues a state change for the callback and returns without calling it, so it
+ * can be used with the enabled status lock held. The callbacks are called in
+ * the order the changes were queued from a notifier thread. A change to the
+ * state the callback was last told about, or is about to be told about, is
+ * dropped. Does nothing if fnCallback is NULL.
+ */
+void ant_state_notify(ANTNativeANTStateCb fnCallback, ANTRadioEnabledStatus uiNewState);
+
+/*------------------------------------------------------------------------------
+ * ant_state_notify_progress()
+ *
+ * Queues progress of enabling or disabling the radio like a state change, so
+ * the callbacks see it in order with the state changes. Progress is never
+ * dropped as a repeat, and is dropped rather than replacing a state change if
+ * the queue is full. Does nothing if fnProgress is NULL.
+ */
+void ant_state_notify_progress(ANTNativeANTProgressCb fnProgress, ANT_U8 ucPhase, ANTStatus status, ANT_U32 ulPhaseUs);
+
+/*------------------------------------------------------------------------------
+ * ant_state_notify_set_deferred()
+ *
+ * While deferred no notifier thread is started, and the queued changes wait for
+ * ant_state_notify_flush(). Used by the transport in threadless mode.
+ */
+void ant_state_notify_set_deferred(ANT_BOOL bDeferred);
+
+/*------------------------------------------------------------------------------
+ * ant_state_notify_flush()
+ *
+ * Calls the callbacks with the queued changes on the calling thread, if
+ * deferred. Must be called without the enabled status lock held.
+ */
+void ant_state_notify_flush(void);
+
+/*------------------------------------------------------------------------------
+ * ant_state_notify_stop()
+ *
+ * Delivers the changes still queued and waits for the notifier thread to exit.
+ * A later change starts a new one. Called by ant_deinit().
+ */
+void ant_state_notify_stop(void);
+
+#endif /* ifndef __ANT_STATE_NOTIFY_H */
@@ -0,0 +1,57 @@
+/*
+ * ANT Stack
+ *
+ * Copyright 2011 Dynastream Innovations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/******************************************************************************\
+*
+*   FILE NAME:      ant_thread.h
+*
+*   BRIEF:
+*      This file defines how the HAL starts its threads and sets up the locks
+*      they wait on for flow control, following ant_set_thread_config().
+*
+*
+\******************************************************************************/
+
+#ifndef __ANT_THREAD_H
+#define __ANT_THREAD_H
+
+#include <pthread.h>
+
+#include "ant_types.h"
+
+/*------------------------------------------------------------------------------
+ * ant_thread_create()
+ *
+ * Starts a thread like pthread_create() with default attributes, but with the
+ * stack size, scheduling, CPU affinity and name from ant_set_thread_config().
+ * pcRole is added to the name prefix to name the thread. Settings that can't
+ * be applied, e.g. real-time scheduling without permission, are logged and the
+ * thread runs without them. Returns 0 or an error number.
+ */
+int ant_thread_create(pthread_t *pstThread, const char *pcRole, void *(*fnStart)(void *), void *pvArg);
+
+/*------------------------------------------------------------------------------
+ * ant_thread_mutex_init()
+ *
+ * Initialises a lock held while sending or waiting for flow control, with
+ * priority inheritance where supported, so a real-time thread waiting for it
+ * isn't held up by a lower priority thread holding it. Returns 0 or an error
+ * number like pthread_mutex_init().
+ */
+int ant_thread_mutex_init(pthread_mutex_t *pstMutex);
+
+#endif /* ifndef __ANT_THREAD_H */
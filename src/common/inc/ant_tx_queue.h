@@ -0,0 +1,80 @@
+/*
+ * ANT Stack
+ *
+ * Copyright 2011 Dynastream Innovations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/******************************************************************************\
+*
+*   FILE NAME:      ant_tx_queue.h
+*
+*   BRIEF:
+*      This file defines the tx queue, used to send messages from threads that
+*      must not block waiting for flow control, like the rx thread, or from
+*      handlers of the threadless rx loop.
+*
+*
+\******************************************************************************/
+
+#ifndef __ANT_TX_QUEUE_H
+#define __ANT_TX_QUEUE_H
+
+#include "ant_types.h"
+
+// Number of messages that can wait to be sent.
+#ifndef ANT_TX_QUEUE_SIZE
+#define ANT_TX_QUEUE_SIZE                    8
+#endif
+
+/*------------------------------------------------------------------------------
+ * ant_tx_queue_start()
+ *
+ * Starts the tx queue thread. Called by the transport from ant_init().
+ */
+ANTStatus ant_tx_queue_start(void);
+
+/*------------------------------------------------------------------------------
+ * ant_tx_queue_stop()
+ *
+ * Stops the tx queue thread, dropping any messages not sent yet. Called by the
+ * transport from ant_deinit(). The queue is no longer deferred afterwards.
+ */
+void ant_tx_queue_stop(void);
+
+/*------------------------------------------------------------------------------
+ * ant_tx_queue_set_deferred()
+ *
+ * Stops the tx queue thread and leaves queued messages for ant_tx_queue_flush()
+ * instead, or starts the thread again. Used by the transport in threadless mode.
+ */
+ANTStatus ant_tx_queue_set_deferred(ANT_BOOL bDeferred);
+
+/*------------------------------------------------------------------------------
+ * ant_tx_queue_flush()
+ *
+ * Sends the queued messages on the calling thread, if the queue is deferred.
+ * Must not be called while the rx handlers are running, as the messages may
+ * wait for flow control.
+ */
+void ant_tx_queue_flush(void);
+
+/*------------------------------------------------------------------------------
+ * ant_tx_queue_message()
+ *
+ * Copies a message into the tx queue and returns without waiting for it to be
+ * sent. The tx queue thread sends the messages in order with ant_tx_message().
+ */
+ANTStatus ant_tx_queue_message(ANT_U8 ucLen, const ANT_U8 *pucMesg);
+
+#endif /* ifndef __ANT_TX_QUEUE_H */
@@ -0,0 +1,135 @@
+/*
+ * ANT Stack
+ *
+ * Copyright 2011 Dynastream Innovations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/******************************************************************************\
+*
+*   FILE NAME:      ant_uring.h
+*
+*   BRIEF:
+*      This file defines a minimal io_uring wrapper, used by the transports to
+*      keep multishot reads into provided buffers outstanding on their paths,
+*      and to send through the same ring.
+*
+*
+\******************************************************************************/
+
+#ifndef __ANT_URING_H
+#define __ANT_URING_H
+
+#include <stddef.h> /* for size_t */
+#include <stdint.h> /* for uint64_t */
+
+#include "ant_types.h"
+
+typedef struct {
+   /* io_uring file descriptor, -1 if not set up */
+   int iRingFd;
+   /* Mapped submission queue ring, completion queue ring and entries */
+   void *pvSqRing;
+   size_t szSqRing;
+   void *pvCqRing;
+   size_t szCqRing;
+   void *pvSqes;
+   size_t szSqes;
+   /* Submission queue, in the mapped ring */
+   unsigned *puiSqHead;
+   unsigned *puiSqTail;
+   unsigned *puiSqArray;
+   unsigned uiSqMask;
+   unsigned uiSqEntries;
+   /* Tail including entries prepared but not submitted yet */
+   unsigned uiSqLocalTail;
+   /* Completion queue, in the mapped ring */
+   unsigned *puiCqHead;
+   unsigned *puiCqTail;
+   unsigned uiCqMask;
+   void *pvCqes;
+} ant_uring_t;
+
+/* A ring of buffers provided to the kernel, for reads to pick one from */
+typedef struct {
+   /* Mapped ring the kernel takes buffers from, NULL if not set up */
+   void *pvRing;
+   size_t szRing;
+   unsigned uiMask;
+   /* Tail of the ring, advanced as buffers are given back */
+   ANT_U16 usTail;
+   /* The buffers, ulBufferSize bytes each, indexed by buffer id */
+   ANT_U8 *pucBuffers;
+   ANT_U32 ulBufferSize;
+} ant_uring_buffers_t;
+
+/* A completed request */
+typedef struct {
+   uint64_t ullUserData;
+   /* Bytes read or written, negative errno on failure */
+   int iResult;
+   /* Set while a multishot request stays queued for more completions */
+   ANT_BOOL bMore;
+   /* Id of the provided buffer the data was read into, -1 if none */
+   int iBufferId;
+} ant_uring_cqe_t;
+
+/* Sets up an io_uring. Fails with errno ENOSYS if io_uring, multishot reads
+ * or provided buffer rings aren't available. Returns 0 on success, -1 on
+ * failure. */
+int ant_uring_init(ant_uring_t *pstRing, ANT_U32 ulEntries);
+
+/* Tears down the io_uring, cancelling outstanding requests. */
+void ant_uring_close(ant_uring_t *pstRing);
+
+/* Signals an eventfd when requests complete. Returns 0 on success, -1 on
+ * failure. */
+int ant_uring_register_eventfd(ant_uring_t *pstRing, int iEventFd);
+
+/* Provides ulCount buffers of ulBufferSize bytes from pucBuffers to the reads
+ * of buffer group usGroup. ulCount must be a power of two. Returns 0 on
+ * success, -1 on failure. */
+int ant_uring_provide_buffers(ant_uring_t *pstRing, ant_uring_buffers_t *pstBuffers, ANT_U16 usGroup,
+      ANT_U8 *pucBuffers, ANT_U32 ulCount, ANT_U32 ulBufferSize);
+
+/* Unmaps the ring of provided buffers, once the io_uring is closed. */
+void ant_uring_free_buffers(ant_uring_buffers_t *pstBuffers);
+
+/* Gets the provided buffer a completion read into. */
+ANT_U8 *ant_uring_buffer(ant_uring_buffers_t *pstBuffers, int iBufferId);
+
+/* Gives a provided buffer back for the reads to use again, without a system
+ * call. */
+void ant_uring_recycle_buffer(ant_uring_buffers_t *pstBuffers, int iBufferId);
+
+/* Prepares a multishot read from iFd, which completes every time data is
+ * read into a buffer of group usGroup, until it fails or runs out of
+ * buffers. Returns 0 on success, -1 if the submission queue is full. */
+int ant_uring_prep_read_multishot(ant_uring_t *pstRing, int iFd, ANT_U16 usGroup, uint64_t ullUserData);
+
+/* Prepares a write of ulLen bytes to iFd. pvBuf must stay valid until the
+ * write completes. With bLinkNext the next prepared request only starts once
+ * this one has written everything, and is cancelled if it didn't. Returns 0
+ * on success, -1 if the submission queue is full. */
+int ant_uring_prep_write(ant_uring_t *pstRing, int iFd, const void *pvBuf, ANT_U32 ulLen, ANT_BOOL bLinkNext,
+      uint64_t ullUserData);
+
+/* Submits all prepared requests with one system call. Returns the number
+ * submitted, -1 on failure. */
+int ant_uring_submit(ant_uring_t *pstRing);
+
+/* Takes the next completion, without a system call. Returns 1 and fills in
+ * pstCqe, or 0 if no request has completed. */
+int ant_uring_reap(ant_uring_t *pstRing, ant_uring_cqe_t *pstCqe);
+
+#endif /* ifndef __ANT_URING_H */
@@ -39,6 +39,21 @@ endif # BOARD_ANT_WIRELESS_DEVICE = "vfs-prerelease"
 LOCAL_SRC_FILES := \
    $(COMMON_DIR)/JAntNative.cpp \
    $(COMMON_DIR)/ant_utils.c \
+   $(COMMON_DIR)/ant_rx_pool.c \
+   $(COMMON_DIR)/ant_command.c \
+   $(COMMON_DIR)/ant_configure.c \
+   $(COMMON_DIR)/ant_cache.c \
+   $(COMMON_DIR)/ant_rx_queue.c \
+   $(COMMON_DIR)/ant_decoder.c \
+   $(COMMON_DIR)/ant_link_stats.c \
+   $(COMMON_DIR)/ant_tx_batch.c \
+   $(COMMON_DIR)/ant_state_notify.c \
+   $(COMMON_DIR)/ant_tx_queue.c \
+   $(COMMON_DIR)/ant_reactor.c \
+   $(COMMON_DIR)/ant_uring.c \
+   $(COMMON_DIR)/ant_thread.c \
+   $(COMMON_DIR)/ant_radio_async.c \
+   $(COMMON_DIR)/ant_journal.c \
    $(ANT_DIR)/ant_native_chardev.c \
    $(ANT_DIR)/ant_rx_chardev.c \
 
@@ -51,4 +51,7 @@
 
 #define ANT_FLOW_GO_WAIT_TIMEOUT_SEC         10
 
+// How long a write waits for a non-blocking transport path to accept data
+#define ANT_WRITE_READY_TIMEOUT_MS           1000
+
 #endif /* ifndef __VFS_INDEPENDENT_H */
@@ -84,4 +84,16 @@
 //     That signals Flow Stop:
 #define ANT_FLOW_STOP                        ((ANT_U8)0x80)
 
+// If the chip uses separate command and data paths, define ANT_RX_THREAD_PER_PATH to read
+// the data path on its own rx thread, so data traffic cannot delay command responses and
+// flow control:
+// #define ANT_RX_THREAD_PER_PATH
+
+// To keep multishot reads outstanding on the transport paths with io_uring
+// instead of polling them, and send through the same ring, define
+// ANT_RX_IO_URING. Needs Linux 6.7 for multishot reads and paths that can be
+// reopened. Falls back to polling at runtime without them, or if built without
+// the io_uring headers:
+// #define ANT_RX_IO_URING
+
 #endif /* ifndef __VFS_PRERELEASE_H */